@@ -12,13 +12,25 @@ using namespace std;
 extern bool ImageRWSpeedTest(int argc, char **argv);
 extern bool DiskReadSpeedTest(int argc, char **argv);
 extern bool DiskWriteTest(int argc, char **argv);
+extern bool FixFacingTest(int argc, char **argv);
 extern bool GaussianTest(int argc, char **argv);
+extern bool HalfEdgeMeshTest(int argc, char **argv);
 extern bool HashStringTest(int argc, char **argv);
+extern bool ImageConvertTest(int argc, char **argv);
+extern bool ImageStatsTest(int argc, char **argv);
+extern bool ImageStreamTest(int argc, char **argv);
 extern bool KDTreeTest(int argc, char **argv);
+extern bool LoadOBJTest(int argc, char **argv);
+extern bool LoadSaveTest(int argc, char **argv);
 extern bool Matrix44Test(int argc, char **argv);
+extern bool ModelCacheTest(int argc, char **argv);
 extern bool PullPushTest(int argc, char **argv);
+extern bool PyramidTest(int argc, char **argv);
+extern bool RGBETest(int argc, char **argv);
+extern bool SimplifyMeshTest(int argc, char **argv);
 extern bool tImageTest(int argc, char **argv);
 extern bool VCDTest(int argc, char **argv);
+extern bool WeldVerticesTest(int argc, char **argv);
 extern bool TimerTest(int argc, char **argv);
 
 namespace {
@@ -33,13 +45,25 @@ namespace {
         cerr << "-ImageRWSpeedTest\n";
         cerr << "-DiskReadSpeedTest\n";
         cerr << "-DiskWriteTest\n";
+        cerr << "-FixFacingTest\n";
         cerr << "-GaussianTest\n";
+        cerr << "-HalfEdgeMeshTest\n";
         cerr << "-HashStringTest\n";
+        cerr << "-ImageConvertTest\n";
+        cerr << "-ImageStatsTest\n";
+        cerr << "-ImageStreamTest\n";
         cerr << "-KDTreeTest\n";
+        cerr << "-LoadOBJTest\n";
+        cerr << "-LoadSaveTest\n";
         cerr << "-Matrix44Test\n";
+        cerr << "-ModelCacheTest\n";
         cerr << "-PullPushTest\n";
+        cerr << "-PyramidTest\n";
+        cerr << "-RGBETest\n";
+        cerr << "-SimplifyMeshTest\n";
         cerr << "-TimerTest\n";
         cerr << "-tImageTest\n";
+        cerr << "-WeldVerticesTest\n";
         cerr << "-\n";
         cerr << "-\n";
 
@@ -56,14 +80,26 @@ namespace {
             } else if(string(argv[i]) == "-testall") {
                 ImageRWSpeedTest(argc-i, &(argv[i]));
                 DiskReadSpeedTest(argc-i, &(argv[i]));
+                FixFacingTest(argc-i, &(argv[i]));
                 GaussianTest(argc-i, &(argv[i]));
+                HalfEdgeMeshTest(argc-i, &(argv[i]));
                 HashStringTest(argc-i, &(argv[i]));
+                ImageConvertTest(argc-i, &(argv[i]));
+                ImageStatsTest(argc-i, &(argv[i]));
+                ImageStreamTest(argc-i, &(argv[i]));
                 KDTreeTest(argc-i, &(argv[i]));
+                LoadOBJTest(argc-i, &(argv[i]));
+                LoadSaveTest(argc-i, &(argv[i]));
                 Matrix44Test(argc-i, &(argv[i]));
+                ModelCacheTest(argc-i, &(argv[i]));
                 PullPushTest(argc-i, &(argv[i]));
+                PyramidTest(argc-i, &(argv[i]));
+                RGBETest(argc-i, &(argv[i]));
+                SimplifyMeshTest(argc-i, &(argv[i]));
                 TimerTest(argc-i, &(argv[i]));
                 tImageTest(argc-i, &(argv[i]));
                 VCDTest(argc-i, &(argv[i]));
+                WeldVerticesTest(argc-i, &(argv[i]));
                 DiskWriteTest(argc-i, &(argv[i]));
 
                 return;
@@ -71,14 +107,26 @@ namespace {
             else if(string(argv[i]) == "-ImageRWSpeedTest") { ImageRWSpeedTest(argc-i, &(argv[i])); }
             else if(string(argv[i]) == "-DiskReadSpeedTest") { DiskReadSpeedTest(argc-i, &(argv[i])); }
             else if(string(argv[i]) == "-DiskWriteTest") { DiskWriteTest(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-FixFacingTest") { FixFacingTest(argc-i, &(argv[i])); }
             else if(string(argv[i]) == "-GaussianTest") { GaussianTest(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-HalfEdgeMeshTest") { HalfEdgeMeshTest(argc-i, &(argv[i])); }
             else if(string(argv[i]) == "-HashStringTest") { HashStringTest(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-ImageConvertTest") { ImageConvertTest(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-ImageStatsTest") { ImageStatsTest(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-ImageStreamTest") { ImageStreamTest(argc-i, &(argv[i])); }
             else if(string(argv[i]) == "-KDTreeTest") { KDTreeTest(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-LoadOBJTest") { LoadOBJTest(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-LoadSaveTest") { LoadSaveTest(argc-i, &(argv[i])); }
             else if(string(argv[i]) == "-Matrix44Test") { Matrix44Test(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-ModelCacheTest") { ModelCacheTest(argc-i, &(argv[i])); }
             else if(string(argv[i]) == "-PullPushTest") { PullPushTest(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-PyramidTest") { PyramidTest(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-RGBETest") { RGBETest(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-SimplifyMeshTest") { SimplifyMeshTest(argc-i, &(argv[i])); }
             else if(string(argv[i]) == "-TimerTest") { TimerTest(argc-i, &(argv[i])); }
             else if(string(argv[i]) == "-tImageTest") { tImageTest(argc-i, &(argv[i])); }
             else if(string(argv[i]) == "-VCDTest") { VCDTest(argc-i, &(argv[i])); }
+            else if(string(argv[i]) == "-WeldVerticesTest") { WeldVerticesTest(argc-i, &(argv[i])); }
             else if(argv[i][0] == '-') {
                 Usage("Unknown option.");
             } else {
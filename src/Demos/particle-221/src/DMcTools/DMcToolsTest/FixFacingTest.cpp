@@ -0,0 +1,91 @@
+// Test giving all the faces of a mesh the same winding
+
+#include "Model/Mesh.h"
+#include "Model/HalfEdgeMesh.h"
+#include "TestMeshes.h"
+#include "Util/Timer.h"
+#include "Util/Utils.h"
+
+#include <iostream>
+using namespace std;
+
+namespace {
+    // 1 if face F goes from E->v0 to E->v1
+    int EdgeDir(const Face *F, const Edge *E)
+    {
+        return (F->v0 == E->v0 && F->v1 == E->v1) || (F->v1 == E->v0 && F->v2 == E->v1) || (F->v2 == E->v0 && F->v0 == E->v1);
+    }
+
+    // Count the edges whose two faces go the same way along them.
+    int CountDisagreements(const Mesh &M)
+    {
+        int n = 0;
+        for(Edge *E = M.Edges; E; E = E->next)
+            if(E->Faces.size() == 2 && EdgeDir(E->Faces[0], E) == EdgeDir(E->Faces[1], E))
+                n++;
+        return n;
+    }
+
+    int CountDisagreements(const HalfEdgeMesh &M)
+    {
+        int n = 0;
+        for(int h=0; h<(int)M.Twin.size(); h++)
+            if(M.Twin[h] > h && M.From(M.Twin[h]) == M.From(h))
+                n++;
+        return n;
+    }
+};
+
+bool FixFacingTest(int argc, char **argv)
+{
+    bool ok = true;
+
+    // Several separate tori, each of which can be fixed
+    Mesh M(MakeTori(5, 30, 20, 0.4));
+    const int Before = CountDisagreements(M);
+    M.FixFacing();
+    const bool meshOk = Before > 0 && CountDisagreements(M) == 0;
+    cerr << "FixFacing Mesh tori: " << Before << " disagreeing edges before, " << CountDisagreements(M) << " after: " << (meshOk ? "ok" : "WRONG") << endl;
+    ok = ok && meshOk;
+
+    // A Moebius strip has edges that can't agree, but FixFacing leaves far fewer than the random windings had.
+    HalfEdgeMesh H(MakeTori(1, 30, 4, 0.4, true));
+    const int MoebiusBefore = CountDisagreements(H);
+    const int nMoebiusFlipped = H.FixFacing();
+    const int nConflicts = CountDisagreements(H);
+    const bool moebiusOk = nMoebiusFlipped > 0 && nConflicts > 0 && nConflicts < MoebiusBefore && H.FacesAreFixed;
+    cerr << "FixFacing Moebius strip: " << MoebiusBefore << " disagreeing edges before, " << nConflicts << " after: "
+         << (moebiusOk ? "ok" : "WRONG") << endl;
+    ok = ok && moebiusOk;
+
+    // A third face on an edge makes it non-manifold, and the faces on each side are still fixed.
+    TriObject Fin = MakeTori(1, 30, 20, 0.4);
+    Fin.verts.push_back(Fin.verts[0]);
+    Fin.verts.push_back(Fin.verts[1]);
+    Fin.verts.push_back(Vector(0, 0, 5));
+    Fin.VertexCount = int(Fin.verts.size());
+    HalfEdgeMesh HF(Fin);
+    HF.FixFacing();
+    int nNonManifold = 0, nBad = 0;
+    for(int h=0; h<(int)HF.Indices.size(); h++) {
+        if(HF.Twin[h] == HalfEdgeMesh::NONMANIFOLD)
+            nNonManifold++;
+        else if(HF.Twin[h] >= 0 && HF.From(HF.Twin[h]) != HF.To(h))
+            nBad++;
+    }
+    const bool finOk = nNonManifold == 3 && nBad == 0;
+    cerr << "FixFacing non-manifold edge: " << (finOk ? "ok" : "WRONG") << endl;
+    ok = ok && finOk;
+
+    // Speed on a million triangles, in 20 parts
+    Mesh Big(MakeTori(20, 250, 100, 0.3));
+    Timer T;
+    T.Start();
+    Big.FixFacing();
+    const float tMesh = T.Reset();
+    const bool bigOk = CountDisagreements(Big) == 0;
+    cerr << "FixFacing Mesh " << Big.FaceCount << " faces: " << tMesh << " sec. " << (bigOk ? "ok" : "WRONG") << endl;
+    ok = ok && bigOk;
+
+    return ok;
+}
@@ -0,0 +1,122 @@
+// Test the flat-array half-edge mesh
+
+#include "Model/HalfEdgeMesh.h"
+#include "TestMeshes.h"
+#include "Util/Timer.h"
+#include "Util/Utils.h"
+
+#include <iostream>
+using namespace std;
+
+namespace {
+    // A unit cube with outward faces
+    TriObject MakeCube()
+    {
+        const int Q[6][4] = {{0,2,6,4}, {1,5,7,3}, {0,4,5,1}, {2,3,7,6}, {0,1,3,2}, {4,6,7,5}};
+        TriObject Ob;
+        for(int f=0; f<6; f++) {
+            const int T[6] = {0, 1, 2, 0, 2, 3};
+            for(int c=0; c<6; c++) {
+                const int i = Q[f][T[c]];
+                Ob.verts.push_back(Vector(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+            }
+        }
+        Ob.VertexCount = int(Ob.verts.size());
+        Ob.FaceCount = Ob.VertexCount / 3;
+        Ob.RebuildBBox();
+        return Ob;
+    }
+
+    // True if every edge has two faces that go opposite ways along it.
+    bool AllAgree(const HalfEdgeMesh &M)
+    {
+        for(int h=0; h<(int)M.Indices.size(); h++)
+            if(M.Twin[h] < 0 || M.From(M.Twin[h]) != M.To(h))
+                return false;
+        return true;
+    }
+};
+
+bool HalfEdgeMeshTest(int argc, char **argv)
+{
+    bool ok = true;
+
+    // Welding and connectivity: a torus has V - E + F = 0 and no boundary.
+    const int NU = 60, NV = 40;
+    TriObject Tor = MakeTorus(NU, NV, 0.3);
+    HalfEdgeMesh M(Tor);
+    bool conOk = M.VertexCount == NU * NV && M.FaceCount == 2 * NU * NV && M.EdgeCount == 3 * NU * NV;
+    conOk = conOk && M.CheckIntegrity(true) == 0;
+    cerr << "HalfEdgeMesh import: " << (conOk ? "ok" : "WRONG") << endl;
+    ok = ok && conOk;
+
+    // Orientation: every face ends up with the winding of face 0.
+    const Vector N0 = Cross(Tor.verts[1] - Tor.verts[0], Tor.verts[2] - Tor.verts[0]);
+    const int nFlipped = M.FixFacing();
+    M.GenFaceNormals();
+    bool facingOk = AllAgree(M) && nFlipped > 0 && M.CheckIntegrity() == 0;
+    facingOk = facingOk && Dot(M.FaceNormals[0], N0) > 0;
+    cerr << "HalfEdgeMesh FixFacing flipped " << nFlipped << ": " << (facingOk ? "ok" : "WRONG") << endl;
+    ok = ok && facingOk;
+
+    // Smooth normals on the torus point away from the center of the tube.
+    M.GenNormals();
+    bool norOk = M.VertexCount == NU * NV;
+    const double Sign = Dot(M.normals[0], M.verts[0]) > 0 ? 1 : -1;
+    for(int v=0; v<M.VertexCount; v++) {
+        const Vector &P = M.verts[v];
+        Vector Ring(P.x, P.y, 0);
+        Ring.normalize();
+        Vector Out = P - Ring * 2.0;
+        Out.normalize();
+        norOk = norOk && Dot(M.normals[v], Out) * Sign > 0.99;
+    }
+    cerr << "HalfEdgeMesh smooth normals: " << (norOk ? "ok" : "WRONG") << endl;
+    ok = ok && norOk;
+
+    // Creases: each corner of a cube becomes three vertices with axis-aligned normals.
+    HalfEdgeMesh Cube(MakeCube());
+    Cube.creaseAngle = M_PI * 0.25;
+    Cube.GenNormals();
+    bool creaseOk = Cube.VertexCount == 24 && Cube.FaceCount == 12 && Cube.CheckIntegrity() == 0;
+    for(int h=0; h<(int)Cube.Indices.size(); h++)
+        creaseOk = creaseOk && Dot(Cube.normals[Cube.Indices[h]], Cube.FaceNormals[HalfEdgeMesh::FaceOf(h)]) > 0.999;
+    cerr << "HalfEdgeMesh crease normals: " << (creaseOk ? "ok" : "WRONG") << endl;
+    ok = ok && creaseOk;
+
+    // RenderObject round trip, and removing vertices that nothing uses
+    RenderObject RO;
+    Cube.ExportRenderObject(RO);
+    RO.verts.insert(RO.verts.begin(), f3Vector(9, 9, 9));
+    RO.normals.insert(RO.normals.begin(), f3Vector(0, 0, 1));
+    for(int i=0; i<(int)RO.indices.size(); i++)
+        RO.indices[i]++;
+    HalfEdgeMesh R(RO);
+    R.RemoveUnusedVertices();
+    TriObject T0, T1;
+    Cube.ExportTriObject(T0);
+    R.ExportTriObject(T1);
+    bool roundOk = R.VertexCount == 24 && R.CheckIntegrity() == 0 && T0.verts == T1.verts && T0.normals.size() == T1.normals.size();
+    for(int i=0; roundOk && i<(int)T0.normals.size(); i++)
+        roundOk = (T0.normals[i] - T1.normals[i]).length2() < 1e-12;
+    cerr << "HalfEdgeMesh RenderObject round trip: " << (roundOk ? "ok" : "WRONG") << endl;
+    ok = ok && roundOk;
+
+    // Speed on a million triangles
+    TriObject Big = MakeTorus(1000, 500, 0.1);
+    Timer Tm;
+    Tm.Start();
+    HalfEdgeMesh BM(Big);
+    const float tImport = Tm.Reset();
+    BM.FixFacing();
+    const float tFix = Tm.Reset();
+    BM.GenNormals();
+    const float tNor = Tm.Reset();
+    RenderObject BR;
+    BM.ExportRenderObject(BR);
+    const float tExport = Tm.Reset();
+    cerr << "HalfEdgeMesh " << BM.FaceCount << " faces: import " << tImport << " sec., FixFacing " << tFix
+         << ", GenNormals " << tNor << ", export " << tExport << endl;
+
+    return ok;
+}
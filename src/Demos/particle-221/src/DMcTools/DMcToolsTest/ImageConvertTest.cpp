@@ -0,0 +1,106 @@
+#include "Image/ImageConvert.h"
+#include "Image/tImage.h"
+#include "Util/Timer.h"
+#include "Util/Utils.h"
+
+#include <iostream>
+#include <cstring>
+using namespace std;
+
+namespace {
+    // The generic per-pixel conversion that the kernels replace.
+    template<class DstImage_T, class SrcImage_T>
+    void SlowConvert(DstImage_T &Dst, const SrcImage_T &Src)
+    {
+        Dst.SetSize(Src.w(), Src.h());
+        for(int i=0; i<Src.size(); i++)
+            Dst[i] = static_cast<typename DstImage_T::PixType>(Src[i]);
+    }
+
+    template<class Image_T>
+    bool SameBits(const Image_T &A, const Image_T &B)
+    {
+        return A.w() == B.w() && A.h() == B.h() && memcmp(A.pp(), B.pp(), A.size() * sizeof(typename Image_T::PixType)) == 0;
+    }
+
+    // Convert Src to DstImage_T both ways, check they match, and time the fast one.
+    template<class DstImage_T, class SrcImage_T>
+    bool CheckConvert(const char *Name, const SrcImage_T &Src)
+    {
+        Timer T;
+        T.Start();
+        DstImage_T Slow;
+        SlowConvert(Slow, Src);
+        const float tSlow = T.Reset();
+        DstImage_T Fast(Src);
+        const float tFast = T.Reset();
+        DstImage_T Serial;
+        ConvertImage(Serial, Src, false);
+
+        const bool ok = SameBits(Slow, Fast) && SameBits(Slow, Serial);
+        cerr << "ImageConvert " << Name << ": " << (ok ? "exact" : "WRONG") << ", " << tFast << " sec. vs. " << tSlow << " generic\n";
+        return ok;
+    }
+};
+
+bool ImageConvertTest(int argc, char **argv)
+{
+    bool ok = true;
+    const int wid = 1920, hgt = 1081; // An odd size leaves a remainder for the scalar loops.
+
+    // Floats outside 0..1 test the clamping, and floats from a wide range of exponents test half and RGBE.
+    f3Image F(wid, hgt);
+    for(int i=0; i<F.size(); i++) {
+        const float Big = float(pow(2.0, DRand() * 40.0 - 20.0));
+        F[i] = f3Pixel(float(DRand() * 1.4 - 0.2), float(DRand() * Big), float(DRand() < 0.1 ? 0.0 : DRand() * Big * 0.001));
+    }
+    f4Image F4(F);
+    f1Image F1(wid, hgt);
+    for(int i=0; i<F1.size(); i++)
+        F1[i] = f1Pixel(float(DRand() * 1.2 - 0.1));
+
+    ok = CheckConvert<uc3Image>("f3->uc3", F) && ok;
+    ok = CheckConvert<uc4Image>("f4->uc4", F4) && ok;
+    ok = CheckConvert<uc1Image>("f1->uc1", F1) && ok;
+    ok = CheckConvert<us3Image>("f3->us3", F) && ok;
+    ok = CheckConvert<us1Image>("f1->us1", F1) && ok;
+#ifdef DMC_USE_HALF_FLOAT
+    ok = CheckConvert<h3Image>("f3->h3", F) && ok;
+#endif
+    ok = CheckConvert<rgbeImage>("f3->rgbe", F) && ok;
+
+    uc3Image U3(F);
+    us3Image S3(F);
+    ok = CheckConvert<f3Image>("uc3->f3", U3) && ok;
+    ok = CheckConvert<f3Image>("us3->f3", S3) && ok;
+#ifdef DMC_USE_HALF_FLOAT
+    h3Image H3(F);
+    ok = CheckConvert<f3Image>("h3->f3", H3) && ok;
+#endif
+
+    // RGBE to float isn't a channel-wise conversion, so check it against make_f3Pixel() instead.
+    rgbeImage E(F);
+    f3Image EF(E), ES(wid, hgt);
+    for(int i=0; i<E.size(); i++)
+        ES[i] = E[i].make_f3Pixel();
+    const bool rgbeOk = SameBits(EF, ES);
+    cerr << "ImageConvert rgbe->f3: " << (rgbeOk ? "exact" : "WRONG") << endl;
+    ok = ok && rgbeOk;
+
+    // Swizzles
+    uc4Image Sw(U3);
+    const int BGRA[] = {2, 1, 0, 3};
+    SwizzleChannels(Sw, BGRA);
+    bool swOk = true;
+    for(int i=0; i<Sw.size(); i++)
+        swOk = swOk && Sw[i][0] == U3[i][2] && Sw[i][1] == U3[i][1] && Sw[i][2] == U3[i][0] && Sw[i][3] == 255;
+    const int RRR[] = {0, 0, 0};
+    f3Image Fr(F);
+    SwizzleChannels(Fr, RRR);
+    for(int i=0; i<Fr.size(); i++)
+        swOk = swOk && Fr[i] == f3Pixel(F[i][0]);
+    cerr << "ImageConvert swizzles: " << (swOk ? "ok" : "WRONG") << endl;
+    ok = ok && swOk;
+
+    return ok;
+}
@@ -0,0 +1,111 @@
+#include "Image/ImageStats.h"
+#include "Image/tImage.h"
+#include "Util/Timer.h"
+#include "Util/Utils.h"
+
+#include <iostream>
+#include <algorithm>
+using namespace std;
+
+namespace {
+    // The value at fraction p of the way through the sorted values of channel c, the slow way.
+    template<class Image_T>
+    typename Image_T::PixType::ElType SortedPercentile(const Image_T &Img, const float p, const int c)
+    {
+        vector<float> V;
+        for(int i=0; i<Img.size(); i++)
+            if(Img[i][c] == Img[i][c])
+                V.push_back(float(Img[i][c]));
+        sort(V.begin(), V.end());
+        return typename Image_T::PixType::ElType(V[std::min(size_t(p * (V.size() - 1) + 0.5), V.size() - 1)]);
+    }
+};
+
+bool ImageStatsTest(int argc, char **argv)
+{
+    bool ok = true;
+
+    // Float, with a wide range of values, some negative, and a few NaNs
+    f3Image F(613, 417);
+    for(int i=0; i<F.size(); i++)
+        F[i] = f3Pixel(float(NRand(10.0)), float(DRand() * DRand() * 1000.0), -float(DRand()));
+    F[17][1] = numeric_limits<float>::quiet_NaN();
+
+    ImageStats<f3Image> SF(64, -40, 40);
+    SF.Add(F);
+
+    const float P[] = {0.0f, 0.01f, 0.25f, 0.5f, 0.9f, 0.99f, 1.0f};
+    const int nP = 7;
+    f3Pixel Out[nP];
+    SF.Percentiles(Out, P, nP, F);
+
+    bool exact = true;
+    for(int j=0; j<nP; j++)
+        for(int c=0; c<3; c++)
+            exact = exact && Out[j][c] == SortedPercentile(F, P[j], c);
+    exact = exact && SF.Min(2) == SortedPercentile(F, 0.0f, 2) && SF.Max(0) == SortedPercentile(F, 1.0f, 0);
+    exact = exact && SF.NaNCount(1) == 1 && SF.Count(1) == size_t(F.size() - 1);
+    cerr << "ImageStats float percentiles, min, max: " << (exact ? "exact" : "WRONG") << endl;
+    ok = ok && exact;
+
+    // Percentile() is the bottom of the first level's bucket, which is within a part in 256.
+    const float Approx = SF.Percentile(0.5f, 1), Med = SortedPercentile(F, 0.5f, 1);
+    cerr << "ImageStats float approximate median " << Approx << " vs. " << Med << endl;
+    ok = ok && Approx <= Med && Med - Approx <= Med / 128.0f;
+
+    // The mean and the histogram
+    double Sum = 0;
+    for(int i=0; i<F.size(); i++)
+        Sum += F[i][0];
+    vector<size_t> H(64, 0);
+    for(int i=0; i<F.size(); i++) {
+        const double b = floor((F[i][0] + 40.0) * (64 / 80.0));
+        if(b >= 0 && b < 64)
+            H[int(b)]++;
+    }
+    bool histOk = fabs(SF.Mean(0) - Sum / F.size()) < 1e-9 * F.size();
+    for(int b=0; b<64; b++)
+        histOk = histOk && SF.Histogram(b, 0) == H[b];
+    cerr << "ImageStats mean and histogram: " << (histOk ? "ok" : "WRONG") << endl;
+    ok = ok && histOk;
+
+    // A band of rows at a time gives the same as all at once.
+    ImageStats<f3Image> SB(64, -40, 40);
+    for(int y=0; y<F.h(); y+=50)
+        SB.Add(&F(0, y), size_t(F.w()) * std::min(50, F.h() - y));
+    f3Pixel OutB[nP];
+    SB.Percentiles(OutB, P, nP, F);
+    bool bandsOk = SB.Count() == SF.Count() && SB.Min(0) == SF.Min(0) && SB.Max(1) == SF.Max(1);
+    for(int j=0; j<nP; j++)
+        bandsOk = bandsOk && OutB[j] == Out[j];
+    cerr << "ImageStats in bands: " << (bandsOk ? "ok" : "WRONG") << endl;
+    ok = ok && bandsOk;
+
+    // Unsigned char is exact from the first level.
+    uc3Image U(300, 200);
+    for(int i=0; i<U.size(); i++)
+        U[i] = uc3Pixel((unsigned char)(LRand() % 256), (unsigned char)(i % 200), (unsigned char)(LRand() % 7));
+    ImageStats<uc3Image> SU;
+    SU.Add(U);
+    bool ucOk = true;
+    for(int c=0; c<3; c++)
+        for(int j=0; j<nP; j++)
+            ucOk = ucOk && SU.Percentile(P[j], c) == SortedPercentile(U, P[j], c);
+    cerr << "ImageStats unsigned char percentiles: " << (ucOk ? "exact" : "WRONG") << endl;
+    ok = ok && ucOk;
+
+    // Speed on a 4K frame
+    f3Image Big(3840, 2160);
+    for(int i=0; i<Big.size(); i++)
+        Big[i] = f3Pixel(float(DRand() * 100.0));
+    ImageStats<f3Image> S4(256, 0, 100);
+    Timer T;
+    T.Start();
+    S4.Clear();
+    S4.Add(Big);
+    const float tAdd = T.Reset();
+    S4.Percentiles(Out, P, nP, Big);
+    cerr << "ImageStats 3840x2160 f3: " << tAdd << " sec. for stats and histograms, " << T.Read() << " sec. for exact percentiles\n";
+
+    return ok;
+}
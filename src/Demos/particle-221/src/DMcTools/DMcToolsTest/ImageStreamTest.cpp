@@ -0,0 +1,236 @@
+// Test reading and writing images a band of rows at a time
+
+#include "Image/ImageAlgorithms.h"
+#include "Image/ImageStream.h"
+#include "Image/tImage.h"
+#include "Util/Utils.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+namespace {
+    // Noise with flat runs, so a run-length encoder makes both kinds of packet, and with elements in [0,1) if they're float.
+    template<class Image_T>
+    Image_T MakeImage(const int wid, const int hgt)
+    {
+        typedef typename Image_T::PixType::ElType El_T;
+        const bool isFloat = typeid(El_T) == typeid(float);
+        const int Chan = Image_T::PixType::Chan;
+
+        Image_T Img(wid, hgt);
+        for(int y=0; y<hgt; y++) {
+            for(int x=0; x<wid; x++) {
+                if(x > 0 && (x / 40) % 3 == 0) {
+                    Img(x,y) = Img(x-1,y);
+                    continue;
+                }
+                for(int c=0; c<Chan; c++)
+                    Img(x,y)[c] = isFloat ? El_T(DRand()) : El_T(LRand());
+            }
+        }
+        return Img;
+    }
+
+    template<class Image_T>
+    bool SamePixels(const Image_T &A, const Image_T &B)
+    {
+        return A.w() == B.w() && A.h() == B.h() && memcmp(A.pp(), B.pp(), A.size_bytes()) == 0;
+    }
+
+    // Write Img to fname a band of n rows at a time.
+    template<class Image_T>
+    void WriteBands(const char *fname, const Image_T &Img, const int n)
+    {
+        ImageWriter *W = OpenImageWriter<Image_T>(fname, Img.w(), Img.h());
+        Image_T Rows(Img.w(), n);
+        for(int y=0; y<Img.h(); y+=n) {
+            const int k = min(n, Img.h() - y);
+            memcpy(Rows.pp(), Img.pp(Img.ind(0, y)), k * Img.w() * sizeof(typename Image_T::PixType));
+            W->WriteRows(Rows, k);
+        }
+        delete W;
+    }
+
+    // Read fname a band of n rows at a time.
+    template<class Image_T>
+    Image_T ReadBands(const char *fname, const int n)
+    {
+        ImageReader *R = OpenImageReader(fname);
+        Image_T Img(R->w(), R->h()), Rows;
+        int y = 0, k;
+        try {
+            while((k = R->ReadRows(Rows, n)) > 0) {
+                memcpy(Img.pp(Img.ind(0, y)), Rows.pp(), k * Img.w() * sizeof(typename Image_T::PixType));
+                y += k;
+            }
+        }
+        catch(DMcError &) {
+            delete R;
+            throw;
+        }
+        const bool Done = y == Img.h() && R->y() == Img.h();
+        delete R;
+        if(!Done) throw DMcError("ReadRows stopped early.");
+        return Img;
+    }
+
+    // Write Img to fname in bands of one height and read it back in bands of another, and compare it to Load().
+    // If Lossless, it must also come back as Img.
+    template<class Image_T>
+    bool RoundTrip(const char *fname, const Image_T &Img, const bool Lossless)
+    {
+        WriteBands(fname, Img, 7);
+        const Image_T R = ReadBands<Image_T>(fname, 5);
+        const Image_T L(fname);
+        const bool RTok = SamePixels(R, L) && (!Lossless || SamePixels(R, Img));
+        cerr << "ImageStream " << fname << " " << Img.w() << "x" << Img.h() << " x " << int(Image_T::PixType::Chan) << ": "
+             << (RTok ? "ok" : "WRONG") << endl;
+        remove(fname);
+        return RTok;
+    }
+
+    // Make the Targa file start at the bottom left, so that its rows are stored in the opposite order.
+    void FlipTGA(const char *fname)
+    {
+        FILE *f = fopen(fname, "r+b");
+        ASSERT_RM(f, "Error opening Targa file");
+        fseek(f, 17, SEEK_SET);
+        const unsigned char Desc = (unsigned char)(fgetc(f) & ~0x30);
+        fseek(f, 17, SEEK_SET);
+        fputc(Desc, f);
+        fclose(f);
+    }
+
+    // Cut the last n bytes off the file.
+    void ChopFile(const char *fname, const size_t n)
+    {
+        FILE *f = fopen(fname, "rb");
+        ASSERT_RM(f, "Error opening file to chop");
+        vector<char> Buf;
+        char Chunk[65536];
+        size_t k;
+        while((k = fread(Chunk, 1, sizeof(Chunk), f)) > 0)
+            Buf.insert(Buf.end(), Chunk, Chunk + k);
+        fclose(f);
+
+        f = fopen(fname, "wb");
+        ASSERT_RM(f, "Error opening file to chop");
+        fwrite(&Buf[0], 1, Buf.size() - n, f);
+        fclose(f);
+    }
+
+    // Read a Targa file that Save() wrote, run-length encoded, and then the same file bottom-up.
+    template<class Image_T>
+    bool TGARoundTrip(const char *fname, const Image_T &Img, const bool RLE)
+    {
+        if(RLE)
+            Img.Save(fname);
+        else
+            WriteBands(fname, Img, 7);
+
+        const Image_T R = ReadBands<Image_T>(fname, 5);
+        bool TGAok = SamePixels(R, Img);
+
+        FlipTGA(fname);
+        Image_T Flipped(Img);
+        VFlip(Flipped);
+        const Image_T RF = ReadBands<Image_T>(fname, 5);
+        const Image_T LF(fname);
+        TGAok = TGAok && SamePixels(RF, Flipped) && SamePixels(LF, Flipped);
+
+        cerr << "ImageStream " << (RLE ? "RLE " : "") << "Targa " << Img.w() << "x" << Img.h() << " x " << int(Image_T::PixType::Chan)
+             << ", top-down and bottom-up: " << (TGAok ? "ok" : "WRONG") << endl;
+        remove(fname);
+        return TGAok;
+    }
+};
+
+bool ImageStreamTest(int argc, char **argv)
+{
+    bool ok = true;
+
+    // Odd sizes, bands that don't divide the height, and files of a few MB, so reads cross the read-ahead.
+    const f3Image F = MakeImage<f3Image>(997, 613);
+    const uc3Image U = MakeImage<uc3Image>(997, 613);
+    const uc4Image U4 = MakeImage<uc4Image>(997, 613);
+    const uc1Image U1 = MakeImage<uc1Image>(997, 613);
+
+    ok = RoundTrip("ImageStreamTest.ppm", U, true) && ok;
+    ok = RoundTrip("ImageStreamTest.pgm", U1, true) && ok;
+    ok = RoundTrip("ImageStreamTest.ppm", MakeImage<us3Image>(301, 97), true) && ok;
+    ok = RoundTrip("ImageStreamTest.pfm", F, true) && ok;
+    ok = RoundTrip("ImageStreamTest.bmp", U, true) && ok;
+    ok = RoundTrip("ImageStreamTest.bmp", U1, true) && ok;
+    ok = RoundTrip("ImageStreamTest.tga", U4, true) && ok;
+    ok = RoundTrip("ImageStreamTest.hdr", F, false) && ok;
+
+    ok = TGARoundTrip("ImageStreamTest.tga", U, false) && ok;
+    ok = TGARoundTrip("ImageStreamTest.tga", U, true) && ok;
+    ok = TGARoundTrip("ImageStreamTest.tga", U4, true) && ok;
+    ok = TGARoundTrip("ImageStreamTest.tga", U1, true) && ok;
+
+    // The streaming algorithms must give what the in-memory ones do.
+    {
+        const char *InName = "ImageStreamTestIn.pfm", *OutName = "ImageStreamTestOut.pfm";
+        F.Save(InName);
+
+        f3Image DS;
+        Downsample(DS, F, 300, 200);
+        {
+            ImageReader *R = OpenImageReader(InName);
+            ImageWriter *W = OpenImageWriter<f3Image>(OutName, 300, 200);
+            Downsample<f3Image>(*W, *R, 300, 200);
+            delete W;
+            delete R;
+        }
+        const bool dsOk = SamePixels(f3Image(OutName), DS);
+        cerr << "ImageStream Downsample: " << (dsOk ? "ok" : "WRONG") << endl;
+        ok = ok && dsOk;
+
+        const f1Image Kernel = MakeGaussianKernel<f1Image>(7, 1.5f);
+        f3Image Conv;
+        ConvolveImage(Conv, F, Kernel);
+        {
+            ImageReader *R = OpenImageReader(InName);
+            ImageWriter *W = OpenImageWriter<f3Image>(OutName, F.w(), F.h());
+            ConvolveImage<f3Image>(*W, *R, Kernel);
+            delete W;
+            delete R;
+        }
+        const bool convOk = SamePixels(f3Image(OutName), Conv);
+        cerr << "ImageStream ConvolveImage: " << (convOk ? "ok" : "WRONG") << endl;
+        ok = ok && convOk;
+
+        remove(InName);
+        remove(OutName);
+    }
+
+    // Files that end early throw instead of reading past the end. The run-length encoded one only finds out partway down.
+    {
+        const char *PPMName = "ImageStreamTest.ppm", *TGAName = "ImageStreamTest.tga";
+        U.Save(PPMName);
+        U.Save(TGAName);
+        ChopFile(PPMName, 3 * 997 * 3);
+        ChopFile(TGAName, 3 * 997 * 3);
+
+        int Threw = 0;
+        for(int i=0; i<2; i++) {
+            try {
+                ReadBands<uc3Image>(i ? TGAName : PPMName, 5);
+            }
+            catch(DMcError &) {
+                Threw++;
+            }
+        }
+        const bool truncOk = Threw == 2;
+        cerr << "ImageStream truncated PPM and Targa: " << (truncOk ? "ok" : "WRONG") << endl;
+        ok = ok && truncOk;
+        remove(PPMName);
+        remove(TGAName);
+    }
+
+    return ok;
+}
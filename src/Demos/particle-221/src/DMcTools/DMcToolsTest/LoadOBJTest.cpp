@@ -0,0 +1,140 @@
+// Test loading Wavefront OBJ files
+
+#include "Model/Model.h"
+#include "Model/TriObject.h"
+#include "TestMeshes.h"
+#include "Util/Timer.h"
+#include "Util/Utils.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+namespace {
+    // Read the vertices and v/t/n faces with stdio and sscanf, and make separate triangles, like the loader did before.
+    void SlowLoadOBJ(TriObject &Ob, const char *fname)
+    {
+        FILE *f = fopen(fname, "r");
+        ASSERT_RM(f, "Error opening input file");
+        vector<Vector> tverts, ttexcoords, tnormals;
+        char TmpBuf[4096];
+        while(fgets(TmpBuf, 4096, f)) {
+            double x, y, z = 0;
+            if(!strncmp(TmpBuf, "v ", 2) && 3 == sscanf(TmpBuf + 2, "%lf %lf %lf", &x, &y, &z))
+                tverts.push_back(Vector(x, y, z));
+            else if(!strncmp(TmpBuf, "vt ", 3) && 2 == sscanf(TmpBuf + 3, "%lf %lf", &x, &y))
+                ttexcoords.push_back(Vector(x, y, 0));
+            else if(!strncmp(TmpBuf, "vn ", 3) && 3 == sscanf(TmpBuf + 3, "%lf %lf %lf", &x, &y, &z))
+                tnormals.push_back(Vector(x, y, z));
+            else if(TmpBuf[0] == 'f') {
+                int v[16], t[16], n[16], i = 0, j;
+                for(char *buf = TmpBuf + 1; i < 16 && 3 == sscanf(buf, " %d/%d/%d%n", &v[i], &t[i], &n[i], &j); buf += j)
+                    i++;
+                for(int k=2; k<i; k++) {
+                    const int c[3] = {0, k-1, k};
+                    for(int l=0; l<3; l++) {
+                        Ob.verts.push_back(tverts[v[c[l]] - 1]);
+                        Ob.texcoords.push_back(ttexcoords[t[c[l]] - 1]);
+                        Ob.normals.push_back(tnormals[n[c[l]] - 1]);
+                    }
+                }
+            }
+        }
+        fclose(f);
+    }
+
+    void WriteFile(const char *fname, const char *Text)
+    {
+        FILE *f = fopen(fname, "w");
+        ASSERT_RM(f, "Error opening output file");
+        fputs(Text, f);
+        fclose(f);
+    }
+
+    bool SameBits(const vector<Vector> &A, const vector<Vector> &B)
+    {
+        return A.size() == B.size() && (A.empty() || !memcmp(&A[0], &B[0], A.size() * sizeof(Vector)));
+    }
+
+    TriObject *FindObj(Model &M, const char *Name)
+    {
+        for(int i=0; i<(int)M.Objs.size(); i++)
+            if(!strcmp(M.Objs[i]->Name, Name))
+                return (TriObject *)M.Objs[i];
+        return NULL;
+    }
+};
+
+bool LoadOBJTest(int argc, char **argv)
+{
+    bool ok = true;
+
+    // Groups, materials, smoothing, and all the forms of faces
+    WriteFile("LoadOBJTest.mtl",
+        "newmtl red\r\nKd 1 0 0\r\nNs 100\r\n"
+        "newmtl blue\nKd 0 0 1\n");
+    WriteFile("LoadOBJTest.obj",
+        "# A square\nmtllib LoadOBJTest.mtl\n"
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+        "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+        "vn 0 0 1\n"
+        "g front\nusemtl red\n"
+        "f 1/1/1 2/2/1 3/3/1 4/4/1\n"
+        "g back\ns off\n"
+        "f -1//1 -2//1 -3//1\n"
+        "g front\n"
+        "f 1/1 3/3 4/4\n"
+        "  f 1 2 3\n"
+        "g back\nusemtl blue\n");
+    {
+        Model M;
+        M.LoadOBJ("LoadOBJTest.obj");
+        TriObject *Front = FindObj(M, "front"), *Back = FindObj(M, "back");
+        const bool groupsOk = M.Objs.size() == 2 && Front && Back;
+        const bool frontOk = groupsOk && Front->verts.size() == 12 && Front->texcoords.size() == 12 && Front->normals.size() == 6 &&
+            Front->verts[4] == Vector(1, 1, 0) && Front->texcoords[7] == Vector(1, 1, 0) &&
+            Front->dcolors.size() == 1 && Front->dcolors[0] == Vector(1, 0, 0) && Front->ShininessValid;
+        const bool backOk = groupsOk && Back->verts.size() == 3 && Back->texcoords.size() == 0 && Back->normals.size() == 3 &&
+            Back->verts[0] == Vector(0, 1, 0) && Back->verts[2] == Vector(1, 0, 0) && Back->creaseAngle == 0 &&
+            Back->dcolors.size() == 1 && Back->dcolors[0] == Vector(0, 0, 1) && M.Box.MaxV == Vector(1, 1, 0);
+        cerr << "LoadOBJ groups and materials: " << (frontOk && backOk ? "ok" : "WRONG") << endl;
+        ok = ok && frontOk && backOk;
+    }
+
+    // A bad index is an error.
+    WriteFile("LoadOBJTest.obj", "v 0 0 0\nv 1 0 0\nf 1 2 3\n");
+    bool Threw = false;
+    try {
+        Model M;
+        M.LoadOBJ("LoadOBJTest.obj");
+    }
+    catch(DMcError &) {
+        Threw = true;
+    }
+    cerr << "LoadOBJ bad index: " << (Threw ? "ok" : "WRONG") << endl;
+    ok = ok && Threw;
+
+    // Against the stdio loader on a file that's many chunks
+    WriteGridOBJ("LoadOBJTest.obj", 700, 700);
+    Timer T;
+    T.Start();
+    TriObject Slow;
+    SlowLoadOBJ(Slow, "LoadOBJTest.obj");
+    const float tSlow = T.Reset();
+    Model M;
+    M.LoadOBJ("LoadOBJTest.obj");
+    const float tFast = T.Reset();
+    const TriObject *Ob = M.Objs.size() == 1 ? (TriObject *)M.Objs[0] : NULL;
+    const bool same = Ob && SameBits(Ob->verts, Slow.verts) && SameBits(Ob->texcoords, Slow.texcoords) &&
+        SameBits(Ob->normals, Slow.normals);
+    cerr << "LoadOBJ " << Slow.verts.size() / 3 << " triangles: stdio " << tSlow << " sec., LoadOBJ " << tFast << " sec. "
+         << (same ? "ok" : "WRONG") << endl;
+    ok = ok && same;
+
+    remove("LoadOBJTest.obj");
+    remove("LoadOBJTest.mtl");
+
+    return ok;
+}
@@ -0,0 +1,281 @@
+// Test the image loaders by saving and loading, and with files that end early
+
+#include "Image/ImageLoadSave.h"
+#include "Image/ImageStream.h"
+#include "Image/tImage.h"
+#include "Util/Utils.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+namespace {
+    // Noise with flat runs, so a run-length encoder makes both kinds of packet, and with elements in [0,1) if they're float.
+    template<class Image_T>
+    Image_T MakeImage(const int wid, const int hgt)
+    {
+        typedef typename Image_T::PixType::ElType El_T;
+        const bool isFloat = typeid(El_T) == typeid(float);
+        const int Chan = Image_T::PixType::Chan;
+
+        Image_T Img(wid, hgt);
+        for(int y=0; y<hgt; y++) {
+            for(int x=0; x<wid; x++) {
+                if(x > 0 && (x / 20) % 3 == 0) {
+                    Img(x,y) = Img(x-1,y);
+                    continue;
+                }
+                for(int c=0; c<Chan; c++)
+                    Img(x,y)[c] = isFloat ? El_T(DRand()) : El_T(LRand());
+            }
+        }
+        return Img;
+    }
+
+    template<class Image_T>
+    bool SamePixels(const Image_T &A, const Image_T &B)
+    {
+        return A.w() == B.w() && A.h() == B.h() && memcmp(A.pp(), B.pp(), A.size_bytes()) == 0;
+    }
+
+    // Save Img in exactly its own pixel format, which tSave() doesn't always do.
+    template<class Image_T>
+    void SaveAsIs(const char *fname, Image_T &Img)
+    {
+        typedef typename Image_T::PixType::ElType El_T;
+        ImageLoadSave saver;
+        saver.SetImage((unsigned char *)Img.pp(), Img.w(), Img.h(), Image_T::PixType::Chan,
+            typeid(El_T)==typeid(unsigned int), typeid(El_T)==typeid(unsigned short), typeid(El_T)==typeid(float));
+        saver.Save(fname);
+        saver.Pix = NULL; saver.wid = saver.hgt = saver.chan = 0;
+    }
+
+    void WriteFile(const char *fname, const vector<unsigned char> &Bytes)
+    {
+        FILE *f = fopen(fname, "wb");
+        ASSERT_RM(f, "Error opening test file");
+        fwrite(&Bytes[0], 1, Bytes.size(), f);
+        fclose(f);
+    }
+
+    vector<unsigned char> ReadFile(const char *fname)
+    {
+        FILE *f = fopen(fname, "rb");
+        ASSERT_RM(f, "Error opening test file");
+        vector<unsigned char> Bytes;
+        unsigned char Chunk[65536];
+        size_t k;
+        while((k = fread(Chunk, 1, sizeof(Chunk), f)) > 0)
+            Bytes.insert(Bytes.end(), Chunk, Chunk + k);
+        fclose(f);
+        return Bytes;
+    }
+
+    // Cut the last n bytes off the file.
+    void ChopFile(const char *fname, const size_t n)
+    {
+        vector<unsigned char> Bytes = ReadFile(fname);
+        Bytes.resize(Bytes.size() - n);
+        WriteFile(fname, Bytes);
+    }
+
+    // Whether loading the file throws a DMcError.
+    template<class Image_T>
+    bool LoadThrows(const char *fname)
+    {
+        try {
+            Image_T Img(fname);
+        }
+        catch(DMcError &) {
+            return true;
+        }
+        return false;
+    }
+
+    void PutShort(vector<unsigned char> &B, const int v)
+    {
+        B.push_back((unsigned char)v);
+        B.push_back((unsigned char)(v >> 8));
+    }
+
+    void PutInt(vector<unsigned char> &B, const int v)
+    {
+        PutShort(B, v);
+        PutShort(B, v >> 16);
+    }
+
+    template<class Image_T>
+    bool RoundTrip(const char *Name, const char *fname, Image_T Img)
+    {
+        SaveAsIs(fname, Img);
+        const Image_T L(fname);
+        const bool RTok = SamePixels(L, Img);
+        cerr << "LoadSave " << Name << ": " << (RTok ? "ok" : "WRONG") << endl;
+        remove(fname);
+        return RTok;
+    }
+};
+
+bool LoadSaveTest(int argc, char **argv)
+{
+    bool ok = true;
+
+    // Odd widths leave BMP rows padded.
+    const uc3Image U3 = MakeImage<uc3Image>(301, 97);
+    const uc1Image U1 = MakeImage<uc1Image>(301, 97);
+    const uc4Image U4 = MakeImage<uc4Image>(301, 97);
+
+    ok = RoundTrip("PPM", "LoadSaveTest.ppm", U3) && ok;
+    ok = RoundTrip("PGM", "LoadSaveTest.pgm", U1) && ok;
+    ok = RoundTrip("PAM", "LoadSaveTest.pam", U4) && ok;
+    ok = RoundTrip("16-bit PPM", "LoadSaveTest.ppm", MakeImage<us3Image>(301, 97)) && ok;
+    ok = RoundTrip("float PPM", "LoadSaveTest.pfm", MakeImage<f3Image>(301, 97)) && ok;
+    ok = RoundTrip("float PGM", "LoadSaveTest.pfm", MakeImage<f1Image>(301, 97)) && ok;
+    ok = RoundTrip("BMP", "LoadSaveTest.bmp", U3) && ok;
+    ok = RoundTrip("gray BMP", "LoadSaveTest.bmp", U1) && ok;
+    ok = RoundTrip("RLE Targa", "LoadSaveTest.tga", U3) && ok;
+    ok = RoundTrip("RLE gray Targa", "LoadSaveTest.tga", U1) && ok;
+    ok = RoundTrip("RLE Targa with alpha", "LoadSaveTest.tga", U4) && ok;
+
+    // Raw Targa, top-down as written and then bottom-up by changing the origin.
+    {
+        const char *fname = "LoadSaveTest.tga";
+        ImageWriter *W = OpenImageWriter<uc4Image>(fname, U4.w(), U4.h());
+        W->WriteRows(U4);
+        delete W;
+        const uc4Image L(fname);
+
+        vector<unsigned char> Bytes = ReadFile(fname);
+        Bytes[17] &= ~0x30;
+        WriteFile(fname, Bytes);
+        uc4Image Flipped(U4);
+        VFlip(Flipped);
+        const uc4Image LF(fname);
+
+        const bool rawOk = SamePixels(L, U4) && SamePixels(LF, Flipped);
+        cerr << "LoadSave raw Targa, top-down and bottom-up: " << (rawOk ? "ok" : "WRONG") << endl;
+        ok = ok && rawOk;
+        remove(fname);
+    }
+
+    // HDR keeps eight bits of mantissa.
+    {
+        const char *fname = "LoadSaveTest.hdr";
+        const f3Image F = MakeImage<f3Image>(301, 97);
+        F.Save(fname);
+        const f3Image L(fname);
+        bool hdrOk = L.w() == F.w() && L.h() == F.h();
+        for(int i=0; hdrOk && i<F.size(); i++)
+            for(int c=0; c<3; c++)
+                hdrOk = hdrOk && fabs(L[i][c] - F[i][c]) <= 1.0f / 128.0f;
+        cerr << "LoadSave HDR: " << (hdrOk ? "ok" : "WRONG") << endl;
+        ok = ok && hdrOk;
+        remove(fname);
+    }
+
+    // A run-length encoded 8-bit BMP with every kind of code, and with its end-of-bitmap cut off.
+    {
+        const char *fname = "LoadSaveTest.bmp";
+        const unsigned char Rows[] = {
+            2, 1, 0, 3, 1, 2, 1, 0, 0, 0, // Bottom row: a run, and an odd absolute stretch and its padding
+            0, 4, 2, 2, 1, 2, 1, 2, 0, 0, // An even absolute stretch, then a run
+            0, 2, 2, 0, 3, 1, 0, 1 // Top row: a delta over two pixels, a run, and the end of the bitmap
+        };
+        vector<unsigned char> B;
+        B.push_back('B'); B.push_back('M');
+        PutInt(B, 14 + 40 + 12 + sizeof(Rows)); PutInt(B, 0); PutInt(B, 14 + 40 + 12);
+        PutInt(B, 40); PutInt(B, 5); PutInt(B, 3); PutShort(B, 1); PutShort(B, 8);
+        PutInt(B, 1); PutInt(B, sizeof(Rows)); PutInt(B, 0); PutInt(B, 0); PutInt(B, 3); PutInt(B, 0);
+        const unsigned char Map[] = {0, 0, 0, 0, 0, 0, 255, 0, 255, 0, 0, 0}; // Black, red, blue, as BGR0
+        B.insert(B.end(), Map, Map + sizeof(Map));
+        B.insert(B.end(), Rows, Rows + sizeof(Rows));
+        WriteFile(fname, B);
+
+        const int Inds[15] = {0, 0, 1, 1, 1, 2, 2, 1, 2, 2, 1, 1, 1, 2, 1};
+        const uc3Pixel Colors[3] = {uc3Pixel(0, 0, 0), uc3Pixel(255, 0, 0), uc3Pixel(0, 0, 255)};
+        const uc3Image L(fname);
+        bool rleOk = L.w() == 5 && L.h() == 3;
+        for(int i=0; rleOk && i<15; i++)
+            rleOk = L[i] == Colors[Inds[i]];
+
+        ChopFile(fname, 4);
+        rleOk = rleOk && LoadThrows<uc3Image>(fname);
+        cerr << "LoadSave RLE8 BMP: " << (rleOk ? "ok" : "WRONG") << endl;
+        ok = ok && rleOk;
+        remove(fname);
+    }
+
+    // A bottom-up, color-mapped, run-length encoded Targa whose run crosses from one row to the next.
+    {
+        const char *fname = "LoadSaveTest.tga";
+        const unsigned char Bytes[] = {
+            0, 1, 9, 0, 0, 3, 0, 24, 0, 0, 0, 0, 4, 0, 2, 0, 8, 0, // Header
+            30, 20, 10, 0, 100, 200, 3, 2, 1, // Color map, as BGR
+            0x85, 1, 0x01, 2, 0 // Six of color 1 and then colors 2 and 0
+        };
+        WriteFile(fname, vector<unsigned char>(Bytes, Bytes + sizeof(Bytes)));
+
+        const int Inds[8] = {1, 1, 2, 0, 1, 1, 1, 1};
+        const uc3Pixel Colors[3] = {uc3Pixel(10, 20, 30), uc3Pixel(200, 100, 0), uc3Pixel(1, 2, 3)};
+        const uc3Image L(fname);
+        bool mapOk = L.w() == 4 && L.h() == 2;
+        for(int i=0; mapOk && i<8; i++)
+            mapOk = L[i] == Colors[Inds[i]];
+
+        ChopFile(fname, 1);
+        mapOk = mapOk && LoadThrows<uc3Image>(fname);
+        cerr << "LoadSave color-mapped RLE Targa: " << (mapOk ? "ok" : "WRONG") << endl;
+        ok = ok && mapOk;
+        remove(fname);
+    }
+
+    // Files that end early, in the pixels or in the header, throw instead of reading past the end.
+    {
+        const char *Names[] = {"LoadSaveTest.ppm", "LoadSaveTest.bmp", "LoadSaveTest.tga", "LoadSaveTest.hdr"};
+        bool truncOk = true;
+        for(int i=0; i<4; i++) {
+            if(i < 3)
+                U3.Save(Names[i]);
+            else
+                MakeImage<f3Image>(301, 97).Save(Names[i]);
+            ChopFile(Names[i], 100);
+            truncOk = truncOk && LoadThrows<uc3Image>(Names[i]);
+
+            vector<unsigned char> Bytes = ReadFile(Names[i]);
+            Bytes.resize(i == 3 ? 30 : 10);
+            WriteFile(Names[i], Bytes);
+            truncOk = truncOk && LoadThrows<uc3Image>(Names[i]);
+            remove(Names[i]);
+        }
+        cerr << "LoadSave truncated files: " << (truncOk ? "ok" : "WRONG") << endl;
+        ok = ok && truncOk;
+    }
+
+    // MappedImage uses the pixels of a file in place when it can, and loads it otherwise.
+    {
+        const char *PPMName = "LoadSaveTest.ppm", *PGMName = "LoadSaveTest.pgm", *TGAName = "LoadSaveTest.tga";
+        U3.Save(PPMName);
+        uc1Image G(U1);
+        SaveAsIs(PGMName, G);
+        U3.Save(TGAName);
+
+        bool mapOk;
+        {
+            MappedImage<uc3Image> M3(PPMName);
+            MappedImage<uc1Image> M1(PGMName);
+            MappedImage<uc3Image> MT(TGAName);
+            MappedImage<us3Image> MS(PPMName);
+            mapOk = M3.IsMapped() && SamePixels(M3.Img(), U3) && M1.IsMapped() && SamePixels(M1.Img(), U1) &&
+                !MT.IsMapped() && SamePixels(MT.Img(), U3) && !MS.IsMapped() && SamePixels(MS.Img(), us3Image(U3));
+        }
+        cerr << "LoadSave MappedImage: " << (mapOk ? "ok" : "WRONG") << endl;
+        ok = ok && mapOk;
+        remove(PPMName);
+        remove(PGMName);
+        remove(TGAName);
+    }
+
+    return ok;
+}
@@ -0,0 +1,184 @@
+// Test saving and loading the binary model cache
+
+#include "Model/Model.h"
+#include "Model/LightDB.h"
+#include "Model/RenderObject.h"
+#include "Model/TriObject.h"
+#include "TestMeshes.h"
+#include "Util/Timer.h"
+#include "Util/Utils.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+extern LightDB LitDB;
+
+namespace {
+    template<class T>
+    bool SameBits(const vector<T> &A, const vector<T> &B)
+    {
+        return A.size() == B.size() && (A.empty() || !memcmp(&A[0], &B[0], A.size() * sizeof(T)));
+    }
+
+    bool SameTri(const TriObject &A, const TriObject &B)
+    {
+        return SameBits(A.verts, B.verts) && SameBits(A.normals, B.normals) && SameBits(A.tangents, B.tangents) &&
+            SameBits(A.texcoords, B.texcoords) && SameBits(A.dcolors, B.dcolors) && SameBits(A.alphas, B.alphas) &&
+            !strcmp(A.Name, B.Name) && A.TexPtr == B.TexPtr && A.dcolor == B.dcolor && A.scolor == B.scolor &&
+            A.shininess == B.shininess && A.creaseAngle == B.creaseAngle && A.SColorValid == B.SColorValid &&
+            A.Box.MinV == B.Box.MinV && A.Box.MaxV == B.Box.MaxV && A.VertexType == B.VertexType;
+    }
+};
+
+bool ModelCacheTest(int argc, char **argv)
+{
+    bool ok = true;
+
+    // Everything in a TriObject and a RenderObject comes back.
+    {
+        Model M;
+        TriObject *T = new TriObject;
+        strcpy(T->Name, "tri");
+        for(int i=0; i<30; i++) {
+            T->verts.push_back(MakeDRand(0.0, 1.0));
+            T->normals.push_back(MakeDRand(0.0, 1.0));
+            T->alphas.push_back(DRand());
+        }
+        T->dcolors.push_back(Vector(1, 0, 0));
+        T->scolor = Vector(0.5, 0.5, 0.5);
+        T->SColorValid = true;
+        T->shininess = 12;
+        T->creaseAngle = 0;
+        T->TexPtr = Model::TexDB.FindByNameOrAdd("ModelCacheTest.png");
+        T->RebuildBBox();
+        M.InsertObject(*T);
+
+        RenderObject *R = new RenderObject;
+        strcpy(R->Name, "render");
+        for(int i=0; i<10; i++) {
+            R->verts.push_back(f3Vector(float(i), 0, 1));
+            R->texcoords.push_back(f3Vector(0, float(i), 0));
+        }
+        for(int i=0; i<24; i++)
+            R->indices.push_back(int(LRand() % 10));
+        R->VertexType = OBJ_TEXCOORDS;
+        M.InsertObject(*R);
+
+        M.SaveCache("ModelCacheTest.dmc");
+        Model L;
+        const bool loaded = !L.LoadCache("ModelCacheTest.dmc");
+        const bool same = loaded && L.Objs.size() == 2 && L.Objs[0]->ObjectType == DMC_TRI_OBJECT &&
+            L.Objs[1]->ObjectType == DMC_RENDER_OBJECT && SameTri(*T, *(TriObject *)L.Objs[0]) &&
+            SameBits(R->verts, ((RenderObject *)L.Objs[1])->verts) && SameBits(R->texcoords, ((RenderObject *)L.Objs[1])->texcoords) &&
+            SameBits(R->indices, ((RenderObject *)L.Objs[1])->indices) && !strcmp(L.Objs[1]->Name, "render") &&
+            L.Objs[1]->VertexType == OBJ_TEXCOORDS && L.Box.MaxV == M.Box.MaxV;
+        const bool attribsOk = L.LoadCache("ModelCacheTest.dmc", NULL, OBJ_NONE) && L.Objs.size() == 2;
+        cerr << "ModelCache round trip: " << (same && attribsOk ? "ok" : "WRONG") << endl;
+        ok = ok && same && attribsOk;
+    }
+
+    // LoadCached writes the cache, then uses it until the source changes.
+    WriteGridOBJ("ModelCacheTest.obj", 500, 500);
+    remove("ModelCacheTest.obj.dmc");
+    Timer T;
+    T.Start();
+    Model A;
+    A.LoadCached("ModelCacheTest.obj", OBJ_NONE);
+    const float tParse = T.Reset();
+    Model B;
+    B.LoadCached("ModelCacheTest.obj", OBJ_NONE);
+    const float tCache = T.Reset();
+    Model B2;
+    const bool fresh = !B2.LoadCache("ModelCacheTest.obj.dmc", "ModelCacheTest.obj", OBJ_NONE);
+    const bool same = fresh && A.Objs.size() == 1 && B.Objs.size() == 1 && SameTri(*(TriObject *)A.Objs[0], *(TriObject *)B.Objs[0]);
+    cerr << "ModelCache " << ((TriObject *)A.Objs[0])->verts.size() / 3 << " triangles: parse and save " << tParse
+         << " sec., load cache " << tCache << " sec. " << (same ? "ok" : "WRONG") << endl;
+    ok = ok && same;
+
+    // Editing the source in place, which is likely within the same second and keeps the size, also makes the cache stale.
+    FILE *f = fopen("ModelCacheTest.obj", "r+b");
+    fputc('#', f);
+    fclose(f);
+    Model E;
+    const bool editOk = E.LoadCache("ModelCacheTest.obj.dmc", "ModelCacheTest.obj", OBJ_NONE);
+    f = fopen("ModelCacheTest.obj", "r+b");
+    fputc('v', f);
+    fclose(f);
+    cerr << "ModelCache same size edit: " << (editOk ? "ok" : "WRONG") << endl;
+    ok = ok && editOk;
+
+    f = fopen("ModelCacheTest.obj", "a");
+    fprintf(f, "f 1/1/1 2/2/2 3/3/3\n");
+    fclose(f);
+    Model C;
+    const bool stale = C.LoadCache("ModelCacheTest.obj.dmc", "ModelCacheTest.obj", OBJ_NONE);
+    C.LoadCached("ModelCacheTest.obj", OBJ_NONE);
+    const bool staleOk = stale && ((TriObject *)C.Objs[0])->verts.size() == ((TriObject *)A.Objs[0])->verts.size() + 3;
+    cerr << "ModelCache stale source: " << (staleOk ? "ok" : "WRONG") << endl;
+    ok = ok && staleOk;
+
+    // A cache that was cut short isn't loaded.
+    {
+        FILE *in = fopen("ModelCacheTest.obj.dmc", "rb");
+        vector<char> Bytes(4096);
+        Bytes.resize(fread(&Bytes[0], 1, Bytes.size(), in));
+        fclose(in);
+        FILE *out = fopen("ModelCacheTest.dmc", "wb");
+        fwrite(&Bytes[0], 1, Bytes.size(), out);
+        fclose(out);
+    }
+    Model D;
+    const bool cutOk = D.LoadCache("ModelCacheTest.dmc", NULL, OBJ_NONE) && D.Objs.empty();
+    cerr << "ModelCache truncated: " << (cutOk ? "ok" : "WRONG") << endl;
+    ok = ok && cutOk;
+
+    // Changing the material file also makes the cache stale.
+    {
+        FILE *mtl = fopen("ModelCacheTest.mtl", "w");
+        fprintf(mtl, "newmtl red\nKd 1 0 0\n");
+        fclose(mtl);
+        FILE *obj = fopen("ModelCacheTest.obj", "w");
+        fprintf(obj, "mtllib ModelCacheTest.mtl\nv 0 0 0\nv 1 0 0\nv 0 1 0\nusemtl red\nf 1 2 3\n");
+        fclose(obj);
+    }
+    remove("ModelCacheTest.obj.dmc");
+    Model MA, MB, MC;
+    MA.LoadCached("ModelCacheTest.obj", OBJ_NONE);
+    const bool mtlCached = !MB.LoadCache("ModelCacheTest.obj.dmc", "ModelCacheTest.obj", OBJ_NONE) &&
+        MB.Dependencies.size() == 1 && MB.Dependencies[0] == "ModelCacheTest.mtl";
+    f = fopen("ModelCacheTest.mtl", "a");
+    fprintf(f, "Ns 10\n");
+    fclose(f);
+    const bool mtlOk = mtlCached && MC.LoadCache("ModelCacheTest.obj.dmc", "ModelCacheTest.obj", OBJ_NONE);
+    cerr << "ModelCache stale material: " << (mtlOk ? "ok" : "WRONG") << endl;
+    ok = ok && mtlOk;
+
+    // The cache can't hold the lights of a VRML file, so it isn't made.
+    {
+        FILE *wrl = fopen("ModelCacheTest.wrl", "w");
+        fprintf(wrl, "#VRML V1.0 ascii\nSeparator {\nPointLight { location 0 0 5 }\n"
+            "Coordinate3 { point [ 0 0 0, 1 0 0, 0 1 0 ] }\nIndexedFaceSet { coordIndex [ 0, 1, 2, -1 ] }\n}\n");
+        fclose(wrl);
+    }
+    remove("ModelCacheTest.wrl.dmc");
+    const size_t NumLights = LitDB.LightList.size();
+    Model V;
+    const bool wrlLoaded = !V.LoadCached("ModelCacheTest.wrl", OBJ_NONE);
+    FILE *wrlCache = fopen("ModelCacheTest.wrl.dmc", "rb");
+    const bool lightOk = wrlLoaded && LitDB.LightList.size() == NumLights + 1 && !wrlCache;
+    if(wrlCache)
+        fclose(wrlCache);
+    cerr << "ModelCache not caching lights: " << (lightOk ? "ok" : "WRONG") << endl;
+    ok = ok && lightOk;
+
+    remove("ModelCacheTest.dmc");
+    remove("ModelCacheTest.obj");
+    remove("ModelCacheTest.obj.dmc");
+    remove("ModelCacheTest.mtl");
+    remove("ModelCacheTest.wrl");
+    remove("ModelCacheTest.wrl.dmc");
+
+    return ok;
+}
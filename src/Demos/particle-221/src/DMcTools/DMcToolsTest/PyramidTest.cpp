@@ -0,0 +1,90 @@
+#include "Image/ImagePyramid.h"
+#include "Image/ImageAlgorithms.h"
+#include "Image/tImage.h"
+#include "Util/Timer.h"
+
+#include <cstdio>
+#include <cmath>
+
+namespace {
+    // The biggest difference between two float images of the same size.
+    float MaxDiff(const f3Image &A, const f3Image &B)
+    {
+        ASSERT_R(A.w() == B.w() && A.h() == B.h());
+        float maxErr = 0;
+        for(int i=0; i<A.size(); i++)
+            for(int c=0; c<3; c++)
+                maxErr = std::max(maxErr, fabsf(A[i][c] - B[i][c]));
+        return maxErr;
+    }
+
+    float sRGBToLinear(const float s) { return s <= 0.04045f ? s / 12.92f : powf((s + 0.055f) / 1.055f, 2.4f); }
+};
+
+bool PyramidTest(int argc, char **argv)
+{
+    bool ok = true;
+
+    // The box filter on an even-sized image is Downsample2x2().
+    f3Image In(256, 128);
+    for(int i=0; i<In.size(); i++)
+        In[i] = f3Pixel(float(drand48()), float(i % 7) / 7.0f, (i % In.w()) < In.w() / 2 ? 1.0f : 0.0f);
+
+    ImagePyramid<f3Image> Box;
+    Box.Build(In, PYR_BOX);
+    f3Image L1, D1;
+    Box.GetLevel(L1, 1);
+    Downsample2x2(D1, In);
+    float err = MaxDiff(L1, D1);
+    printf("Pyramid box vs. Downsample2x2: max error %g\n", err);
+    ok = ok && err < 1e-5f;
+
+    // Non-power-of-two sizes round down to 1x1, all in one allocation.
+    f3Image Odd(37, 11, f3Pixel(0.25f, 0.5f, 0.75f));
+    ImagePyramid<f3Image> Kai;
+    Kai.Build(Odd, PYR_KAISER);
+    const int ExpW[] = {37, 18, 9, 4, 2, 1}, ExpH[] = {11, 5, 2, 1, 1, 1};
+    bool sizesOk = Kai.NumLevels() == 6;
+    size_t total = 0;
+    for(int l=0; sizesOk && l<Kai.NumLevels(); l++) {
+        sizesOk = sizesOk && Kai.w(l) == ExpW[l] && Kai.h(l) == ExpH[l] && Kai.Level(l) == Kai.pp() + total;
+        total += size_t(Kai.w(l)) * Kai.h(l);
+    }
+    sizesOk = sizesOk && Kai.size() == total;
+    printf("Pyramid 37x11 level sizes: %s\n", sizesOk ? "ok" : "WRONG");
+    ok = ok && sizesOk;
+
+    // The filters' weights sum to one, so a constant image stays constant.
+    float constErr = 0;
+    for(int l=0; l<Kai.NumLevels(); l++)
+        for(int i=0; i<Kai.w(l) * Kai.h(l); i++)
+            constErr = std::max(constErr, fabsf(Kai.Level(l)[i].b() - 0.75f));
+    printf("Pyramid Kaiser constant image: max error %g\n", constErr);
+    ok = ok && constErr < 1e-5f;
+
+    // An sRGB checkerboard averages in linear light, not in sRGB.
+    uc3Image Check(64, 64);
+    for(int y=0; y<64; y++)
+        for(int x=0; x<64; x++)
+            Check(x,y) = uc3Pixel((unsigned char)(((x ^ y) & 1) ? 255 : 0));
+    ImagePyramid<uc3Image> Lin;
+    Lin.Build(Check, PYR_BOX, true);
+    const int Expected = int(255.0f * (1.055f * powf(0.5f, 1.0f / 2.4f) - 0.055f) + 0.5f);
+    const int Got = Lin.Level(1)[0].r();
+    printf("Pyramid sRGB 50%% gray: %d, expected %d (%g linear)\n", Got, Expected, sRGBToLinear(Got / 255.0f));
+    ok = ok && Got == Expected;
+
+    // Speed
+    f3Image Big(2048, 2048);
+    for(int i=0; i<Big.size(); i++)
+        Big[i] = f3Pixel(float(drand48()));
+    for(int f=PYR_BOX; f<=PYR_LANCZOS; f++) {
+        Timer T;
+        T.Start();
+        ImagePyramid<f3Image> P;
+        P.Build(Big, PyramidFilter_e(f));
+        printf("Pyramid 2048x2048 f3 filter %d: %d levels in %f sec.\n", f, P.NumLevels(), T.Read());
+    }
+
+    return ok;
+}
@@ -0,0 +1,85 @@
+// Test loading and saving HDR files
+
+#include "Image/tImage.h"
+#include "Util/Timer.h"
+#include "Util/Utils.h"
+
+#include <iostream>
+#include <cstring>
+using namespace std;
+
+namespace {
+    // Flat areas that encode as runs, noise that doesn't, black, and a wide range of exponents
+    f3Image MakeHDR(const int wid, const int hgt)
+    {
+        f3Image Img(wid, hgt);
+        for(int y=0; y<hgt; y++) {
+            for(int x=0; x<wid; x++) {
+                const float Scale = float(pow(2.0, (x * 40.0) / wid - 20.0));
+                if(x % 300 < 100)
+                    Img(x,y) = f3Pixel(Scale * 0.5f, Scale * 0.25f, Scale);
+                else if(x % 300 < 120)
+                    Img(x,y) = f3Pixel(0.0f);
+                else
+                    Img(x,y) = f3Pixel(float(DRand()), float(DRand()), float(DRand())) * Scale;
+            }
+        }
+        return Img;
+    }
+
+    // What the Radiance code's setrgbe() and rgbe_color() make of a pixel, with frexp() and ldexp()
+    f3Pixel RadianceRoundTrip(const f3Pixel &p)
+    {
+        double d = p.r() > p.g() ? p.r() : p.g();
+        if(p.b() > d) d = p.b();
+        if(d <= 1e-32)
+            return f3Pixel(0.0f);
+
+        int e;
+        d = frexp(d, &e) * 255.9999 / d;
+        const unsigned char r = (unsigned char)(p.r() * d), g = (unsigned char)(p.g() * d), b = (unsigned char)(p.b() * d);
+        const float f = (float)ldexp(1.0, e - 8);
+        return f3Pixel((r + 0.5f) * f, (g + 0.5f) * f, (b + 0.5f) * f);
+    }
+};
+
+bool RGBETest(int argc, char **argv)
+{
+    bool ok = true;
+    const char *fname = "RGBETest.hdr";
+
+    // An odd width leaves a remainder for the scalar loops.
+    f3Image Img = MakeHDR(2047, 301);
+    Img.Save(fname);
+    f3Image F(fname);
+
+    bool exact = F.w() == Img.w() && F.h() == Img.h();
+    for(int i=0; exact && i<Img.size(); i++) {
+        const f3Pixel P = RadianceRoundTrip(Img[i]);
+        exact = memcmp(&P, &F[i], sizeof(P)) == 0;
+    }
+    cerr << "RGBE save and load: " << (exact ? "exact" : "WRONG") << endl;
+    ok = ok && exact;
+
+    // Loading straight to half must give the same as converting the float image.
+    h3Image H(fname), HF(F);
+    const bool halfOk = H.w() == HF.w() && H.h() == HF.h() && memcmp(H.pp(), HF.pp(), H.size() * sizeof(h3Pixel)) == 0;
+    cerr << "RGBE load to half: " << (halfOk ? "exact" : "WRONG") << endl;
+    ok = ok && halfOk;
+
+    // Speed on a large light probe
+    f3Image Big = MakeHDR(4096, 2048);
+    Timer T;
+    T.Start();
+    Big.Save(fname);
+    const float tSave = T.Reset();
+    f3Image BigF(fname);
+    const float tLoad = T.Reset();
+    h3Image BigH(fname);
+    const float tLoadH = T.Reset();
+    cerr << "RGBE 4096x2048: save " << tSave << " sec., load " << tLoad << " sec., load to half " << tLoadH << " sec.\n";
+
+    remove(fname);
+
+    return ok;
+}
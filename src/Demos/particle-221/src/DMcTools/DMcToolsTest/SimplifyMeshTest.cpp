@@ -0,0 +1,157 @@
+// Test quadric error mesh simplification
+
+#include "Model/RenderObject.h"
+#include "Model/SimplifyMesh.h"
+#include "TestMeshes.h"
+#include "Util/Timer.h"
+#include "Util/Utils.h"
+
+#include <iostream>
+using namespace std;
+
+namespace {
+    // A bumpy unit square of N by N quads with a texture seam down the middle each way. The vertices on a seam
+    // are split into one for each side, with the same position and different texcoords.
+    RenderObject MakeSeamedGrid(const int N)
+    {
+        RenderObject Ob;
+        vector<int> Id(4 * (N + 1) * (N + 1), -1);
+        for(int qy=0; qy<N; qy++) {
+            for(int qx=0; qx<N; qx++) {
+                int Corner[4];
+                for(int k=0; k<4; k++) {
+                    const int i = qx + (k & 1), j = qy + (k >> 1);
+                    const int sx = i == N / 2 ? qx >= N / 2 : i > N / 2, sy = j == N / 2 ? qy >= N / 2 : j > N / 2;
+                    int &V = Id[((j * (N + 1) + i) * 2 + sx) * 2 + sy];
+                    if(V < 0) {
+                        const double x = i / double(N), y = j / double(N);
+                        V = int(Ob.verts.size());
+                        Ob.verts.push_back(f3Vector(float(x), float(y), float(0.1 * sin(3 * M_PI * x) * sin(2 * M_PI * y))));
+                        Ob.texcoords.push_back(f3Vector(float(x + sx), float(y + sy), 0));
+                    }
+                    Corner[k] = V;
+                }
+                const int T[6] = {0, 1, 3, 0, 3, 2};
+                for(int k=0; k<6; k++)
+                    Ob.indices.push_back(Corner[T[k]]);
+            }
+        }
+        Ob.VertexCount = int(Ob.verts.size());
+        Ob.FaceCount = int(Ob.indices.size()) / 3;
+        Ob.RebuildBBox();
+        return Ob;
+    }
+
+    // Every boundary edge inside the square has to have the other side of its seam running the other way.
+    // The edges of the square can slide a little along it.
+    bool SeamsClosed(const HalfEdgeMesh &M)
+    {
+        vector<int> B;
+        for(int h=0; h<(int)M.Indices.size(); h++)
+            if(M.Twin[h] == HalfEdgeMesh::BOUNDARY)
+                B.push_back(h);
+
+        for(int i=0; i<(int)B.size(); i++) {
+            const Vector &P0 = M.verts[M.From(B[i])], &P1 = M.verts[M.To(B[i])];
+            const double e = 1e-2;
+            if((P0.x < e && P1.x < e) || (P0.x > 1 - e && P1.x > 1 - e) || (P0.y < e && P1.y < e) || (P0.y > 1 - e && P1.y > 1 - e))
+                continue;
+            bool Found = false;
+            for(int j=0; !Found && j<(int)B.size(); j++)
+                Found = M.verts[M.From(B[j])] == P1 && M.verts[M.To(B[j])] == P0;
+            if(!Found)
+                return false;
+        }
+        return true;
+    }
+
+    // The largest distance from a vertex to the torus surface
+    double TorusDist(const HalfEdgeMesh &M)
+    {
+        double D = 0;
+        for(int v=0; v<(int)M.verts.size(); v++) {
+            const Vector &P = M.verts[v];
+            const double r = sqrt(P.x * P.x + P.y * P.y) - 2.0;
+            D = max(D, fabs(sqrt(r * r + P.z * P.z) - 1.0));
+        }
+        return D;
+    }
+};
+
+bool SimplifyMeshTest(int argc, char **argv)
+{
+    bool ok = true;
+
+    // A torus stays a torus down to a few hundred faces.
+    {
+        HalfEdgeMesh M(MakeTorus(120, 60));
+        M.GenNormals();
+        const double Err = SimplifyMesh(M, SimplifyTarget(1000));
+        bool unitNormals = M.normals.size() == M.verts.size();
+        for(int v=0; unitNormals && v<(int)M.normals.size(); v++)
+            unitNormals = fabs(M.normals[v].length() - 1.0) < 1e-6;
+        const double Dist = TorusDist(M);
+        const bool torOk = M.CheckIntegrity(true) == 0 && M.FaceCount <= 1000 && M.FaceCount > 900 &&
+            M.VertexCount * 2 == M.FaceCount && unitNormals && Dist < 0.1 && Err > 0;
+        cerr << "SimplifyMesh torus to " << M.FaceCount << " faces, distance " << Dist << ", error " << Err << ": "
+             << (torOk ? "ok" : "WRONG") << endl;
+        ok = ok && torOk;
+    }
+
+    // A flat square goes down to almost nothing for free, and its edges stay put.
+    {
+        HalfEdgeMesh M(MakeGrid(40, 40));
+        const BBox<Vector> Box = M.Box;
+        SimplifyMesh(M, SimplifyTarget(0, 1e-12));
+        bool flat = true;
+        for(int v=0; flat && v<(int)M.verts.size(); v++)
+            flat = M.verts[v].z == 0;
+        const bool gridOk = M.CheckIntegrity(true) == 0 && M.FaceCount < 200 && flat && M.Box.MinV == Box.MinV &&
+            M.Box.MaxV == Box.MaxV;
+        cerr << "SimplifyMesh flat square to " << M.FaceCount << " faces: " << (gridOk ? "ok" : "WRONG") << endl;
+        ok = ok && gridOk;
+    }
+
+    // The seams of a textured square don't crack open.
+    {
+        HalfEdgeMesh M(MakeSeamedGrid(60));
+        const bool closedBefore = SeamsClosed(M);
+        SimplifyMesh(M, SimplifyTarget(600));
+        const bool seamOk = closedBefore && M.CheckIntegrity(true) == 0 && M.FaceCount <= 600 &&
+            M.texcoords.size() == M.verts.size() && SeamsClosed(M);
+        cerr << "SimplifyMesh seamed square to " << M.FaceCount << " faces: " << (seamOk ? "ok" : "WRONG") << endl;
+        ok = ok && seamOk;
+    }
+
+    // A chain of levels of detail in one pass
+    {
+        HalfEdgeMesh M(MakeTorus(400, 250));
+        vector<SimplifyTarget> Targets;
+        Targets.push_back(SimplifyTarget(50000));
+        Targets.push_back(SimplifyTarget(10000));
+        Targets.push_back(SimplifyTarget(2000));
+        Targets.push_back(SimplifyTarget(0, 0.05));
+        vector<HalfEdgeMesh> LODs;
+        vector<double> Errors;
+
+        Timer T;
+        T.Start();
+        SimplifyMesh(LODs, Errors, M, Targets);
+        const float tLOD = T.Reset();
+
+        bool lodOk = LODs.size() == Targets.size();
+        for(int i=0; lodOk && i<(int)LODs.size(); i++) {
+            lodOk = LODs[i].CheckIntegrity(true) == 0 && (Targets[i].MaxFaces == 0 || LODs[i].FaceCount <= Targets[i].MaxFaces) &&
+                Errors[i] <= Targets[i].MaxError;
+            if(i > 0)
+                lodOk = lodOk && LODs[i].FaceCount <= LODs[i-1].FaceCount && Errors[i] >= Errors[i-1];
+        }
+        cerr << "SimplifyMesh " << M.FaceCount << " faces to";
+        for(int i=0; i<(int)LODs.size(); i++)
+            cerr << " " << LODs[i].FaceCount << " (" << Errors[i] << ")";
+        cerr << " in " << tLOD << " sec.: " << (lodOk ? "ok" : "WRONG") << endl;
+        ok = ok && lodOk;
+    }
+
+    return ok;
+}
@@ -0,0 +1,112 @@
+// Meshes and model files that several of the tests are made of
+
+#ifndef dmc_test_meshes_h
+#define dmc_test_meshes_h
+
+#include "Model/TriObject.h"
+#include "Util/Assert.h"
+#include "Util/Utils.h"
+
+#include <cmath>
+#include <cstdio>
+
+// Tori of separate triangles, like an OBJ loader makes, each with tube
+// radius 1 around a circle of radius 2 and spaced along the x axis. A
+// FlipFrac of the triangles are wound backward. A half twist makes each
+// one a flat Moebius strip instead, which can't be given one winding.
+inline TriObject MakeTori(const int NumTori, const int NU, const int NV, const double FlipFrac = 0, const bool Twist = false)
+{
+    TriObject Ob;
+    for(int t=0; t<NumTori; t++) {
+        for(int u=0; u<NU; u++) {
+            for(int v=0; v<NV; v++) {
+                Vector P[4];
+                for(int k=0; k<4; k++) {
+                    int uu = u + (k & 1), vv = v + (k >> 1);
+                    if(Twist && uu == NU) {
+                        uu = 0;
+                        vv = NV - vv;
+                    }
+                    if(Twist)
+                        P[k] = Vector(uu * 2.0 * M_PI / NU, vv, 0);
+                    else {
+                        const double a = (uu % NU) * 2.0 * M_PI / NU, b = (vv % NV) * 2.0 * M_PI / NV;
+                        P[k] = Vector((2.0 + cos(b)) * cos(a), (2.0 + cos(b)) * sin(a), sin(b));
+                    }
+                    P[k].x += t * 10.0;
+                }
+
+                const int T[2][3] = {{0, 1, 3}, {0, 3, 2}};
+                for(int i=0; i<2; i++) {
+                    const bool Flip = FlipFrac > 0 && DRand() < FlipFrac;
+                    Ob.verts.push_back(P[T[i][0]]);
+                    Ob.verts.push_back(P[T[i][Flip ? 2 : 1]]);
+                    Ob.verts.push_back(P[T[i][Flip ? 1 : 2]]);
+                }
+            }
+        }
+    }
+    Ob.VertexCount = int(Ob.verts.size());
+    Ob.FaceCount = Ob.VertexCount / 3;
+    Ob.RebuildBBox();
+    return Ob;
+}
+
+// One closed torus
+inline TriObject MakeTorus(const int NU, const int NV, const double FlipFrac = 0)
+{
+    return MakeTori(1, NU, NV, FlipFrac);
+}
+
+// The unit square in z=0 as NX by NY quads of separate triangles, with up
+// to Noise added to each corner of each triangle, which cracks them apart.
+inline TriObject MakeGrid(const int NX, const int NY, const double Noise = 0)
+{
+    TriObject Ob;
+    for(int y=0; y<NY; y++) {
+        for(int x=0; x<NX; x++) {
+            const int C[6][2] = {{0,0}, {1,0}, {1,1}, {0,0}, {1,1}, {0,1}};
+            for(int c=0; c<6; c++) {
+                Vector P((x + C[c][0]) / double(NX), (y + C[c][1]) / double(NY), 0);
+                if(Noise > 0)
+                    P += Vector(DRand(), DRand(), DRand()) * Noise;
+                Ob.verts.push_back(P);
+            }
+        }
+    }
+    Ob.VertexCount = int(Ob.verts.size());
+    Ob.FaceCount = Ob.VertexCount / 3;
+    Ob.RebuildBBox();
+    return Ob;
+}
+
+// An OBJ file of a grid of quads that share vertices, with texcoords and
+// normals, and with the numbers written a few different ways.
+inline void WriteGridOBJ(const char *fname, const int NX, const int NY)
+{
+    FILE *f = fopen(fname, "w");
+    ASSERT_RM(f, "Error opening output file");
+    const char *Fmts[] = {"%f", "%.17g", "%g", "%e", "%.3f"};
+    for(int y=0; y<=NY; y++) {
+        for(int x=0; x<=NX; x++) {
+            const char *Fmt = Fmts[(x + y) % 5];
+            const double z = (DRand() - 0.5) * pow(10.0, int(LRand() % 12) - 6);
+            fprintf(f, "v %d %d ", x, y);
+            fprintf(f, Fmt, z);
+            fprintf(f, "\nvt ");
+            fprintf(f, Fmt, x / double(NX));
+            fprintf(f, " ");
+            fprintf(f, Fmt, y / double(NY));
+            fprintf(f, "\nvn 0 %s0 1\n", (x & 1) ? "-" : "");
+        }
+    }
+    for(int y=0; y<NY; y++) {
+        for(int x=0; x<NX; x++) {
+            const int a = y * (NX + 1) + x + 1, b = a + 1, c = b + NX + 1, d = a + NX + 1;
+            fprintf(f, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c, d, d, d);
+        }
+    }
+    fclose(f);
+}
+
+#endif
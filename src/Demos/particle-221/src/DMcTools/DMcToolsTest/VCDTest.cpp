@@ -2,32 +2,78 @@
 
 #include "Image/ImageAlgorithms.h"
 #include "Image/tImage.h"
+#include "Util/Timer.h"
+#include "Util/Utils.h"
 
 using namespace std;
 
-void VCDLoop()
-{
-    f3Image InImg("D:/Pictures/Stuff/By Us/MyArt/WoodFloor1.tif");
-    InImg.Save("vcdout00.jpg");
+namespace {
+    // Flat colored blocks with noise on them, which VCD should smooth without blurring the edges.
+    f3Image MakeBlocks(const int wid, const int hgt, const double Noise)
+    {
+        f3Image Img(wid, hgt);
+        for(int y=0; y<hgt; y++) {
+            for(int x=0; x<wid; x++) {
+                const int b = (x / 24) * 7 + (y / 24) * 3;
+                const f3Pixel Base(float(b % 5) / 4.0f, float(b % 3) / 2.0f, float(b % 7) / 6.0f);
+                Img(x,y) = Base + f3Pixel(float(NRand(Noise)), float(NRand(Noise)), float(NRand(Noise)));
+            }
+        }
+        return Img;
+    }
 
-    for(int i=1; i<15; i++) {
-        cerr << "Starting VCD pass " << i << endl;
+    float RMSDiff(const f3Image &A, const f3Image &B)
+    {
+        double sum = 0;
+        for(int i=0; i<A.size(); i++)
+            sum += DiffSqr(A[i], B[i]);
+        return float(sqrt(sum / (3.0 * A.size())));
+    }
+};
+
+bool VCDTest(int argc, char **argv)
+{
+    bool ok = true;
+    const float ImageStDev = 2.0f, ColorStDev = 0.2f;
+    const int FiltWid = 2 * 3 * 2 + 1; // Three standard deviations each way
 
-        f3Image VCDImg;
-        VCD(VCDImg, InImg, 5, 3, 0.25, 1);
+    f3Image In = MakeBlocks(256, 256, 0.05);
 
-        char Name[100];
-        sprintf(Name, "vcdout%02d.jpg", i);
-        VCDImg.Save(Name);
+    Timer T;
+    T.Start();
+    f3Image Exact;
+    VCD(Exact, In, FiltWid, ImageStDev, ColorStDev, 1);
+    const float tExact = T.Reset();
 
-        InImg = VCDImg;
+    // The lattice should be much closer to the exact result than the exact result is to the input.
+    const float Change = RMSDiff(Exact, In);
+    const float Qualities[] = {0.5f, 0.75f, 1.0f};
+    for(int q=0; q<3; q++) {
+        T.Reset();
+        f3Image Fast;
+        VCDLattice(Fast, In, ImageStDev, ColorStDev, 1, Qualities[q]);
+        const float tFast = T.Read();
+        const float Err = RMSDiff(Fast, Exact);
+        cerr << "VCD 256x256 quality " << Qualities[q] << ": RMS error " << Err << " vs. change of " << Change
+             << "; " << tFast << " sec. vs. " << tExact << " exact\n";
+        ok = ok && Err < 0.2f * Change;
     }
-}
 
-bool VCDTest(int argc, char **argv)
-{
-    cerr << "VCDTest\n";
-    VCDLoop();
+    // The lattice's cost doesn't grow with the kernel.
+    T.Reset();
+    VCD(Exact, In, 6 * 6 + 1, 6.0f, ColorStDev, 1);
+    const float tExactWide = T.Reset();
+    f3Image FastWide;
+    VCDLattice(FastWide, In, 6.0f, ColorStDev, 1);
+    cerr << "VCD 256x256 stdev 6: RMS error " << RMSDiff(FastWide, Exact) << "; " << T.Read() << " sec. vs. " << tExactWide << " exact\n";
+
+    // It must not blur across the edges of the blocks.
+    f3Image Fast, Blur;
+    VCDLattice(Fast, In, ImageStDev, ColorStDev, 2);
+    GaussianBlur(Blur, In, FiltWid, ImageStDev);
+    const f3Image Clean = MakeBlocks(256, 256, 0);
+    cerr << "VCD edges: RMS error of lattice " << RMSDiff(Fast, Clean) << ", gaussian blur " << RMSDiff(Blur, Clean) << endl;
+    ok = ok && RMSDiff(Fast, Clean) < RMSDiff(Blur, Clean);
 
-    return true;
+    return ok;
 }
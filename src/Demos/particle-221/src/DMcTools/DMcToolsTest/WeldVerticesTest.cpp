@@ -0,0 +1,93 @@
+// Test welding vertices and making meshes from separate triangles
+
+#include "Model/WeldVertices.h"
+#include "Model/HalfEdgeMesh.h"
+#include "Model/Mesh.h"
+#include "TestMeshes.h"
+#include "Util/Timer.h"
+#include "Util/Utils.h"
+
+#include <iostream>
+using namespace std;
+
+namespace {
+    // Add the points one at a time, each becoming the first earlier vertex within Eps.
+    void SlowWeld(vector<int> &Remap, vector<int> &FirstIndex, const vector<Vector> &Pts, const double Eps)
+    {
+        Remap.resize(Pts.size());
+        FirstIndex.clear();
+        for(int i=0; i<(int)Pts.size(); i++) {
+            int v;
+            for(v=0; v<(int)FirstIndex.size(); v++)
+                if(VecEq(Pts[FirstIndex[v]], Pts[i], Eps * Eps))
+                    break;
+            if(v == (int)FirstIndex.size())
+                FirstIndex.push_back(i);
+            Remap[i] = v;
+        }
+    }
+
+    // Points on a grid, each used several times, with a little noise on some of them.
+    vector<Vector> MakePoints(const int n, const double Noise)
+    {
+        vector<Vector> Pts;
+        for(int i=0; i<n; i++) {
+            const int g = int(LRand() % (n / 4));
+            Vector P(g % 17, (g / 17) % 13, g / (17 * 13));
+            if(DRand() < 0.3)
+                P += Vector(DRand(), DRand(), DRand()) * Noise;
+            if(DRand() < 0.1)
+                P = -P; // Makes -0.
+            Pts.push_back(P);
+        }
+        return Pts;
+    }
+};
+
+bool WeldVerticesTest(int argc, char **argv)
+{
+    bool ok = true;
+
+    // Against adding the points one at a time, exactly and with a tolerance
+    const double Epss[] = {0, 1e-3, 0.3, 1.5};
+    for(int e=0; e<4; e++) {
+        vector<Vector> Pts = MakePoints(6000, 1e-3);
+        vector<int> R0, F0, R1, F1, R2, F2;
+        SlowWeld(R0, F0, Pts, Epss[e]);
+        WeldVertices(R1, F1, Pts, Epss[e]);
+        WeldVertices(R2, F2, Pts, Epss[e], false);
+        const bool same = R0 == R1 && F0 == F1 && R0 == R2 && F0 == F2;
+        cerr << "WeldVertices Eps=" << Epss[e] << ": " << F1.size() << " vertices " << (same ? "ok" : "WRONG") << endl;
+        ok = ok && same;
+    }
+
+    // Mesh and HalfEdgeMesh make the same mesh from slightly cracked triangles.
+    const int NX = 30, NY = 20;
+    TriObject Grid = MakeGrid(NX, NY, 1e-7);
+    Mesh M;
+    M.MeshMaxDist = 1e-5;
+    M.ImportTriObject(Grid);
+    HalfEdgeMesh H(Grid, 1e-5 / (Grid.Box.MaxV - Grid.Box.MinV).length());
+    const int nV = (NX + 1) * (NY + 1), nF = 2 * NX * NY, nE = nV + nF - 1;
+    const bool meshOk = M.VertexCount == nV && M.FaceCount == nF && M.EdgeCount == nE &&
+        H.VertexCount == nV && H.FaceCount == nF && H.EdgeCount == nE && H.CheckIntegrity() == 0;
+    cerr << "WeldVertices Mesh and HalfEdgeMesh import: " << (meshOk ? "ok" : "WRONG") << endl;
+    ok = ok && meshOk;
+
+    // Speed on a million triangles
+    TriObject Big = MakeGrid(1000, 500, 0);
+    Timer T;
+    T.Start();
+    vector<int> R, F;
+    WeldVertices(R, F, Big.verts);
+    const float tExact = T.Reset();
+    WeldVertices(R, F, Big.verts, 1e-6);
+    const float tNear = T.Reset();
+    Mesh BM;
+    BM.ImportTriObject(Big);
+    const float tMesh = T.Reset();
+    cerr << "WeldVertices " << Big.verts.size() << " points: exact " << tExact << " sec., within Eps " << tNear
+         << ", Mesh import " << tMesh << endl;
+
+    return ok;
+}
@@ -7,8 +7,13 @@
 // during compile.
 
 #include "Image/ImageLoadSave.h"
+#include "Image/ImageStream.h"
+#include "Util/MappedFile.h"
 
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
 using namespace std;
 
 typedef unsigned char byte;
@@ -30,22 +35,19 @@ static DMC_INLINE void bmpError(const char *fname, const char *st)
 }
 
 /*******************************************/
-static DMC_INLINE unsigned int getshort(FILE *fp)
+// Little-endian reads from the mapped file.
+static DMC_INLINE unsigned int getshort(const byte *p)
 {
-    int c, c1;
-    c = getc(fp); c1 = getc(fp);
-    return ((unsigned int) c) + (((unsigned int) c1) << 8);
+    return ((unsigned int) p[0]) + (((unsigned int) p[1]) << 8);
 }
 
 /*******************************************/
-static DMC_INLINE unsigned int getint(FILE *fp)
+static DMC_INLINE unsigned int getint(const byte *p)
 {
-    int c, c1, c2, c3;
-    c = getc(fp); c1 = getc(fp); c2 = getc(fp); c3 = getc(fp);
-    return ((unsigned int) c) +
-        (((unsigned int) c1) << 8) +
-        (((unsigned int) c2) << 16) +
-        (((unsigned int) c3) << 24);
+    return ((unsigned int) p[0]) +
+        (((unsigned int) p[1]) << 8) +
+        (((unsigned int) p[2]) << 16) +
+        (((unsigned int) p[3]) << 24);
 }
 
 /*******************************************/
@@ -70,300 +72,190 @@ static DMC_INLINE void putint(FILE *fp, int i)
 }
 
 /*******************************************/
-static int loadBMP1(FILE *fp, byte *Pix, unsigned int w, unsigned int h)
-{
-    int i,j,c,bitnum,padw;
-    byte *pp;
-
-    c = 0;
-    padw = ((w + 31)/32) * 32; /* 'w', padded to be a multiple of 32 */
-
-    for(i=h-1; i>=0; i--)
-    {
-        pp = Pix + (i * w);
+// The uncompressed loaders read straight out of the mapped file, src, one padded row
+// at a time. The rows are stored bottom-up. The caller checked that all the rows are there.
 
-        for(j=bitnum=0; j<padw; j++,bitnum++)
-        {
-            if((bitnum&7) == 0)
-            { /* read the next byte */
-                c = getc(fp);
-                bitnum = 0;
-            }
+static void loadBMP1(const byte *src, byte *Pix, unsigned int w, unsigned int h)
+{
+    int rowbytes = ((w + 31)/32) * 4; /* 'w', padded to be a multiple of 32 bits */
 
-            if(j<(int)w) {
-                *pp++ = (c & 0x80) ? 1 : 0;
-                c <<= 1;
-            }
-        }
-        if(FERROR(fp)) break;
+    for(int i=h-1; i>=0; i--, src += rowbytes) {
+        byte *pp = Pix + (i * w);
+        for(int j=0; j<(int)w; j++)
+            pp[j] = (src[j>>3] >> (7 - (j&7))) & 1;
     }
-
-    return (FERROR(fp));
 }
 
-static int loadBMP4(FILE *fp, byte *Pix, unsigned int w, unsigned int h, unsigned int comp)
+/*******************************************/
+static void loadBMP4(const byte *src, byte *Pix, unsigned int w, unsigned int h)
 {
-    int i,j,c,c1,x,y,nybnum,padw,rv;
-    byte *pp;
-
-    rv = 0;
-    c = c1 = 0;
-
-    if(comp == BI_RGB) { /* read uncompressed data */
-        padw = ((w + 7)/8) * 8; /* 'w' padded to a multiple of 8pix (32 bits) */
-
-        for(i=h-1; i>=0; i--) {
-            pp = Pix + (i * w);
-
-            for(j=nybnum=0; j<padw; j++,nybnum++) {
-                if((nybnum & 1) == 0) { /* read next byte */
-                    c = getc(fp);
-                    nybnum = 0;
-                }
-
-                if(j<(int)w) {
-                    *pp++ = (c & 0xf0) >> 4;
-                    c <<= 4;
-                }
-            }
-            if(FERROR(fp)) break;
-        }
-    }
-
-    else if(comp == BI_RLE4) { /* read RLE4 compressed data */
-        x = y = 0;
-        pp = Pix + x + (h-y-1)*w;
-
-        while (y<(int)h) {
-            c = getc(fp); if(c == EOF) { rv = 1; break; }
-
-            if(c) { /* encoded mode */
-                c1 = getc(fp);
-                for(i=0; i<c; i++,x++,pp++)
-                    *pp = (i&1) ? (c1 & 0x0f) : ((c1>>4)&0x0f);
-            }
-
-            else { /* c==0x00 : escape codes */
-                c = getc(fp); if(c == EOF) { rv = 1; break; }
-
-                if(c == 0x00) { /* end of line */
-                    x=0; y++; pp = Pix + x + (h-y-1)*w;
-                }
-
-                else if(c == 0x01) break; /* end of Pix */
+    int rowbytes = ((w + 7)/8) * 4; /* 'w' padded to a multiple of 8pix (32 bits) */
 
-                else if(c == 0x02) { /* delta */
-                    c = getc(fp); x += c;
-                    c = getc(fp); y += c;
-                    pp = Pix + x + (h-y-1)*w;
-                }
-
-                else { /* absolute mode */
-                    for(i=0; i<c; i++, x++, pp++) {
-                        if((i&1) == 0) c1 = getc(fp);
-                        *pp = (i&1) ? (c1 & 0x0f) : ((c1>>4)&0x0f);
-                    }
-
-                    if(((c&3)==1) || ((c&3)==2)) getc(fp); /* read pad byte */
-                }
-            } /* escape processing */
-            if(FERROR(fp)) break;
-        } /* while */
-    }
-
-    else {
-        fprintf(stderr,"unknown BMP compression type 0x%0x\n", comp);
+    for(int i=h-1; i>=0; i--, src += rowbytes) {
+        byte *pp = Pix + (i * w);
+        for(int j=0; j<(int)w; j++)
+            pp[j] = (j&1) ? (src[j>>1] & 0x0f) : (src[j>>1] >> 4);
     }
-
-    if(FERROR(fp)) rv = 1;
-    return rv;
 }
 
 /*******************************************/
-static int loadBMP8(FILE *fp, byte *Pix, unsigned int w, unsigned int h, unsigned int comp)
+static void loadBMP8(const byte *src, byte *Pix, unsigned int w, unsigned int h)
 {
-    int i,c,c1,padw,x,y,rv;
-    byte *pp;
-
-    rv = 0;
-
-    if(comp == BI_RGB)
-    { /* read uncompressed data */
-        padw = ((w + 3)/4) * 4; /* 'w' padded to a multiple of 4pix (32 bits) */
+    int rowbytes = ((w + 3)/4) * 4; /* 'w' padded to a multiple of 4pix (32 bits) */
 
-        for(i=h-1; i>=0; i--)
-          {
-            pp = Pix + (i * w);
-
-            fread(pp, 1, w, fp);
-            for(int j=w; j<padw; j++)
-              getc(fp);
-
-            if(FERROR(fp)) {rv = 1; break;}
-          }
-    }
-    else if(comp == BI_RLE8) { /* read RLE8 compressed data */
-        x = y = 0;
-        pp = Pix + x + (h-y-1)*w;
-
-        while (y<(int)h) {
-            c = getc(fp); if(c == EOF) { rv = 1; break; }
-
-            if(c) { /* encoded mode */
-                c1 = getc(fp);
-                for(i=0; i<c; i++,x++,pp++) *pp = c1;
-            }
-
-            else { /* c==0x00 : escape codes */
-                c = getc(fp); if(c == EOF) { rv = 1; break; }
-
-                if(c == 0x00) { /* end of line */
-                    x=0; y++; pp = Pix + x + (h-y-1)*w;
-                }
-
-                else if(c == 0x01) break; /* end of Pix */
-
-                else if(c == 0x02) { /* delta */
-                    c = getc(fp); x += c;
-                    c = getc(fp); y += c;
-                    pp = Pix + x + (h-y-1)*w;
-                }
-
-                else { /* absolute mode */
-                    for(i=0; i<c; i++, x++, pp++) {
-                        c1 = getc(fp);
-                        *pp = c1;
-                    }
+    for(int i=h-1; i>=0; i--, src += rowbytes)
+        memcpy(Pix + (i * w), src, w);
+}
 
-                    if(c & 1) getc(fp); /* odd length run: read an extra pad byte */
-                }
-            } /* escape processing */
-            if(FERROR(fp)) break;
-        } /* while */
-    }
+/*******************************************/
+static void loadBMP24(const byte *src, byte *Pix, unsigned int w, unsigned int h)
+{
+    int rowbytes = ((w * 3 + 3)/4) * 4;
 
-    else {
-        fprintf(stderr,"unknown BMP compression type 0x%0x\n", comp);
+    for(int i=h-1; i>=0; i--, src += rowbytes) {
+        byte *pp = Pix + (i * w * 3);
+        const byte *sp = src;
+        for(int j=0; j<(int)w; j++, pp+=3, sp+=3) {
+            pp[0] = sp[2]; /* red */
+            pp[1] = sp[1]; /* green */
+            pp[2] = sp[0]; /* blue */
+        }
     }
-
-    if(FERROR(fp)) rv = 1;
-    return rv;
 }
 
 /*******************************************/
-static int loadBMP24(FILE *fp, byte *Pix, unsigned int w, unsigned int h)
+static void loadBMP32(const byte *src, byte *Pix, unsigned int w, unsigned int h)
 {
-    int rv = 0;
-
-    int padb = (4 - ((w*3) % 4)) & 0x03; /* # of pad bytes to read at EOscanline */
-    int linebytecnt = padb + 3 * w;
-    unsigned char * lbuf = new unsigned char[linebytecnt];
-    ASSERT_RM(lbuf, "memory alloc failed");
-
-    for(int i=h-1; i>=0; i--) {
-    byte *pp = Pix + (i * w * 3);
-
-        fread(lbuf, 1, linebytecnt, fp);
-        int w3=w*3;
-        for(int j=0; j<w3; ) {
-            pp[2] = lbuf[j++]; /* blue */
-            pp[1] = lbuf[j++]; /* green */
-            pp[0] = lbuf[j++]; /* red */
-            pp += 3;
+    int rowbytes = w * 4;
+
+    for(int i=h-1; i>=0; i--, src += rowbytes) {
+        byte *pp = Pix + (i * w * 4);
+        const byte *sp = src;
+        for(int j=0; j<(int)w; j++, pp+=4, sp+=4) {
+            pp[0] = sp[2]; /* red */
+            pp[1] = sp[1]; /* green */
+            pp[2] = sp[0]; /* blue */
+            pp[3] = sp[3]; /* alpha */
         }
-
-        rv = (FERROR(fp));
-        if(rv) break;
     }
-
-    delete [] lbuf;
-
-    return rv;
 }
 
 /*******************************************/
-static int loadBMP32(FILE *fp, byte *Pix, unsigned int w, unsigned int h)
+// Decode RLE8 or RLE4 data from src to end into one palette index per pixel.
+// Runs are memset and absolute stretches are copied a row segment at a time.
+// Runs are clipped to the image, so a bad file can't write outside Pix.
+// Returns true if the data ran out before the end-of-bitmap code.
+static bool loadBMPRLE(const byte *src, const byte *end, byte *Pix, int w, int h, bool rle4)
 {
-    int i,j,padb,rv;
-    byte *pp;
+    int x = 0, y = 0;
+
+    memset(Pix, 0, w * h); // Delta codes skip pixels.
+
+    while(y < h) {
+        if(end - src < 2) return true;
+        int c = *src++, c1 = *src++;
+        byte *pp = Pix + (h-y-1)*w;
+
+        if(c) { /* encoded mode: c pixels of c1 */
+            int n = min(c, w - x);
+            if(n > 0) {
+                if(rle4) {
+                    for(int i=0; i<n; i++)
+                        pp[x+i] = (i&1) ? (c1 & 0x0f) : (c1 >> 4);
+                } else
+                    memset(pp + x, c1, n);
+            }
+            x += c;
+        }
 
-    rv = 0;
+        else if(c1 == 0x00) { /* end of line */
+            x = 0; y++;
+        }
 
-    padb = 0; /* # of pad bytes to read at EOscanline */
+        else if(c1 == 0x01) break; /* end of Pix */
 
-    for(i=h-1; i>=0; i--) {
-        pp = Pix + (i * w * 3);
-
-        for(j=0; j<(int)w; j++) {
-            pp[3] = getc(fp); /* alpha */
-            pp[2] = getc(fp); /* blue */
-            pp[1] = getc(fp); /* green */
-            pp[0] = getc(fp); /* red */
-            pp += 4;
+        else if(c1 == 0x02) { /* delta */
+            if(end - src < 2) return true;
+            x += *src++;
+            y += *src++;
         }
 
-        for(j=0; j<padb; j++) getc(fp);
-
-        rv = (FERROR(fp));
-        if(rv) break;
+        else { /* absolute mode: c1 literal pixels, padded to 16 bits */
+            int nbytes = rle4 ? (c1 + 1) / 2 : c1;
+            if(end - src < nbytes) return true;
+            int n = min(c1, w - x);
+            if(n > 0) {
+                if(rle4) {
+                    for(int i=0; i<n; i++)
+                        pp[x+i] = (i&1) ? (src[i>>1] & 0x0f) : (src[i>>1] >> 4);
+                } else
+                    memcpy(pp + x, src, n);
+            }
+            x += c1;
+            src += (nbytes + 1) & ~1;
+        }
     }
 
-    return rv;
+    return false;
 }
 
 /*******************************************/
-// Returns false on success.
-void ImageLoadSave::LoadBMP(const char *fname)
+// What LoadBMP() and the BMP reader need to know about the file.
+struct BMPInfo
 {
-    int i, c, c1, rv=0;
+    unsigned int biWidth, biHeight, biBitCount, biCompression;
+    int cmaplen, chan;
+    byte red[256], grn[256], blu[256];
+    bool Gray;
+    size_t Bits; // The offset of the bitmap data
+};
+
+/*******************************************/
+// Parse and check the headers and colormap of a BMP file. Data to End is the start of the file,
+// enough of it to hold the headers and colormap, and FileSize is the size of the whole file.
+static void parseBMP(const byte *Data, const byte *End, const DMCINT64 FileSize, const char *fname, BMPInfo &B)
+{
+    int i;
     unsigned int bfSize, bfOffBits, biSize, biWidth, biHeight, biPlanes;
     unsigned int biBitCount, biCompression, biSizeImage, biXPelsPerMeter;
     unsigned int biYPelsPerMeter, biClrUsed, biClrImportant;
-    int bPad;
     int cmaplen = 0;
-    byte red[256], grn[256], blu[256];
+    byte *red = B.red, *grn = B.grn, *blu = B.blu;
     bool Gray = true;
 
-    Pix = NULL;
-
-    FILE *fp = fopen(fname,"rb");
-    if(!fp) bmpError(fname, "couldn't open file");
-
-    fseek(fp, 0L, 2); /* figure out the file size */
+    const byte *fp = Data, *fend = End;
 
-    // long filesize =
-    ftell(fp);
-    fseek(fp, 0L, 0);
+    if(fend - fp < 26) bmpError(fname, "EOF reached in file header");
 
-    /* read the file type (first two bytes) */
-    c = getc(fp); c1 = getc(fp);
-    if(c!='B' || c1!='M') bmpError(fname, "file type != 'BM'");
+    /* check the file type (first two bytes) */
+    if(fp[0]!='B' || fp[1]!='M') bmpError(fname, "file type != 'BM'");
 
-    bfSize = getint(fp);
-    getshort(fp); /* reserved and ignored */
-    getshort(fp);
-    bfOffBits = getint(fp);
+    bfSize = getint(fp+2);
+    /* reserved and ignored */
+    bfOffBits = getint(fp+10);
 
-    biSize = getint(fp);
+    biSize = getint(fp+14);
+    const byte *hp = fp + 18;
 
     if(biSize == WIN_NEW || biSize == OS2_NEW) {
-        biWidth = getint(fp);
-        biHeight = getint(fp);
-        biPlanes = getshort(fp);
-        biBitCount = getshort(fp);
-        biCompression = getint(fp);
-        biSizeImage = getint(fp);
-        biXPelsPerMeter = getint(fp);
-        biYPelsPerMeter = getint(fp);
-        biClrUsed = getint(fp);
-        biClrImportant = getint(fp);
+        if(fend - fp < 54) bmpError(fname, "EOF reached in file header");
+        biWidth = getint(hp);
+        biHeight = getint(hp+4);
+        biPlanes = getshort(hp+8);
+        biBitCount = getshort(hp+10);
+        biCompression = getint(hp+12);
+        biSizeImage = getint(hp+16);
+        biXPelsPerMeter = getint(hp+20);
+        biYPelsPerMeter = getint(hp+24);
+        biClrUsed = getint(hp+28);
+        biClrImportant = getint(hp+32);
     }
 
     else { /* old bitmap format */
-        biWidth = getshort(fp); /* Types have changed ! */
-        biHeight = getshort(fp);
-        biPlanes = getshort(fp);
-        biBitCount = getshort(fp);
+        biWidth = getshort(hp); /* Types have changed ! */
+        biHeight = getshort(hp+2);
+        biPlanes = getshort(hp+4);
+        biBitCount = getshort(hp+6);
 
         /* Not in old versions so have to compute them*/
         biSizeImage = (((biPlanes * biBitCount*biWidth)+31)/32)*4*biHeight;
@@ -385,8 +277,6 @@ void ImageLoadSave::LoadBMP(const char *fname)
     }
 #endif
 
-    if(FERROR(fp)) bmpError(fname,"EOF reached in file header");
-
     /* error checking */
     if((biBitCount!=1 && biBitCount!=4 && biBitCount!=8 && biBitCount!=24 && biBitCount!=32) ||
         biPlanes!=1 || biCompression>BI_RLE4) {
@@ -401,32 +291,28 @@ void ImageLoadSave::LoadBMP(const char *fname)
             throw DMcError(er.str());
     }
 
-    bPad = 0;
-    if(biSize != WIN_OS2_OLD) {
-        /* skip ahead to colormap, using biSize */
-        c = biSize - 40; /* 40 bytes read from biSize to biClrImportant */
-        for(i=0; i<c; i++) getc(fp);
-
-        bPad = bfOffBits - (biSize + 14);
+    if(biWidth == 0 || biHeight == 0 || biWidth > 0x7fff || biHeight > 0x7fff) {
+        stringstream er; er << "Bogus BMP File '" << fname << "': " << (int)biWidth << "x" << (int)biHeight;
+        throw DMcError(er.str());
     }
 
-    /* load up colormap, if any */
-    cmaplen = (biClrUsed) ? biClrUsed : 1 << biBitCount;
+    /* the colormap, if any, follows the info header */
+    const byte *cp = fp + 14 + biSize;
+    const int cmapentry = (biSize == WIN_OS2_OLD) ? 3 : 4;
+    cmaplen = (biClrUsed) ? min(biClrUsed, 256u) : (biBitCount < 24 ? 1 << biBitCount : 0);
     if(biBitCount<24) {
-        int i;
-
-        for(i=0; i<cmaplen; i++) {
-            blu[i] = getc(fp);
-            grn[i] = getc(fp);
-            red[i] = getc(fp);
-            if(biSize != WIN_OS2_OLD) {
-                getc(fp);
-                bPad -= 4;
-            }
+        if(cp + cmaplen * cmapentry > fend) bmpError(fname, "EOF reached in BMP colormap");
+
+        for(i=0; i<cmaplen; i++, cp += cmapentry) {
+            blu[i] = cp[0];
+            grn[i] = cp[1];
+            red[i] = cp[2];
             Gray = Gray && (red[i] == grn[i] && grn[i] == blu[i]);
         }
 
-        if(FERROR(fp)) bmpError(fname, "EOF reached in BMP colormap");
+        // Indices past the colormap are black, rather than garbage.
+        for(i=cmaplen; i<256; i++)
+            red[i] = grn[i] = blu[i] = 0;
 
 #ifdef DMC_DEBUG
         {
@@ -439,75 +325,149 @@ void ImageLoadSave::LoadBMP(const char *fname)
 #endif
     }
 
-    if(biSize != WIN_OS2_OLD) {
-    /* Waste any unused bytes between the colour map (if present)
-        and the start of the actual bitmap data. */
-
-        while (bPad > 0) {
-            (void) getc(fp);
-            bPad--;
-        }
-    }
-
-    wid = biWidth; hgt = biHeight; is_uint = false; is_float = false;
+    /* Skip any unused bytes between the colour map (if present)
+       and the start of the actual bitmap data. */
+    const DMCINT64 Bits = (biSize != WIN_OS2_OLD) ? (DMCINT64)bfOffBits : (DMCINT64)(cp - fp);
+    if(Bits > FileSize) bmpError(fname, "File appears truncated.");
 
     if(biBitCount==24)
-        chan = 3;
+        B.chan = 3;
     else if(biBitCount==32)
-        chan = 4;
+        B.chan = 4;
     else
-        chan = 1;
+        B.chan = 1;
 
     if(biBitCount < 24 && !Gray) {
         // It's color mapped 24-bit.
-        chan = 3;
+        B.chan = 3;
+    }
+
+    if(biBitCount < 24 && Gray && cmaplen <= 2) bmpError(fname, "Weird gray BMP image."); // XXX How does a one-bit image work?
+
+    if(biCompression == BI_RGB) {
+        // Make sure all the rows are there before decoding any of them.
+        size_t rowbytes = ((biWidth * biBitCount + 31) / 32) * 4;
+        if(FileSize - Bits < (DMCINT64)rowbytes * biHeight) bmpError(fname, "File appears truncated. Winging it.\n");
+    }
+
+    B.biWidth = biWidth; B.biHeight = biHeight; B.biBitCount = biBitCount; B.biCompression = biCompression;
+    B.cmaplen = cmaplen; B.Gray = Gray; B.Bits = size_t(Bits);
+}
+
+/*******************************************/
+// Decode h uncompressed rows starting at src, which are stored bottom-up, into one byte per channel.
+static void loadBMPRows(const BMPInfo &B, const byte *src, byte *Dest, const unsigned int h)
+{
+    if(B.biBitCount == 1)
+        loadBMP1(src,Dest,B.biWidth,h); // Bloats into 1 byte per channel.
+    else if(B.biBitCount == 4)
+        loadBMP4(src,Dest,B.biWidth,h); // Bloats into 1 byte per channel.
+    else if(B.biBitCount == 8)
+        loadBMP8(src,Dest,B.biWidth,h); // Copies into 1 byte per channel.
+    else if(B.biBitCount == 24)
+        loadBMP24(src,Dest,B.biWidth,h);
+    else if(B.biBitCount == 32)
+        loadBMP32(src,Dest,B.biWidth,h);
+}
+
+/*******************************************/
+// Replace the n palette indices in Inds with the palette entries in Pix. Inds may be Pix if the image is gray.
+static void expandBMPPalette(const BMPInfo &B, const byte *Inds, byte *Pix, const int n)
+{
+    if(B.Gray) {
+        // Convert color map image to monochrome.
+        for(int i=0; i<n; i++)
+            Pix[i] = B.red[Inds[i]];
+    } else {
+        // Convert color map image to 24 bit.
+        for(int i=0; i<n; i++) {
+            Pix[i*3+0] = B.red[Inds[i]];
+            Pix[i*3+1] = B.grn[Inds[i]];
+            Pix[i*3+2] = B.blu[Inds[i]];
+        }
     }
+}
+
+/*******************************************/
+// The file is mapped, not read, and each pixel is decoded straight into the tImage.
+void ImageLoadSave::LoadBMP(const char *fname)
+{
+    Pix = NULL;
+
+    MappedFile File(fname);
+    BMPInfo B;
+    parseBMP(File.data(), File.end(), File.size(), fname, B);
+    const byte *src = File.data() + B.Bits;
+
+    wid = B.biWidth; hgt = B.biHeight; chan = B.chan; is_uint = false; is_float = false;
 
     // From ImageLoadSave.cpp
     Pix = ImageAlloc();
 
+    // Color mapped color images are decoded to indices first, then looked up into Pix.
+    std::vector<byte> Inds;
+    byte *Dest = Pix;
+    if(B.biBitCount < 24 && chan == 3) {
+        Inds.resize(size());
+        Dest = &Inds[0];
+    }
+
     // load up the image
-    if(biBitCount == 1)
-        rv = loadBMP1(fp,Pix,biWidth,biHeight); // Bloats into 1 byte per channel.
-    else if(biBitCount == 4)
-        rv = loadBMP4(fp,Pix,biWidth,biHeight, biCompression); // Bloats into 1 byte per channel.
-    else if(biBitCount == 8)
-        rv = loadBMP8(fp,Pix,biWidth,biHeight, biCompression); // Copies into 1 byte per channel.
-    else if(biBitCount == 24)
-        rv = loadBMP24(fp,Pix,biWidth,biHeight);
-    else if(biBitCount == 32)
-        rv = loadBMP32(fp,Pix,biWidth,biHeight);
-    else
-        bmpError(fname, "Weird bit depth.\n");
+    if(B.biCompression == BI_RLE8 || B.biCompression == BI_RLE4) {
+        if(loadBMPRLE(src, File.end(), Dest, wid, hgt, B.biCompression == BI_RLE4))
+            bmpError(fname, "File appears truncated. Winging it.\n");
+    } else
+        loadBMPRows(B, src, Dest, hgt);
 
-    if(rv) bmpError(fname, "File appears truncated. Winging it.\n");
+    if(B.biBitCount < 24) {
+        // It's color mapped.
+        expandBMPPalette(B, Dest, Pix, size());
+    }
+}
 
-    fclose(fp);
+namespace {
+    // Reads each band of rows in one piece and decodes them. The rows are stored bottom-up, so any row can be found.
+    // Run-length encoded rows can't be found without decoding all the rows below them, so those throw.
+    class BMPReader : public ImageReader
+    {
+        StreamFile File;
+        BMPInfo B;
+        size_t rowbytes;
+        std::vector<byte> Inds, Band;
 
-    if(biBitCount < 24) {
-        // It's color mapped.
+    public:
+        BMPReader(const char *fname) : File(fname)
+        {
+            const byte *End, *Data = File.Window(0, StreamFile::HEADER_BYTES, End);
+            parseBMP(Data, End, File.size(), fname, B);
+            if(B.biCompression != BI_RGB) bmpError(fname, "Can't read a run-length encoded BMP a few rows at a time.");
+
+            wid = B.biWidth; hgt = B.biHeight; chan = B.chan;
+            rowbytes = ((B.biWidth * B.biBitCount + 31) / 32) * 4;
+            if(B.biBitCount < 24 && chan == 3)
+                Inds.resize(wid);
+        }
 
-        if(Gray) {
-            if(cmaplen <= 2) bmpError(fname, "Weird gray BMP image."); // XXX How does a one-bit image work?
-            chan = 1;
-            // Convert color map image to monochrome.
-            // Replace the palette indices with the palette entries.
-            for(i=0; i<size(); i++) {
-                Pix[i] = red[Pix[i]];
-            }
-        } else {
-            // Convert color map image to 24 bit.
-            // Replace the palette indices with the palette entries.
-            // The data is in Pix, but is one-third the right size.
-            // Work backward to not overwrite.
-            unsigned char *tmp = Pix;
-            for(i=size()-1; i; i--) {
-                Pix[i*3+0] = red[tmp[i]];
-                Pix[i*3+1] = grn[tmp[i]];
-                Pix[i*3+2] = blu[tmp[i]];
+        void ReadRaw(unsigned char *Rows, const int n)
+        {
+            // The band's rows are together in the file, last row first.
+            Band.resize(n * rowbytes);
+            File.Read(&Band[0], Band.size(), B.Bits + (DMCINT64)(hgt - yNext - n) * rowbytes);
+
+            for(int y=0; y<n; y++) {
+                byte *Row = Rows + size_t(y) * wid * chan;
+                byte *Dest = Inds.empty() ? Row : &Inds[0];
+                loadBMPRows(B, &Band[(n-1-y) * rowbytes], Dest, 1);
+                if(B.biBitCount < 24)
+                    expandBMPPalette(B, Dest, Row, wid);
             }
         }
-    }
+    };
+};
+
+ImageReader *OpenBMPReader(const char *fname)
+{
+    return new BMPReader(fname);
 }
 
 /*******************************************/
@@ -607,5 +567,108 @@ void ImageLoadSave::SaveBMP(const char *fname) const
         writeBMP24(fp, Pix, wid, hgt);
     else bmpError(fname, "Bad bit depth");
 
-    if(FERROR(fp)) bmpError(fname, "Premature file close.");
+    bool failed = FERROR(fp);
+    fclose(fp);
+    if(failed) bmpError(fname, "Premature file close.");
+}
+
+/*******************************************/
+// Seek to a byte offset that may be past 2GB.
+static int seekBMP(FILE *fp, const long long offset)
+{
+#ifdef DMC_MACHINE_win
+    return _fseeki64(fp, offset, SEEK_SET);
+#else
+    return fseeko(fp, off_t(offset), SEEK_SET);
+#endif
+}
+
+namespace {
+    // The same header as SaveBMP(). BMP rows are stored bottom-up, so each row is written at its own offset.
+    class BMPWriter : public ImageWriter
+    {
+        FILE *fp;
+        string fname;
+        long long bytesperline, bitsoffset;
+        std::vector<byte> Row;
+
+    public:
+        BMPWriter(const char *fname_, const int w, const int h, const int ch) : fp(NULL), fname(fname_)
+        {
+            wid = w; hgt = h; chan = ch;
+
+            int nc=0, nbits=0;
+            if(chan == 1) {
+                // Grayscale
+                nc = 256;
+                nbits = 8;
+            } else if(chan == 3) {
+                // True color
+                nbits = 24;
+                nc = 0;
+            } else {
+                bmpError(fname_, "Can only save a 1- or 3-channel BMP for now.");
+            }
+
+            fp = fopen(fname_, "wb");
+            if(!fp) bmpError(fname_, "couldn't write file");
+
+            bytesperline = ((wid * nbits + 31) / 32) * 4; /* # bytes written per line */
+            bitsoffset = 14 + 40 + (nc * 4);
+            Row.resize(size_t(bytesperline), 0);
+
+            putc('B', fp); putc('M', fp); /* BMP file magic number */
+
+            putint(fp, int(bitsoffset + bytesperline * hgt)); /* filesize */
+            putshort(fp, 0); /* reserved1 */
+            putshort(fp, 0); /* reserved2 */
+            putint(fp, int(bitsoffset)); /* offset from BOfile to BObitmap */
+
+            putint(fp, 40); /* biSize: size of bitmap info header */
+            putint(fp, wid); /* biWidth */
+            putint(fp, hgt); /* biHeight */
+            putshort(fp, 1); /* biPlanes: must be '1' */
+            putshort(fp, nbits); /* biBitCount: 1,4,8, or 24 */
+            putint(fp, BI_RGB); /* biCompression: BI_RGB, BI_RLE8 or BI_RLE4 */
+            putint(fp, int(bytesperline*hgt)); /* biSizeImage: size of raw image data */
+            putint(fp, 96 * 39); /* biXPelsPerMeter: (96dpi * 39" per meter) */
+            putint(fp, 96 * 39); /* biYPelsPerMeter: (96dpi * 39" per meter) */
+            putint(fp, nc); /* biClrUsed: # of colors used in cmap */
+            putint(fp, nc); /* biClrImportant: same as above */
+
+            /* write out the colormap */
+            for(int i=0; i<nc; i++) {
+                putc(i,fp); putc(i,fp); putc(i,fp); putc(0,fp);
+            }
+        }
+
+        ~BMPWriter()
+        {
+            fclose(fp);
+        }
+
+        void WriteRaw(const unsigned char *Rows, const int n)
+        {
+            for(int y=0; y<n; y++) {
+                const byte *pp = Rows + size_t(y) * wid * chan;
+                if(chan == 1)
+                    memcpy(&Row[0], pp, wid);
+                else
+                    for(int j=0; j<wid; j++, pp += 3) {
+                        Row[j*3+0] = pp[2];
+                        Row[j*3+1] = pp[1];
+                        Row[j*3+2] = pp[0];
+                    }
+
+                if(seekBMP(fp, bitsoffset + (hgt-1-(yNext+y)) * bytesperline) ||
+                    fwrite(&Row[0], 1, Row.size(), fp) != Row.size())
+                    bmpError(fname.c_str(), "Premature file close.");
+            }
+        }
+    };
+};
+
+ImageWriter *OpenBMPWriter(const char *fname, const int w, const int h, const int chan)
+{
+    return new BMPWriter(fname, w, h, chan);
 }
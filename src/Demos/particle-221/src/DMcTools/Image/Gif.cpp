@@ -13,6 +13,9 @@
 #include "Image/ImageLoadSave.h"
 
 #include <memory>
+#include <vector>
+#include <algorithm>
+#include <cstring>
 #include <cstdio>
 
 using namespace std;
@@ -37,43 +40,23 @@ static int EGApalette[16][3] = {
     {255,100,100}, {255,100,255}, {255,255,100}, {255,255,255}
 };
 
-/* Fetch the next code from the raster data stream. The codes can be
-* any length from 3 to 12 bits, packed into 8-bit bytes, so we have to
-* maintain our location in the Raster array as a BIT Offset. We compute
-* the byte Offset into the raster array by dividing this by 8, pick up
-* three bytes, compute the bit Offset into our 24-bit chunk, shift to
-* bring the desired code to the bottom, then mask it off and return it.
-*/
-
-/*****************************/
-
 // info structure filled in by ReadGIF()
 struct GIFInfo {
     unsigned char *pic; // image data
     int chan;
     unsigned char r[256], g[256], b[256]; // colormap
 
-    int BitOffset, // Bit Offset of next code
-        XC, YC, // Output X and Y coords of current pixel
-        Pass, // Used by output routine if interlaced pic
-        OutCount, // Decompressor output 'stack count'
-        LeftOfs, TopOfs, // image offset
+    int LeftOfs, TopOfs, // image offset
         Width, Height,
         BitsPerPixel, // Bits per pixel, read from GIF header
         ColorMapSize, // number of colors
         Background, // background color
         CodeSize, // Code size, read from GIF header
         InitCodeSize, // Starting code size, used during Clear
-        Code, // Value returned by ReadCode
-        MaxCode, // limiting value for current code size
         ClearCode, // GIF clear code
         EOFCode, // GIF end-of-information code
-        CurCode, OldCode, InCode, // Decompressor variables
         FirstFree, // First free code, generated per GIF spec
-        FreeCode, // Decompressor, next free slot in hash table
-        FinChar, // Decompressor variable
         BitMask, // AND mask for data size
-        ReadMask, // Code AND mask for current code size
         Misc, // miscellaneous bits (interlace, local cmap)
         filesize; // Length of the input file.
 
@@ -86,13 +69,6 @@ struct GIFInfo {
     byte *pic8;
     byte *dataptr;
 
-    // The hash table used by the decompressor
-    int Prefix[4096];
-    int Suffix[4096];
-
-    // An output array used by the decompressor
-    int OutCode[4097];
-
     //////////////////////////////
     DMC_INLINE void gifWarning(const char *st)
     {
@@ -117,69 +93,107 @@ struct GIFInfo {
     }
 
     //////////////////////////////
-    DMC_INLINE int readCode()
-    {
-        int RawCode, ByteOffset;
-
-        ByteOffset = BitOffset / 8;
-        RawCode = Raster[ByteOffset] + (Raster[ByteOffset + 1] << 8);
-        if(CodeSize >= 8)
-            RawCode += (((int) Raster[ByteOffset + 2]) << 16);
-        RawCode >>= (BitOffset % 8);
-        BitOffset += CodeSize;
-
-        return(RawCode & ReadMask);
-    }
-
-    //////////////////////////////
-    DMC_INLINE void doInterlace(int Index)
+    // Decode the LZW codes in Src[0..SrcEnd) into palette indices in Out. Returns how many it decoded, at most maxpixels.
+    // Each code's string is kept as where it first appeared in Out and its length, so a code's whole string is copied at once
+    // instead of following its chain of prefixes backward. A string can run up to 4096 bytes past maxpixels, so Out must have room.
+    int decodeLZW(const byte *Src, const byte *SrcEnd, byte *Out, const int maxpixels)
     {
-        static byte *ptr = NULL;
-        static int oldYC = -1;
-
-        if(oldYC != YC) { ptr = pic8 + YC * Width * chan; oldYC = YC; }
-
-        if(YC < Height) {
-            *ptr++ = r[Index];
-            if(!GrayColormap)
-            {
-                *ptr++ = g[Index];
-                *ptr++ = b[Index];
+        int Pos[4096], Len[4096];
+
+        unsigned int BitBuf = 0; // The bits read but not yet used, starting at the low bit
+        int BitCnt = 0;
+        int CodeSize = InitCodeSize, MaxCode = 1 << CodeSize, FreeCode = FirstFree;
+        int Prev = -1, PrevPos = 0, PrevLen = 0; // The last code and its string, or -1 right after a clear
+        int n = 0;
+
+        while(n < maxpixels) {
+            // The codes are packed in from the low bit of each byte.
+            while(BitCnt < CodeSize) {
+                if(Src >= SrcEnd)
+                    return n; // Truncated
+                BitBuf |= (unsigned int)(*Src++) << BitCnt;
+                BitCnt += 8;
             }
-        }
-
-        // Update the X-coordinate, and if it overflows, update the Y-coordinate
+            int Code = BitBuf & (MaxCode - 1);
+            BitBuf >>= CodeSize;
+            BitCnt -= CodeSize;
 
-        if(++XC == Width) {
-
-            /* deal with the interlace as described in the GIF
-            * spec. Put the decoded scan line out to the screen if we haven't gone
-            * past the bottom of it
-            */
+            if(Code == ClearCode) {
+                CodeSize = InitCodeSize;
+                MaxCode = 1 << CodeSize;
+                FreeCode = FirstFree;
+                Prev = -1;
+                continue;
+            }
+            if(Code == EOFCode)
+                break;
 
-            XC = 0;
+            int CurPos = n;
+            if(Code < ClearCode) {
+                Out[n++] = byte(Code);
+            } else if(Code < FreeCode) {
+                memcpy(Out + n, Out + Pos[Code], Len[Code]); // It's entirely before n, so they don't overlap.
+                n += Len[Code];
+            } else if(Code == FreeCode && Prev >= 0) {
+                // The code being defined now: the last string and its own first character.
+                memcpy(Out + n, Out + PrevPos, PrevLen);
+                Out[n + PrevLen] = Out[PrevPos];
+                n += PrevLen + 1;
+            } else {
+                gifWarning("bad LZW code");
+                break;
+            }
 
-            switch (Pass) {
-case 0:
-    YC += 8;
-    if(YC >= Height) { Pass++; YC = 4; }
-    break;
+            // The new code is the last string and the first character of this one, which follows it in Out.
+            // When the table is full, codes are only read until the encoder sends a clear.
+            if(Prev >= 0 && FreeCode < 4096) {
+                Pos[FreeCode] = PrevPos;
+                Len[FreeCode] = PrevLen + 1;
+                FreeCode++;
+                if(FreeCode >= MaxCode && CodeSize < 12) {
+                    CodeSize++;
+                    MaxCode <<= 1;
+                }
+            }
 
-case 1:
-    YC += 8;
-    if(YC >= Height) { Pass++; YC = 2; }
-    break;
+            Prev = Code;
+            PrevPos = CurPos;
+            PrevLen = n - CurPos;
+        }
 
-case 2:
-    YC += 4;
-    if(YC >= Height) { Pass++; YC = 1; }
-    break;
+        return std::min(n, maxpixels);
+    }
 
-case 3:
-    YC += 2; break;
+    //////////////////////////////
+    // Look up the colors of the first npixels indices, which are in the order the file stores them, and put them in pic8.
+    // Interlaced files store every 8th row starting at 0, then every 8th starting at 4, then every 4th starting at 2, then the odd rows.
+    void expandIndices(const byte *Ind, const int npixels)
+    {
+        std::vector<int> RowY(Height);
+        if(Interlace) {
+            const int Start[4] = {0, 4, 2, 1}, Step[4] = {8, 8, 4, 2};
+            int k = 0;
+            for(int p=0; p<4; p++)
+                for(int y=Start[p]; y<Height; y+=Step[p])
+                    RowY[k++] = y;
+        } else {
+            for(int y=0; y<Height; y++)
+                RowY[y] = y;
+        }
 
-default:
-    break;
+        for(int k=0; k<Height && k*Width<npixels; k++) {
+            const byte *src = Ind + k*Width;
+            byte *dst = pic8 + RowY[k] * Width * chan;
+            const int n = std::min(Width, npixels - k*Width);
+            if(GrayColormap) {
+                for(int x=0; x<n; x++)
+                    dst[x] = r[src[x]];
+            } else {
+                for(int x=0; x<n; x++, dst+=3) {
+                    dst[0] = r[src[x]];
+                    dst[1] = g[src[x]];
+                    dst[2] = b[src[x]];
+                }
             }
         }
     }
@@ -187,11 +201,9 @@ default:
     //////////////////////////////
     int readImage()
     {
-        byte ch, ch1, *ptr1, *picptr;
+        byte ch, ch1, *ptr1;
         int i, npixels, maxpixels;
 
-        npixels = maxpixels = 0;
-
         // read in values from the image descriptor
 
         ch = NEXTBYTE;
@@ -213,7 +225,6 @@ default:
                 g[i] = NEXTBYTE;
                 b[i] = NEXTBYTE;
                 GrayColormap = GrayColormap && (r[i] == g[i] && r[i] == b[i]);
-                cerr << i << endl;
             }
 
             if(WantPaletteInds) {
@@ -239,7 +250,7 @@ default:
 
         ClearCode = (1 << CodeSize);
         EOFCode = ClearCode + 1;
-        FreeCode = FirstFree = ClearCode + 2;
+        FirstFree = ClearCode + 2;
 
         // The GIF spec has it that the code size is the code size used to
         // compute the above values is the code size given in the file, but
@@ -248,13 +259,11 @@ default:
 
         CodeSize++;
         InitCodeSize = CodeSize;
-        MaxCode = (1 << CodeSize);
-        ReadMask = MaxCode - 1;
 
         // UNBLOCK: Read the raster data. Here we just transpose it from the
         // GIF array to the Raster array, turning it from a series of blocks
         // into one long data stream, which makes life much easier for
-        // readCode().
+        // decodeLZW().
 
         ptr1 = Raster;
         do {
@@ -271,124 +280,20 @@ default:
             << (Interlace ? "" : "non-") << "interlaced\n";
 #endif
 
-        // Allocate the 'pic' */
         maxpixels = Width*Height;
 
-        picptr = pic8 = new unsigned char[maxpixels*chan];
-
-        // Decompress the file, continuing until you see the GIF EOF
-        // code. One obvious enhancement is to add checking for corrupt
-        // files here.
-
-        Code = readCode();
-        while (Code != EOFCode) {
-            // Clear code sets everything back to its initial value, then
-            // reads the immediately subsequent code as uncompressed data.
-
-            if(Code == ClearCode) {
-                CodeSize = InitCodeSize;
-                MaxCode = (1 << CodeSize);
-                ReadMask = MaxCode - 1;
-                FreeCode = FirstFree;
-                Code = readCode();
-                CurCode = OldCode = Code;
-                FinChar = CurCode & BitMask;
-                if(!Interlace) {
-                    *picptr++ = r[FinChar];
-                    //cerr << int(FinChar) << '-';
-                    if(!GrayColormap) {
-                        *picptr++ = g[FinChar];
-                        *picptr++ = b[FinChar];
-                    }
-                }
-                else doInterlace(FinChar);
-                npixels++;
-            }
-            else {
-                // If not a clear code, must be data: save same as CurCode and InCode
-
-                // if we're at maxcode and didn't get a clear, stop loading
-                if(FreeCode>=4096) {
-                    gifWarning("freecode blew up");
-                    break; }
-
-                CurCode = InCode = Code;
-
-                // If greater or equal to FreeCode, not in the hash table yet; repeat the last character decoded.
-
-                if(CurCode >= FreeCode) {
-                    CurCode = OldCode;
-                    if(OutCount > 4096) {
-                        gifWarning("outcount1 blew up");
-                        break; }
-                    OutCode[OutCount++] = FinChar;
-                }
-
-                // Unless this code is raw data, pursue the chain pointed to by
-                // CurCode through the hash table to its end; each code in the
-                // chain puts its associated output code on the output queue.
-
-                while (CurCode > BitMask) {
-                    if(OutCount > 4096) break; // corrupt file
-                    OutCode[OutCount++] = Suffix[CurCode];
-                    CurCode = Prefix[CurCode];
-                }
-
-                if(OutCount > 4096) {
-                    gifWarning("outcount blew up");
-                    break; }
-
-                // The last code in the chain is treated as raw data.
-
-                FinChar = CurCode & BitMask;
-                OutCode[OutCount++] = FinChar;
+        // Decompress the file, continuing until you see the GIF EOF code.
+        byte *Ind = new byte[maxpixels + 4096];
+        npixels = decodeLZW(Raster, ptr1, Ind, maxpixels);
 
-                // Now we put the data out to the Output routine. It's been stacked LIFO, so deal with it that way...
-
-                // safety thing: prevent exceeding range of 'pic8'
-                if(npixels + OutCount > maxpixels) OutCount = maxpixels-npixels;
-
-                npixels += OutCount;
-                if(!Interlace) for(i=OutCount-1; i>=0; i--) {
-                    *picptr++ = r[OutCode[i]];
-                    //cerr << OutCode[i] << '_';
-                    if(!GrayColormap) {
-                        *picptr++ = g[OutCode[i]];
-                        *picptr++ = b[OutCode[i]];
-                    }
-                }
-                else for(i=OutCount-1; i>=0; i--) doInterlace(OutCode[i]);
-                OutCount = 0;
-
-                // Build the hash table on-the-fly. No table is stored in the file.
-
-                Prefix[FreeCode] = OldCode;
-                Suffix[FreeCode] = FinChar;
-                OldCode = InCode;
-
-                // Point to the next slot in the table. If we exceed the current
-                // MaxCode value, increment the code size unless it's already
-                // 12. If it is, do nothing: the next code decompressed better
-                // be CLEAR
-
-                FreeCode++;
-                if(FreeCode >= MaxCode) {
-                    if(CodeSize < 12) {
-                        CodeSize++;
-                        MaxCode *= 2;
-                        ReadMask = (1 << CodeSize) - 1;
-                    }
-                }
-            }
-            Code = readCode();
-            if(npixels >= maxpixels) break;
-        }
-
-        if(npixels != maxpixels) {
+        if(npixels != maxpixels)
             gifWarning(": This GIF file seems to be truncated. Winging it.\n");
-            if(!Interlace) // clear->EOBuffer */
-                memset((char *) pic8+npixels, 0, (size_t) (maxpixels-npixels));
-        }
+
+        // Allocate the 'pic' and fill it in. The pixels that weren't decoded are black.
+        pic8 = new unsigned char[maxpixels*chan];
+        memset(pic8, 0, (size_t) maxpixels*chan);
+        expandIndices(Ind, npixels);
+        delete [] Ind;
 
         // fill in the GIFInfo structure */
         pic = pic8;
@@ -406,7 +311,6 @@ default:
         bool gotimage;
 
         // initialize variables
-        BitOffset = XC = YC = Pass = OutCount = 0;
         gotimage = false;
         RawGIF = Raster = pic8 = NULL;
         bool gif89 = false;
@@ -550,7 +454,10 @@ default:
                             for(j=0; j<sbsize; j++, sp++, ptr1++) *sp = *ptr1;
                         } while (sbsize);
                         *sp = '\0';
+#ifdef DMC_DEBUG
                         cerr << "GIF Comment: " << cmt << endl;
+#endif
+                        delete [] cmt;
                     }
                 }
                 else if(fn == 0x01) { // PlainText Extension
@@ -730,319 +637,199 @@ void ImageLoadSave::LoadGIF(const char *fname, bool WantPaletteInds)
 //////////////////////////////////////////////////////////////////////
 // GIF Saving Routines
 
-// Used in output
-static unsigned long masks[] = { 0x0000, 0x0001, 0x0003, 0x0007, 0x000F,
-0x001F, 0x003F, 0x007F, 0x00FF,
-0x01FF, 0x03FF, 0x07FF, 0x0FFF,
-0x1FFF, 0x3FFF, 0x7FFF, 0xFFFF };
-
-struct GIFWriter
-{
-    int init_bits;
-    int EOFCode;
-
-    // Number of characters so far in this 'packet'
-    int a_count;
+namespace {
+    const int MAX_LZW_BITS = 12;
+    const int MAX_LZW_CODES = 1 << MAX_LZW_BITS;
 
-    // Define the storage for the packet accumulator
-    char accum[256];
-
-    // What file we will write to.
-    FILE *fp;
-    const char *bname;
-
-    //////////////////////////////////////////////////////////////////////
-    // Set up the 'byte output' routine
-    DMC_INLINE void char_init()
+    // The LZW dictionary of the encoder. It maps a prefix code and the character after it to the code of that string.
+    // It's an open address hash table with linear probing that's never more than half full.
+    // Each key has a stamp in its top bits, so clearing the dictionary only needs to change the stamp.
+    struct LZWDict
     {
-        a_count = 0;
-    }
+        static const int SIZE_BITS = 13;
+        static const int SIZE = 1 << SIZE_BITS;
 
-    //////////////////////////////////////////////////////////////////////
-    // Flush the packet to disk, and reset the accumulator
-    DMC_INLINE void flush_char()
-    {
-        if(a_count > 0) {
-            fputc(a_count, fp);
-            fwrite(accum, (size_t) 1, (size_t) a_count, fp);
-            a_count = 0;
-        }
-    }
+        unsigned int Keys[SIZE]; // Stamp<<20 | Prefix<<8 | c. Zero is never a valid key.
+        unsigned short Codes[SIZE];
+        unsigned int Stamp;
 
-    //////////////////////////////////////////////////////////////////////
-    // Add a character to the end of the current packet, and if it is 254
-    // characters, flush the packet to disk.
-    DMC_INLINE void char_out(int c)
-    {
-        accum[a_count++] = c;
-        if(a_count >= 254)
-            flush_char();
-    }
-
-    //////////////////////////////////////////////////////////////////////
-    // Crap used by the compress routine.
-
-    unsigned long cur_accum;
-    int cur_bits;
-
-#define min(a,b) ((a>b) ? b : a)
-
-#define NUM_BITS 12 /* BITS was already defined on some systems */
-
-#define HSIZE 5003 /* 80% occupancy */
-
-    typedef long int count_int;
-
-    int n_bits; /* number of bits/code */
-    int maxbits; /* user settable max # bits/code */
-    int maxcode; /* maximum code, given n_bits */
-    int maxmaxcode; /* NEVER generate this */
-
-#define MAXCODE(n_bits) ((1 << (n_bits)) - 1)
-
-    count_int htab [HSIZE];
-    unsigned short codetab [HSIZE];
-#define HashTabOf(i) htab[i]
-#define CodeTabOf(i) codetab[i]
-
-    int hsize; /* for dynamic table sizing */
-
-    /*
-    * To save much memory, we overlay the table used by compress() with those
-    * used by decompress(). The tab_prefix table is the same size and type
-    * as the codetab. The tab_suffix table needs 2**BITS characters. We
-    * get this from the beginning of htab. The output stack uses the rest
-    * of htab, and contains characters. There is plenty of room for any
-    * possible stack (stack used to be 8000 characters).
-    */
-
-#define tab_prefixof(i) CodeTabOf(i)
-#define tab_suffixof(i) ((byte *)(htab))[i]
-#define de_stack ((byte *)&tab_suffixof(1<<NUM_BITS))
-
-    int free_ent; /* first unused entry */
+        LZWDict()
+        {
+            Stamp = 0;
+            memset(Keys, 0, sizeof(Keys));
+            Clear();
+        }
 
-    // block compression parameters -- after all codes are used up,
-    // and compression rate changes, start over.
-    int clear_flg;
+        void Clear()
+        {
+            Stamp++;
+            if(Stamp >= (1u << 12)) {
+                memset(Keys, 0, sizeof(Keys));
+                Stamp = 1;
+            }
+        }
 
-    long int in_count; /* length of input */
-    long int out_count; /* # of codes output (for DEBUGging) */
+        // Returns the code of Prefix followed by c, or -1 and the slot to Insert() it into.
+        DMC_INLINE int Find(const int Prefix, const int c, int &Slot) const
+        {
+            const unsigned int Key = (Stamp << 20) | (Prefix << 8) | c;
+            int i = int(((Key & 0xfffff) * 2654435761u) >> (32 - SIZE_BITS));
+            while(Keys[i] != Key) {
+                if((Keys[i] >> 20) != Stamp) {
+                    Slot = i;
+                    return -1;
+                }
+                i = (i + 1) & (SIZE - 1);
+            }
+            return Codes[i];
+        }
 
-    //////////////////////////////
-    void cl_hash(count_int hsize)
-    {
-        count_int *htab_p = htab+hsize;
-        long i;
-        long m1 = -1;
-
-        i = hsize - 16;
-        do { /* might use Sys V memset(3) here */
-            *(htab_p-16) = m1;
-            *(htab_p-15) = m1;
-            *(htab_p-14) = m1;
-            *(htab_p-13) = m1;
-            *(htab_p-12) = m1;
-            *(htab_p-11) = m1;
-            *(htab_p-10) = m1;
-            *(htab_p-9) = m1;
-            *(htab_p-8) = m1;
-            *(htab_p-7) = m1;
-            *(htab_p-6) = m1;
-            *(htab_p-5) = m1;
-            *(htab_p-4) = m1;
-            *(htab_p-3) = m1;
-            *(htab_p-2) = m1;
-            *(htab_p-1) = m1;
-            htab_p -= 16;
-        } while ((i -= 16) >= 0);
-
-        for(i += 16; i > 0; i--)
-            *--htab_p = m1;
-    }
+        DMC_INLINE void Insert(const int Slot, const int Prefix, const int c, const int Code)
+        {
+            Keys[Slot] = (Stamp << 20) | (Prefix << 8) | c;
+            Codes[Slot] = (unsigned short) Code;
+        }
+    };
 
-    /*
-    * Compress
-    *
-    * Algorithm: use open addressing double hashing (no chaining) on the
-    * prefix code / next character combination. We do a variant of Knuth's
-    * algorithm D (vol. 3, sec. 6.4) along with G. Knott's relatively-prime
-    * secondary probe. Here, the modular division first probe gives way
-    * to a faster exclusive-or manipulation. Also do block compression with
-    * an adaptive reset, whereby the code table is cleared when the compression
-    * ratio decreases, but after the table fills. The variable-length output
-    * codes are re-sized at this point, and a special CLEAR code is generated
-    * for the decompressor. Late addition: construct the table according to
-    * file size for noticeable speed improvement on small files. Please direct
-    * questions about this implementation to ames!jaw.
-    */
-
-    /*****************************************************************
-    * Output the given code.
-    * Inputs:
-    * code: A n_bits-bit integer. If == -1, then EOF. This assumes
-    * that n_bits <= (long)wordsize - 1.
-    *
-    * Outputs:
-    * Outputs code to the file.
-    *
-    * Algorithm:
-    * Maintain a BITS character long buffer (so that 8 codes will
-    * fit in it exactly). Use the VAX insv instruction to insert each
-    * code in turn. When the buffer fills up empty it and start over.
-    */
-    void output(int code)
+    // Packs codes into a byte stream starting at the low bit, storing 32 bits at a time.
+    struct LZWCodeWriter
     {
-        cur_accum &= masks[cur_bits];
+        byte *Out; // Must be big enough for all the codes.
+        unsigned long long Acc;
+        int AccBits;
 
-        if(cur_bits > 0)
-            cur_accum |= ((long)code << cur_bits);
-        else
-            cur_accum = code;
+        LZWCodeWriter(byte *Out_) : Out(Out_), Acc(0), AccBits(0) {}
 
-        cur_bits += n_bits;
-
-        while(cur_bits >= 8) {
-            char_out((int) (cur_accum & 0xff));
-            cur_accum >>= 8;
-            cur_bits -= 8;
+        DMC_INLINE void Put(const int Code, const int nBits)
+        {
+            Acc |= (unsigned long long) Code << AccBits;
+            AccBits += nBits;
+            if(AccBits >= 32) {
+                const unsigned int w = (unsigned int) Acc;
+                Out[0] = byte(w);
+                Out[1] = byte(w >> 8);
+                Out[2] = byte(w >> 16);
+                Out[3] = byte(w >> 24);
+                Out += 4;
+                Acc >>= 32;
+                AccBits -= 32;
+            }
         }
 
-        /*
-        * If the next entry is going to be too big for the code size,
-        * then increase it, if possible.
-        */
-
-        if(free_ent > maxcode || clear_flg) {
-
-            if(clear_flg) {
-                maxcode = MAXCODE (n_bits = init_bits);
-                clear_flg = 0;
-            }
-            else {
-                n_bits++;
-                if(n_bits == maxbits)
-                    maxcode = maxmaxcode;
-                else
-                    maxcode = MAXCODE(n_bits);
+        // Store the bits that are left. Returns the end of the stream.
+        byte *Finish()
+        {
+            for(; AccBits > 0; AccBits -= 8) {
+                *Out++ = byte(Acc);
+                Acc >>= 8;
             }
+            return Out;
         }
+    };
 
-        if(code == EOFCode) {
-            /* At EOF, write the rest of the buffer */
-            while(cur_bits > 0) {
-                char_out((int)(cur_accum & 0xff));
-                cur_accum >>= 8;
-                cur_bits -= 8;
+    // LZW compress the len palette indices in data, which have InitCodeSize bits or fewer, and append
+    // them to Blocks as GIF data sub-blocks, with the zero-length block that ends them.
+    // The codes are the same as the classic compress(): the code size grows after the first code that
+    // needs it, and the dictionary is cleared when it fills up.
+    void CompressLZW(const byte *data, const int len, const int InitCodeSize, vector<byte> &Blocks)
+    {
+        const int ClearCode = 1 << InitCodeSize, EOFCode = ClearCode + 1, FirstFree = ClearCode + 2;
+        const int InitBits = InitCodeSize + 1;
+
+        // Each character makes at most one code of at most 12 bits, plus a clear code every few thousand.
+        vector<byte> Codes(size_t(len) * 2 + 64);
+        LZWCodeWriter W(&Codes[0]);
+        LZWDict Dict;
+
+        int nBits = InitBits, FreeCode = FirstFree;
+        W.Put(ClearCode, nBits);
+
+        int ent = data[0];
+        for(int i=1; i<len; i++) {
+            const int c = data[i];
+            int Slot;
+            const int Code = Dict.Find(ent, c, Slot);
+            if(Code >= 0) {
+                ent = Code;
+                continue;
             }
 
-            flush_char();
+            W.Put(ent, nBits);
+            if(FreeCode >= (1 << nBits) && nBits < MAX_LZW_BITS)
+                nBits++;
 
-            fflush(fp);
+            if(FreeCode < MAX_LZW_CODES) {
+                Dict.Insert(Slot, ent, c, FreeCode++);
+            } else {
+                Dict.Clear();
+                FreeCode = FirstFree;
+                W.Put(ClearCode, nBits);
+                nBits = InitBits;
+            }
+            ent = c;
+        }
 
-            ASSERT_RM(!ferror(fp), "unable to write GIF file");
+        W.Put(ent, nBits);
+        if(FreeCode >= (1 << nBits) && nBits < MAX_LZW_BITS)
+            nBits++;
+        W.Put(EOFCode, nBits);
+        const byte *CodesEnd = W.Finish();
+
+        // Cut the stream into sub-blocks of up to 255 bytes, each preceded by its length.
+        const byte *sp = &Codes[0];
+        size_t nCodeBytes = CodesEnd - sp;
+        size_t o = Blocks.size();
+        Blocks.resize(o + nCodeBytes + (nCodeBytes + 254) / 255 + 1);
+        while(nCodeBytes > 0) {
+            const size_t blen = std::min(nCodeBytes, size_t(255));
+            Blocks[o++] = byte(blen);
+            memcpy(&Blocks[o], sp, blen);
+            o += blen;
+            sp += blen;
+            nCodeBytes -= blen;
         }
+        Blocks[o++] = 0; // Zero-length packet (EOF)
     }
 
-    //////////////////////////////////////////////////////////////////////
-    void compress(byte *data, int len)
+    // An image quantized and compressed, ready to write to a file.
+    struct GIFFrame
     {
-        long fcode;
-        int i = 0;
-        int c;
-        int ent;
-        int disp;
-        int hsize_reg;
-        int hshift;
-
-        // Set up the necessary values
-        maxbits = NUM_BITS;
-        maxmaxcode = 1<<NUM_BITS;
-        memset(htab, 0, sizeof(htab));
-        memset(codetab, 0, sizeof(codetab));
-        hsize = HSIZE;
-        free_ent = 0;
-        cur_accum = 0;
-        cur_bits = 0;
-
-        out_count = 0;
-        clear_flg = 0;
-        in_count = 1;
-        maxcode = MAXCODE(n_bits = init_bits);
-
-        int ClearCode = (1 << (init_bits - 1));
-        EOFCode = ClearCode + 1;
-        free_ent = ClearCode + 2;
-
-        char_init();
-        // Translate the byte using lookup table.
-        ent = *data++; len--;
-
-        hshift = 0;
-        for(fcode = (long) hsize; fcode < 65536L; fcode *= 2L)
-            hshift++;
-        hshift = 8 - hshift; /* set hash code range bound */
-
-        hsize_reg = hsize;
-        cl_hash((count_int) hsize_reg); /* clear hash table */
-
-        output(ClearCode);
-
-        while (len) {
-            c = *data++; len--;
-            in_count++;
-
-            fcode = (long) (((long) c << maxbits) + ent);
-            i = (((int) c << hshift) ^ ent); /* xor hashing */
-
-            if(HashTabOf (i) == fcode) {
-                ent = CodeTabOf(i);
-                continue;
-            }
-
-            else if((long)HashTabOf(i) < 0) /* empty slot */
-                goto nomatch;
-
-            disp = hsize_reg - i; /* secondary hash (after G. Knott) */
-            if(i == 0)
-                disp = 1;
-
-probe:
-            if((i -= disp) < 0)
-                i += hsize_reg;
+        int wid, hgt;
+        int BitsPerPixel, InitCodeSize;
+        vector<uc3Pixel> CMap;
+        vector<byte> Blocks; // The compressed indices as sub-blocks
+    };
+
+    // Quantize and compress an image. Each frame can be encoded on its own thread.
+    void EncodeFrame(GIFFrame &F, const byte *Pix, const int wid, const int hgt, const int MaxColorsWanted, const bool GrayScale)
+    {
+        const int size = wid*hgt;
+        F.wid = wid;
+        F.hgt = hgt;
 
-            if(HashTabOf (i) == fcode) {
-                ent = CodeTabOf (i);
-                continue;
-            }
+        // Fill in the 8-bit image and the color map somehow.
+        Quantizer<uc3Pixel, unsigned char> Qnt((uc3Pixel *)Pix, size, GrayScale);
+        Qnt.SetParams(MaxColorsWanted);
+        byte *pic8 = Qnt.GetIndexImage(); // I must now delete pic8.
+        F.CMap = Qnt.GetColorMap();
 
-            if((long)HashTabOf (i) >= 0)
-                goto probe;
+        // Compute 'BitsPerPixel'.
+        for(F.BitsPerPixel=1; F.BitsPerPixel<8; F.BitsPerPixel++) {
+            if(size_t(1<<F.BitsPerPixel) >= F.CMap.size())
+                break;
+        }
 
-nomatch:
-            output(ent);
-            out_count++;
-            ent = c;
+        F.InitCodeSize = F.BitsPerPixel <= 1 ? 2 : F.BitsPerPixel;
 
-            if(free_ent < maxmaxcode) {
-                CodeTabOf (i) = free_ent++; /* code -> hashtable */
-                HashTabOf (i) = fcode;
-            }
-            else
-            {
-                // Clear out the hash table for block compress.
-                cl_hash ((count_int) hsize);
-                free_ent = ClearCode + 2;
-                clear_flg = 1;
-
-                output(ClearCode);
-            }
+        F.Blocks.clear();
+        try {
+            CompressLZW(pic8, size, F.InitCodeSize, F.Blocks);
         }
-
-        /* Put out the final code */
-        output(ent);
-        out_count++;
-        output(EOFCode);
+        catch(...) {
+            delete [] pic8;
+            throw;
+        }
+        delete [] pic8;
     }
 
     //////////////////////////////
@@ -1053,45 +840,54 @@ nomatch:
         fputc((w>>8)&0xff, fp);
     }
 
-    //////////////////////////////////////////////////////////////////////
-    void WriteGIF(const char *fname, int wid, int hgt, byte *Pix, int MaxColorsWanted = 256,
-        bool GrayScale = false, const char *comment = NULL)
+    // Write the frame's color map, padded with black to 1<<BitsPerPixel entries.
+    void WriteColorMap(const GIFFrame &F, FILE *fp)
     {
-        int size = wid*hgt;
-
-        if((fp = fopen(fname, "wb")) == 0)
-            throw DMcError("WriteGIF() failed: can't write GIF image file " + string(fname));
-
-        int ColorMapSize, InitCodeSize, BitsPerPixel;
+        const int ColorMapSize = 1 << F.BitsPerPixel;
+        vector<byte> Map(ColorMapSize * 3, byte(0));
+        for(int i=0; i<ColorMapSize && i<int(F.CMap.size()); i++) {
+            Map[i*3+0] = F.CMap[i].r();
+            Map[i*3+1] = F.CMap[i].g();
+            Map[i*3+2] = F.CMap[i].b();
+        }
+        fwrite(&Map[0], (size_t) 1, Map.size(), fp);
+    }
 
-        // Fill in the 8-bit image and the color map somehow.
-        Quantizer<uc3Pixel, unsigned char> Qnt((uc3Pixel *)Pix, size, GrayScale);
-        Qnt.SetParams(MaxColorsWanted);
-        byte *pic8 = Qnt.GetIndexImage(); // I must now delete pic8.
-        size_t NumColors = Qnt.GetColorMap().size();
+    // Write the image separator, the image descriptor, and the compressed data.
+    // A local color map is used for animations, where each frame has its own colors.
+    void WriteImageBlock(const GIFFrame &F, FILE *fp, const bool LocalColorMap)
+    {
+        fputc(',', fp); /* image separator */
 
-        // Compute 'BitsPerPixel'.
-        for(BitsPerPixel=1; BitsPerPixel<8; BitsPerPixel++) {
-            if(size_t(1<<BitsPerPixel) >= NumColors)
-                break;
-        }
+        /* Write the Image header */
+        putword(0, fp); // LeftOfs
+        putword(0, fp); // TopOfs
+        putword(F.wid, fp);
+        putword(F.hgt, fp);
 
-        ColorMapSize = 1 << BitsPerPixel;
+        if(LocalColorMap) {
+            fputc(0x80 | (F.BitsPerPixel - 1), fp); // Local colormap, no interlace.
+            WriteColorMap(F, fp);
+        } else
+            fputc(0x00, fp); // Global colormap, no interlace.
 
-        if(BitsPerPixel <= 1)
-            InitCodeSize = 2;
-        else
-            InitCodeSize = BitsPerPixel;
+        fputc(F.InitCodeSize, fp);
+        fwrite(&F.Blocks[0], (size_t) 1, F.Blocks.size(), fp);
+    }
 
-        if(comment && strlen(comment) > (size_t) 0)
-            fwrite(id89, (size_t) 1, (size_t) 6, fp); /* the GIF magic number */
-        else
-            fwrite(id87, (size_t) 1, (size_t) 6, fp); /* the GIF magic number */
+    // Write the magic number and the screen descriptor, with the frame's color map as the global one if it's given.
+    // Without one, BitsPerPixel should be that of the biggest local color map, since some readers use it anyway.
+    void WriteHeader(FILE *fp, const int wid, const int hgt, const bool gif89, const GIFFrame *GlobalMap, int BitsPerPixel = 8)
+    {
+        fwrite(gif89 ? id89 : id87, (size_t) 1, (size_t) 6, fp); /* the GIF magic number */
 
         putword(wid, fp); /* screen descriptor */
         putword(hgt, fp);
 
-        int i = 0x80; /* Yes, there is a color map */
+        if(GlobalMap)
+            BitsPerPixel = GlobalMap->BitsPerPixel;
+
+        int i = GlobalMap ? 0x80 : 0; /* Is there a color map? */
         i |= (8-1)<<4; /* OR in the color resolution (hardwired 8) */
         i |= (BitsPerPixel - 1); /* OR in the # of bits per pixel */
         fputc(i,fp);
@@ -1101,62 +897,59 @@ nomatch:
 
         fputc(0, fp); /* future expansion byte */
 
-        // Write the colormap.
-        i=0;
-        for(i=0; i<BitsPerPixel && i<ColorMapSize; i++) {
-            fputc(Qnt.GetColorMap()[i].r(), fp);
-            fputc(Qnt.GetColorMap()[i].g(), fp);
-            fputc(Qnt.GetColorMap()[i].b(), fp);
-        }
-
-        for(; i<ColorMapSize; i++) {
-            fputc(0, fp);
-            fputc(0, fp);
-            fputc(0, fp);
-        }
-
-        if(comment && strlen(comment) > (size_t) 0) { /* write comment blocks */
-            const char *sp;
-            int i, blen;
-
-            fputc(0x21, fp); /* EXTENSION block */
-            fputc(0xFE, fp); /* comment extension */
+        if(GlobalMap)
+            WriteColorMap(*GlobalMap, fp);
+    }
 
-            sp = comment;
-            while ((blen=int(strlen(sp))) > 0) {
-                if(blen>255) blen = 255;
-                fputc(blen, fp);
-                for(i=0; i<blen; i++, sp++) fputc(*sp, fp);
-            }
-            fputc(0, fp); /* zero-length data subblock to end extension */
+    void WriteComment(FILE *fp, const char *comment)
+    {
+        const char *sp;
+        int blen;
+
+        fputc(0x21, fp); /* EXTENSION block */
+        fputc(0xFE, fp); /* comment extension */
+
+        sp = comment;
+        while ((blen=int(strlen(sp))) > 0) {
+            if(blen>255) blen = 255;
+            fputc(blen, fp);
+            fwrite(sp, (size_t) 1, (size_t) blen, fp);
+            sp += blen;
         }
+        fputc(0, fp); /* zero-length data subblock to end extension */
+    }
 
-        fputc(',', fp); /* image separator */
-
-        /* Write the Image header */
-        putword(0, fp); // LeftOfs
-        putword(0, fp); // TopOfs
-        putword(wid, fp);
-        putword(hgt, fp);
-
-        fputc(0x00, fp); // Global colormap, no interlace.
-
-        fputc(InitCodeSize, fp);
-        init_bits = InitCodeSize+1;
-        compress(pic8, wid*hgt);
-
-        fputc(0, fp); /* Write out a Zero-length packet (EOF) */
+    void CloseGIF(FILE *fp, const char *fname)
+    {
         fputc(';', fp); /* Write GIF file terminator */
 
-        delete [] pic8;
-
         if(ferror(fp)) {
             fclose(fp);
-            throw DMcError("File error in WriteGIF()");
+            throw DMcError("File error writing GIF file " + string(fname));
         }
 
         fclose(fp);
     }
+
+    //////////////////////////////////////////////////////////////////////
+    void WriteGIF(const char *fname, int wid, int hgt, byte *Pix, int MaxColorsWanted = 256,
+        bool GrayScale = false, const char *comment = NULL)
+    {
+        GIFFrame F;
+        EncodeFrame(F, Pix, wid, hgt, MaxColorsWanted, GrayScale);
+
+        FILE *fp = fopen(fname, "wb");
+        if(fp == NULL)
+            throw DMcError("WriteGIF() failed: can't write GIF image file " + string(fname));
+
+        const bool HasComment = comment && strlen(comment) > (size_t) 0;
+        WriteHeader(fp, wid, hgt, HasComment, &F);
+        if(HasComment)
+            WriteComment(fp, comment);
+        WriteImageBlock(F, fp, false);
+
+        CloseGIF(fp, fname);
+    }
 };
 
 void ImageLoadSave::SaveGIF(const char *fname, int MaxColorsWanted) const
@@ -1170,6 +963,59 @@ void ImageLoadSave::SaveGIF(const char *fname, int MaxColorsWanted) const
         throw DMcError(er.str());
     }
 
-    GIFWriter gw;
-    gw.WriteGIF(fname, wid, hgt, (unsigned char *)Pix, MaxColorsWanted, (chan==1), "Written using DaveMc Tools");
+    WriteGIF(fname, wid, hgt, (unsigned char *)Pix, MaxColorsWanted, (chan==1), "Written using DaveMc Tools");
+}
+
+void SaveGIFAnimation(const char *fname, const vector<uc3Image *> &Frames, const int DelayCentiSec, const int MaxColorsWanted)
+{
+    ASSERT_R(fname);
+    if(Frames.empty()) throw DMcError("No frames. Not saving.");
+
+    const int wid = Frames[0]->w(), hgt = Frames[0]->h();
+    for(size_t f=0; f<Frames.size(); f++)
+        if(Frames[f]->w() != wid || Frames[f]->h() != hgt || wid < 1 || hgt < 1)
+            throw DMcError("The frames of a GIF animation must all be the same size. Not saving.");
+
+    // Each frame is quantized and compressed on its own, so they're done in parallel.
+    const int nFrames = int(Frames.size());
+    vector<GIFFrame> Enc(nFrames);
+    string Err;
+#pragma omp parallel for schedule(dynamic)
+    for(int f=0; f<nFrames; f++) {
+        try {
+            EncodeFrame(Enc[f], (byte *)Frames[f]->pv(), wid, hgt, MaxColorsWanted, false);
+        }
+        catch(DMcError &e) {
+#pragma omp critical (SaveGIFAnimationErr)
+            Err = e.Er;
+        }
+        catch(std::bad_alloc &) {
+#pragma omp critical (SaveGIFAnimationErr)
+            Err = "Out of memory encoding a GIF frame.";
+        }
+    }
+    if(!Err.empty())
+        throw DMcError(Err);
+
+    FILE *fp = fopen(fname, "wb");
+    if(fp == NULL)
+        throw DMcError("SaveGIFAnimation() failed: can't write GIF image file " + string(fname));
+
+    int MaxBitsPerPixel = 1;
+    for(int f=0; f<nFrames; f++)
+        MaxBitsPerPixel = std::max(MaxBitsPerPixel, Enc[f].BitsPerPixel);
+    WriteHeader(fp, wid, hgt, true, NULL, MaxBitsPerPixel);
+
+    // The NETSCAPE2.0 application extension makes it loop forever.
+    const byte Loop[19] = {0x21, 0xFF, 11, 'N','E','T','S','C','A','P','E','2','.','0', 3, 1, 0, 0, 0};
+    fwrite(Loop, (size_t) 1, sizeof(Loop), fp);
+
+    for(int f=0; f<nFrames; f++) {
+        // Graphic control extension with the frame's delay
+        const byte GCE[8] = {0x21, 0xF9, 4, 0, byte(DelayCentiSec & 0xff), byte((DelayCentiSec >> 8) & 0xff), 0, 0};
+        fwrite(GCE, (size_t) 1, sizeof(GCE), fp);
+        WriteImageBlock(Enc[f], fp, true);
+    }
+
+    CloseGIF(fp, fname);
 }
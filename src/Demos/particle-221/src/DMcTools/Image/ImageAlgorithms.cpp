@@ -6,12 +6,314 @@
 // Also: Filter, PullPush, VCD need to be parameterized properly.
 
 #include "Image/ImageAlgorithms.h"
+#include "Image/ImageStream.h"
+#include "Image/ImageTiles.h"
+#include "Image/RowKernels.h"
 
 #include <vector>
+#include <list>
 #include <algorithm>
 
 using namespace std;
 
+// Bands of rows for the streaming versions of the algorithms. See ImageStream.h.
+namespace {
+	// Rows [Y0,Y1) of a w() x h() image, addressed by their place in the whole image.
+	// The tile operators work on these just like on whole images, so the streaming algorithms share them.
+	template <class Image_T>
+	struct RowWindow
+	{
+		typedef typename Image_T::PixType PixType;
+
+		PixType *P; // Row Y0
+		int wid, hgt, Y0, Y1;
+
+		RowWindow(PixType *P_, const int wid_, const int hgt_, const int Y0_, const int Y1_) : P(P_), wid(wid_), hgt(hgt_), Y0(Y0_), Y1(Y1_) {}
+
+		int w() const { return wid; }
+		int h() const { return hgt; }
+
+		const PixType *pp(const int x, const int y) const
+		{
+			ASSERT_D(x>=0 && x<wid && y>=Y0 && y<Y1);
+			return P + size_t(y-Y0)*wid + x;
+		}
+
+		PixType *pp(const int x, const int y)
+		{
+			ASSERT_D(x>=0 && x<wid && y>=Y0 && y<Y1);
+			return P + size_t(y-Y0)*wid + x;
+		}
+
+		const PixType &operator()(const int x, const int y) const { return *pp(x,y); }
+		PixType &operator()(const int x, const int y) { return *pp(x,y); }
+	};
+
+	// The rows of an image, from top to bottom.
+	template <class Image_T>
+	struct RowSource
+	{
+		virtual ~RowSource() {}
+		virtual int w() const = 0;
+		virtual int h() const = 0;
+
+		// Put the next n rows in rows r to r+n-1 of Rows.
+		virtual void Read(Image_T &Rows, const int r, const int n) = 0;
+	};
+
+	// Makes V the n rows of Img starting at row r, without copying them.
+	template <class Image_T>
+	struct RowsView
+	{
+		Image_T V;
+
+		RowsView(Image_T &Img, const int r, const int n) { V.SetImage(Img.pp(0, r), Img.w(), n); }
+		~RowsView() { V.SetImage(); } // Detach the rows so V doesn't delete them.
+	};
+
+	// The rows of an image file.
+	template <class Image_T>
+	struct ReaderSource : public RowSource<Image_T>
+	{
+		ImageReader &In;
+
+		ReaderSource(ImageReader &In_) : In(In_) {}
+
+		int w() const { return In.w(); }
+		int h() const { return In.h(); }
+
+		void Read(Image_T &Rows, const int r, const int n)
+		{
+			RowsView<Image_T> R(Rows, r, n);
+			if(In.ReadRows(R.V, n) != n)
+				throw DMcError("Ran out of rows while streaming an image.");
+		}
+	};
+
+	// The rows of an image, holding the band of them that the algorithm is working on.
+	// The band only moves down, so each row is read once.
+	template <class Image_T>
+	struct RowBuffer
+	{
+		Image_T Rows;
+		const int wid, hgt; // Of the whole image
+		int Y0, Y1; // The rows in Rows
+
+		RowBuffer(const int wid_, const int hgt_) : wid(wid_), hgt(hgt_), Y0(0), Y1(0) {}
+
+		RowWindow<Image_T> Window() { return RowWindow<Image_T>(Rows.pp(), wid, hgt, Y0, Y1); }
+
+		// Hold rows [ya,yb) of Src, keeping the ones it already has.
+		void Slide(RowSource<Image_T> &Src, const int ya, const int yb)
+		{
+			ASSERT_R(ya >= Y0 && yb >= Y1 && yb >= ya && yb <= hgt);
+
+			// Move the rows that stay to the top.
+			const int Keep = std::max(Y1 - ya, 0);
+			if(Rows.h() < yb - ya || Rows.h() < 1) {
+				Image_T Bigger(wid, std::max(yb - ya, 1));
+				if(Keep > 0)
+					std::copy(Rows.pp(0, ya - Y0), Rows.pp(0, ya - Y0) + size_t(Keep) * wid, Bigger.pp());
+				Rows.swap(Bigger);
+			} else if(Keep > 0 && ya > Y0)
+				std::copy(Rows.pp(0, ya - Y0), Rows.pp(0, ya - Y0) + size_t(Keep) * wid, Rows.pp());
+
+			// Skip the rows above the band.
+			for(int y = Y1; y < ya; ) {
+				const int n = std::min(ya - y, Rows.h());
+				Src.Read(Rows, 0, n);
+				y += n;
+			}
+
+			const int y = std::max(Y1, ya);
+			if(yb > y)
+				Src.Read(Rows, y - ya, yb - y);
+			Y0 = ya;
+			Y1 = yb;
+		}
+	};
+};
+
+// The tile operators of the algorithms below. See ForEachTile().
+namespace {
+	template <class Image_T>
+	struct Resample4Op
+	{
+		Image_T &Out;
+		const Image_T &Img;
+		const float xs, ys;
+
+		Resample4Op(Image_T &Out_, const Image_T &Img_, const float xs_, const float ys_) : Out(Out_), Img(Img_), xs(xs_), ys(ys_) {}
+
+		void Inside(const int x0, const int y0, const int x1, const int y1) const
+		{
+			for(int y=y0; y<y1; y++) {
+				const float yf = y * ys;
+				for(int x=x0; x<x1; x++) {
+					const float xf = x * xs;
+					typename Image_T::PixType p(0);
+					bool good = sample4(p, Img, xf, yf);
+					if(!good)
+						good = sample2(p, Img, xf, yf);
+					if(!good)
+						sample1(p, Img, floorf(xf), floorf(yf));
+					Out(x,y) = p;
+				}
+			}
+		}
+
+		void Edge(const int x, const int y) const {}
+	};
+
+	template <class Image_T>
+	struct Downsample2x2Op
+	{
+		typedef typename Image_T::PixType::MathPixType MathPix_T;
+		typedef typename Image_T::PixType::MathType Math_T;
+
+		Image_T &Out;
+		const Image_T &Img;
+		const int ws, hs; // Output pixels that have a full 2x2 box of input pixels
+
+		Downsample2x2Op(Image_T &Out_, const Image_T &Img_) : Out(Out_), Img(Img_), ws(Img_.w() / 2), hs(Img_.h() / 2) {}
+
+		void Inside(const int x0, const int y0, const int x1, const int y1) const
+		{
+			for(int y=y0; y<y1; y++) {
+				for(int x=x0; x<x1; x++) {
+					if(x < ws && y < hs)
+						//Out(x,y) = 0.25f * (Img((x<<1),(y<<1)) + Img((x<<1)+1,(y<<1)) + Img((x<<1),(y<<1)+1) + Img((x<<1)+1,(y<<1)+1));
+						Out(x,y) = (static_cast<MathPix_T>(Img((x<<1),(y<<1))) +
+							static_cast<MathPix_T>(Img((x<<1)+1,(y<<1))) +
+							static_cast<MathPix_T>(Img((x<<1),(y<<1)+1)) +
+							static_cast<MathPix_T>(Img((x<<1)+1,(y<<1)+1)) ) / static_cast<Math_T>(4);
+					else if(y < hs)
+						// Out(ws,y) = 0.5f * (Img((ws<<1),(y<<1)) + Img((ws<<1),(y<<1)+1));
+						Out(x,y) = (static_cast<MathPix_T>(Img((x<<1),(y<<1))) + static_cast<MathPix_T>(Img((x<<1),(y<<1)+1)))
+							/ static_cast<Math_T>(2);
+					else if(x < ws)
+						// Out(x,hs) = 0.5f * (Img((x<<1),(hs<<1)) + Img((x<<1)+1,(hs<<1)));
+						Out(x,y) = (static_cast<MathPix_T>(Img((x<<1),(y<<1))) + static_cast<MathPix_T>(Img((x<<1)+1,(y<<1))))
+							/ static_cast<Math_T>(2);
+					else
+						Out(x,y) = Img((x<<1),(y<<1));
+				}
+			}
+		}
+
+		void Edge(const int x, const int y) const {}
+	};
+
+	// Tone map pixels i0 to i1.
+	template<class OutImage_T, class InImage_T>
+	void ToneMapRun(OutImage_T &Out, const InImage_T &Img, const typename InImage_T::PixType::ElType Scale,
+		const typename InImage_T::PixType::ElType Bias, const int i0, const int i1)
+	{
+		for(int i=i0; i<i1; i++) {
+			typename InImage_T::PixType tmp = Scale * Img[i];
+			tmp += Bias;
+			Out[i] = static_cast<typename OutImage_T::PixType>(tmp);
+		}
+	}
+
+	// Float to unsigned char with the same channels is one long run of channels.
+	template<int Chan_>
+	void ToneMapRun(tImage<tPixel<unsigned char, Chan_> > &Out, const tImage<tPixel<float, Chan_> > &Img, const float Scale,
+		const float Bias, const int i0, const int i1)
+	{
+		RowFloatToUChar((unsigned char *)Out.pp(i0), (const float *)Img.pp(i0), Scale, Bias, (i1-i0)*Chan_);
+	}
+
+	template<class OutImage_T, class InImage_T>
+	struct ToneMapLinearOp
+	{
+		typedef typename InImage_T::PixType::ElType El_T;
+
+		OutImage_T &Out;
+		const InImage_T &Img;
+		const El_T Scale, Bias;
+
+		ToneMapLinearOp(OutImage_T &Out_, const InImage_T &Img_, const El_T Scale_, const El_T Bias_) : Out(Out_), Img(Img_), Scale(Scale_), Bias(Bias_) {}
+
+		void Inside(const int x0, const int y0, const int x1, const int y1) const
+		{
+			for(int y=y0; y<y1; y++)
+				ToneMapRun(Out, Img, Scale, Bias, y*Img.w()+x0, y*Img.w()+x1);
+		}
+
+		void Edge(const int x, const int y) const {}
+	};
+
+	// Reads Img and writes Out, which starts as a copy of Img, so the border pixels stay the same.
+	template <class Image_T>
+	struct DeSpeckleOp
+	{
+		Image_T &Out;
+		const Image_T &Img;
+
+		DeSpeckleOp(Image_T &Out_, const Image_T &Img_) : Out(Out_), Img(Img_) {}
+
+		void Inside(const int x0, const int y0, const int x1, const int y1) const
+		{
+			for(int y=y0; y<y1; y++) {
+				for(int x=x0; x<x1; x++) {
+					typename Image_T::PixType MinP = Img(x-1,y-1), MaxP = Img(x-1,y-1);
+					MinP = Min(MinP,Img(x,y-1)); MaxP = Max(MaxP,Img(x,y-1));
+					MinP = Min(MinP,Img(x+1,y-1)); MaxP = Max(MaxP,Img(x+1,y-1));
+					MinP = Min(MinP,Img(x-1,y)); MaxP = Max(MaxP,Img(x-1,y));
+					MinP = Min(MinP,Img(x+1,y)); MaxP = Max(MaxP,Img(x+1,y));
+					MinP = Min(MinP,Img(x-1,y+1)); MaxP = Max(MaxP,Img(x-1,y+1));
+					MinP = Min(MinP,Img(x,y+1)); MaxP = Max(MaxP,Img(x,y+1));
+					MinP = Min(MinP,Img(x+1,y+1)); MaxP = Max(MaxP,Img(x+1,y+1));
+					Out(x,y) = Clamp(MinP, Img(x,y),MaxP);
+				}
+			}
+		}
+
+		void Edge(const int x, const int y) const {}
+	};
+
+	template <class Image_T>
+	struct DeSpeckleNOp
+	{
+		Image_T &NImg;
+		const Image_T &Img;
+		const int N;
+
+		DeSpeckleNOp(Image_T &NImg_, const Image_T &Img_, const int N_) : NImg(NImg_), Img(Img_), N(N_) {}
+
+		void Inside(const int x0, const int y0, const int x1, const int y1) const
+		{
+			for(int y=y0; y<y1; y++) {
+				for(int x=x0; x<x1; x++) {
+					typename Image_T::PixType MinP = Img(x-1,y-1), MaxP = Img(x-1,y-1);
+					MinP = Min(MinP,Img(x,y-1));   MaxP = Max(MaxP,Img(x,y-1));
+					MinP = Min(MinP,Img(x+1,y-1)); MaxP = Max(MaxP,Img(x+1,y-1));
+					MinP = Min(MinP,Img(x-1,y));   MaxP = Max(MaxP,Img(x-1,y));
+					MinP = Min(MinP,Img(x+1,y));   MaxP = Max(MaxP,Img(x+1,y));
+					MinP = Min(MinP,Img(x-1,y+1)); MaxP = Max(MaxP,Img(x-1,y+1));
+					MinP = Min(MinP,Img(x,y+1));   MaxP = Max(MaxP,Img(x,y+1));
+					MinP = Min(MinP,Img(x+1,y+1)); MaxP = Max(MaxP,Img(x+1,y+1));
+
+					typename Image_T::PixType Me = Img(x,y);
+					int c=0;
+					c += Img(x-1,y-1) <= Me;
+					c += Img(x,y-1) <= Me;
+					c += Img(x+1,y-1) <= Me;
+					c += Img(x-1,y) <= Me;
+					c += Img(x+1,y) <= Me;
+					c += Img(x-1,y+1) <= Me;
+					c += Img(x,y+1) <= Me;
+					c += Img(x+1,y+1) <= Me;
+					NImg(x,y) = c>=N?Me:MaxP;
+				}
+			}
+		}
+
+		void Edge(const int x, const int y) const {}
+	};
+};
+
 // Bi-cubic resampling to arbitrary size.
 // Works well for upsampling and downsampling by a factor less than two.
 // Doesn't work for downsampling by a factor bigger than two; instead call Downsample().
@@ -29,21 +331,7 @@ void Resample4(Image_T &Out, const Image_T &Img, const int w1, const int h1)
 	const float xs = (Img.w() - 1) / float(w1-1);
 	const float ys = (Img.h() - 1) / float(h1-1);
 
-	float yf = 0;
-	for(int y=0; y<h1; y++) {
-		float xf = 0;
-		for(int x=0; x<w1; x++) {
-            typename Image_T::PixType p;
-			bool good = sample4(p, Img, xf, yf);
-			if(!good)
-				good = sample2(p, Img, xf, yf);
-			if(!good)
-				sample1(p, Img, floorf(xf), floorf(yf));
-            Out(x,y) = p;
-			xf += xs;
-		}
-		yf += ys;
-	}
+	ForEachTile(w1, h1, 0, Resample4Op<Image_T>(Out, Img, xs, ys));
 }
 
 template void Resample4(f3Image &Out, const f3Image &Img, const int w1, const int h1);
@@ -57,31 +345,7 @@ void Downsample2x2(Image_T &Out, const Image_T &Img)
 
 	Out.SetSize(w1, h1);
 
-	const int ws = Img.w() / 2; // Number of times through simple loop.
-	const int hs = Img.h() / 2;
-
-	for(int y=0; y<hs; y++) {
-        for(int x=0; x<ws; x++) {
-            //Out(x,y) = 0.25f * (Img((x<<1),(y<<1)) + Img((x<<1)+1,(y<<1)) + Img((x<<1),(y<<1)+1) + Img((x<<1)+1,(y<<1)+1));
-            Out(x,y) = (static_cast<typename Image_T::PixType::MathPixType>(Img((x<<1),(y<<1))) +
-                static_cast<typename Image_T::PixType::MathPixType>(Img((x<<1)+1,(y<<1))) +
-                static_cast<typename Image_T::PixType::MathPixType>(Img((x<<1),(y<<1)+1)) +
-                static_cast<typename Image_T::PixType::MathPixType>(Img((x<<1)+1,(y<<1)+1)) ) / static_cast<typename Image_T::PixType::MathType>(4);
-		}
-		if(w1 != ws)
-			// Out(ws,y) = 0.5f * (Img((ws<<1),(y<<1)) + Img((ws<<1),(y<<1)+1));
-			Out(ws,y) = (static_cast<typename Image_T::PixType::MathPixType>(Img((ws<<1),(y<<1))) + static_cast<typename Image_T::PixType::MathPixType>(Img((ws<<1),(y<<1)+1)))
-            / static_cast<typename Image_T::PixType::MathType>(2);
-	}
-	if(h1 != hs) {
-		for(int x=0; x<ws; x++) {
-			// Out(x,hs) = 0.5f * (Img((x<<1),(hs<<1)) + Img((x<<1)+1,(hs<<1)));
-			Out(x,hs) = (static_cast<typename Image_T::PixType::MathPixType>(Img((x<<1),(hs<<1))) + static_cast<typename Image_T::PixType::MathPixType>(Img((x<<1)+1,(hs<<1))))
-                / static_cast<typename Image_T::PixType::MathType>(2);
-		}
-		if(w1 != ws)
-			Out(ws,hs) = Img((ws<<1),(hs<<1));
-	}
+	ForEachTile(w1, h1, 0, Downsample2x2Op<Image_T>(Out, Img));
 }
 
 template void Downsample2x2(f3Image &Out, const f3Image &Img);
@@ -113,17 +377,87 @@ template void Downsample(f3Image &Out, const f3Image &Img, const int w1, const i
 template void Downsample(f4Image &Out, const f4Image &Img, const int w1, const int h1);
 template void Downsample(uc3Image &Out, const uc3Image &Img, const int w1, const int h1);
 
+namespace {
+	// Downsample2x2() of the rows of Src, a band at a time.
+	template <class Image_T>
+	struct Downsample2x2Source : public RowSource<Image_T>
+	{
+		RowSource<Image_T> &Src;
+		RowBuffer<Image_T> In;
+		int yNext;
+
+		Downsample2x2Source(RowSource<Image_T> &Src_) : Src(Src_), In(Src_.w(), Src_.h()), yNext(0) {}
+
+		int w() const { return (1+Src.w())/2; }
+		int h() const { return (1+Src.h())/2; }
+
+		void Read(Image_T &Rows, const int r, const int n)
+		{
+			In.Slide(Src, 2*yNext, std::min(2*(yNext+n), Src.h()));
+
+			RowWindow<Image_T> InW = In.Window(), OutW(Rows.pp(0, r), w(), h(), yNext, yNext+n);
+			ForEachTileRows(w(), h(), 0, Downsample2x2Op<RowWindow<Image_T> >(OutW, InW), yNext, yNext+n);
+			yNext += n;
+		}
+	};
+};
+
+// The same steps as the in-memory version, each on a band of rows: downsample by two until the next
+// step would be too small, then resample the rest of the way.
+template <class Image_T>
+void Downsample(ImageWriter &Out, ImageReader &In, const int w1, const int h1)
+{
+	ASSERT_R(Out.w() == w1 && Out.h() == h1);
+
+	ReaderSource<Image_T> Reader(In);
+	std::list<Downsample2x2Source<Image_T> > Steps;
+	RowSource<Image_T> *Src = &Reader;
+	while(Src->w() / 2 >= w1 && Src->h() / 2 >= h1) {
+		Steps.push_back(Downsample2x2Source<Image_T>(*Src));
+		Src = &Steps.back();
+	}
+
+	const int B = DMC_TILE_SIZE; // Output rows per band
+	Image_T OutRows(w1, B);
+
+	if(Src->w() == w1 && Src->h() == h1) {
+		// Quickly copy the rows without resampling
+		for(int y0=0; y0<h1; y0+=B) {
+			const int n = std::min(B, h1 - y0);
+			Src->Read(OutRows, 0, n);
+			Out.WriteRows(OutRows, n);
+		}
+		return;
+	}
+
+	if(w1 < 2 || h1 < 2) throw DMcError("Downsample: Can't resample to a single row or column.");
+
+	const float xs = (Src->w() - 1) / float(w1-1);
+	const float ys = (Src->h() - 1) / float(h1-1);
+
+	// Output row y samples input rows int(y*ys)-1 to int(y*ys)+2.
+	RowBuffer<Image_T> InRows(Src->w(), Src->h());
+	for(int y0=0; y0<h1; y0+=B) {
+		const int y1 = std::min(y0 + B, h1);
+		InRows.Slide(*Src, std::max(int(y0 * ys) - 1, InRows.Y0), std::min(int((y1-1) * ys) + 3, Src->h()));
+
+		RowWindow<Image_T> InW = InRows.Window(), OutW(OutRows.pp(), w1, h1, y0, y1);
+		ForEachTileRows(w1, h1, 0, Resample4Op<RowWindow<Image_T> >(OutW, InW, xs, ys), y0, y1);
+		Out.WriteRows(OutRows, y1 - y0);
+	}
+}
+
+template void Downsample<f3Image>(ImageWriter &Out, ImageReader &In, const int w1, const int h1);
+template void Downsample<f4Image>(ImageWriter &Out, ImageReader &In, const int w1, const int h1);
+template void Downsample<uc3Image>(ImageWriter &Out, ImageReader &In, const int w1, const int h1);
+
 // Map a float image to an unsigned char image.
 template<class OutImage_T, class InImage_T>
 void ToneMapLinear(OutImage_T &Out, const InImage_T &Img, const typename InImage_T::PixType::ElType Scale, const typename InImage_T::PixType::ElType Bias)
 {
 	Out.SetSize(Img.w(), Img.h());
 
-	for(int i=0; i<Img.size(); i++) {
-		typename InImage_T::PixType tmp = Scale * Img[i];
-		tmp += Bias;
-		Out[i] = static_cast<typename OutImage_T::PixType>(tmp);
-	}
+	ForEachTile(Img.w(), Img.h(), 0, ToneMapLinearOp<OutImage_T, InImage_T>(Out, Img, Scale, Bias));
 }
 
 // This instantiation is touchy. Your code has to really give float args.
@@ -131,6 +465,27 @@ template void ToneMapLinear(uc1Image &Out, const f1Image &Img, const float Scale
 template void ToneMapLinear(uc3Image &Out, const f3Image &Img, const float Scale, const float Bias);
 template void ToneMapLinear(uc1Image &Out, const f3Image &Img, const float Scale, const float Bias);
 
+// Each band of rows is read, tone mapped like a whole image, and written.
+template<class OutImage_T, class InImage_T>
+void ToneMapLinear(ImageWriter &Out, ImageReader &In, const typename InImage_T::PixType::ElType Scale, const typename InImage_T::PixType::ElType Bias)
+{
+	ASSERT_R(Out.w() == In.w() && Out.h() == In.h());
+
+	const int B = DMC_TILE_SIZE;
+	InImage_T InRows;
+	OutImage_T OutRows(In.w(), B);
+
+	int n;
+	while((n = In.ReadRows(InRows, B)) > 0) {
+		ForEachTile(In.w(), n, 0, ToneMapLinearOp<OutImage_T, InImage_T>(OutRows, InRows, Scale, Bias));
+		Out.WriteRows(OutRows, n);
+	}
+}
+
+template void ToneMapLinear<uc1Image, f1Image>(ImageWriter &Out, ImageReader &In, const float Scale, const float Bias);
+template void ToneMapLinear<uc3Image, f3Image>(ImageWriter &Out, ImageReader &In, const float Scale, const float Bias);
+template void ToneMapLinear<uc1Image, f3Image>(ImageWriter &Out, ImageReader &In, const float Scale, const float Bias);
+
 // Map a float image to an unsigned char image, given the extrema that map to 0..255.
 template<class OutImage_T, class InImage_T>
 void ToneMapExtrema(OutImage_T &Out, const InImage_T &Img,
@@ -165,22 +520,13 @@ template void ToneMapFindExtrema(uc1Image &Out, const f3Image &Img);
 
 // Clamp each pixel to the extrema of its neighbors.
 // WARNING: Since it treats channels independently, it can cause chromatic shift.
+// The neighbors are read from a copy of the image, so the result doesn't depend on the order the tiles are done.
 template <class Image_T>
 void DeSpeckle(Image_T &Img)
 {
-	for(int y=1; y<Img.h()-1; y++) {
-		for(int x=1; x<Img.w()-1; x++) {
-			typename Image_T::PixType MinP = Img(x-1,y-1), MaxP = Img(x-1,y-1);
-			MinP = Min(MinP,Img(x,y-1)); MaxP = Max(MaxP,Img(x,y-1));
-			MinP = Min(MinP,Img(x+1,y-1)); MaxP = Max(MaxP,Img(x+1,y-1));
-			MinP = Min(MinP,Img(x-1,y)); MaxP = Max(MaxP,Img(x-1,y));
-			MinP = Min(MinP,Img(x+1,y)); MaxP = Max(MaxP,Img(x+1,y));
-			MinP = Min(MinP,Img(x-1,y+1)); MaxP = Max(MaxP,Img(x-1,y+1));
-			MinP = Min(MinP,Img(x,y+1)); MaxP = Max(MaxP,Img(x,y+1));
-			MinP = Min(MinP,Img(x+1,y+1)); MaxP = Max(MaxP,Img(x+1,y+1));
-			Img(x,y) = Clamp(MinP, Img(x,y),MaxP);
-		}
-	}
+	const Image_T In(Img);
+
+	ForEachTile(Img.w(), Img.h(), 1, DeSpeckleOp<Image_T>(Img, In));
 }
 
 // Instantiate it.
@@ -196,30 +542,7 @@ void DeSpeckleN(Image_T &Img, int N)
 	Image_T NImg(Img.w(), Img.h());
 	NImg.fill(uc1Pixel(255)); // The 255 is a hack.
 
-	for(int y=1; y<Img.h()-1; y++) {
-		for(int x=1; x<Img.w()-1; x++) {
-			typename Image_T::PixType MinP = Img(x-1,y-1), MaxP = Img(x-1,y-1);
-			MinP = Min(MinP,Img(x,y-1));   MaxP = Max(MaxP,Img(x,y-1));
-			MinP = Min(MinP,Img(x+1,y-1)); MaxP = Max(MaxP,Img(x+1,y-1));
-			MinP = Min(MinP,Img(x-1,y));   MaxP = Max(MaxP,Img(x-1,y));
-			MinP = Min(MinP,Img(x+1,y));   MaxP = Max(MaxP,Img(x+1,y));
-			MinP = Min(MinP,Img(x-1,y+1)); MaxP = Max(MaxP,Img(x-1,y+1));
-			MinP = Min(MinP,Img(x,y+1));   MaxP = Max(MaxP,Img(x,y+1));
-			MinP = Min(MinP,Img(x+1,y+1)); MaxP = Max(MaxP,Img(x+1,y+1));
-
-			typename Image_T::PixType Me = Img(x,y);
-			int c=0;
-			c += Img(x-1,y-1) <= Me;
-			c += Img(x,y-1) <= Me;
-			c += Img(x+1,y-1) <= Me;
-			c += Img(x-1,y) <= Me;
-			c += Img(x+1,y) <= Me;
-			c += Img(x-1,y+1) <= Me;
-			c += Img(x,y+1) <= Me;
-			c += Img(x+1,y+1) <= Me;
-			NImg(x,y) = c>=N?Me:MaxP;
-		}
-	}
+	ForEachTile(Img.w(), Img.h(), 1, DeSpeckleNOp<Image_T>(NImg, Img, N));
 
 	Img = NImg;
 }
@@ -514,15 +837,12 @@ namespace {
 		return sum;
 	}
 
-	// Convolve the parts of the image where the kernel is fully inside. This should be fast.
+	// Convolve a rectangle of the image where the kernel is fully inside. This should be fast.
 	template <class Image_T, class KernelImage_T>
-	void ConvolveMiddle(Image_T &Out, const Image_T &In, const KernelImage_T &Kernel)
+	void ConvolveMiddle(Image_T &Out, const Image_T &In, const KernelImage_T &Kernel, const int x0, const int y0, const int x1, const int y1)
 	{
-		const int N = Kernel.w();
-		const int N2 = N/2;
-		const int wid = In.w(), hgt = In.h();
-		for(int y=N2; y<hgt-N2; y++) {
-			for(int x=N2; x<wid-N2; x++) {
+		for(int y=y0; y<y1; y++) {
+			for(int x=x0; x<x1; x++) {
 				Out(x,y) = sample_kernel_full(In, Kernel, x, y);
 			}
 		}
@@ -530,68 +850,86 @@ namespace {
 
 	// Kernel width, N, is known at compile time.
 	template <class Image_T, class KernelImage_T, int N>
-	void ConvolveMiddleN(Image_T &Out, const Image_T &In, const KernelImage_T &Kernel)
+	void ConvolveMiddleN(Image_T &Out, const Image_T &In, const KernelImage_T &Kernel, const int x0, const int y0, const int x1, const int y1)
 	{
-		const int N2 = N/2;
 		ASSERT_R((Kernel.w() == N));
-		const int wid = In.w(), hgt = In.h();
 
-		// Do center.
-		for(int y=N2; y<hgt-N2; y++) {
-			for(int x=N2; x<wid-N2; x++) {
+		for(int y=y0; y<y1; y++) {
+			for(int x=x0; x<x1; x++) {
 				Out(x,y) = sample_kernel_fullN<Image_T, KernelImage_T, N>(In, Kernel, x, y);
 			}
 		}
 	}
 
-	// Specialization for f1Image, 5.
-	// Uses direct pixel access and loop unrolling for big speedup.
-	template <>
-	void ConvolveMiddleN<f1Image, f1Image, 5>(f1Image &Out, const f1Image &In, const f1Image &Kernel)
+	// Convolve a rectangle a row at a time, instead of a pixel at a time.
+	// Only float images qualify, so the general version declines.
+	template <class Image_T, class KernelImage_T>
+	bool ConvolveMiddleRows(Image_T &Out, const Image_T &In, const KernelImage_T &Kernel, const int x0, const int y0, const int x1, const int y1)
 	{
-		float *OutP = (float *)Out.pv();
-		const float *InP = (const float *)In.pv();
-		const float *KP = (const float *)Kernel.pv();
-
-		const int wid = In.w(), hgt = In.h();
-		for(int y=2; y<hgt-2; y++) {
-			for(int x=2; x<wid-2; x++) {
-				float sum = 0;
-
-				sum += KP[0] * InP[(y-2)*wid+x-2];
-				sum += KP[1] * InP[(y-2)*wid+x-1];
-				sum += KP[2] * InP[(y-2)*wid+x];
-				sum += KP[3] * InP[(y-2)*wid+x+1];
-				sum += KP[4] * InP[(y-2)*wid+x+2];
-
-				sum += KP[5] * InP[(y-1)*wid+x-2];
-				sum += KP[6] * InP[(y-1)*wid+x-1];
-				sum += KP[7] * InP[(y-1)*wid+x];
-				sum += KP[8] * InP[(y-1)*wid+x+1];
-				sum += KP[9] * InP[(y-1)*wid+x+2];
-
-				sum += KP[10] * InP[(y)*wid+x-2];
-				sum += KP[11] * InP[(y)*wid+x-1];
-				sum += KP[12] * InP[(y)*wid+x];
-				sum += KP[13] * InP[(y)*wid+x+1];
-				sum += KP[14] * InP[(y)*wid+x+2];
-
-				sum += KP[15] * InP[(y+1)*wid+x-2];
-				sum += KP[16] * InP[(y+1)*wid+x-1];
-				sum += KP[17] * InP[(y+1)*wid+x];
-				sum += KP[18] * InP[(y+1)*wid+x+1];
-				sum += KP[19] * InP[(y+1)*wid+x+2];
-
-				sum += KP[20] * InP[(y+2)*wid+x-2];
-				sum += KP[21] * InP[(y+2)*wid+x-1];
-				sum += KP[22] * InP[(y+2)*wid+x];
-				sum += KP[23] * InP[(y+2)*wid+x+1];
-				sum += KP[24] * InP[(y+2)*wid+x+2];
-
-				OutP[y*wid+x] = sum;
-			}
+		return false;
+	}
+
+	// A row of a float image is a run of channels, so RowConvolve() does the whole row of the rectangle,
+	// several channels per instruction, for any number of channels. It sums the taps in the same order as
+	// sample_kernel_full(), so the results are identical to the pixel at a time loops.
+	template <class Image_T>
+	void ConvolveFloatRows(Image_T &Out, const Image_T &In, const f1Image &Kernel,
+		const int x0, const int y0, const int x1, const int y1)
+	{
+		const int Chan = Image_T::PixType::Chan;
+		const int N = Kernel.w();
+		const int N2 = N/2;
+		std::vector<const float *> Rows(N);
+
+		for(int y=y0; y<y1; y++) {
+			for(int yk=0; yk<N; yk++)
+				Rows[yk] = (const float *)In.pp(x0 - N2, y - N2 + yk);
+			RowConvolve((float *)Out.pp(x0, y), &Rows[0], (const float *)Kernel.pp(), N, Chan, (x1 - x0) * Chan);
 		}
 	}
+
+	template <int Chan_>
+	bool ConvolveMiddleRows(tImage<tPixel<float, Chan_> > &Out, const tImage<tPixel<float, Chan_> > &In, const f1Image &Kernel,
+		const int x0, const int y0, const int x1, const int y1)
+	{
+		ConvolveFloatRows(Out, In, Kernel, x0, y0, x1, y1);
+		return true;
+	}
+
+	template <int Chan_>
+	bool ConvolveMiddleRows(RowWindow<tImage<tPixel<float, Chan_> > > &Out, const RowWindow<tImage<tPixel<float, Chan_> > > &In,
+		const f1Image &Kernel, const int x0, const int y0, const int x1, const int y1)
+	{
+		ConvolveFloatRows(Out, In, Kernel, x0, y0, x1, y1);
+		return true;
+	}
+
+	// Tile operator for ConvolveImage. N is the kernel width if it's known at compile time, or 0.
+	template <class Image_T, class KernelImage_T, int N>
+	struct ConvolveOp
+	{
+		Image_T &Out;
+		const Image_T &In;
+		const KernelImage_T &Kernel;
+
+		ConvolveOp(Image_T &Out_, const Image_T &In_, const KernelImage_T &Kernel_) : Out(Out_), In(In_), Kernel(Kernel_) {}
+
+		void Inside(const int x0, const int y0, const int x1, const int y1) const
+		{
+			if(ConvolveMiddleRows(Out, In, Kernel, x0, y0, x1, y1))
+				return;
+
+			if(N)
+				ConvolveMiddleN<Image_T, KernelImage_T, N>(Out, In, Kernel, x0, y0, x1, y1);
+			else
+				ConvolveMiddle(Out, In, Kernel, x0, y0, x1, y1);
+		}
+
+		void Edge(const int x, const int y) const
+		{
+			Out(x,y) = sample_kernel_weighted(In, Kernel, x, y);
+		}
+	};
 };
 
 template <class Image_T, class KernelImage_T>
@@ -603,30 +941,272 @@ void ConvolveImage(Image_T &Out, const Image_T &In, const KernelImage_T &Kernel)
 	const int wid = In.w(), hgt = In.h();
 	Out.SetSize(wid, hgt);
 
-	// Do top and bottom edges.
-	for(int y=0; y<N2; y++)
-		for(int x=N2; x<wid-N2; x++)
-			Out(x,y) = sample_kernel_weighted(In, Kernel, x, y);
-	for(int y=hgt-N2; y<hgt; y++)
-		for(int x=N2; x<wid-N2; x++)
-			Out(x,y) = sample_kernel_weighted(In, Kernel, x, y);
-
-	// Do left and right edges.
-	for(int y=0; y<hgt; y++) {
-		for(int x=0; x<N2; x++)
-			Out(x,y) = sample_kernel_weighted(In, Kernel, x, y);
-		for(int x=wid-N2; x<wid; x++)
-			Out(x,y) = sample_kernel_weighted(In, Kernel, x, y);
-	}
-
+	// ForEachTile does the edges, where the kernel hangs off the image, with sample_kernel_weighted.
 	if(N == 5)
-		ConvolveMiddleN<Image_T, KernelImage_T, 5>(Out, In, Kernel); // If kernel size is known at compile time.
+		ForEachTile(wid, hgt, N2, ConvolveOp<Image_T, KernelImage_T, 5>(Out, In, Kernel)); // If kernel size is known at compile time.
 	else if(N == 9)
-		ConvolveMiddleN<Image_T, KernelImage_T, 9>(Out, In, Kernel); // If kernel size is known at compile time.
+		ForEachTile(wid, hgt, N2, ConvolveOp<Image_T, KernelImage_T, 9>(Out, In, Kernel)); // If kernel size is known at compile time.
 	else
-		ConvolveMiddle(Out, In, Kernel); // If kernel size is not known at compile time.
+		ForEachTile(wid, hgt, N2, ConvolveOp<Image_T, KernelImage_T, 0>(Out, In, Kernel)); // If kernel size is not known at compile time.
+}
+
+template void ConvolveImage(f1Image &Out, const f1Image &In, const f1Image &Kernel);
+template void ConvolveImage(f3Image &Out, const f3Image &In, const f1Image &Kernel);
+
+// Each band of output rows is convolved from a window of input rows that reaches N/2 rows past it.
+// The bands are done by the same tile operators as the in-memory version, so the results are the same.
+template <class Image_T, class KernelImage_T>
+void ConvolveImage(ImageWriter &Out, ImageReader &In, const KernelImage_T &Kernel)
+{
+	typedef RowWindow<Image_T> Win_T;
+	const int N = Kernel.w();
+	const int N2 = N/2;
+	ASSERT_R((N & 1) && N >= 3); // Filter must be an odd width so it can center on a pixel.
+	const int wid = In.w(), hgt = In.h();
+	ASSERT_R(Out.w() == wid && Out.h() == hgt);
+
+	const int B = DMC_TILE_SIZE;
+	ReaderSource<Image_T> Reader(In);
+	RowBuffer<Image_T> InRows(wid, hgt);
+	Image_T OutRows(wid, B);
+
+	for(int y0=0; y0<hgt; y0+=B) {
+		const int y1 = std::min(y0 + B, hgt);
+		InRows.Slide(Reader, std::max(y0 - N2, 0), std::min(y1 + N2, hgt));
+
+		Win_T InW = InRows.Window(), OutW(OutRows.pp(), wid, hgt, y0, y1);
+		if(N == 5)
+			ForEachTileRows(wid, hgt, N2, ConvolveOp<Win_T, KernelImage_T, 5>(OutW, InW, Kernel), y0, y1);
+		else if(N == 9)
+			ForEachTileRows(wid, hgt, N2, ConvolveOp<Win_T, KernelImage_T, 9>(OutW, InW, Kernel), y0, y1);
+		else
+			ForEachTileRows(wid, hgt, N2, ConvolveOp<Win_T, KernelImage_T, 0>(OutW, InW, Kernel), y0, y1);
+
+		Out.WriteRows(OutRows, y1 - y0);
+	}
 }
 
+template void ConvolveImage<f1Image>(ImageWriter &Out, ImageReader &In, const f1Image &Kernel);
+template void ConvolveImage<f3Image>(ImageWriter &Out, ImageReader &In, const f1Image &Kernel);
+
+namespace {
+	// Make a normalized 1D gaussian kernel of width N with standard deviation sigma.
+	// MakeGaussianKernel() is the outer product of this with itself, so blurring the rows and then the columns
+	// with it gives the same result as ConvolveImage() with the 2D kernel. That's true at the edges, too,
+	// since the taps that fall inside the image are a rectangle, so their weights factor the same way.
+	template <class El_T>
+	std::vector<El_T> MakeGaussianKernel1D(const int N, const El_T sigma)
+	{
+		std::vector<El_T> K(N);
+		const int N2 = N/2;
+		El_T Sum = 0;
+
+		for(int x=-N2; x<=N2; x++) {
+			K[x+N2] = static_cast<El_T>(Gaussian(x, sigma));
+			Sum += K[x+N2];
+		}
+
+		for(int i=0; i<N; i++)
+			K[i] /= Sum;
+
+		return K;
+	}
+
+	// Blur each row of wid pixels of C elements with the 1D kernel.
+	// The taps of a pixel are C elements apart, so the middle of the row is one loop over all its elements
+	// per tap, which the compiler vectorizes. Near the ends, divide by the sum of the taps inside the row.
+	template <class El_T>
+	void ConvolveRows1D(El_T *Out, const El_T *In, const int wid, const int hgt, const int C, const std::vector<El_T> &K)
+	{
+		const int N = (int)K.size();
+		const int N2 = N/2;
+		const int rowels = wid * C;
+		const int midlo = min(N2, wid), midhi = max(wid-N2, midlo);
+
+		for(int y=0; y<hgt; y++) {
+			const El_T *InR = In + y*rowels;
+			El_T *OutR = Out + y*rowels;
+
+			// Do the ends.
+			for(int x=0; x<wid; x++) {
+				if(x == midlo) x = midhi;
+				if(x >= wid) break;
+
+				int kl = max(0, N2-x), kh = min(N-1, N2+wid-1-x);
+				El_T weight = 0;
+				for(int c=0; c<C; c++)
+					OutR[x*C+c] = 0;
+				for(int k=kl; k<=kh; k++) {
+					weight += K[k];
+					for(int c=0; c<C; c++)
+						OutR[x*C+c] += K[k] * InR[(x+k-N2)*C+c];
+				}
+				for(int c=0; c<C; c++)
+					OutR[x*C+c] /= weight;
+			}
+
+			// Do the middle.
+			const int ilo = midlo*C, ihi = midhi*C;
+			for(int i=ilo; i<ihi; i++)
+				OutR[i] = K[0] * InR[i-N2*C];
+			for(int k=1; k<N; k++) {
+				const El_T Kk = K[k];
+				const El_T *InK = InR + (k-N2)*C;
+				for(int i=ilo; i<ihi; i++)
+					OutR[i] += Kk * InK[i];
+			}
+		}
+	}
+
+	// Blur the columns of an image of hgt rows of rowels elements with the 1D kernel.
+	// Each tap adds a whole row to the output row, which vectorizes. The rows are done in strips
+	// so the N input rows of a strip stay in cache while they're reused for the next output row.
+	template <class El_T>
+	void ConvolveColumns1D(El_T *Out, const El_T *In, const int rowels, const int hgt, const std::vector<El_T> &K)
+	{
+		const int N = (int)K.size();
+		const int N2 = N/2;
+		const int STRIP = 1024;
+
+		for(int i0=0; i0<rowels; i0+=STRIP) {
+			const int i1 = min(i0+STRIP, rowels);
+
+			for(int y=0; y<hgt; y++) {
+				int kl = max(0, N2-y), kh = min(N-1, N2+hgt-1-y);
+				El_T *OutR = Out + y*rowels;
+
+				El_T weight = 0;
+				for(int k=kl; k<=kh; k++)
+					weight += K[k];
+				const El_T invWeight = El_T(1) / weight;
+
+				const El_T *InK = In + (y+kl-N2)*rowels;
+				El_T Kk = K[kl] * invWeight;
+				for(int i=i0; i<i1; i++)
+					OutR[i] = Kk * InK[i];
+				for(int k=kl+1; k<=kh; k++) {
+					InK = In + (y+k-N2)*rowels;
+					Kk = K[k] * invWeight;
+					for(int i=i0; i<i1; i++)
+						OutR[i] += Kk * InK[i];
+				}
+			}
+		}
+	}
+
+	// Coefficients of the recursive gaussian of Young and van Vliet, "Recursive implementation of the
+	// Gaussian filter", Signal Processing 44, 1995. They are divided by b0.
+	template <class El_T>
+	struct RecursiveGaussian
+	{
+		El_T B, b1, b2, b3;
+
+		RecursiveGaussian(const double sigma)
+		{
+			double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * sqrt(1.0 - 0.26891 * sigma);
+			double q2 = q*q, q3 = q2*q;
+			double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+			b1 = El_T((2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0);
+			b2 = El_T(-(1.4281 * q2 + 1.26661 * q3) / b0);
+			b3 = El_T(0.422205 * q3 / b0);
+			B = El_T(1) - (b1 + b2 + b3);
+		}
+
+		// Filter the columns of hgt rows of rowels elements in place, forward and then backward.
+		// The pad rows after the image must be zero on input. They hold the tail of the forward pass so the backward
+		// pass sees what's past the edge. Each step updates a whole row from the three before it, which vectorizes.
+		void Columns(El_T *D, const int rowels, const int hgt, const int pad) const
+		{
+			const int n = hgt + pad;
+
+			for(int y=0; y<n; y++) {
+				El_T *R = D + y*rowels;
+				const El_T *R1 = y>0 ? R - rowels : NULL, *R2 = y>1 ? R - 2*rowels : NULL, *R3 = y>2 ? R - 3*rowels : NULL;
+				if(y > 2) {
+					for(int i=0; i<rowels; i++)
+						R[i] = B * R[i] + b1 * R1[i] + b2 * R2[i] + b3 * R3[i];
+				} else {
+					for(int i=0; i<rowels; i++)
+						R[i] = B * R[i] + (R1 ? b1 * R1[i] : 0) + (R2 ? b2 * R2[i] : 0);
+				}
+			}
+
+			for(int y=n-1; y>=0; y--) {
+				El_T *R = D + y*rowels;
+				const El_T *R1 = y<n-1 ? R + rowels : NULL, *R2 = y<n-2 ? R + 2*rowels : NULL, *R3 = y<n-3 ? R + 3*rowels : NULL;
+				if(y < n-3) {
+					for(int i=0; i<rowels; i++)
+						R[i] = B * R[i] + b1 * R1[i] + b2 * R2[i] + b3 * R3[i];
+				} else {
+					for(int i=0; i<rowels; i++)
+						R[i] = B * R[i] + (R1 ? b1 * R1[i] : 0) + (R2 ? b2 * R2[i] : 0);
+				}
+			}
+		}
+
+		// The response at each of hgt positions to an input that is one inside the image and zero outside.
+		// Dividing by it gives the edges the same meaning as the convolution: the weights inside the image sum to one.
+		std::vector<El_T> EdgeWeights(const int hgt, const int pad) const
+		{
+			std::vector<El_T> W(hgt + pad, El_T(0));
+			for(int y=0; y<hgt; y++)
+				W[y] = 1;
+			Columns(&W[0], 1, hgt, pad);
+			W.resize(hgt);
+			return W;
+		}
+	};
+
+	// Transpose an image of hgt rows of wid pixels of C elements into one of wid rows of hgt pixels.
+	// The tiles keep both the reads and the writes in cache.
+	template <class El_T>
+	void TransposePixels(El_T *Out, const El_T *In, const int wid, const int hgt, const int C)
+	{
+		const int TILE = 32;
+		for(int y0=0; y0<hgt; y0+=TILE) {
+			const int y1 = min(y0+TILE, hgt);
+			for(int x0=0; x0<wid; x0+=TILE) {
+				const int x1 = min(x0+TILE, wid);
+				for(int x=x0; x<x1; x++)
+					for(int y=y0; y<y1; y++)
+						for(int c=0; c<C; c++)
+							Out[(x*hgt+y)*C+c] = In[(y*wid+x)*C+c];
+			}
+		}
+	}
+
+	// Blur the columns with the recursive gaussian, then transpose, blur the columns again, and transpose back.
+	// Buf has room for pad rows after the image, either way around.
+	template <class El_T>
+	void RecursiveBlur(El_T *Out, const El_T *In, const int wid, const int hgt, const int C, const El_T sigma, const int pad)
+	{
+		RecursiveGaussian<El_T> G(sigma);
+		const int npix = wid * hgt;
+		std::vector<El_T> Buf((npix + pad * max(wid, hgt)) * C, El_T(0));
+		std::vector<El_T> BufT(Buf.size(), El_T(0));
+
+		std::copy(In, In + npix * C, Buf.begin());
+		G.Columns(&Buf[0], wid*C, hgt, pad);
+		std::vector<El_T> Wy = G.EdgeWeights(hgt, pad);
+		for(int y=0; y<hgt; y++) {
+			const El_T s = El_T(1) / Wy[y];
+			for(int i=y*wid*C; i<(y+1)*wid*C; i++)
+				Buf[i] *= s;
+		}
+
+		TransposePixels(&BufT[0], &Buf[0], wid, hgt, C);
+		G.Columns(&BufT[0], hgt*C, wid, pad);
+		std::vector<El_T> Wx = G.EdgeWeights(wid, pad);
+		for(int x=0; x<wid; x++) {
+			const El_T s = El_T(1) / Wx[x];
+			for(int i=x*hgt*C; i<(x+1)*hgt*C; i++)
+				BufT[i] *= s;
+		}
+
+		TransposePixels(Out, &BufT[0], hgt, wid, C);
+	}
+};
+
 // FiltWid x FiltWid gaussian blur for any image type.
 // FiltWid must be odd.
 template <class Image_T>
@@ -634,13 +1214,32 @@ void GaussianBlur(Image_T &Out, const Image_T &In, const int FiltWid, const type
 {
 	ASSERT_R((FiltWid & 1) && FiltWid >= 3); // Filter must be an odd width so it can center on a pixel.
 
-	typedef tPixel<typename Image_T::PixType::ElType, 1> KernelPixelType;
-	typedef tImage<KernelPixelType> KernelImageType;
+	typedef typename Image_T::PixType::ElType El_T;
+	const int C = Image_T::PixType::Chan;
+	const int wid = In.w(), hgt = In.h();
+	Out.SetSize(wid, hgt);
+	if(wid <= 0 || hgt <= 0)
+		return;
+
+	const El_T *InP = (const El_T *)In.pv();
+	El_T *OutP = (El_T *)Out.pv();
+
+	// The recursive filter costs the same for any width, but is only a close approximation, and can't be truncated.
+	// Use it when the kernel is big and reaches out past three sigma, so truncating wouldn't matter anyway.
+	if(FiltWid >= 15 && stdev >= 2.5 && FiltWid >= 6 * stdev) {
+		RecursiveBlur(OutP, InP, wid, hgt, C, El_T(stdev), FiltWid/2);
+		return;
+	}
 
-	KernelImageType Kernel = MakeGaussianKernel<KernelImageType>(FiltWid, stdev);
+	// Otherwise blur the rows and then the columns, which costs 2 * FiltWid instead of FiltWid^2 per pixel.
+	std::vector<El_T> K = MakeGaussianKernel1D<El_T>(FiltWid, El_T(stdev));
+	std::vector<El_T> Tmp(wid * hgt * C);
 
-	ConvolveImage(Out, In, Kernel);
+	ConvolveRows1D(&Tmp[0], InP, wid, hgt, C, K);
+	ConvolveColumns1D(OutP, &Tmp[0], wid * C, hgt, K);
 }
 
 template void GaussianBlur<f1Image>(f1Image &Out, const f1Image &In, const int FiltWid, float stdev);
 template void GaussianBlur<f3Image>(f3Image &Out, const f3Image &In, const int FiltWid, float stdev);
+
+template f1Image MakeGaussianKernel<f1Image>(const int N, float sigma); // For VCD()
@@ -10,6 +10,9 @@
 
 #include <vector>
 
+class ImageReader;
+class ImageWriter;
+
 // Cheezy box filter for MIP level generation, etc.
 template <class Image_T>
 void Downsample2x2(Image_T &Out, const Image_T &Img);
@@ -19,6 +22,12 @@ void Downsample2x2(Image_T &Out, const Image_T &Img);
 template <class Image_T>
 void Downsample(Image_T &Out, const Image_T &Img, const int w1, const int h1);
 
+// Downsample the image being read from In to w1 x h1 and write it to Out, keeping only a few rows of each in memory.
+// The rows are done in Image_T's pixel type and give the same result as the in-memory version.
+// Call it as Downsample<f3Image>(Out, In, w1, h1). Out must be w1 x h1.
+template <class Image_T>
+void Downsample(ImageWriter &Out, ImageReader &In, const int w1, const int h1);
+
 // Bi-cubic resampling to arbitrary size.
 // Works well for upsampling and downsampling by a factor less than two.
 // Doesn't work for downsampling by a factor bigger than two.
@@ -30,6 +39,11 @@ void Resample4(Image_T &Out, const Image_T &Img, const int w, const int h);
 template<class OutImage_T, class InImage_T>
 void ToneMapLinear(OutImage_T &Out, const InImage_T &Img, const typename InImage_T::PixType::ElType Scale, const typename InImage_T::PixType::ElType Bias);
 
+// Tone map the image being read from In and write it to Out a band of rows at a time.
+// Call it as ToneMapLinear<uc3Image, f3Image>(Out, In, Scale, Bias).
+template<class OutImage_T, class InImage_T>
+void ToneMapLinear(ImageWriter &Out, ImageReader &In, const typename InImage_T::PixType::ElType Scale, const typename InImage_T::PixType::ElType Bias);
+
 // Map a float image to an unsigned char image, given the extrema that map to 0..255.
 template<class OutImage_T, class InImage_T>
 void ToneMapExtrema(OutImage_T &Out, const InImage_T &Img, const typename InImage_T::PixType &MinP, const typename InImage_T::PixType &MaxP);
@@ -83,8 +97,14 @@ KernelImage_T MakeGaussianKernel(const int N, const typename KernelImage_T::PixT
 template <class Image_T, class KernelImage_T>
 void ConvolveImage(Image_T &Out, const Image_T &In, const KernelImage_T &Kernel);
 
+// Convolve the image being read from In and write it to Out, keeping only the rows under the kernel in memory.
+// Gives the same result as the in-memory version. Call it as ConvolveImage<f3Image>(Out, In, Kernel).
+template <class Image_T, class KernelImage_T>
+void ConvolveImage(ImageWriter &Out, ImageReader &In, const KernelImage_T &Kernel);
+
 // FiltWid x FiltWid gaussian blur for any image type.
-// FiltWid must be odd.
+// FiltWid must be odd. Blurs the rows and then the columns. Wide kernels that reach past
+// three standard deviations use a recursive filter that costs the same for any width.
 template <class Image_T>
 void GaussianBlur(Image_T &Out, const Image_T &In, const int FiltWid, const typename Image_T::PixType::MathType stdev);
 
@@ -93,6 +113,12 @@ void GaussianBlur(Image_T &Out, const Image_T &In, const int FiltWid, const type
 template <class Image_T>
 void VCD(Image_T &Out, const Image_T &In, const int FiltWid, const typename Image_T::PixType::MathType ImageStDev, const typename Image_T::PixType::MathType ColorStDev, const int iterations = 1);
 
+// Approximately the same as VCD() with a kernel wide enough for the whole gaussian, but the cost doesn't depend on its width.
+// Uses a permutohedral lattice in (x, y, color). Quality is on (0, 1]. 1 is the most accurate; smaller makes the lattice
+// coarser, which is faster. Only for float images.
+template <class Image_T>
+void VCDLattice(Image_T &Out, const Image_T &In, const typename Image_T::PixType::MathType ImageStDev, const typename Image_T::PixType::MathType ColorStDev, const int iterations = 1, const float Quality = 1.0f);
+
 // Any pixel in SrcIm not equal to Key gets copied to DstIm.
 // Copies a rectangle from SrcIm of size bwid x bhgt with upper-right
 // corner srcx,srcy to upper-right corner dstx,dsty in DstIm.
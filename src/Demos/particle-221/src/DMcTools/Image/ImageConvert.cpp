@@ -0,0 +1,252 @@
+//////////////////////////////////////////////////////////////////////
+// ImageConvert.cpp - Fast conversion of images between pixel types, and channel swizzles
+//
+// Copyright David K. McAllister, 2008.
+
+#include "Image/ImageConvert.h"
+
+#include <algorithm>
+#include <cstring>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef DMC_USE_F16C
+#include <immintrin.h>
+#endif
+
+namespace {
+    const size_t CONVERT_CHUNK_SIZE = 1 << 16; // Pixels per parallel chunk. Smaller images are done in one thread.
+
+    // Each kernel converts n elements, where an element is a channel, or a whole pixel for RGBE.
+    typedef void (*ConvertKernel_t)(void *D, const void *S, const int n);
+
+    void UCharToFloat(void *D, const void *S, const int n) { RowUCharToFloat((float *)D, (const unsigned char *)S, n); }
+    void FloatToUChar(void *D, const void *S, const int n) { RowFloatToUChar((unsigned char *)D, (const float *)S, 1.0f, 0.0f, n); }
+    void UShortToFloat(void *D, const void *S, const int n) { RowUShortToFloat((float *)D, (const unsigned short *)S, n); }
+    void FloatToUShort(void *D, const void *S, const int n) { RowFloatToUShort((unsigned short *)D, (const float *)S, n); }
+
+#ifdef DMC_USE_HALF_FLOAT
+    // These use the tables in the half class, as channel_cast does. With F16C they do eight at a time instead,
+    // except for the groups of eight that have a value that the instructions treat differently from the half class.
+    void HalfToFloat(void *D, const void *S, const int n)
+    {
+        float *Dp = (float *)D;
+        const half *Sp = (const half *)S;
+        int i = 0;
+#ifdef DMC_USE_F16C
+        // F16C makes signaling NaNs quiet, so leave infinities and NaNs to the tables.
+        const __m128i ExpMask = _mm_set1_epi16(0x7c00);
+        for(; i+8<=n; i+=8) {
+            const __m128i h = _mm_loadu_si128((const __m128i *)(Sp+i));
+            if(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(h, ExpMask), ExpMask)))
+                for(int k=0; k<8; k++)
+                    Dp[i+k] = float(Sp[i+k]);
+            else
+                _mm256_storeu_ps(Dp+i, _mm256_cvtph_ps(h));
+        }
+#endif
+        for(; i<n; i++)
+            Dp[i] = float(Sp[i]);
+    }
+
+#ifdef DMC_USE_F16C
+    // Four floats to halfs the way half(float) does, or false if one of them needs the half class.
+    // half(float) rounds halfway up, not to even, so add half a unit in the last place to the bits and truncate.
+    // This is only the same for +0 and the floats from HALF_NRM_MIN up to 32768, which can't round up to infinity.
+    // Outside that, half(float) drops the sign of -0, and differs from F16C in rounding denormals and in NaNs.
+    DMC_INLINE bool FloatsToHalfs(__m128i &H, const float *Sp)
+    {
+        const __m128i b = _mm_castps_si128(_mm_loadu_ps(Sp));
+        const __m128i e = _mm_and_si128(_mm_srli_epi32(b, 23), _mm_set1_epi32(0xff));
+        const __m128i Normal = _mm_and_si128(_mm_cmpgt_epi32(e, _mm_set1_epi32(127-15)), _mm_cmplt_epi32(e, _mm_set1_epi32(127+15)));
+        if(_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(Normal, _mm_cmpeq_epi32(b, _mm_setzero_si128())))) != 0xf)
+            return false;
+        const __m128i r = _mm_add_epi32(b, _mm_and_si128(Normal, _mm_set1_epi32(0x1000)));
+        H = _mm_cvtps_ph(_mm_castsi128_ps(r), _MM_FROUND_TO_ZERO);
+        return true;
+    }
+#endif
+
+    void FloatToHalf(void *D, const void *S, const int n)
+    {
+        half *Dp = (half *)D;
+        const float *Sp = (const float *)S;
+        int i = 0;
+#ifdef DMC_USE_F16C
+        for(; i+8<=n; i+=8) {
+            __m128i lo, hi;
+            if(FloatsToHalfs(lo, Sp+i) && FloatsToHalfs(hi, Sp+i+4))
+                _mm_storeu_si128((__m128i *)(Dp+i), _mm_unpacklo_epi64(lo, hi));
+            else
+                for(int k=0; k<8; k++)
+                    Dp[i+k] = half(Sp[i+k]);
+        }
+#endif
+        for(; i<n; i++)
+            Dp[i] = half(Sp[i]);
+    }
+#endif
+
+    // The float that each RGBE exponent byte scales the mantissas by, so decoding doesn't call ldexp().
+    struct RGBEScaleTable
+    {
+        float Scale[256];
+        RGBEScaleTable()
+        {
+            Scale[0] = 0.0f;
+            for(int e=1; e<256; e++)
+                Scale[e] = (float)ldexp(1.0, e - (128+8));
+        }
+    } RGBEScales;
+
+    void RGBEToFloat(void *D, const void *S, const int n) { RGBEToFloatRow((float *)D, (const unsigned char *)S, n); }
+    void FloatToRGBE(void *D, const void *S, const int n) { FloatToRGBERow((unsigned char *)D, (const float *)S, n); }
+
+    struct ConvertEntry
+    {
+        const std::type_info &Dst, &Src;
+        size_t DstSize, SrcSize; // Bytes per pixel
+        int Elems; // Kernel elements per pixel
+        ConvertKernel_t Kernel;
+    };
+
+#define CONVERT_ENTRY(D, S, Els, K) { typeid(D), typeid(S), sizeof(D), sizeof(S), Els, K }
+#define CONVERT_CHANNELS(DEl, SEl, K) \
+    CONVERT_ENTRY(tPixel<DEl COMMA 1>, tPixel<SEl COMMA 1>, 1, K), \
+    CONVERT_ENTRY(tPixel<DEl COMMA 2>, tPixel<SEl COMMA 2>, 2, K), \
+    CONVERT_ENTRY(tPixel<DEl COMMA 3>, tPixel<SEl COMMA 3>, 3, K), \
+    CONVERT_ENTRY(tPixel<DEl COMMA 4>, tPixel<SEl COMMA 4>, 4, K)
+#define COMMA ,
+
+    const ConvertEntry ConvertTable[] = {
+        CONVERT_CHANNELS(float, unsigned char, UCharToFloat),
+        CONVERT_CHANNELS(unsigned char, float, FloatToUChar),
+        CONVERT_CHANNELS(float, unsigned short, UShortToFloat),
+        CONVERT_CHANNELS(unsigned short, float, FloatToUShort),
+#ifdef DMC_USE_HALF_FLOAT
+        CONVERT_CHANNELS(float, half, HalfToFloat),
+        CONVERT_CHANNELS(half, float, FloatToHalf),
+#endif
+        CONVERT_ENTRY(f3Pixel, rgbePixel, 1, RGBEToFloat),
+        CONVERT_ENTRY(rgbePixel, f3Pixel, 1, FloatToRGBE)
+    };
+
+#undef COMMA
+#undef CONVERT_CHANNELS
+#undef CONVERT_ENTRY
+};
+
+// The zero scale of exponent 0 gives its zero pixel.
+void RGBEToFloatRow(float *D, const unsigned char *S, const int n)
+{
+    int i = 0;
+#ifdef DMC_USE_SSE
+    // Four pixels at a time. Each pixel's store writes a fourth float that the next pixel's store overwrites,
+    // so the last pixel of the row is left for the scalar loop.
+    const __m128i Z = _mm_setzero_si128();
+    const __m128 Half = _mm_set1_ps(0.5f);
+    for(; i+5<=n; i+=4) {
+        const __m128i b = _mm_loadu_si128((const __m128i *)(S+i*4));
+        const __m128i lo = _mm_unpacklo_epi8(b, Z), hi = _mm_unpackhi_epi8(b, Z);
+        const unsigned char *Sp = S+i*4;
+        _mm_storeu_ps(D+i*3, _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, Z)), Half), _mm_set1_ps(RGBEScales.Scale[Sp[3]])));
+        _mm_storeu_ps(D+i*3+3, _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, Z)), Half), _mm_set1_ps(RGBEScales.Scale[Sp[7]])));
+        _mm_storeu_ps(D+i*3+6, _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, Z)), Half), _mm_set1_ps(RGBEScales.Scale[Sp[11]])));
+        _mm_storeu_ps(D+i*3+9, _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, Z)), Half), _mm_set1_ps(RGBEScales.Scale[Sp[15]])));
+    }
+#endif
+    for(; i<n; i++) {
+        const unsigned char *Sp = S+i*4;
+        const float f = RGBEScales.Scale[Sp[3]];
+        D[i*3+0] = (Sp[0] + 0.5f) * f;
+        D[i*3+1] = (Sp[1] + 0.5f) * f;
+        D[i*3+2] = (Sp[2] + 0.5f) * f;
+    }
+}
+
+// The mantissa and exponent that frexp() would return come from the bits of the float.
+void FloatToRGBERow(unsigned char *Dp, const float *Sp, const int n)
+{
+    for(int i=0; i<n; i++, Dp+=4, Sp+=3) {
+        const float maxc = std::max(std::max(Sp[0], Sp[1]), Sp[2]);
+        if(maxc <= 1e-32) {
+            Dp[0] = Dp[1] = Dp[2] = Dp[3] = 0;
+            continue;
+        }
+
+        unsigned int bits;
+        memcpy(&bits, &maxc, sizeof(bits));
+        const unsigned int bexp = (bits >> 23) & 0xff;
+        if(bexp == 0xff) { // Inf or NaN
+            const rgbePixel P(f3Pixel(Sp[0], Sp[1], Sp[2]));
+            memcpy(Dp, &P, 4);
+            continue;
+        }
+
+        // maxc is positive and normal, so frexp() would give the mantissa bits with an exponent of -1.
+        bits = (bits & 0x007fffff) | (126u << 23);
+        float mant;
+        memcpy(&mant, &bits, sizeof(mant));
+        const float val = mant * 255.9999 / maxc;
+
+        Dp[0] = (unsigned char)(Sp[0] * val);
+        Dp[1] = (unsigned char)(Sp[1] * val);
+        Dp[2] = (unsigned char)(Sp[2] * val);
+        Dp[3] = (unsigned char)(int(bexp) - 126 + 128);
+    }
+}
+
+bool ConvertPixelsFast(void *Dst, const std::type_info &DstType, const void *Src, const std::type_info &SrcType, const size_t n,
+                       const bool Parallel)
+{
+    const ConvertEntry *E = NULL;
+    for(size_t k=0; k<sizeof(ConvertTable) / sizeof(ConvertTable[0]); k++) {
+        if(ConvertTable[k].Dst == DstType && ConvertTable[k].Src == SrcType) {
+            E = &ConvertTable[k];
+            break;
+        }
+    }
+    if(E == NULL)
+        return false;
+
+    const int NumChunks = int((n + CONVERT_CHUNK_SIZE - 1) / CONVERT_CHUNK_SIZE);
+#pragma omp parallel for schedule(static) if(Parallel && NumChunks > 1)
+    for(int c=0; c<NumChunks; c++) {
+        const size_t i0 = c * CONVERT_CHUNK_SIZE, i1 = std::min(n, i0 + CONVERT_CHUNK_SIZE);
+        E->Kernel((char *)Dst + i0 * E->DstSize, (const char *)Src + i0 * E->SrcSize, int((i1 - i0) * E->Elems));
+    }
+
+    return true;
+}
+
+template<class Image_T>
+void SwizzleChannels(Image_T &Img, const int *Order)
+{
+    typedef typename Image_T::PixType PixType;
+    const int Chan = PixType::Chan;
+    for(int c=0; c<Chan; c++)
+        ASSERT_R(Order[c] >= 0 && Order[c] < Chan);
+
+    PixType *P = Img.pp();
+    const int n = Img.size();
+#pragma omp parallel for schedule(static) if(size_t(n) > CONVERT_CHUNK_SIZE)
+    for(int i=0; i<n; i++) {
+        const PixType p = P[i];
+        for(int c=0; c<Chan; c++)
+            P[i][c] = p[Order[c]];
+    }
+}
+
+template void SwizzleChannels(uc3Image &Img, const int *Order);
+template void SwizzleChannels(uc4Image &Img, const int *Order);
+template void SwizzleChannels(us3Image &Img, const int *Order);
+template void SwizzleChannels(us4Image &Img, const int *Order);
+#ifdef DMC_USE_HALF_FLOAT
+template void SwizzleChannels(h3Image &Img, const int *Order);
+template void SwizzleChannels(h4Image &Img, const int *Order);
+#endif
+template void SwizzleChannels(f3Image &Img, const int *Order);
+template void SwizzleChannels(f4Image &Img, const int *Order);
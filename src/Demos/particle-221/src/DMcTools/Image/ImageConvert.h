@@ -0,0 +1,36 @@
+//////////////////////////////////////////////////////////////////////
+// ImageConvert.h - Fast conversion of images between pixel types, and channel swizzles
+//
+// Copyright David K. McAllister, 2008.
+
+// Converting an image to another pixel type with the tImage copy constructor or operator= first looks for the pair
+// of pixel types in the table of kernels in ImageConvert.cpp, using ConvertPixelsFast(), which is declared in tImage.h.
+// The table has each number of channels of unsigned char, unsigned short, and half to and from float, and RGBE to and
+// from f3. These run over a whole span of channels at once, in parallel, and give exactly the same pixels as the
+// generic per-pixel conversion, which the other pairs still use.
+
+#ifndef dmc_ImageConvert_h
+#define dmc_ImageConvert_h
+
+#include "Image/tImage.h"
+
+// Convert Src to Dst's pixel type, like Dst = Src does, but optionally without using more than one thread.
+template<class DstImage_T, class SrcImage_T>
+void ConvertImage(DstImage_T &Dst, const SrcImage_T &Src, const bool Parallel = true)
+{
+    typedef typename DstImage_T::PixType DstPix_T;
+    typedef typename SrcImage_T::PixType SrcPix_T;
+
+    Dst.SetSize(Src.w(), Src.h());
+    if(ConvertPixelsFast(Dst.pp(), typeid(DstPix_T), Src.pp(), typeid(SrcPix_T), Src.size(), Parallel))
+        return;
+    for(int i=0; i<Src.size(); i++)
+        Dst[i] = static_cast<DstPix_T>(Src[i]);
+}
+
+// Reorder the channels of each pixel in place. Channel c becomes what was channel Order[c], so {2,1,0} swaps RGB and BGR.
+// Order has one entry for each channel of the pixel type. An entry can be repeated to copy one channel to several.
+template<class Image_T>
+void SwizzleChannels(Image_T &Img, const int *Order);
+
+#endif
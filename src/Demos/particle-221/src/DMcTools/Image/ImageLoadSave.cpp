@@ -24,8 +24,10 @@
 // If a converted image was created, it is deleted.
 
 #include "Image/ImageLoadSave.h"
+#include "Image/ImageStream.h"
 #include "Image/tImage.h"
 #include "Image/RGBEio.h"
+#include "Util/MappedFile.h"
 #include "Util/Utils.h"
 
 #include "tiffio.h"
@@ -43,6 +45,9 @@ extern "C" {
 
 #include <fstream>
 #include <string>
+#include <vector>
+#include <cstring>
+#include <cctype>
 using namespace std;
 
 #define RAS_MAGIC 0x59a66a95
@@ -352,39 +357,70 @@ void ImageLoadSave::LoadRas(const char *fname)
 //////////////////////////////////////////////////////
 // PPM File Format
 
+namespace {
+    // Skip whitespace and # comments in a PPM header.
+    const unsigned char *SkipPPMSpace(const unsigned char *p, const unsigned char *end)
+    {
+        while(p < end) {
+            if(*p == '#') {
+                const unsigned char *eol = p;
+                while(eol < end && *eol != '\n') eol++;
+                if(Verbose) cerr << string((const char *)p, (const char *)eol) << endl;
+                p = eol;
+            } else if(isspace(*p))
+                p++;
+            else
+                break;
+        }
+        return p;
+    }
+
+    // Read a decimal number from a PPM header.
+    const unsigned char *GetPPMInt(const unsigned char *p, const unsigned char *end, int &v, const char *fname)
+    {
+        p = SkipPPMSpace(p, end);
+        if(p >= end || !isdigit(*p)) throw DMcError("Bad PPM header: " + string(fname));
+        v = 0;
+        while(p < end && isdigit(*p))
+            v = v * 10 + (*p++ - '0');
+        return p;
+    }
+
+    // Copy n elements of ElSize bytes from src to dest, reversing the bytes of each.
+    void CopySwapped(unsigned char *dest, const unsigned char *src, const int n, const int ElSize)
+    {
+        for(int i=0; i<n; i++, dest += ElSize, src += ElSize)
+            for(int b=0; b<ElSize; b++)
+                dest[b] = src[ElSize-1-b];
+    }
+};
+
 // PAM is four-channel PPM. PFM is one- or three-channel float. PGM is one-channel uchar.
-void ImageLoadSave::LoadPPM(const char *fname)
+size_t ImageLoadSave::ParsePPM(const unsigned char *Data, const unsigned char *End, const DMCINT64 FileSize, const char *fname)
 {
-    ifstream InFile(fname, ios::in | ios::binary);
-    if(!InFile.is_open()) throw DMcError("Could not open file for LoadPPM: " + string(fname));
+    const unsigned char *p = Data, *end = End;
 
-    char Magic1, Magic2;
-    InFile >> Magic1 >> Magic2;
+    p = SkipPPMSpace(p, end);
+    char Magic1 = p < end ? *p++ : 0;
+    char Magic2 = p < end ? *p++ : 0;
 
     if(Magic1!='P' || (Magic2!='5' && Magic2!='6' && Magic2!='7' &&
         Magic2!='8' && Magic2!='Z' && Magic2!='S' && Magic2!='T' && Magic2!='U' && Magic2!='V')) {
-            InFile.close();
             throw DMcError("Not a known PPM file: " + string(fname));
     }
 
-    InFile.get();
-    char c = InFile.peek();
-    while(c=='#') {
-        char line[999];
-        InFile.getline(line, 1000);
-        if(Verbose) cerr << line << endl;
-        c = InFile.peek();
-    }
-
     int dyn_range;
-    InFile >> wid >> hgt >> dyn_range;
-    InFile.get();
+    p = GetPPMInt(p, end, wid, fname);
+    p = GetPPMInt(p, end, hgt, fname);
+    p = GetPPMInt(p, end, dyn_range, fname);
+    p++; // The one whitespace character before the pixels.
 
     if(dyn_range != 255) throw DMcError("PPM Must be 255.");
 
     // XXX Need to distinguish one-channel float images.
     is_uint = false;
     is_float = false;
+    is_ushort = false;
     switch(Magic2) {
     case '5':
         chan = 1;
@@ -413,19 +449,30 @@ void ImageLoadSave::LoadPPM(const char *fname)
         break;
     }
 
-    Pix = ImageAlloc();
-    InFile.read((char *)Pix, size_bytes());
+    const DMCINT64 bytes = (DMCINT64)wid * hgt * chan * ((is_uint || is_float) ? 4 : is_ushort ? 2 : 1);
+    if(p > end || FileSize - (p - Data) < bytes) throw DMcError("PPM file is truncated: " + string(fname));
 
-    InFile.close();
+    return size_t(p - Data);
+}
+
+// The file is mapped, and the pixels are copied from it into the tImage in one pass.
+void ImageLoadSave::LoadPPM(const char *fname)
+{
+    MappedFile File(fname);
+    const unsigned char *src = File.data() + ParsePPM(File.data(), File.end(), File.size(), fname);
+
+    Pix = ImageAlloc();
 
 #ifdef DMC_LITTLE_ENDIAN
     // Intel is little-endian.
     // Always assume they are stored as big-endian.
     if(is_uint || is_float)
-        ConvertLong((unsigned int *)Pix, size()*chan);
-    if(is_ushort)
-        ConvertShort((unsigned short *)Pix, size()*chan);
+        CopySwapped(Pix, src, size()*chan, 4);
+    else if(is_ushort)
+        CopySwapped(Pix, src, size()*chan, 2);
+    else
 #endif
+        memcpy(Pix, src, size_bytes());
 
     if(Verbose) cerr << "Loaded a PPM image.\n";
 }
@@ -472,6 +519,93 @@ void ImageLoadSave::SavePPM(const char *fname) const
     if(Verbose) cerr << "Wrote PPM file " << fname << endl;
 }
 
+namespace {
+    // Reads each band of rows straight out of the file.
+    class PPMReader : public ImageReader
+    {
+        StreamFile File;
+        DMCINT64 Pixels; // The offset of the first pixel
+        int ElSize;
+        vector<unsigned char> Tmp;
+
+    public:
+        PPMReader(const char *fname) : File(fname)
+        {
+            ImageLoadSave Header;
+            const unsigned char *End, *Data = File.Window(0, StreamFile::HEADER_BYTES, End);
+            Pixels = Header.ParsePPM(Data, End, File.size(), fname);
+            wid = Header.wid; hgt = Header.hgt; chan = Header.chan;
+            is_uint = Header.is_uint; is_ushort = Header.is_ushort; is_float = Header.is_float;
+            ElSize = (is_uint || is_float) ? 4 : is_ushort ? 2 : 1;
+        }
+
+        void ReadRaw(unsigned char *Rows, const int n)
+        {
+            const size_t rowels = size_t(wid) * chan, bytes = n * rowels * ElSize;
+            const DMCINT64 Off = Pixels + (DMCINT64)yNext * rowels * ElSize;
+#ifdef DMC_LITTLE_ENDIAN
+            if(ElSize > 1) {
+                Tmp.resize(bytes);
+                File.Read(&Tmp[0], bytes, Off);
+                CopySwapped(Rows, &Tmp[0], int(n * rowels), ElSize);
+            } else
+#endif
+                File.Read(Rows, bytes, Off);
+        }
+    };
+
+    class PPMWriter : public ImageWriter
+    {
+        FILE *fp;
+        int ElSize;
+        vector<unsigned char> Tmp;
+
+    public:
+        PPMWriter(const char *fname, const int w, const int h, const int ch, const bool is_uint_, const bool is_ushort_, const bool is_float_)
+        {
+            wid = w; hgt = h; chan = ch;
+            is_uint = is_uint_; is_ushort = is_ushort_; is_float = is_float_;
+            ElSize = (is_uint || is_float) ? 4 : is_ushort ? 2 : 1;
+
+            fp = fopen(fname, "wb");
+            if(fp == NULL) throw DMcError("Could not open file for PPMWriter: " + string(fname));
+
+            // The same header as SavePPM().
+            char Magic2 = is_ushort ? char('S' + chan - 1) : (chan==1 ? (is_float?'Z':'5') : (chan==3 ? (is_float?'7':'6') : '8'));
+            fprintf(fp, "P%c\n%d %d\n255\n", Magic2, wid, hgt);
+        }
+
+        ~PPMWriter()
+        {
+            fclose(fp);
+        }
+
+        void WriteRaw(const unsigned char *Rows, const int n)
+        {
+            const size_t bytes = size_t(n) * wid * chan * ElSize;
+#ifdef DMC_LITTLE_ENDIAN
+            // Multibyte words are stored big-endian.
+            if(ElSize > 1) {
+                Tmp.resize(bytes);
+                CopySwapped(&Tmp[0], Rows, n * wid * chan, ElSize);
+                Rows = &Tmp[0];
+            }
+#endif
+            if(fwrite(Rows, 1, bytes, fp) != bytes) throw DMcError("PPMWriter: write failed.");
+        }
+    };
+};
+
+ImageReader *OpenPPMReader(const char *fname)
+{
+    return new PPMReader(fname);
+}
+
+ImageWriter *OpenPPMWriter(const char *fname, const int w, const int h, const int chan, const bool is_uint, const bool is_ushort, const bool is_float)
+{
+    return new PPMWriter(fname, w, h, chan, is_uint, is_ushort, is_float);
+}
+
 //////////////////////////////////////////////////////
 // SGI Iris RGB Images
 
@@ -853,6 +987,120 @@ void ImageLoadSave::SaveTIFF(const char *fname) const
     TIFFClose(tif);
 }
 
+namespace {
+    // Reads one scanline at a time with TIFFReadScanline, so the strips must hold interleaved channels.
+    // Unlike LoadTIFF(), the rows keep the file's channels and element type instead of becoming RGBA.
+    class TIFFReader : public ImageReader
+    {
+        TIFF *tif;
+
+    public:
+        TIFFReader(const char *fname)
+        {
+            TIFFSetErrorHandler(TiffErrHand);
+
+            tif = TIFFOpen(fname, "r");
+            if(!tif) throw DMcError("Could not open TIFF file '" + string(fname) + "'.");
+
+            uint32 w = 0, h = 0;
+            uint16 spp = 1, bps = 8, planar = PLANARCONFIG_CONTIG, fmt = SAMPLEFORMAT_UINT;
+            TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
+            TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h);
+            TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+            TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bps);
+            TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planar);
+            TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &fmt);
+
+            wid = w; hgt = h; chan = spp;
+            is_ushort = bps == 16;
+            is_float = bps == 32 && fmt == SAMPLEFORMAT_IEEEFP;
+            is_uint = bps == 32 && !is_float;
+
+            if(planar != PLANARCONFIG_CONTIG || chan < 1 || chan > 4 || (bps != 8 && bps != 16 && bps != 32) ||
+                (is_float && chan != 1 && chan != 3) || (is_uint && chan != 1)) {
+                    TIFFClose(tif);
+                    throw DMcError("Can't read this TIFF file a few rows at a time: '" + string(fname) + "'");
+            }
+        }
+
+        ~TIFFReader()
+        {
+            TIFFClose(tif);
+        }
+
+        void ReadRaw(unsigned char *Rows, const int n)
+        {
+            const size_t rowbytes = TIFFScanlineSize(tif);
+            for(int y=0; y<n; y++)
+                if(TIFFReadScanline(tif, Rows + y * rowbytes, yNext + y, 0) < 0)
+                    throw DMcError("TIFFReadScanline failed.");
+        }
+    };
+
+    // The same tags as SaveTIFF().
+    class TIFFWriter : public ImageWriter
+    {
+        TIFF *tif;
+
+    public:
+        TIFFWriter(const char *fname, const int w, const int h, const int ch, const bool is_uint_, const bool is_ushort_, const bool is_float_)
+        {
+            wid = w; hgt = h; chan = ch;
+            is_uint = is_uint_; is_ushort = is_ushort_; is_float = is_float_;
+
+            TIFFSetErrorHandler(TiffErrHand);
+
+            tif = TIFFOpen(fname, "w");
+            if(tif==NULL) throw DMcError("TIFFOpen failed: " + string(fname));
+
+            int bitsperchan = 8;
+            if(is_float || is_uint) bitsperchan = 32;
+            else if(is_ushort) bitsperchan = 16;
+
+            TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, wid);
+            TIFFSetField(tif, TIFFTAG_IMAGELENGTH, hgt);
+            TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bitsperchan);
+            TIFFSetField(tif, TIFFTAG_COMPRESSION, LEMPELZIV);
+            TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, (chan > 2) ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK);
+            TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, chan);
+            TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+            TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+            TIFFSetField(tif, TIFFTAG_XRESOLUTION, 96.0);
+            TIFFSetField(tif, TIFFTAG_YRESOLUTION, 96.0);
+            TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, 2);
+            TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
+            if(is_float)
+                TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
+            uint16 extyp = EXTRASAMPLE_ASSOCALPHA;
+            if(chan==2 || chan==4)
+                TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &extyp);
+        }
+
+        ~TIFFWriter()
+        {
+            TIFFClose(tif);
+        }
+
+        void WriteRaw(const unsigned char *Rows, const int n)
+        {
+            const size_t rowbytes = size_t(wid) * chan * ((is_float || is_uint) ? 4 : is_ushort ? 2 : 1);
+            for(int y=0; y<n; y++)
+                if(TIFFWriteScanline(tif, (void *)(Rows + y * rowbytes), yNext + y, 0) < 0)
+                    throw DMcError("TIFFWriteScanline failed.");
+        }
+    };
+};
+
+ImageReader *OpenTIFFReader(const char *fname)
+{
+    return new TIFFReader(fname);
+}
+
+ImageWriter *OpenTIFFWriter(const char *fname, const int w, const int h, const int chan, const bool is_uint, const bool is_ushort, const bool is_float)
+{
+    return new TIFFWriter(fname, w, h, chan, is_uint, is_ushort, is_float);
+}
+
 #else /* DMC_USE_TIFF */
 
 void ImageLoadSave::LoadTIFF(const char *fname)
@@ -865,6 +1113,16 @@ void ImageLoadSave::SaveTIFF(const char *fname) const
     throw DMcError("TIFF Support not compiled in.");
 }
 
+ImageReader *OpenTIFFReader(const char *fname)
+{
+    throw DMcError("TIFF Support not compiled in.");
+}
+
+ImageWriter *OpenTIFFWriter(const char *fname, const int w, const int h, const int chan, const bool is_uint, const bool is_ushort, const bool is_float)
+{
+    throw DMcError("TIFF Support not compiled in.");
+}
+
 #endif /* DMC_USE_TIFF */
 
 //////////////////////////////////////////////////////
@@ -1130,6 +1388,154 @@ void ImageLoadSave::SavePNG(const char *fname) const
     fclose(fp);
 }
 
+namespace {
+    // Reads a row at a time with png_read_row(), with the same transformations as LoadPNG().
+    // Interlaced images have to be read whole, so they throw.
+    class PNGReader : public ImageReader
+    {
+        FILE *fp;
+        png_structp png_ptr;
+        png_infop info_ptr;
+        string fname;
+
+    public:
+        PNGReader(const char *fname_) : fp(NULL), png_ptr(NULL), info_ptr(NULL), fname(fname_)
+        {
+            if((fp = fopen(fname_, "rb"))==NULL) throw DMcError(fname + " can't open PNG file");
+            unsigned char buf[4];
+            if(fread(buf, 1, 4, fp) != 4 || png_sig_cmp(buf, 0, 4)) {
+                fclose(fp);
+                throw DMcError(fname + " is not a PNG file.");
+            }
+
+            png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, NULL, NULL);
+            if(png_ptr)
+                info_ptr = png_create_info_struct(png_ptr);
+            if(!png_ptr || !info_ptr) {
+                png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
+                fclose(fp);
+                throw DMcError(fname + " PNG info_ptr failed.");
+            }
+
+            if(setjmp(png_jmpbuf(png_ptr))) {
+                png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+                fclose(fp);
+                throw DMcError(fname + " PNG file read failed.");
+            }
+
+            png_init_io(png_ptr, fp);
+            png_set_sig_bytes(png_ptr, 4);
+            png_read_info(png_ptr, info_ptr);
+
+            if(png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE) {
+                png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+                fclose(fp);
+                throw DMcError("Can't read an interlaced PNG a few rows at a time: '" + fname + "'");
+            }
+
+            if(png_get_color_type(png_ptr, info_ptr)==PNG_COLOR_TYPE_PALETTE || png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+                png_set_expand(png_ptr);
+            png_set_strip_16(png_ptr);
+            png_set_packing(png_ptr);
+
+            double gamma;
+            if(png_get_gAMA(png_ptr, info_ptr, &gamma))
+                png_set_gamma(png_ptr, guess_display_gamma(), gamma);
+
+            // Let the transformations decide the number of channels.
+            png_read_update_info(png_ptr, info_ptr);
+
+            wid = png_get_image_width(png_ptr, info_ptr);
+            hgt = png_get_image_height(png_ptr, info_ptr);
+            chan = png_get_channels(png_ptr, info_ptr);
+        }
+
+        ~PNGReader()
+        {
+            png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+            fclose(fp);
+        }
+
+        void ReadRaw(unsigned char *Rows, const int n)
+        {
+            if(setjmp(png_jmpbuf(png_ptr)))
+                throw DMcError(fname + " PNG file read failed.");
+
+            for(int y=0; y<n; y++)
+                png_read_row(png_ptr, Rows + size_t(y) * wid * chan, NULL);
+        }
+    };
+
+    // The same options as SavePNG().
+    class PNGWriter : public ImageWriter
+    {
+        FILE *fp;
+        png_structp png_ptr;
+        png_infop info_ptr;
+
+    public:
+        PNGWriter(const char *fname, const int w, const int h, const int ch) : fp(NULL), png_ptr(NULL), info_ptr(NULL)
+        {
+            wid = w; hgt = h; chan = ch;
+
+            if((fp = fopen(fname, "wb"))==NULL) throw DMcError("PNGWriter failed: can't write to " + string(fname));
+
+            png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+            if(png_ptr)
+                info_ptr = png_create_info_struct(png_ptr);
+            if(!png_ptr || !info_ptr) {
+                png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
+                fclose(fp);
+                throw DMcError("PNGWriter: info_ptr failure");
+            }
+
+            if(setjmp(png_jmpbuf(png_ptr))) {
+                png_destroy_write_struct(&png_ptr, &info_ptr);
+                fclose(fp);
+                throw DMcError("PNGWriter: setjmp failure");
+            }
+
+            png_init_io(png_ptr, fp);
+
+            int chan2color_type[] =
+            { 0, PNG_COLOR_TYPE_GRAY, PNG_COLOR_TYPE_GRAY_ALPHA,
+            PNG_COLOR_TYPE_RGB, PNG_COLOR_TYPE_RGB_ALPHA
+            };
+            png_set_IHDR(png_ptr, info_ptr, wid, hgt, 8, chan2color_type[chan],
+                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+            png_write_info(png_ptr, info_ptr);
+        }
+
+        ~PNGWriter()
+        {
+            // Finish the file only if it's complete. Otherwise libpng complains.
+            if(!setjmp(png_jmpbuf(png_ptr)) && yNext == hgt)
+                png_write_end(png_ptr, info_ptr);
+            png_destroy_write_struct(&png_ptr, &info_ptr);
+            fclose(fp);
+        }
+
+        void WriteRaw(const unsigned char *Rows, const int n)
+        {
+            if(setjmp(png_jmpbuf(png_ptr)))
+                throw DMcError("PNGWriter: write failed");
+
+            for(int y=0; y<n; y++)
+                png_write_row(png_ptr, (png_bytep)(Rows + size_t(y) * wid * chan));
+        }
+    };
+};
+
+ImageReader *OpenPNGReader(const char *fname)
+{
+    return new PNGReader(fname);
+}
+
+ImageWriter *OpenPNGWriter(const char *fname, const int w, const int h, const int chan)
+{
+    return new PNGWriter(fname, w, h, chan);
+}
+
 #else /* DMC_USE_PNG */
 
 void ImageLoadSave::LoadPNG(const char *fname)
@@ -1142,6 +1548,16 @@ void ImageLoadSave::SavePNG(const char *fname) const
     throw DMcError("PNG Support not compiled in.");
 }
 
+ImageReader *OpenPNGReader(const char *fname)
+{
+    throw DMcError("PNG Support not compiled in.");
+}
+
+ImageWriter *OpenPNGWriter(const char *fname, const int w, const int h, const int chan)
+{
+    throw DMcError("PNG Support not compiled in.");
+}
+
 #endif /* DMC_USE_PNG */
 
 //////////////////////////////////////////////////////
@@ -1246,53 +1662,69 @@ void ImageLoadSave::SaveMAT(const char *fname) const
 
 // Currently this loads and saves f3Images, not rgbeImages.
 // I will add this later.
-void ImageLoadSave::LoadRGBE(const char* fname)
+
+size_t ImageLoadSave::ParseRGBE(const unsigned char *Data, const unsigned char *End, const char *fname, float &exposure)
 {
-    FILE *filep = fopen(fname, "rb");
-    if(filep == NULL) throw DMcError("LoadRGBE: Unable to load HDR: " + string(fname));
+    const unsigned char *src = Data, *end = End;
 
-    int i, j, row;
-    float exposure;
+    /* The header is lines of text ending with a blank line. */
+    exposure = 1.0f;
+    for(int l=0; ; l++) {
+        const unsigned char *eol = src;
+        while(eol < end && *eol != '\n') eol++;
+        if(eol >= end) throw DMcError("LoadRGBE: Not a HDR file: " + string(fname));
 
-    /*a very basic RADIANCE pic file header */
-    char line[1000];
-    fgets(line, 1000, filep);
-    if(!strcmp(line, "#?RADIANCE")) throw DMcError("LoadRGBE: Not a HDR file: " + string(fname));
+        string line((const char *)src, (const char *)eol);
+        src = eol + 1;
 
-    fgets(line, 1000, filep);
-    fgets(line, 1000, filep);
-    fscanf(filep, "EXPOSURE=%f\n", &exposure);
+        if(l == 0 && line.compare(0, 2, "#?")) throw DMcError("LoadRGBE: Not a HDR file: " + string(fname));
+        if(line.empty()) break;
+        if(isexpos(line.c_str())) exposure *= float(exposval(line.c_str()));
+    }
     if(Verbose) cerr << "Reading HDR file with exposure " << exposure << endl;
-    //fgets(line, 1000, filep);
-    fscanf(filep, "-Y %d +X %d\n", &hgt, &wid);
+
+    /* Then the resolution line. */
+    const unsigned char *eol = src;
+    while(eol < end && *eol != '\n') eol++;
+    if(eol >= end || sscanf(string((const char *)src, (const char *)eol).c_str(), "-Y %d +X %d", &hgt, &wid) != 2)
+        throw DMcError("LoadRGBE: Bad resolution line: " + string(fname));
+    src = eol + 1;
+
     if(Verbose) cerr << wid << "x" << hgt << endl;
     is_uint = false;
+    is_ushort = false;
     is_float = true;
     chan = 3;
-    Pix = ImageAlloc();
 
-    RGBE *helpit = new RGBE[wid];
+    return size_t(src - Data);
+}
 
-    /*Allocate enough space for one row of COLOR at a time */
-    COLOR* oneRow = (COLOR*)malloc(sizeof(COLOR)*wid);
+// The file is mapped, and each scanline is decoded straight into its row of the image.
+void ImageLoadSave::LoadRGBE(const char* fname)
+{
+    MappedFile File(fname);
+    float exposure;
+    const unsigned char *src = File.data() + ParseRGBE(File.data(), File.end(), fname, exposure), *end = File.end();
+
+    Pix = ImageAlloc();
+
+    RGBE *helpit = new RGBE[SCANSCRATCH(wid)];
 
     float invexp = 1.0f / exposure;
 
     /* Convert RGBE representation to float,float,float representation */
-    int k=0;
     float *P = (float *)Pix;
-    for (row=0;row<hgt;row++) {
-        freadscan(oneRow, helpit, wid, filep);
-        for(i=0;i<wid;i++) {
-            for(j=0;j<3;j++) {
-                P[k] = oneRow[i][j] * invexp;
-                k++;
-            }
+    for (int row=0;row<hgt;row++) {
+        float *oneRow = &P[row*wid*3];
+        if(mreadscan((COLOR *)oneRow, helpit, wid, src, end) < 0) {
+            delete [] helpit;
+            throw DMcError("LoadRGBE: HDR file is truncated: " + string(fname));
         }
+        if(invexp != 1.0f)
+            for(int i=0; i<wid*3; i++)
+                oneRow[i] *= invexp;
     }
-    fclose(filep);
 
-    free(oneRow);
     delete [] helpit;
 }
 
@@ -1328,7 +1760,7 @@ void ImageLoadSave::SaveRGBE(const char* fname) const
     fprintf(filep,"\n");
     fprintf(filep,"-Y %d +X %d\n",hgt, wid);
 
-    RGBE *helpit = new RGBE[wid];
+    RGBE *helpit = new RGBE[SCANSCRATCH(wid)];
 
     /* Convert separated channel representation to per pixel representation */
     // int k=0;
@@ -1353,3 +1785,101 @@ void ImageLoadSave::SaveRGBE(const char* fname) const
 
     if(Verbose) cerr << "Wrote out HDR file with exposure " << exposure << endl;
 }
+
+namespace {
+    // Decodes each scanline out of a window on the file.
+    class RGBEReader : public ImageReader
+    {
+        StreamFile File;
+        DMCINT64 Off; // The offset of the next scanline
+        float invexp;
+        RGBE *helpit;
+
+    public:
+        RGBEReader(const char *fname) : File(fname), helpit(NULL)
+        {
+            ImageLoadSave Header;
+            float exposure;
+            const unsigned char *End, *Data = File.Window(0, StreamFile::HEADER_BYTES, End);
+            Off = Header.ParseRGBE(Data, End, fname, exposure);
+            wid = Header.wid; hgt = Header.hgt; chan = Header.chan;
+            is_uint = Header.is_uint; is_ushort = Header.is_ushort; is_float = Header.is_float;
+            invexp = 1.0f / exposure;
+            helpit = new RGBE[SCANSCRATCH(wid)];
+        }
+
+        ~RGBEReader()
+        {
+            delete [] helpit;
+        }
+
+        void ReadRaw(unsigned char *Rows, const int n)
+        {
+            for(int y=0; y<n; y++) {
+                float *oneRow = (float *)Rows + size_t(y) * wid * 3;
+
+                // A scanline is usually smaller than a flat one, but if it runs off the window, get a bigger one.
+                for(size_t Need = size_t(wid) * 4 + 64; ; Need *= 2) {
+                    const unsigned char *End, *p = File.Window(Off, Need, End), *src = p;
+                    if(mreadscan((COLOR *)oneRow, helpit, wid, src, End) >= 0) {
+                        Off += src - p;
+                        break;
+                    }
+                    if(size_t(End - p) < Need)
+                        throw DMcError("RGBEReader: HDR file is truncated.");
+                }
+                if(invexp != 1.0f)
+                    for(int i=0; i<wid*3; i++)
+                        oneRow[i] *= invexp;
+            }
+        }
+    };
+
+    // The same header as SaveRGBE().
+    class RGBEWriter : public ImageWriter
+    {
+        FILE *filep;
+        RGBE *helpit;
+
+    public:
+        RGBEWriter(const char *fname, const int w, const int h)
+        {
+            wid = w; hgt = h; chan = 3;
+            is_float = true;
+
+            filep = fopen(fname, "wb");
+            if(filep == NULL) throw DMcError("RGBEWriter: Unable to save HDR: " + string(fname));
+            helpit = new RGBE[SCANSCRATCH(wid)];
+
+            fprintf(filep,"#?RADIANCE\n");
+            fprintf(filep,"# %s\n","no comment");
+            fprintf(filep,"FORMAT=32-bit_rle_rgbe\n");
+            fprintf(filep,"EXPOSURE=%25.13f\n",DMcExposureGlobal);
+            fprintf(filep,"\n");
+            fprintf(filep,"-Y %d +X %d\n",hgt, wid);
+        }
+
+        ~RGBEWriter()
+        {
+            fclose(filep);
+            delete [] helpit;
+        }
+
+        void WriteRaw(const unsigned char *Rows, const int n)
+        {
+            for(int y=0; y<n; y++)
+                if(fwritescan((COLOR *)((const float *)Rows + size_t(y) * wid * 3), helpit, wid, filep) < 0)
+                    throw DMcError("RGBEWriter: write failed.");
+        }
+    };
+};
+
+ImageReader *OpenRGBEReader(const char *fname)
+{
+    return new RGBEReader(fname);
+}
+
+ImageWriter *OpenRGBEWriter(const char *fname, const int w, const int h)
+{
+    return new RGBEWriter(fname, w, h);
+}
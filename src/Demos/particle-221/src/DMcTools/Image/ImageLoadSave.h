@@ -9,6 +9,10 @@
 #include "Util/Assert.h"
 #include "Image/tImage.h"
 
+#include <vector>
+
+class MappedFile;
+
 const int BMP_ = 0x00706d62; // "bmp\0", etc.
 const int GIF_ = 0x00666967;
 const int HDR_ = 0x00726468;
@@ -78,6 +82,18 @@ public:
     void Load(const char *fname);
     void Save(const char *fname) const;
 
+    // Parse the header of a binary PGM, PPM, PAM, PFM, or PSM file. Data to End is the start of the file,
+    // enough of it to hold the header, and FileSize is the size of the whole file.
+    // Sets wid, hgt, chan, and the is_*, and returns the offset of the first pixel in the file.
+    size_t ParsePPM(const unsigned char *Data, const unsigned char *End, const DMCINT64 FileSize, const char *fname);
+
+    // Parse the header of an HDR file, which starts with Data to End.
+    // Sets wid, hgt, chan, the is_*, and exposure, and returns the offset of the first scanline in the file.
+    size_t ParseRGBE(const unsigned char *Data, const unsigned char *End, const char *fname, float &exposure);
+
+    // Called by Load*() and the image streams. It creates a tImage that matches the is_* and chan args. Stores the pointer to the tImage in baseImg.
+    unsigned char *ImageAlloc();
+
 private:
     void LoadBMP(const char *fname);                                                                                    
     void LoadGIF(const char *fname, bool WantPaletteInds = false); // If true, returns one channel image. No palette.   
@@ -99,9 +115,35 @@ private:
     void SaveRGBE(const char *fname) const;                                                                             
     void SaveTGA(const char *fname) const;                                                                              
     void SaveTIFF(const char *fname) const;                                                                             
+};
 
-    // Called by Load*(). It creates a tImage that matches the is_* and chan args. Stores the pointer to the tImage in baseImg.
-    unsigned char *ImageAlloc();
+// A read-only view of an image file whose pixels are mapped into memory instead of read and copied.
+// This only works when the file stores its pixels exactly like Image_T does: binary PGM, PPM, and PAM
+// files viewed as a uc1Image, uc3Image, and uc4Image. Other files are loaded into the image as usual.
+// Either way, Img() is the image. It's only valid while the MappedImage exists.
+// Writing to the pixels of a mapped image crashes.
+template<class Image_T>
+class MappedImage
+{
+    MappedFile *File; // NULL if the file was loaded, not mapped.
+    Image_T Image;
+
+    // Not copyable.
+    MappedImage(const MappedImage &);
+    MappedImage &operator=(const MappedImage &);
+
+public:
+    // Throws a DMcError on error.
+    MappedImage(const char *fname);
+    ~MappedImage();
+
+    const Image_T &Img() const { return Image; }
+    bool IsMapped() const { return File != NULL; }
 };
 
+// Save the frames as an animated GIF that loops forever, showing each frame for DelayCentiSec hundredths of a second.
+// The frames must all be the same size. Each gets its own color map of up to MaxColorsWanted colors.
+// The frames are quantized and compressed in parallel. Throws a DMcError on error.
+void SaveGIFAnimation(const char *fname, const std::vector<uc3Image *> &Frames, const int DelayCentiSec = 4, const int MaxColorsWanted = 256);
+
 #endif
@@ -0,0 +1,337 @@
+//////////////////////////////////////////////////////////////////////
+// ImagePyramid.cpp - Build all the MIP levels of an image at once.
+//
+// Copyright David K. McAllister, 2008.
+
+#include "Image/ImagePyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <typeinfo>
+
+using namespace std;
+
+void PyramidLayout::Set(const int wid, const int hgt, const bool RoundUp, const int MaxLevels)
+{
+    ASSERT_R(wid > 0 && hgt > 0);
+
+    W.clear();
+    H.clear();
+    Offset.clear();
+
+    int w = wid, h = hgt;
+    size_t Ofs = 0;
+    while(true) {
+        W.push_back(w);
+        H.push_back(h);
+        Offset.push_back(Ofs);
+        Ofs += size_t(w) * h;
+
+        if((w == 1 && h == 1) || (MaxLevels > 0 && NumLevels() >= MaxLevels))
+            break;
+
+        w = RoundUp ? (w + 1) >> 1 : std::max(w >> 1, 1);
+        h = RoundUp ? (h + 1) >> 1 : std::max(h >> 1, 1);
+    }
+    Offset.push_back(Ofs);
+}
+
+namespace {
+    const int MIN_PARALLEL_FLOATS = 1 << 14; // Smaller levels than this aren't worth starting threads for.
+
+    float Sinc(const float x)
+    {
+        if(fabsf(x) < 1e-6f)
+            return 1.0f;
+        const float px = float(M_PI) * x;
+        return sinf(px) / px;
+    }
+
+    // The modified Bessel function of the first kind, for the Kaiser window.
+    float BesselI0(const float x)
+    {
+        float sum = 1.0f, term = 1.0f;
+        const float q = x * x * 0.25f;
+        for(int k=1; k<25 && term > sum * 1e-8f; k++) {
+            term *= q / float(k * k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    // The filters, in units of output pixels.
+    const float WINDOW_RADIUS = 3.0f;
+    const float KAISER_ALPHA = 4.0f;
+
+    float KaiserFilter(const float x)
+    {
+        const float t = x / WINDOW_RADIUS;
+        if(t <= -1.0f || t >= 1.0f)
+            return 0.0f;
+        return Sinc(x) * BesselI0(KAISER_ALPHA * sqrtf(1.0f - t * t)) / BesselI0(KAISER_ALPHA);
+    }
+
+    float LanczosFilter(const float x)
+    {
+        if(x <= -WINDOW_RADIUS || x >= WINDOW_RADIUS)
+            return 0.0f;
+        return Sinc(x) * Sinc(x / WINDOW_RADIUS);
+    }
+
+    // The taps that make each pixel of a row of n1 from a row of n0. Every output pixel has NumTaps of them.
+    // The indices are clamped to the row, and the weights sum to one.
+    struct FilterTaps
+    {
+        int NumTaps;
+        vector<int> Ind; // n1 * NumTaps of them
+        vector<float> Wgt;
+
+        FilterTaps(const int n0, const int n1, const PyramidFilter_e Filter)
+        {
+            const float Ratio = float(n0) / float(n1); // Source pixels per output pixel
+            const float Radius = (Filter == PYR_BOX ? 0.5f : WINDOW_RADIUS) * Ratio;
+            const int MaxTaps = int(ceilf(2.0f * Radius)) + 1;
+
+            // Find the taps with nonzero weight under each output pixel.
+            vector<int> First(n1), Count(n1);
+            vector<float> G(size_t(n1) * MaxTaps);
+            NumTaps = 1;
+            for(int x=0; x<n1; x++) {
+                float *g = &G[size_t(x) * MaxTaps];
+                if(n0 == n1) {
+                    First[x] = x;
+                    Count[x] = 1;
+                    g[0] = 1.0f;
+                    continue;
+                }
+
+                const float c = (x + 0.5f) * Ratio; // The center of output pixel x in source coordinates
+                const int i0 = int(floorf(c - Radius));
+                float Sum = 0;
+                int k0 = MaxTaps, k1 = 0;
+                for(int k=0; k<MaxTaps; k++) {
+                    const int i = i0 + k;
+                    if(Filter == PYR_BOX)
+                        g[k] = std::max(0.0f, std::min(float(i + 1), c + Radius) - std::max(float(i), c - Radius)); // Overlap of the pixel and the box
+                    else if(Filter == PYR_KAISER)
+                        g[k] = KaiserFilter((i + 0.5f - c) / Ratio);
+                    else
+                        g[k] = LanczosFilter((i + 0.5f - c) / Ratio);
+                    Sum += g[k];
+                    if(g[k] != 0) {
+                        k0 = std::min(k0, k);
+                        k1 = k + 1;
+                    }
+                }
+
+                ASSERT_R(Sum > 0);
+                for(int k=0; k<MaxTaps; k++)
+                    g[k] /= Sum;
+                First[x] = i0 + k0;
+                Count[x] = k1 - k0;
+                memmove(g, g + k0, (k1 - k0) * sizeof(float));
+                NumTaps = std::max(NumTaps, Count[x]);
+            }
+
+            // Pad them all to NumTaps with zero weights.
+            Ind.resize(size_t(n1) * NumTaps);
+            Wgt.resize(size_t(n1) * NumTaps);
+            for(int x=0; x<n1; x++) {
+                for(int k=0; k<NumTaps; k++) {
+                    Ind[size_t(x) * NumTaps + k] = std::min(std::max(First[x] + std::min(k, Count[x] - 1), 0), n0 - 1);
+                    Wgt[size_t(x) * NumTaps + k] = k < Count[x] ? G[size_t(x) * MaxTaps + k] : 0.0f;
+                }
+            }
+        }
+    };
+
+    // Filter a w0 x h0 image of Chan floats per pixel to w1 x h1. Does the rows and then the columns.
+    void FilterLevel(float *Dst, const float *Src, float *Tmp, const int w0, const int h0, const int w1, const int h1,
+                     const int Chan, const PyramidFilter_e Filter)
+    {
+        const FilterTaps Tx(w0, w1, Filter), Ty(h0, h1, Filter);
+        const int RowFloats0 = w0 * Chan, RowFloats1 = w1 * Chan;
+
+        // Rows: w0 x h0 to w1 x h0 in Tmp.
+#pragma omp parallel for schedule(static) if(w1 * h0 * Chan >= MIN_PARALLEL_FLOATS)
+        for(int y=0; y<h0; y++) {
+            const float *S = Src + size_t(y) * RowFloats0;
+            float *T = Tmp + size_t(y) * RowFloats1;
+            for(int x=0; x<w1; x++) {
+                const int *I = &Tx.Ind[size_t(x) * Tx.NumTaps];
+                const float *G = &Tx.Wgt[size_t(x) * Tx.NumTaps];
+                for(int c=0; c<Chan; c++) {
+                    float Acc = 0;
+                    for(int k=0; k<Tx.NumTaps; k++)
+                        Acc += G[k] * S[I[k] * Chan + c];
+                    T[x * Chan + c] = Acc;
+                }
+            }
+        }
+
+        // Columns: a whole row of Tmp times each tap's weight, so the inner loop is a long multiply-add.
+#pragma omp parallel for schedule(static) if(w1 * h1 * Chan >= MIN_PARALLEL_FLOATS)
+        for(int y=0; y<h1; y++) {
+            const int *I = &Ty.Ind[size_t(y) * Ty.NumTaps];
+            const float *G = &Ty.Wgt[size_t(y) * Ty.NumTaps];
+            float *D = Dst + size_t(y) * RowFloats1;
+
+            const float *T0 = Tmp + size_t(I[0]) * RowFloats1;
+            for(int i=0; i<RowFloats1; i++)
+                D[i] = G[0] * T0[i];
+            for(int k=1; k<Ty.NumTaps; k++) {
+                const float *T = Tmp + size_t(I[k]) * RowFloats1;
+                const float g = G[k];
+                for(int i=0; i<RowFloats1; i++)
+                    D[i] += g * T[i];
+            }
+        }
+    }
+
+    float SRGBToLinear(const float s)
+    {
+        return s <= 0.04045f ? s * (1.0f / 12.92f) : powf((s + 0.055f) * (1.0f / 1.055f), 2.4f);
+    }
+
+    float LinearToSRGB(const float l)
+    {
+        return l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+    }
+
+    // Converts channels between the image's element type and linear float.
+    template<class El_T>
+    struct ChannelConverter
+    {
+        const bool sRGB;
+        const int nColorChans; // The channels after these are alpha, which is always linear.
+        float Dec8[256]; // The linear value of each unsigned char
+        float Thresh8[255]; // The linear value halfway between each unsigned char and the next
+
+        ChannelConverter(const bool sRGB_, const int Chan) : sRGB(sRGB_ && element_traits<El_T>::normalized),
+            nColorChans((Chan == 2 || Chan == 4) ? Chan - 1 : Chan)
+        {
+            for(int i=0; i<256; i++)
+                Dec8[i] = sRGB ? SRGBToLinear(i / 255.0f) : i / 255.0f;
+            for(int i=0; i<255; i++)
+                Thresh8[i] = 0.5f * (Dec8[i] + Dec8[i+1]);
+        }
+
+        float ToFloat(const El_T e, const int c) const
+        {
+            float f;
+            basePixel::channel_cast(f, e);
+            return (sRGB && c < nColorChans) ? SRGBToLinear(f) : f;
+        }
+
+        void FromFloat(El_T &e, float f, const int c) const
+        {
+            if(sRGB && c < nColorChans)
+                f = LinearToSRGB(std::max(f, 0.0f));
+            if(element_traits<El_T>::normalized)
+                f += 0.5f / float(element_traits<El_T>::one()); // Round instead of truncating
+            basePixel::channel_cast(e, f);
+        }
+    };
+
+    // Unsigned char is the common case and is done with tables. The nearest code to a linear
+    // value is found by binary search of the midpoints, which is the exact inverse of Dec8.
+    template<>
+    float ChannelConverter<unsigned char>::ToFloat(const unsigned char e, const int c) const
+    {
+        return c < nColorChans ? Dec8[e] : e * (1.0f / 255.0f);
+    }
+
+    template<>
+    void ChannelConverter<unsigned char>::FromFloat(unsigned char &e, float f, const int c) const
+    {
+        if(c < nColorChans)
+            e = (unsigned char)(upper_bound(Thresh8, Thresh8 + 255, f) - Thresh8);
+        else
+            e = (unsigned char)(std::min(std::max(f, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    // Float is already linear float.
+    template<>
+    float ChannelConverter<float>::ToFloat(const float e, const int c) const
+    {
+        return e;
+    }
+
+    template<>
+    void ChannelConverter<float>::FromFloat(float &e, float f, const int c) const
+    {
+        e = f;
+    }
+};
+
+template<class Image_T>
+void ImagePyramid<Image_T>::Build(const Image_T &Img, const PyramidFilter_e Filter, const bool sRGB, const int MaxLevels)
+{
+    typedef typename PixType::ElType El_T;
+    const int Chan = PixType::Chan;
+
+    if(Img.w() < 1 || Img.h() < 1) throw DMcError("ImagePyramid::Build: Image is empty.");
+
+    delete [] Pix;
+    Pix = NULL;
+    Layout.Set(Img.w(), Img.h(), false, MaxLevels);
+    Pix = new PixType[Layout.size()];
+
+    // Level 0 is the image.
+    std::copy(Img.pp(), Img.pp() + Img.size(), Pix);
+    if(NumLevels() == 1)
+        return;
+
+    // Each level is filtered from the float version of the one above it, not its rounded pixels.
+    // Float images are filtered straight from level 0 instead of a copy of it.
+    const ChannelConverter<El_T> Conv(sRGB, Chan);
+    const bool FloatPix = typeid(El_T) == typeid(float) && sizeof(PixType) == Chan * sizeof(float);
+    vector<float> Cur(FloatPix ? 0 : size_t(Img.size()) * Chan), Next(size_t(w(1)) * h(1) * Chan), Tmp(size_t(w(1)) * h(0) * Chan);
+
+    const int n0 = FloatPix ? 0 : Img.size();
+#pragma omp parallel for schedule(static) if(n0 * Chan >= MIN_PARALLEL_FLOATS)
+    for(int i=0; i<n0; i++)
+        for(int c=0; c<Chan; c++)
+            Cur[size_t(i) * Chan + c] = Conv.ToFloat(Img[i][c], c);
+
+    for(int l=1; l<NumLevels(); l++) {
+        const float *Above = (l == 1 && FloatPix) ? reinterpret_cast<const float *>(Pix) : &Cur[0];
+        FilterLevel(&Next[0], Above, &Tmp[0], w(l-1), h(l-1), w(l), h(l), Chan, Filter);
+
+        PixType *P = Level(l);
+        const int n = w(l) * h(l);
+#pragma omp parallel for schedule(static) if(n * Chan >= MIN_PARALLEL_FLOATS)
+        for(int i=0; i<n; i++)
+            for(int c=0; c<Chan; c++)
+                Conv.FromFloat(P[i][c], Next[size_t(i) * Chan + c], c);
+
+        if(l == 1 && FloatPix)
+            Cur.resize(Next.size());
+        Cur.swap(Next); // Next is now big enough for any level below this.
+    }
+}
+
+template<class Image_T>
+void ImagePyramid<Image_T>::GetLevel(Image_T &Out, const int l) const
+{
+    ASSERT_R(Pix && l >= 0 && l < NumLevels());
+    Out.SetSize(w(l), h(l));
+    std::copy(Level(l), Level(l) + size_t(w(l)) * h(l), Out.pp());
+}
+
+// Instantiations
+template class ImagePyramid<uc1Image>;
+template class ImagePyramid<uc2Image>;
+template class ImagePyramid<uc3Image>;
+template class ImagePyramid<uc4Image>;
+template class ImagePyramid<us1Image>;
+template class ImagePyramid<us3Image>;
+template class ImagePyramid<us4Image>;
+#ifdef DMC_USE_HALF_FLOAT
+template class ImagePyramid<h3Image>;
+template class ImagePyramid<h4Image>;
+#endif
+template class ImagePyramid<f1Image>;
+template class ImagePyramid<f3Image>;
+template class ImagePyramid<f4Image>;
@@ -0,0 +1,84 @@
+//////////////////////////////////////////////////////////////////////
+// ImagePyramid.h - Build all the MIP levels of an image at once.
+//
+// Copyright David K. McAllister, 2008.
+
+// An ImagePyramid holds an image and all of its smaller levels, down to 1x1, in one allocation,
+// so a texture's whole MIP chain can be handed to the graphics API level by level without copying.
+//
+// Each level is half the size of the one above it, rounded down but at least 1, the way OpenGL
+// and Direct3D want them, so images of any size work, not just powers of two. Each level is
+// filtered from the one above it. An odd size shrinks by a little more than two, and the filter
+// is stretched to match, so the levels don't drift.
+//
+// The filtering is done in float. The color channels of 8- and 16-bit images can be sRGB. Then they
+// are made linear before filtering and sRGB again after, which keeps the small levels from getting darker.
+// The alpha channel of 2- and 4-channel images is always linear. The rows of each level are done in parallel.
+
+#ifndef dmc_ImagePyramid_h
+#define dmc_ImagePyramid_h
+
+#include "Image/tImage.h"
+
+#include <vector>
+
+enum PyramidFilter_e {
+    PYR_BOX,     // The average of the pixels under each output pixel. For even sizes it's Downsample2x2().
+    PYR_KAISER,  // Kaiser windowed sinc, three output pixels wide. Sharp, with little ringing. The usual choice for textures.
+    PYR_LANCZOS  // Lanczos-3 windowed sinc. A little sharper than Kaiser and rings a little more.
+};
+
+// The sizes of the levels of a pyramid and where each one starts in its allocation.
+// PullPush() keeps its levels the same way.
+struct PyramidLayout
+{
+    std::vector<int> W, H;
+    std::vector<size_t> Offset; // Of the first pixel of each level. Offset[NumLevels()] is the total.
+
+    // Lay out the levels of a wid x hgt image down to 1x1, or at most MaxLevels of them if it's not 0.
+    // Each level is half the size of the last, rounded down, or rounded up if RoundUp is true.
+    void Set(const int wid, const int hgt, const bool RoundUp = false, const int MaxLevels = 0);
+
+    int NumLevels() const { return int(W.size()); }
+    size_t size() const { return Offset.back(); } // Pixels in all the levels
+};
+
+template<class Image_T>
+class ImagePyramid
+{
+public:
+    typedef typename Image_T::PixType PixType;
+
+    ImagePyramid() : Pix(NULL) {}
+    ~ImagePyramid() { delete [] Pix; }
+
+    // Make Img level 0 and filter the rest of the levels from it. MaxLevels of 0 means down to 1x1.
+    // sRGB says that the color channels are sRGB instead of linear. It's ignored for float images.
+    // Throws a DMcError on error.
+    void Build(const Image_T &Img, const PyramidFilter_e Filter = PYR_KAISER, const bool sRGB = false, const int MaxLevels = 0);
+
+    int NumLevels() const { return Layout.NumLevels(); }
+    int w(const int l) const { ASSERT_D(l>=0 && l<NumLevels()); return Layout.W[l]; }
+    int h(const int l) const { ASSERT_D(l>=0 && l<NumLevels()); return Layout.H[l]; }
+
+    // The w(l) x h(l) pixels of level l. The levels follow one another in one allocation.
+    const PixType *Level(const int l) const { ASSERT_D(l>=0 && l<NumLevels()); return Pix + Layout.Offset[l]; }
+    PixType *Level(const int l) { ASSERT_D(l>=0 && l<NumLevels()); return Pix + Layout.Offset[l]; }
+
+    // The whole allocation, and how many pixels are in it.
+    const PixType *pp() const { return Pix; }
+    size_t size() const { return Pix ? Layout.size() : 0; }
+
+    // Copy level l into Out.
+    void GetLevel(Image_T &Out, const int l) const;
+
+private:
+    PixType *Pix;
+    PyramidLayout Layout;
+
+    // Not copyable.
+    ImagePyramid(const ImagePyramid &);
+    ImagePyramid &operator=(const ImagePyramid &);
+};
+
+#endif
@@ -0,0 +1,355 @@
+//////////////////////////////////////////////////////////////////////
+// ImageStats.cpp - Statistics of each channel of an image in one pass.
+//
+// Copyright David K. McAllister, 2008.
+
+#include "Image/ImageStats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+    const size_t STATS_CHUNK_SIZE = 1 << 16; // Fewer pixels than this per thread aren't worth starting threads for.
+
+    // Maps channel values to unsigned ints whose order is the order of the values, and back.
+    template<class El_T> struct RadixKey;
+
+    template<> struct RadixKey<unsigned char>
+    {
+        enum { BITS = 8 };
+        static bool IsNaN(const unsigned char e) { return false; }
+        static unsigned int Key(const unsigned char e) { return e; }
+        static unsigned char Value(const unsigned int k) { return (unsigned char)k; }
+    };
+
+    template<> struct RadixKey<unsigned short>
+    {
+        enum { BITS = 16 };
+        static bool IsNaN(const unsigned short e) { return false; }
+        static unsigned int Key(const unsigned short e) { return e; }
+        static unsigned short Value(const unsigned int k) { return (unsigned short)k; }
+    };
+
+#ifdef DMC_USE_HALF_FLOAT
+    // Negative values have all their bits flipped so that more negative is smaller; positive ones have the sign bit set.
+    template<> struct RadixKey<half>
+    {
+        enum { BITS = 16 };
+        static bool IsNaN(const half e) { return e.isNan(); }
+        static unsigned int Key(const half e)
+        {
+            const unsigned int b = e.bits();
+            return (b & 0x8000) ? (~b & 0xffff) : (b | 0x8000);
+        }
+        static half Value(const unsigned int k)
+        {
+            half h;
+            h.setBits((unsigned short)((k & 0x8000) ? (k & 0x7fff) : (~k & 0xffff)));
+            return h;
+        }
+    };
+#endif
+
+    template<> struct RadixKey<float>
+    {
+        enum { BITS = 32 };
+        static bool IsNaN(const float e) { return e != e; }
+        static unsigned int Key(const float e)
+        {
+            unsigned int b;
+            memcpy(&b, &e, sizeof(b));
+            return (b & 0x80000000u) ? ~b : (b | 0x80000000u);
+        }
+        static float Value(const unsigned int k)
+        {
+            const unsigned int b = (k & 0x80000000u) ? (k & 0x7fffffffu) : ~k;
+            float e;
+            memcpy(&e, &b, sizeof(e));
+            return e;
+        }
+    };
+
+    // The first level of the radix histogram is the top L1_BITS of the key. The rest are the second level.
+    template<class El_T>
+    struct RadixLevels
+    {
+        enum { L1_BITS = RadixKey<El_T>::BITS < 16 ? RadixKey<El_T>::BITS : 16,
+            SHIFT = RadixKey<El_T>::BITS - L1_BITS };
+    };
+
+    // How many spans to split n pixels into.
+    int NumSpans(const size_t n)
+    {
+        int NumParts = 1;
+#ifdef _OPENMP
+        NumParts = int(std::max(size_t(1), std::min(size_t(omp_get_max_threads()), n / STATS_CHUNK_SIZE)));
+#endif
+        return NumParts;
+    }
+};
+
+template<class Image_T>
+ImageStats<Image_T>::ImageStats(const int NumBuckets, const double HistMin_, const double HistMax_)
+    : NBuckets(NumBuckets), HistMin(HistMin_), HistScale(NumBuckets > 0 ? NumBuckets / (HistMax_ - HistMin_) : 0)
+{
+    ASSERT_R(NumBuckets >= 0 && (NumBuckets == 0 || HistMax_ > HistMin_));
+    Clear();
+}
+
+template<class Image_T>
+void ImageStats<Image_T>::ClearCounts(Counts &C) const
+{
+    const int Chan = PixType::Chan;
+    C.N = 0;
+    C.NaNs.assign(Chan, 0);
+    C.Radix.assign(size_t(Chan) << RadixLevels<ElType>::L1_BITS, 0);
+    C.Hist.assign(size_t(NBuckets + 2) * Chan, 0);
+    C.Sum.assign(Chan, 0);
+    C.LoKey.assign(Chan, numeric_limits<unsigned int>::max());
+    C.HiKey.assign(Chan, 0);
+}
+
+template<class Image_T>
+void ImageStats<Image_T>::Clear()
+{
+    ClearCounts(Total);
+}
+
+// This is the inner loop of everything, so everything about each value is done at once.
+template<class Image_T>
+void ImageStats<Image_T>::AddSpan(Counts &C, const PixType *Pix, const size_t n) const
+{
+    typedef RadixKey<ElType> RK;
+    const int Chan = PixType::Chan, SHIFT = RadixLevels<ElType>::SHIFT, L1_BITS = RadixLevels<ElType>::L1_BITS;
+
+    size_t *Radix = &C.Radix[0];
+    size_t *Hist = NBuckets ? &C.Hist[0] : NULL;
+    const double HistTop = NBuckets + 1;
+    double Sum[PixType::Chan];
+    unsigned int Lo[PixType::Chan], Hi[PixType::Chan];
+    for(int c=0; c<Chan; c++) {
+        Sum[c] = 0;
+        Lo[c] = C.LoKey[c];
+        Hi[c] = C.HiKey[c];
+    }
+
+    for(size_t i=0; i<n; i++) {
+        for(int c=0; c<Chan; c++) {
+            const ElType e = Pix[i][c];
+            if(RK::IsNaN(e)) {
+                C.NaNs[c]++;
+                continue;
+            }
+
+            const unsigned int k = RK::Key(e);
+            Radix[(size_t(c) << L1_BITS) + (k >> SHIFT)]++;
+            Lo[c] = std::min(Lo[c], k);
+            Hi[c] = std::max(Hi[c], k);
+            const double v = double(e);
+            Sum[c] += v;
+
+            // Values below the histogram go in the extra bucket before it, and above it in the one after.
+            if(Hist) {
+                const double b = std::min(std::max((v - HistMin) * HistScale + 1.0, 0.0), HistTop);
+                Hist[size_t(b) * Chan + c]++;
+            }
+        }
+    }
+
+    for(int c=0; c<Chan; c++) {
+        C.Sum[c] += Sum[c];
+        C.LoKey[c] = Lo[c];
+        C.HiKey[c] = Hi[c];
+    }
+    C.N += n;
+}
+
+template<class Image_T>
+void ImageStats<Image_T>::MergeCounts(Counts &C, const Counts &S) const
+{
+    C.N += S.N;
+    for(int c=0; c<PixType::Chan; c++) {
+        C.NaNs[c] += S.NaNs[c];
+        C.Sum[c] += S.Sum[c];
+        C.LoKey[c] = std::min(C.LoKey[c], S.LoKey[c]);
+        C.HiKey[c] = std::max(C.HiKey[c], S.HiKey[c]);
+    }
+    for(size_t i=0; i<C.Radix.size(); i++)
+        C.Radix[i] += S.Radix[i];
+    for(size_t i=0; i<C.Hist.size(); i++)
+        C.Hist[i] += S.Hist[i];
+}
+
+template<class Image_T>
+void ImageStats<Image_T>::Add(const PixType *Pix, const size_t n)
+{
+    const int NumParts = NumSpans(n);
+    if(NumParts == 1) {
+        AddSpan(Total, Pix, n);
+        return;
+    }
+
+    if(int(Parts.size()) < NumParts)
+        Parts.resize(NumParts);
+
+#pragma omp parallel for schedule(static)
+    for(int p=0; p<NumParts; p++) {
+        ClearCounts(Parts[p]);
+        const size_t i0 = n * p / NumParts, i1 = n * (p+1) / NumParts;
+        AddSpan(Parts[p], Pix + i0, i1 - i0);
+    }
+
+    for(int p=0; p<NumParts; p++)
+        MergeCounts(Total, Parts[p]);
+}
+
+template<class Image_T>
+void ImageStats<Image_T>::Merge(const ImageStats &S)
+{
+    ASSERT_R(S.NBuckets == NBuckets && S.HistMin == HistMin && S.HistScale == HistScale);
+    MergeCounts(Total, S.Total);
+}
+
+template<class Image_T>
+typename ImageStats<Image_T>::ElType ImageStats<Image_T>::Min(const int c) const
+{
+    return Count(c) ? RadixKey<ElType>::Value(Total.LoKey[c]) : ElType(0);
+}
+
+template<class Image_T>
+typename ImageStats<Image_T>::ElType ImageStats<Image_T>::Max(const int c) const
+{
+    return Count(c) ? RadixKey<ElType>::Value(Total.HiKey[c]) : ElType(0);
+}
+
+// Find the first-level bucket that the value of rank p * (Count(c)-1) is in, and its rank within the bucket.
+template<class Image_T>
+void ImageStats<Image_T>::FindRank(int &Bucket, size_t &Rank, const float p, const int c) const
+{
+    ASSERT_R(Count(c) > 0 && p >= 0 && p <= 1);
+    const int NumL1 = 1 << RadixLevels<ElType>::L1_BITS;
+    const size_t *R = &Total.Radix[size_t(c) * NumL1];
+
+    Rank = std::min(size_t(double(p) * double(Count(c) - 1) + 0.5), Count(c) - 1);
+    for(Bucket=0; Bucket<NumL1-1 && Rank >= R[Bucket]; Bucket++)
+        Rank -= R[Bucket];
+}
+
+template<class Image_T>
+typename ImageStats<Image_T>::ElType ImageStats<Image_T>::Percentile(const float p, const int c) const
+{
+    if(Count(c) == 0)
+        return ElType(0);
+
+    int Bucket;
+    size_t Rank;
+    FindRank(Bucket, Rank, p, c);
+    const unsigned int k = unsigned(Bucket) << RadixLevels<ElType>::SHIFT;
+
+    return RadixKey<ElType>::Value(std::max(k, Total.LoKey[c])); // The lowest bucket starts at the min.
+}
+
+template<class Image_T>
+void ImageStats<Image_T>::Percentiles(PixType *Out, const float *P, const int nP, const PixType *Pix, const size_t n) const
+{
+    typedef RadixKey<ElType> RK;
+    const int Chan = PixType::Chan, SHIFT = RadixLevels<ElType>::SHIFT;
+    ASSERT_R(n == Count());
+
+    // The first-level bucket of each wanted value. Each different one is a Target, which gets a second-level histogram.
+    vector<int> Which(nP * Chan, -1); // Target of each percentile and channel
+    vector<size_t> Rank(nP * Chan, 0);
+    vector<int> TChan, TBucket;
+    for(int j=0; j<nP; j++) {
+        for(int c=0; c<Chan; c++) {
+            if(Count(c) == 0) {
+                Out[j][c] = ElType(0);
+                continue;
+            }
+
+            int b;
+            FindRank(b, Rank[j * Chan + c], P[j], c);
+            if(SHIFT == 0) {
+                Out[j][c] = RK::Value(unsigned(b));
+                continue;
+            }
+
+            int t = 0;
+            while(t < int(TChan.size()) && !(TChan[t] == c && TBucket[t] == b))
+                t++;
+            if(t == int(TChan.size())) {
+                TChan.push_back(c);
+                TBucket.push_back(b);
+            }
+            Which[j * Chan + c] = t;
+        }
+    }
+
+    const int NumT = int(TChan.size());
+    if(NumT == 0)
+        return;
+
+    // The second pass. Each span counts the low bits of the values in the target buckets.
+    // TargetOf maps each channel's first-level buckets to their targets, so each value is looked at once.
+    const size_t NumL1 = size_t(1) << RadixLevels<ElType>::L1_BITS, NumL2 = size_t(1) << SHIFT;
+    vector<int> TargetOf(NumL1 * Chan, -1);
+    for(int t=0; t<NumT; t++)
+        TargetOf[TChan[t] * NumL1 + TBucket[t]] = t;
+
+    const int NumParts = NumSpans(n);
+    vector<vector<size_t> > L2(NumParts);
+
+#pragma omp parallel for schedule(static)
+    for(int p=0; p<NumParts; p++) {
+        L2[p].assign(NumL2 * NumT, 0);
+        size_t *H = &L2[p][0];
+        const size_t i1 = n * (p+1) / NumParts;
+        for(size_t i=n * p / NumParts; i<i1; i++) {
+            for(int c=0; c<Chan; c++) {
+                const ElType e = Pix[i][c];
+                const unsigned int k = RK::Key(e);
+                const int t = TargetOf[c * NumL1 + (k >> SHIFT)];
+                if(t >= 0 && !RK::IsNaN(e))
+                    H[NumL2 * t + (k & (NumL2 - 1))]++;
+            }
+        }
+    }
+
+    for(int p=1; p<NumParts; p++)
+        for(size_t i=0; i<L2[0].size(); i++)
+            L2[0][i] += L2[p][i];
+
+    for(int j=0; j<nP; j++) {
+        for(int c=0; c<Chan; c++) {
+            const int t = Which[j * Chan + c];
+            if(t < 0)
+                continue;
+
+            const size_t *Ht = &L2[0][NumL2 * t];
+            size_t r = Rank[j * Chan + c];
+            size_t low = 0;
+            for(; low<NumL2-1 && r >= Ht[low]; low++)
+                r -= Ht[low];
+            Out[j][c] = RK::Value((unsigned(TBucket[t]) << SHIFT) | unsigned(low));
+        }
+    }
+}
+
+// Instantiations
+template class ImageStats<uc1Image>;
+template class ImageStats<uc3Image>;
+template class ImageStats<uc4Image>;
+template class ImageStats<us1Image>;
+template class ImageStats<us3Image>;
+#ifdef DMC_USE_HALF_FLOAT
+template class ImageStats<h3Image>;
+#endif
+template class ImageStats<f1Image>;
+template class ImageStats<f3Image>;
+template class ImageStats<f4Image>;
@@ -0,0 +1,91 @@
+//////////////////////////////////////////////////////////////////////
+// ImageStats.h - Statistics of each channel of an image in one pass.
+//
+// Copyright David K. McAllister, 2008.
+
+// ImageStats finds the min, max, mean, a histogram, and percentiles of each channel of an image
+// in one pass over it. The pass is split into spans that are done in parallel, each with its own
+// counts, which are then merged.
+//
+// Percentiles come from a radix histogram of the channel values' bits, which are remapped so that
+// their order is the order of the values. Its first level is the top 16 bits, which is exact for
+// unsigned char, unsigned short, and half channels. For float channels, Percentile() is the bottom
+// of the first level's bucket, and Percentiles() makes a second pass over the pixels that counts the
+// low 16 bits of just the values in the buckets that hold the wanted ranks, which makes it exact.
+//
+// Add() can be called many times, for a band of rows at a time or for several frames of a video.
+// Clear() keeps the memory, so doing a new frame each time doesn't allocate.
+// NaNs are counted but are otherwise left out.
+
+#ifndef dmc_ImageStats_h
+#define dmc_ImageStats_h
+
+#include "Image/tImage.h"
+
+#include <vector>
+
+template<class Image_T>
+class ImageStats
+{
+public:
+    typedef typename Image_T::PixType PixType;
+    typedef typename PixType::ElType ElType;
+
+    // The histogram has NumBuckets buckets for each channel, evenly spaced from HistMin to HistMax,
+    // in the channel's own units, such as 0 to 256 for unsigned char. Values outside that aren't
+    // counted in it. NumBuckets of 0 means no histogram.
+    ImageStats(const int NumBuckets = 0, const double HistMin = 0, const double HistMax = 1);
+
+    // Forget everything that has been added.
+    void Clear();
+
+    // Add n more pixels to the statistics.
+    void Add(const PixType *Pix, const size_t n);
+    void Add(const Image_T &Img) { Add(Img.pp(), Img.size()); }
+
+    // Add what was added to S. S must have the same histogram buckets.
+    void Merge(const ImageStats &S);
+
+    size_t Count() const { return Total.N; } // Pixels added
+    size_t Count(const int c) const { return Total.N - Total.NaNs[c]; } // Values of channel c that aren't NaN
+    size_t NaNCount(const int c) const { return Total.NaNs[c]; }
+
+    // These are 0 for a channel that has no values.
+    ElType Min(const int c) const;
+    ElType Max(const int c) const;
+    double Mean(const int c) const { return Count(c) ? Total.Sum[c] / Count(c) : 0; }
+
+    int NumBuckets() const { return NBuckets; }
+    size_t Histogram(const int b, const int c) const { ASSERT_D(b>=0 && b<NBuckets); return Total.Hist[size_t(b + 1) * PixType::Chan + c]; }
+
+    // The value at fraction p on [0,1] of the way through the sorted values of channel c, from the first level of the
+    // radix histogram. Exact unless the channel is float, when it's the bottom of the bucket that the value is in.
+    ElType Percentile(const float p, const int c) const;
+
+    // The exact values at the nP fractions P of the way through each channel, one pixel of them per fraction.
+    // Pix must be the same pixels that were added, since float channels take a second pass over them.
+    void Percentiles(PixType *Out, const float *P, const int nP, const PixType *Pix, const size_t n) const;
+    void Percentiles(PixType *Out, const float *P, const int nP, const Image_T &Img) const { Percentiles(Out, P, nP, Img.pp(), Img.size()); }
+
+private:
+    // The counts of one span of pixels.
+    struct Counts
+    {
+        size_t N;
+        std::vector<size_t> NaNs, Radix, Hist; // Hist has an extra bucket at each end for the values outside it.
+        std::vector<double> Sum;
+        std::vector<unsigned int> LoKey, HiKey;
+    };
+
+    int NBuckets;
+    double HistMin, HistScale;
+    Counts Total;
+    std::vector<Counts> Parts; // The spans of Add() that are done in parallel. Kept so that they aren't reallocated.
+
+    void ClearCounts(Counts &C) const;
+    void AddSpan(Counts &C, const PixType *Pix, const size_t n) const;
+    void MergeCounts(Counts &C, const Counts &S) const;
+    void FindRank(int &Bucket, size_t &Rank, const float p, const int c) const;
+};
+
+#endif
@@ -0,0 +1,308 @@
+//////////////////////////////////////////////////////////////////////
+// ImageStream.cpp - Read and write images a band of scanlines at a time.
+//
+// Copyright David K. McAllister, 2008.
+
+// The readers and writers of each format are with its loader and saver, in ImageLoadSave.cpp, Bmp.cpp, and Targa.cpp.
+// This file converts rows between their pixel types and chooses a format.
+
+// So that StreamFile can seek past 2GB on 32-bit Unix.
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "Image/ImageStream.h"
+#include "Util/Utils.h"
+
+#include <cstring>
+#include <string>
+using namespace std;
+
+namespace {
+    const size_t READ_AHEAD = 1 << 20; // The least that Window() reads at a time.
+
+    int SeekFile(FILE *fp, const DMCINT64 Off, const int Whence)
+    {
+#ifdef _WIN32
+        return _fseeki64(fp, Off, Whence);
+#else
+        return fseeko(fp, off_t(Off), Whence);
+#endif
+    }
+
+    DMCINT64 TellFile(FILE *fp)
+    {
+#ifdef _WIN32
+        return _ftelli64(fp);
+#else
+        return ftello(fp);
+#endif
+    }
+};
+
+StreamFile::StreamFile(const char *fname)
+{
+    ASSERT_R(fname);
+    fp = fopen(fname, "rb");
+    if(!fp) throw DMcError("Failed to open file '" + string(fname) + "'");
+
+    if(SeekFile(fp, 0, SEEK_END) || (Size = TellFile(fp)) < 0 || SeekFile(fp, 0, SEEK_SET)) {
+        fclose(fp);
+        throw DMcError("Can't read a few rows at a time from a file that can't seek: '" + string(fname) + "'");
+    }
+    Pos = 0;
+    BufOff = 0;
+    BufLen = 0;
+}
+
+StreamFile::~StreamFile()
+{
+    fclose(fp);
+}
+
+void StreamFile::Read(void *Dest, const size_t Bytes, const DMCINT64 Off)
+{
+    if(Off < 0 || Off > Size || Size - Off < (DMCINT64)Bytes) throw DMcError("Image file is truncated.");
+    if(Off != Pos) {
+        if(SeekFile(fp, Off, SEEK_SET)) throw DMcError("Seek failed while reading image file.");
+        Pos = Off;
+    }
+
+    const size_t n = fread(Dest, 1, Bytes, fp);
+    Pos += n;
+    if(n != Bytes) throw DMcError("Image file is truncated.");
+}
+
+const unsigned char *StreamFile::Window(const DMCINT64 Off, const size_t Bytes, const unsigned char *&End)
+{
+    ASSERT_R(Off >= 0 && Off <= Size);
+    const DMCINT64 BufEnd = BufOff + (DMCINT64)BufLen;
+    const size_t Need = size_t(min(Size - Off, (DMCINT64)Bytes));
+
+    if(Off < BufOff || Off + (DMCINT64)Need > BufEnd || Buf.empty()) {
+        // Keep the part of the old window that's in the new one and read the rest.
+        const size_t Want = size_t(min(Size - Off, (DMCINT64)(max(Bytes, READ_AHEAD))));
+        size_t Kept = 0;
+        if(Off >= BufOff && Off < BufEnd) {
+            Kept = size_t(BufEnd - Off);
+            memmove(&Buf[0], &Buf[size_t(Off - BufOff)], Kept);
+        }
+        if(Buf.size() <= Want)
+            Buf.resize(Want + 1); // One more so that an empty window still has an address.
+        BufOff = Off;
+        BufLen = Kept;
+        Read(&Buf[Kept], Want - Kept, Off + (DMCINT64)Kept);
+        BufLen = Want;
+    }
+
+    const unsigned char *p = &Buf[0] + size_t(Off - BufOff);
+    End = &Buf[0] + BufLen;
+    return p;
+}
+
+namespace {
+    // Whether the pixels of Image_T are stored exactly like the given file format.
+    template<class Image_T>
+    bool SameFormat(const int chan, const bool is_uint, const bool is_ushort, const bool is_float)
+    {
+        typedef typename Image_T::PixType::ElType El_T;
+        return Image_T::PixType::Chan == chan &&
+            (typeid(El_T)==typeid(unsigned int)) == is_uint &&
+            (typeid(El_T)==typeid(unsigned short)) == is_ushort &&
+            (typeid(El_T)==typeid(float)) == is_float &&
+            (is_uint || is_ushort || is_float || typeid(El_T)==typeid(unsigned char));
+    }
+
+    // Convert the first n pixels of Src to Dst's pixel type.
+    template<class DstImage_T, class SrcImage_T>
+    void ConvertPixels(DstImage_T &Dst, const SrcImage_T &Src, const int n)
+    {
+        if(ConvertPixelsFast(Dst.pp(), typeid(typename DstImage_T::PixType), Src.pp(), typeid(typename SrcImage_T::PixType), n))
+            return;
+        for(int i=0; i<n; i++)
+            Dst[i] = static_cast<typename DstImage_T::PixType>(Src[i]);
+    }
+
+    // Convert the first n pixels of Src, whose type is one that a file can have, to Dst's pixel type.
+    // I must do it this way because member function templates cannot be virtual. See tLoad().
+    template<class Image_T>
+    void ConvertFromBase(Image_T &Dst, const baseImage *Src, const int n)
+    {
+        if(const uc1Image *B = dynamic_cast<const uc1Image *>(Src)) ConvertPixels(Dst, *B, n);
+        else if(const uc2Image *B = dynamic_cast<const uc2Image *>(Src)) ConvertPixels(Dst, *B, n);
+        else if(const uc3Image *B = dynamic_cast<const uc3Image *>(Src)) ConvertPixels(Dst, *B, n);
+        else if(const uc4Image *B = dynamic_cast<const uc4Image *>(Src)) ConvertPixels(Dst, *B, n);
+        else if(const us1Image *B = dynamic_cast<const us1Image *>(Src)) ConvertPixels(Dst, *B, n);
+        else if(const us2Image *B = dynamic_cast<const us2Image *>(Src)) ConvertPixels(Dst, *B, n);
+        else if(const us3Image *B = dynamic_cast<const us3Image *>(Src)) ConvertPixels(Dst, *B, n);
+        else if(const us4Image *B = dynamic_cast<const us4Image *>(Src)) ConvertPixels(Dst, *B, n);
+        else if(const ui1Image *B = dynamic_cast<const ui1Image *>(Src)) ConvertPixels(Dst, *B, n);
+        else if(const f1Image *B = dynamic_cast<const f1Image *>(Src)) ConvertPixels(Dst, *B, n);
+        else if(const f3Image *B = dynamic_cast<const f3Image *>(Src)) ConvertPixels(Dst, *B, n);
+        else throw DMcError("Can't convert from this file's pixel format.");
+    }
+
+    // Convert the first n pixels of Src to the pixel type of Dst, which is one that a file can have.
+    template<class Image_T>
+    void ConvertToBase(baseImage *Dst, const Image_T &Src, const int n)
+    {
+        if(uc1Image *B = dynamic_cast<uc1Image *>(Dst)) ConvertPixels(*B, Src, n);
+        else if(uc2Image *B = dynamic_cast<uc2Image *>(Dst)) ConvertPixels(*B, Src, n);
+        else if(uc3Image *B = dynamic_cast<uc3Image *>(Dst)) ConvertPixels(*B, Src, n);
+        else if(uc4Image *B = dynamic_cast<uc4Image *>(Dst)) ConvertPixels(*B, Src, n);
+        else if(us1Image *B = dynamic_cast<us1Image *>(Dst)) ConvertPixels(*B, Src, n);
+        else if(us2Image *B = dynamic_cast<us2Image *>(Dst)) ConvertPixels(*B, Src, n);
+        else if(us3Image *B = dynamic_cast<us3Image *>(Dst)) ConvertPixels(*B, Src, n);
+        else if(us4Image *B = dynamic_cast<us4Image *>(Dst)) ConvertPixels(*B, Src, n);
+        else if(ui1Image *B = dynamic_cast<ui1Image *>(Dst)) ConvertPixels(*B, Src, n);
+        else if(f1Image *B = dynamic_cast<f1Image *>(Dst)) ConvertPixels(*B, Src, n);
+        else if(f3Image *B = dynamic_cast<f3Image *>(Dst)) ConvertPixels(*B, Src, n);
+        else throw DMcError("Can't convert to this file's pixel format.");
+    }
+
+    // Make Band hold at least n rows of the given format.
+    void SizeBand(ImageLoadSave &Band, const int wid, const int n, const int chan, const bool is_uint, const bool is_ushort, const bool is_float)
+    {
+        if(Band.baseImg && Band.wid == wid && Band.hgt >= n)
+            return;
+
+        delete Band.baseImg;
+        Band.baseImg = NULL;
+        Band.Pix = NULL;
+        Band.SetImage(NULL, wid, n, chan, is_uint, is_ushort, is_float);
+        Band.ImageAlloc();
+    }
+};
+
+template<class Image_T>
+int ImageReader::ReadRows(Image_T &Rows, const int n)
+{
+    if(Rows.w() != wid || Rows.h() != n)
+        Rows.SetSize(wid, n);
+
+    const int k = std::min(n, hgt - yNext);
+    if(k <= 0)
+        return 0;
+
+    if(SameFormat<Image_T>(chan, is_uint, is_ushort, is_float)) {
+        ReadRaw((unsigned char *)Rows.pv(), k);
+    } else {
+        SizeBand(Band, wid, k, chan, is_uint, is_ushort, is_float);
+        ReadRaw(Band.Pix, k);
+        ConvertFromBase(Rows, Band.baseImg, k * wid);
+    }
+
+    yNext += k;
+    return k;
+}
+
+template<class Image_T>
+void ImageWriter::WriteRows(const Image_T &Rows, const int n)
+{
+    ASSERT_R(Rows.w() == wid && n <= Rows.h());
+    if(n > hgt - yNext) throw DMcError("Writing more rows than the image has.");
+    if(n <= 0)
+        return;
+
+    if(SameFormat<Image_T>(chan, is_uint, is_ushort, is_float)) {
+        WriteRaw((const unsigned char *)Rows.pv(), n);
+    } else {
+        SizeBand(Band, wid, n, chan, is_uint, is_ushort, is_float);
+        ConvertToBase(Band.baseImg, Rows, n * wid);
+        WriteRaw(Band.Pix, n);
+    }
+
+    yNext += n;
+}
+
+// Instantiations. The same pixel types as tLoad() and tSave().
+template int ImageReader::ReadRows(uc1Image &Rows, const int n);
+template int ImageReader::ReadRows(uc2Image &Rows, const int n);
+template int ImageReader::ReadRows(uc3Image &Rows, const int n);
+template int ImageReader::ReadRows(uc4Image &Rows, const int n);
+template int ImageReader::ReadRows(us1Image &Rows, const int n);
+template int ImageReader::ReadRows(us2Image &Rows, const int n);
+template int ImageReader::ReadRows(us3Image &Rows, const int n);
+template int ImageReader::ReadRows(us4Image &Rows, const int n);
+template int ImageReader::ReadRows(ui1Image &Rows, const int n);
+template int ImageReader::ReadRows(f1Image &Rows, const int n);
+template int ImageReader::ReadRows(f3Image &Rows, const int n);
+template int ImageReader::ReadRows(f4Image &Rows, const int n);
+template int ImageReader::ReadRows(h3Image &Rows, const int n);
+
+template void ImageWriter::WriteRows(const uc1Image &Rows, const int n);
+template void ImageWriter::WriteRows(const uc2Image &Rows, const int n);
+template void ImageWriter::WriteRows(const uc3Image &Rows, const int n);
+template void ImageWriter::WriteRows(const uc4Image &Rows, const int n);
+template void ImageWriter::WriteRows(const us1Image &Rows, const int n);
+template void ImageWriter::WriteRows(const us2Image &Rows, const int n);
+template void ImageWriter::WriteRows(const us3Image &Rows, const int n);
+template void ImageWriter::WriteRows(const us4Image &Rows, const int n);
+template void ImageWriter::WriteRows(const ui1Image &Rows, const int n);
+template void ImageWriter::WriteRows(const f1Image &Rows, const int n);
+template void ImageWriter::WriteRows(const f3Image &Rows, const int n);
+template void ImageWriter::WriteRows(const f4Image &Rows, const int n);
+template void ImageWriter::WriteRows(const h3Image &Rows, const int n);
+
+ImageReader *OpenImageReader(const char *fname)
+{
+    ASSERT_R(fname);
+
+    switch(GetExtensionVal(fname)) {
+    case BMP_:
+        return OpenBMPReader(fname);
+    case HDR_:
+        return OpenRGBEReader(fname);
+    case PNG_:
+        return OpenPNGReader(fname);
+    case TGA_:
+        return OpenTGAReader(fname);
+    case TIF_:
+        return OpenTIFFReader(fname);
+    case PPM_:
+    case PGM_:
+    case PAM_:
+    case PSM_:
+    case PFM_:
+    case PZM_:
+        return OpenPPMReader(fname);
+    default:
+        throw DMcError("Can't read this kind of file a few rows at a time: '" + string(fname) + "'");
+    }
+}
+
+// Choose the pixel format of the file the same way tSave() does.
+ImageWriter *OpenImageWriter(const char *fname, const int w, const int h, const int chan,
+                             const bool is_uint, const bool is_ushort, const bool is_float)
+{
+    ASSERT_R(fname);
+    if(w < 1 || h < 1 || chan < 1 || chan > 4) throw DMcError("Image is not defined. Not saving.");
+
+    switch(GetExtensionVal(fname)) {
+    case BMP_: // 1 3 uc
+        return OpenBMPWriter(fname, w, h, (chan==2 || chan==1) ? 1 : 3);
+    case TGA_: // 1 3 4 uc
+        return OpenTGAWriter(fname, w, h, (chan==2 || chan==1) ? 1 : chan);
+    case PNG_: // 1 2 3 4 uc
+        return OpenPNGWriter(fname, w, h, chan);
+    case HDR_: // 3f
+        return OpenRGBEWriter(fname, w, h);
+    case TIF_: // 1 2 3 4 uc, us, ui, f
+        return OpenTIFFWriter(fname, w, h, chan, is_uint, is_ushort, is_float);
+    case PGM_:
+        return OpenPPMWriter(fname, w, h, chan, is_uint, is_ushort, is_float);
+    case PPM_: // 1s 2s 3s 4s 1f 3f 3uc
+    case PAM_:
+    case PSM_:
+    case PFM_:
+    case PZM_:
+        if(is_float)
+            return OpenPPMWriter(fname, w, h, (chan==1 || chan==3) ? chan : 3, false, false, true);
+        else if(is_ushort)
+            return OpenPPMWriter(fname, w, h, chan, false, true, false);
+        else
+            return OpenPPMWriter(fname, w, h, 3, false, false, false);
+    default:
+        throw DMcError("Can't write this kind of file a few rows at a time: '" + string(fname) + "'");
+    }
+}
@@ -0,0 +1,175 @@
+//////////////////////////////////////////////////////////////////////
+// ImageStream.h - Read and write images a band of scanlines at a time.
+//
+// Copyright David K. McAllister, 2008.
+
+// Load() and Save() need the whole image in memory. These are for images that are too big for that.
+// An ImageReader reads an image file from top to bottom, some rows at a time, and an ImageWriter
+// writes one the same way. Only the rows being worked on need to be in memory.
+//
+// Like ImageLoadSave, a stream has the pixel format of the file: wid, hgt, chan, and the is_*.
+// ReadRows() and WriteRows() convert between that and the pixel type of the rows you give them,
+// the way tLoad() and tSave() do.
+//
+// These formats can be streamed: PPM and its relatives, BMP, TGA, HDR, PNG, and TIFF.
+// Run-length encoded BMPs and interlaced PNGs can't be read a few rows at a time, so they throw.
+// The readers don't map the file the way the loaders do, since a file too big to load can be too big
+// for the address space. They read each band through a StreamFile instead.
+//
+// The streaming versions of some algorithms are in ImageAlgorithms.h.
+
+#ifndef dmc_ImageStream_h
+#define dmc_ImageStream_h
+
+#include "Image/ImageLoadSave.h"
+
+#include <cstdio>
+
+// A file read a piece at a time at 64-bit offsets, for the readers.
+class StreamFile
+{
+    FILE *fp;
+    DMCINT64 Size; // In bytes.
+    DMCINT64 Pos; // Where fp is, so that reading on from the last read doesn't seek.
+    std::vector<unsigned char> Buf; // Its first BufLen bytes are bytes BufOff on of the file, for Window().
+    DMCINT64 BufOff;
+    size_t BufLen;
+
+    // Not copyable.
+    StreamFile(const StreamFile &);
+    StreamFile &operator=(const StreamFile &);
+
+public:
+    // Open the file. Throws a DMcError if it can't be opened.
+    StreamFile(const char *fname);
+    ~StreamFile();
+
+    static const size_t HEADER_BYTES = 1 << 16; // Enough to hold the header of any format that streams.
+
+    DMCINT64 size() const { return Size; }
+
+    // Read Bytes bytes at Off into Dest. Throws a DMcError if the file ends first.
+    void Read(void *Dest, const size_t Bytes, const DMCINT64 Off);
+
+    // The bytes of the file from Off on, at least Bytes of them unless the file ends first, for parsing.
+    // End gets the end of them. They are good until the next call. Reads ahead so that a run of small
+    // windows moving forward through the file doesn't make a read each.
+    const unsigned char *Window(const DMCINT64 Off, const size_t Bytes, const unsigned char *&End);
+};
+
+class ImageReader
+{
+public:
+    int wid, hgt, chan; // The file's pixel format
+    bool is_uint, is_float, is_ushort;
+
+    virtual ~ImageReader() {}
+
+    int w() const { return wid; }
+    int h() const { return hgt; }
+
+    // The next row that ReadRows() will read.
+    int y() const { return yNext; }
+
+    // Read the next n rows, or as many as are left, into the first rows of Rows, converting them to its pixel type.
+    // Rows is resized to w() x n if it isn't already. Returns how many rows were read, which is 0 at the bottom.
+    // Throws a DMcError on error.
+    template<class Image_T> int ReadRows(Image_T &Rows, const int n);
+
+protected:
+    int yNext;
+
+    ImageReader()
+    {
+        wid = hgt = chan = 0;
+        is_uint = is_float = is_ushort = false;
+        yNext = 0;
+    }
+
+    // Read rows yNext to yNext+n-1 into Rows in the file's pixel format. The caller has checked that they exist.
+    virtual void ReadRaw(unsigned char *Rows, const int n) = 0;
+
+private:
+    ImageLoadSave Band; // Holds the rows in the file's format when they need converting.
+
+    // Not copyable.
+    ImageReader(const ImageReader &);
+    ImageReader &operator=(const ImageReader &);
+};
+
+class ImageWriter
+{
+public:
+    int wid, hgt, chan; // The file's pixel format
+    bool is_uint, is_float, is_ushort;
+
+    // Finishes and closes the file.
+    virtual ~ImageWriter() {}
+
+    int w() const { return wid; }
+    int h() const { return hgt; }
+
+    // The next row that WriteRows() will write.
+    int y() const { return yNext; }
+
+    // Write the first n rows of Rows as the next rows of the file, converting them to the file's pixel format.
+    // Rows must be w() pixels wide. Throws a DMcError on error or if it's more rows than the image has.
+    template<class Image_T> void WriteRows(const Image_T &Rows, const int n);
+    template<class Image_T> void WriteRows(const Image_T &Rows) { WriteRows(Rows, Rows.h()); }
+
+protected:
+    int yNext;
+
+    ImageWriter()
+    {
+        wid = hgt = chan = 0;
+        is_uint = is_float = is_ushort = false;
+        yNext = 0;
+    }
+
+    // Write n rows in the file's pixel format as rows yNext to yNext+n-1. The caller has checked that they fit.
+    virtual void WriteRaw(const unsigned char *Rows, const int n) = 0;
+
+private:
+    ImageLoadSave Band; // Holds the rows in the file's format when they need converting.
+
+    // Not copyable.
+    ImageWriter(const ImageWriter &);
+    ImageWriter &operator=(const ImageWriter &);
+};
+
+// Open an image file for reading a band of rows at a time. The file type is chosen by the extension.
+// Delete the returned reader to close the file. Throws a DMcError on error.
+ImageReader *OpenImageReader(const char *fname);
+
+// Create an image file of w x h pixels to write a band of rows at a time. The file type is chosen by the extension.
+// The pixels are stored in the file format's closest match to chan channels of the given element type,
+// as tSave() would. Delete the returned writer to finish the file. Throws a DMcError on error.
+ImageWriter *OpenImageWriter(const char *fname, const int w, const int h, const int chan,
+                             const bool is_uint = false, const bool is_ushort = false, const bool is_float = false);
+
+// Create an image file for rows of Image_T's pixel type.
+template<class Image_T>
+ImageWriter *OpenImageWriter(const char *fname, const int w, const int h)
+{
+    return OpenImageWriter(fname, w, h, Image_T::PixType::Chan,
+        (typeid(typename Image_T::PixType::ElType)==typeid(unsigned int)),
+        (typeid(typename Image_T::PixType::ElType)==typeid(unsigned short)),
+        (typeid(typename Image_T::PixType::ElType)==typeid(float)));
+}
+
+// The readers and writers of each format. OpenImageReader() and OpenImageWriter() choose among these.
+ImageReader *OpenBMPReader(const char *fname);
+ImageReader *OpenPNGReader(const char *fname);
+ImageReader *OpenPPMReader(const char *fname);
+ImageReader *OpenRGBEReader(const char *fname);
+ImageReader *OpenTGAReader(const char *fname);
+ImageReader *OpenTIFFReader(const char *fname);
+ImageWriter *OpenBMPWriter(const char *fname, const int w, const int h, const int chan);
+ImageWriter *OpenPNGWriter(const char *fname, const int w, const int h, const int chan);
+ImageWriter *OpenPPMWriter(const char *fname, const int w, const int h, const int chan, const bool is_uint, const bool is_ushort, const bool is_float);
+ImageWriter *OpenRGBEWriter(const char *fname, const int w, const int h);
+ImageWriter *OpenTGAWriter(const char *fname, const int w, const int h, const int chan);
+ImageWriter *OpenTIFFWriter(const char *fname, const int w, const int h, const int chan, const bool is_uint, const bool is_ushort, const bool is_float);
+
+#endif
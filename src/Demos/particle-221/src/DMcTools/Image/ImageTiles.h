@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////
+// ImageTiles.h - Run an image algorithm over tiles of the image on all CPUs
+//
+// Copyright David K. McAllister, 2008.
+
+#ifndef dmc_imageTiles_h
+#define dmc_imageTiles_h
+
+#include <algorithm>
+
+// Tiles are this many pixels on a side. A 64x64 tile of f4Pixels is 64 KB, so a tile and its halo
+// stay in L2 cache while a filter reads them over and over.
+#define DMC_TILE_SIZE 64
+
+// Compute every pixel of a wid x hgt output image by splitting it into tiles and giving the tiles to
+// a pool of threads. Without OpenMP the tiles are done in order on one thread.
+//
+// Many algorithms read a window of pixels around each output pixel. Halo is the radius of that window.
+// The pixels whose window is entirely inside the image are the fast case, and are handed out in rectangles.
+// The rest are near the border and need clipping, so they're handed out one at a time.
+// Op_T must have these const members. They are called concurrently, so they must only write their own pixels.
+//     void Inside(const int x0, const int y0, const int x1, const int y1) const; // Do the pixels in [x0,x1) x [y0,y1).
+//     void Edge(const int x, const int y) const; // Do pixel x,y, whose window sticks out of the image.
+// An algorithm that doesn't read neighbors uses Halo 0, and then Edge() is never called.
+//
+// ForEachTileRows() computes only rows [Y0,Y1), for algorithms that stream a band of rows at a time.
+// Each pixel still goes to Inside() or Edge() by where it is in the whole image, so the results are the same.
+template <class Op_T>
+void ForEachTileRows(const int wid, const int hgt, const int Halo, const Op_T &Op, const int Y0, const int Y1,
+                     const int TileSize = DMC_TILE_SIZE)
+{
+    if(wid <= 0 || Y1 <= Y0)
+        return;
+
+    const int tx = (wid + TileSize - 1) / TileSize;
+    const int ty = (Y1 - Y0 + TileSize - 1) / TileSize;
+    const int NumTiles = tx * ty;
+
+    // The part of the image whose pixels' windows are inside it. It may be empty.
+    const int ix0 = std::min(Halo, wid), ix1 = std::max(wid - Halo, ix0);
+    const int iy0 = std::min(Halo, hgt), iy1 = std::max(hgt - Halo, iy0);
+
+#pragma omp parallel for schedule(dynamic)
+    for(int t=0; t<NumTiles; t++) {
+        const int x0 = (t % tx) * TileSize, x1 = std::min(x0 + TileSize, wid);
+        const int y0 = Y0 + (t / tx) * TileSize, y1 = std::min(y0 + TileSize, Y1);
+
+        int ax0 = std::max(x0, ix0), ax1 = std::min(x1, ix1);
+        int ay0 = std::max(y0, iy0), ay1 = std::min(y1, iy1);
+        if(ax0 < ax1 && ay0 < ay1)
+            Op.Inside(ax0, ay0, ax1, ay1);
+        else
+            ay0 = ay1 = y1; // Nothing inside, so all of the tile is edge.
+
+        for(int y=y0; y<y1; y++) {
+            if(y >= ay0 && y < ay1) {
+                for(int x=x0; x<ax0; x++)
+                    Op.Edge(x, y);
+                for(int x=ax1; x<x1; x++)
+                    Op.Edge(x, y);
+            } else {
+                for(int x=x0; x<x1; x++)
+                    Op.Edge(x, y);
+            }
+        }
+    }
+}
+
+template <class Op_T>
+void ForEachTile(const int wid, const int hgt, const int Halo, const Op_T &Op, const int TileSize = DMC_TILE_SIZE)
+{
+    ForEachTileRows(wid, hgt, Halo, Op, 0, hgt, TileSize);
+}
+
+#endif
@@ -10,16 +10,21 @@
 //
 // Data_T is the type of the data. This is usually float.
 // Should also work with Pixel, Vector, unsigned int, etc.
+// For a multi-channel float image, use f3Pixel or f4Pixel and float weights, with Img.pp() as the data.
+//
+// The smaller levels are laid out with PyramidLayout, each half the size of the last, rounded up.
+// They all live in one arena that a PullPusher keeps from one call to the next, so filling in
+// a stream of same-sized images only allocates for the first one. Each level's rows are done
+// in parallel. The pixels on the edges of the levels are done separately from the rest so that
+// the inner loops don't have to check for them.
 
 #ifndef dmc_pullpush_h
 #define dmc_pullpush_h
 
-// #include "Util/Utils.h"
-// #include "Math/MiscMath.h"
+#include "Image/ImagePyramid.h"
 
-// #include <algorithm>
-// #include <cstdlib>
-// #include <cstdio>
+#include <algorithm>
+#include <vector>
 
 template<class Weight_T>
 DMC_INLINE Weight_T MIN1(Weight_T x)
@@ -35,217 +40,235 @@ DMC_INLINE void Composite(Data_T &R, Weight_T &W, Data_T tD, Weight_T tW)
     W = MIN1(W + tW * (1 - W));
 }
 
-// Create an image smaller than the one I'm given, fill in as much of it
-// as I know how. Then call recursively to have the rest of it filled in.
-// Then use it to fill in the rest of me.
+// Pull: Make each smaller level from the 3x3 pixels of the level above it around each of its pixels,
+// weighted 1 in the middle, 1/2 on the sides, and 1/4 on the corners and by the pixels' weights.
+// Push: Fill in each level from the level below it, composited under the pixels that it already knows.
 //
-// All values of Weights must be <= 1.
+// All values of Weights must be <= 1. If none of them are above 0 nothing is known and Data is left alone.
+template<class Data_T, class Weight_T = float>
+class PullPusher
+{
+public:
+    void Fill(Data_T *Data, Weight_T *Weights, const int wid, const int hgt);
+
+private:
+    PyramidLayout Layout;
+    std::vector<Data_T> DataArena; // Levels 1 and smaller, one after another
+    std::vector<Weight_T> WgtArena;
+    std::vector<Data_T *> DLev; // Where each level starts. Level 0 is the caller's.
+    std::vector<Weight_T *> WLev;
+
+    enum { MIN_PARALLEL_PIXELS = 1 << 12 }; // Smaller levels than this aren't worth starting threads for.
+
+    static void PullLevel(Data_T *D1, Weight_T *W1, const int widp, const int hgtp,
+                          const Data_T *D, const Weight_T *W, const int wid, const int hgt);
+    static void PushLevel(Data_T *D, Weight_T *W, const int wid, const int hgt,
+                          const Data_T *D1, const Weight_T *W1, const int widp, const int hgtp);
+
+    static void PullPixel(Data_T *D1, Weight_T *W1, const int widp, const int x, const int y,
+                          const Data_T *D, const Weight_T *W, const int wid, const int hgt);
+    static void PushPixel(Data_T *D, Weight_T *W, const int wid, const int x, const int y,
+                          const Data_T *D1, const Weight_T *W1, const int widp, const int hgtp);
+
+    static void Store(Data_T &D1, Weight_T &W1, const Data_T &Dat, const Weight_T Wgt)
+    {
+        D1 = Dat * (Wgt > 0 ? Weight_T(1) / Wgt : Weight_T(0));
+        W1 = MIN1(Wgt);
+    }
+};
 
 template<class Data_T, class Weight_T>
-void PullPush(Data_T *Data, Weight_T *Weights, int wid, int hgt)
+void PullPusher<Data_T, Weight_T>::Fill(Data_T *Data, Weight_T *Weights, const int wid, const int hgt)
 {
-#ifdef PP_DEBUG
-    DoDebug("Inn", Data, Weights, wid, hgt);
-#endif
-
     if(wid <= 1 && hgt <= 1)
         return;
 
-    int widp = (wid+1) >> 1;
-    int hgtp = (hgt+1) >> 1;
-
-    cerr << "Shrinking to " << widp << "x" << hgtp << endl;
-
-    // XXX What about initializing these?
-    Data_T *Data1 = new Data_T[widp * hgtp];
-    Weight_T *Weights1 = new Weight_T[widp * hgtp];
-
-    // Make the smaller level.
-    int x, y;
-    for(y=0; y<hgtp; y++) {
-        for(x=0; x<widp; x++) {
-            // Deal with the 9 pixels affecting this one.
-            int x2 = x<<1;
-            int y2 = y<<1;
+    Layout.Set(wid, hgt, true);
+    const size_t ArenaSize = Layout.size() - Layout.Offset[1];
+    DataArena.resize(ArenaSize); // Doesn't reallocate unless it has to grow.
+    WgtArena.resize(ArenaSize);
+
+    DLev.resize(Layout.NumLevels());
+    WLev.resize(Layout.NumLevels());
+    DLev[0] = Data;
+    WLev[0] = Weights;
+    for(int l=1; l<Layout.NumLevels(); l++) {
+        DLev[l] = &DataArena[Layout.Offset[l] - Layout.Offset[1]];
+        WLev[l] = &WgtArena[Layout.Offset[l] - Layout.Offset[1]];
+    }
 
-            Weight_T w = Weights[y2*wid+x2];
-            Weight_T Wgt = w;
-            Data_T Dat = Data[y2*wid+x2] * w;
-
-            if(x2>0) {
-                w = Weights[y2*wid+(x2-1)] / 2;
-                //if(TooFar(Data(x2-1, y2), Dat, Wgt)) w = 0;
-                Wgt += w;
-                Dat += Data[y2*wid+(x2-1)] * w;
-
-                if(y2>0) {
-                    w = Weights[(y2-1)*wid+(x2-1)] / 4;
-                    //if(TooFar(Data(x2-1, y2-1), Dat, Wgt)) w = 0;
-                    Wgt += w;
-                    Dat += Data[(y2-1)*wid+(x2-1)] * w;
-                }
-
-                if(y2 < hgt-1) {
-                    w = Weights[(y2+1)*wid+(x2-1)] / 4;
-                    //if(TooFar(Data(x2-1, y2+1), Dat, Wgt)) w = 0;
-                    Wgt += w;
-                    Dat += Data[(y2+1)*wid+(x2-1)] * w;
-                }
-            }
+    const int L = Layout.NumLevels() - 1;
+    for(int l=1; l<=L; l++)
+        PullLevel(DLev[l], WLev[l], Layout.W[l], Layout.H[l], DLev[l-1], WLev[l-1], Layout.W[l-1], Layout.H[l-1]);
 
-            if(y2 < hgt-1) {
-                w = Weights[(y2+1)*wid+x2] / 2;
-                //if(TooFar(Data(x2, y2+1), Dat, Wgt)) w = 0;
-                Wgt += w;
-                Dat += Data[(y2+1)*wid+x2] * w;
-            }
+    if(!(WLev[L][0] > 0))
+        return;
 
-            if(y2>0) {
-                w = Weights[(y2-1)*wid+x2] / 2;
-                //if(TooFar(Data(x2, y2-1), Dat, Wgt)) w = 0;
-                Wgt += w;
-                Dat += Data[(y2-1)*wid+x2] * w;
-            }
+    for(int l=L; l>0; l--)
+        PushLevel(DLev[l-1], WLev[l-1], Layout.W[l-1], Layout.H[l-1], DLev[l], WLev[l], Layout.W[l], Layout.H[l]);
+}
 
-            if(x2 < wid-1) {
-                w = Weights[y2*wid+(x2+1)] / 2;
-                //if(TooFar(Data(x2+1, y2), Dat, Wgt)) w = 0;
-                Wgt += w;
-                Dat += Data[y2*wid+(x2+1)] * w;
-
-                if(y2>0) {
-                    w = Weights[(y2-1)*wid+(x2+1)] / 4;
-                    //if(TooFar(Data(x2+1, y2-1), Dat, Wgt)) w = 0;
-                    Wgt += w;
-                    Dat += Data[(y2-1)*wid+(x2+1)] * w;
-                }
-
-                if(y2 < hgt-1) {
-                    w = Weights[(y2+1)*wid+(x2+1)] / 4;
-                    //if(TooFar(Data(x2+1, y2+1), Dat, Wgt)) w = 0;
-                    Wgt += w;
-                    Dat += Data[(y2+1)*wid+(x2+1)] * w;
-                }
-            }
+// The pixels of the smaller level that are not next to the edge of the bigger one
+// have all 3x3 pixels, so they are done without checking.
+template<class Data_T, class Weight_T>
+void PullPusher<Data_T, Weight_T>::PullLevel(Data_T *D1, Weight_T *W1, const int widp, const int hgtp,
+                                             const Data_T *D, const Weight_T *W, const int wid, const int hgt)
+{
+    const int xHi = std::max(wid >> 1, 1), yHi = std::max(hgt >> 1, 1); // [1, xHi) x [1, yHi) are inside.
+
+#pragma omp parallel for schedule(static) if(widp * hgtp >= MIN_PARALLEL_PIXELS)
+    for(int y=0; y<hgtp; y++) {
+        if(y < 1 || y >= yHi) {
+            for(int x=0; x<widp; x++)
+                PullPixel(D1, W1, widp, x, y, D, W, wid, hgt);
+            continue;
+        }
 
-            // Scale the data by the weights.
-            if(Wgt != 0) {
-                Dat = Dat / Wgt;
+        const int y2 = y << 1;
+        const Data_T *Da = D + size_t(y2 - 1) * wid, *Db = D + size_t(y2) * wid, *Dc = D + size_t(y2 + 1) * wid;
+        const Weight_T *Wa = W + size_t(y2 - 1) * wid, *Wb = W + size_t(y2) * wid, *Wc = W + size_t(y2 + 1) * wid;
+        Data_T *DO = D1 + size_t(y) * widp;
+        Weight_T *WO = W1 + size_t(y) * widp;
 
-                Data1[y*widp+x] = Dat;
-                Weights1[y*widp+x] = MIN1(Wgt);
-            } else {
-                Data1[y*widp+x] = 0;
-                Weights1[y*widp+x] = 0;
-            }
+        PullPixel(D1, W1, widp, 0, y, D, W, wid, hgt);
+        for(int x=1; x<xHi; x++) {
+            const int x2 = x << 1;
+            Weight_T w = Wb[x2];
+            Weight_T Wgt = w;
+            Data_T Dat = Db[x2] * w;
+
+            w = Wb[x2-1] / 2; Wgt += w; Dat += Db[x2-1] * w;
+            w = Wa[x2-1] / 4; Wgt += w; Dat += Da[x2-1] * w;
+            w = Wc[x2-1] / 4; Wgt += w; Dat += Dc[x2-1] * w;
+            w = Wc[x2] / 2;   Wgt += w; Dat += Dc[x2] * w;
+            w = Wa[x2] / 2;   Wgt += w; Dat += Da[x2] * w;
+            w = Wb[x2+1] / 2; Wgt += w; Dat += Db[x2+1] * w;
+            w = Wa[x2+1] / 4; Wgt += w; Dat += Da[x2+1] * w;
+            w = Wc[x2+1] / 4; Wgt += w; Dat += Dc[x2+1] * w;
+
+            Store(DO[x], WO[x], Dat, Wgt);
         }
+        for(int x=xHi; x<widp; x++)
+            PullPixel(D1, W1, widp, x, y, D, W, wid, hgt);
     }
+}
 
-    // Now that I've splatted onto the smaller level,
-    // have the rest of it filled in.
-    PullPush(Data1, Weights1, widp, hgtp);
-
-    // Now use the smaller image to fill me in.
-    for(y=0; y<hgt; y++) {
-        int y1 = y>>1;
-
-        // For even rows.
-        for(x=0; x<wid; x++) {
-            int x1 = x>>1;
-
-            // An even pixel. // No need to mult/div by weight.
-            Weight_T tw = Weights1[y1*widp+x1];
-            Data_T tD = Data1[y1*widp+x1];
-
-            Composite(Data[y*wid+x], Weights[y*wid+x], tD, tw);
-
-            x++;
-            if(x>=wid) break;
-
-            // An odd pixel.
-            Weight_T w = Weights1[y1*widp+x1] / 2;
-            tw = w;
-            tD = w * Data1[y1*widp+x1];
-
-            if(x1+1 < widp) {
-                w = Weights1[y1*widp+(x1+1)] / 2;
-                //if(TooFar(Data1(x1+1, y1), tD, tw)) w = 0;
-                tw += w;
-                tD += w * Data1[y1*widp+(x1+1)];
-            }
-
-            tD /= tw;
-
-            Composite(Data[y*wid+x], Weights[y*wid+x], tD, tw);
+template<class Data_T, class Weight_T>
+void PullPusher<Data_T, Weight_T>::PullPixel(Data_T *D1, Weight_T *W1, const int widp, const int x, const int y,
+                                             const Data_T *D, const Weight_T *W, const int wid, const int hgt)
+{
+    const int x2 = x << 1, y2 = y << 1;
+    Weight_T Wgt = 0;
+    Data_T Dat = Data_T(0);
+    for(int yy = std::max(y2 - 1, 0); yy <= std::min(y2 + 1, hgt - 1); yy++) {
+        for(int xx = std::max(x2 - 1, 0); xx <= std::min(x2 + 1, wid - 1); xx++) {
+            Weight_T w = W[yy*wid+xx];
+            if(xx != x2) w /= 2;
+            if(yy != y2) w /= 2;
+            Wgt += w;
+            Dat += D[yy*wid+xx] * w;
         }
+    }
 
-        y++;
-        if(y>=hgt) break;
-
-        // For odd rows.
-        for(x=0; x<wid; x++) {
-            int x1 = x>>1;
+    Store(D1[y*widp+x], W1[y*widp+x], Dat, Wgt);
+}
 
-            // An even pixel.
-            Weight_T w = Weights1[y1*widp+x1] / 2;
-            Weight_T tw = w;
-            Data_T tD = w * Data1[y1*widp+x1];
+// Each pixel of the bigger level is interpolated from the one to four pixels of the smaller level nearest it.
+// Only the last row and column can be missing some of them.
+template<class Data_T, class Weight_T>
+void PullPusher<Data_T, Weight_T>::PushLevel(Data_T *D, Weight_T *W, const int wid, const int hgt,
+                                             const Data_T *D1, const Weight_T *W1, const int widp, const int hgtp)
+{
+    const int nPairs = (wid - 1) >> 1; // Pairs of columns that have both of their pixels of the smaller level
+
+#pragma omp parallel for schedule(static) if(wid * hgt >= MIN_PARALLEL_PIXELS)
+    for(int y=0; y<hgt; y++) {
+        const int y1 = y >> 1;
+        const bool OddRow = (y & 1) != 0;
+        if(OddRow && y1 + 1 >= hgtp) {
+            for(int x=0; x<wid; x++)
+                PushPixel(D, W, wid, x, y, D1, W1, widp, hgtp);
+            continue;
+        }
 
-            if(y1+1 < hgtp)
-            {
-                w = Weights1[(y1+1)*widp+x1] / 2;
-                //if(TooFar(Data1[(y1+1)*widp+x1], tD, tw)) w = 0;
-                tw += w;
-                tD += w * Data1[(y1+1)*widp+x1];
+        Data_T *DO = D + size_t(y) * wid;
+        Weight_T *WO = W + size_t(y) * wid;
+        const Data_T *Da = D1 + size_t(y1) * widp;
+        const Weight_T *Wa = W1 + size_t(y1) * widp;
+
+        if(!OddRow) {
+            for(int x1=0; x1<nPairs; x1++) {
+                const int x = x1 << 1;
+                Composite(DO[x], WO[x], Da[x1], Wa[x1]);
+
+                const Weight_T w0 = Wa[x1] / 2, w1 = Wa[x1+1] / 2;
+                const Weight_T tw = w0 + w1;
+                Data_T tD = w0 * Da[x1] + w1 * Da[x1+1];
+                tD /= tw;
+                Composite(DO[x+1], WO[x+1], tD, tw);
             }
-
-            tD /= tw;
-
-            Composite(Data[y*wid+x], Weights[y*wid+x], tD, tw);
-
-            x++;
-            if(x>=wid) break;
-
-            // An odd pixel.
-            w = Weights1[y1*widp+x1] / 4;
-            tw = w;
-            tD = w * Data1[y1*widp+x1];
-
-            if(x1+1 < widp) {
-                w = Weights1[y1*widp+(x1+1)] / 4;
-                //if(TooFar(Data1(x1+1, y1), tD, tw)) w = 0;
-                tw += w;
-                tD += w * Data1[y1*widp+(x1+1)];
-
-                if(y1+1 < hgtp) {
-                    w = Weights1[(y1+1)*widp+(x1+1)] / 4;
-                    //if(TooFar(Data1(x1+1, y1+1), tD, tw)) w = 0;
-                    tw += w;
-                    tD += w * Data1[(y1+1)*widp+(x1+1)];
-                }
+        } else {
+            const Data_T *Db = Da + widp;
+            const Weight_T *Wb = Wa + widp;
+            for(int x1=0; x1<nPairs; x1++) {
+                const int x = x1 << 1;
+                Weight_T w0 = Wa[x1] / 2, w1 = Wb[x1] / 2;
+                Weight_T tw = w0 + w1;
+                Data_T tD = w0 * Da[x1] + w1 * Db[x1];
+                tD /= tw;
+                Composite(DO[x], WO[x], tD, tw);
+
+                w0 = Wa[x1] / 4; w1 = Wa[x1+1] / 4;
+                const Weight_T w2 = Wb[x1+1] / 4, w3 = Wb[x1] / 4;
+                tw = w0 + w1 + w2 + w3;
+                tD = w0 * Da[x1] + w1 * Da[x1+1] + w2 * Db[x1+1] + w3 * Db[x1];
+                tD /= tw;
+                Composite(DO[x+1], WO[x+1], tD, tw);
             }
+        }
 
-            if(y1+1 < hgtp) {
-                w = Weights1[(y1+1)*widp+x1] / 4;
-                //if(TooFar(Data1(x1, y1+1), tD, tw)) w = 0;
-                tw += w;
-                tD += w * Data1[(y1+1)*widp+x1];
-            }
+        for(int x=nPairs << 1; x<wid; x++)
+            PushPixel(D, W, wid, x, y, D1, W1, widp, hgtp);
+    }
+}
 
-            tD /= tw;
+template<class Data_T, class Weight_T>
+void PullPusher<Data_T, Weight_T>::PushPixel(Data_T *D, Weight_T *W, const int wid, const int x, const int y,
+                                             const Data_T *D1, const Weight_T *W1, const int widp, const int hgtp)
+{
+    const int x1 = x >> 1, y1 = y >> 1;
+    const bool OddX = (x & 1) != 0, OddY = (y & 1) != 0;
 
-            Composite(Data[y*wid+x], Weights[y*wid+x], tD, tw);
-        }
+    if(!OddX && !OddY) {
+        Composite(D[y*wid+x], W[y*wid+x], D1[y1*widp+x1], W1[y1*widp+x1]); // No need to mult/div by weight.
+        return;
     }
 
-    delete [] Data1;
-    delete [] Weights1;
+    const int xHi = (OddX && x1 + 1 < widp) ? x1 + 1 : x1;
+    const int yHi = (OddY && y1 + 1 < hgtp) ? y1 + 1 : y1;
+    Weight_T tw = 0;
+    Data_T tD = Data_T(0);
+    for(int yy=y1; yy<=yHi; yy++) {
+        for(int xx=x1; xx<=xHi; xx++) {
+            Weight_T w = W1[yy*widp+xx];
+            if(OddX) w /= 2;
+            if(OddY) w /= 2;
+            tw += w;
+            tD += w * D1[yy*widp+xx];
+        }
+    }
 
-#ifdef PP_DEBUG
-    DoDebug("Out", Data, Weights, wid, hgt);
-#endif
+    tD /= tw;
+    Composite(D[y*wid+x], W[y*wid+x], tD, tw);
+}
 
-    cerr << "Finished filling in the " << wid << "x" << hgt << endl;
+// Fill in the pixels of Data whose Weights are less than 1 from the ones around them.
+// Use a PullPusher instead to keep its memory from one call to the next.
+template<class Data_T, class Weight_T>
+void PullPush(Data_T *Data, Weight_T *Weights, int wid, int hgt)
+{
+    PullPusher<Data_T, Weight_T> PP;
+    PP.Fill(Data, Weights, wid, hgt);
 }
 
 #endif
@@ -11,11 +11,226 @@
 #include <algorithm>
 using namespace std;
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+    // The squared distance between two colors, in units of their channel values.
+    // DiffSqr() can't be used here because converting unsigned char channels to its int math type scales them to 0 or 1.
+    template<class Pixel_T>
+    DMC_INLINE typename Pixel_T::FloatMathType ColorDistSqr(const Pixel_T &A, const Pixel_T &B)
+    {
+        typename Pixel_T::FloatMathType DifSum = 0;
+        for(int i=0; i<Pixel_T::Chan; i++) {
+            typename Pixel_T::FloatMathType d = typename Pixel_T::FloatMathType(A[i]) - typename Pixel_T::FloatMathType(B[i]);
+            DifSum += d * d;
+        }
+        return DifSum;
+    }
+
+    // Pixels are mapped to the color map a chunk at a time, in parallel. Each chunk sums its own centroids and error,
+    // and the chunks are added up in order. The chunks don't depend on the number of threads, so neither does the result.
+    const size_t QUANT_CHUNK_SIZE = 1<<16;
+
+    // A k-d tree of the color map entries for finding the closest entry to a color.
+    // It gives exactly the same answer as trying every entry in order: the closest one, and the lowest index of any ties.
+    template<class Pixel_T>
+    class ColorMapTree
+    {
+        typedef typename Pixel_T::FloatMathType MathType;
+        enum {LEAF_SIZE = 4};
+
+        struct Node
+        {
+            int Begin, End; // The span of Order[] in this subtree
+            int Chan;       // The channel it's split on, or -1 for a leaf
+            MathType Split; // Entries in Lower are <= Split in that channel and those in Upper are >= it.
+            int Lower, Upper;
+        };
+
+        const ColorMap<Pixel_T> &CMap;
+        std::vector<int> Order; // Color map indices, ordered so that each subtree is a span.
+        std::vector<Node> Nodes;
+
+        // Make a subtree for Order[b..e) and return its node index.
+        int Build(const int b, const int e)
+        {
+            Node N;
+            N.Begin = b;
+            N.End = e;
+            N.Chan = -1;
+            N.Split = 0;
+            N.Lower = N.Upper = -1;
+            int ni = int(Nodes.size());
+            Nodes.push_back(N);
+
+            if(e - b <= LEAF_SIZE)
+                return ni;
+
+            // Split the longest side of the box at the median.
+            Pixel_T MinP = CMap[Order[b]], MaxP = CMap[Order[b]];
+            for(int i=b+1; i<e; i++) {
+                MinP = Min(MinP, CMap[Order[i]]);
+                MaxP = Max(MaxP, CMap[Order[i]]);
+            }
+            int c = 0;
+            for(int k=1; k<Pixel_T::Chan; k++)
+                if(MathType(MaxP[k]) - MathType(MinP[k]) > MathType(MaxP[c]) - MathType(MinP[c]))
+                    c = k;
+
+            int m = (b + e) / 2;
+            std::nth_element(Order.begin() + b, Order.begin() + m, Order.begin() + e, ChanLess(CMap, c));
+
+            Nodes[ni].Chan = c;
+            Nodes[ni].Split = MathType(CMap[Order[m]][c]);
+            int Lower = Build(b, m);
+            int Upper = Build(m, e);
+            Nodes[ni].Lower = Lower;
+            Nodes[ni].Upper = Upper;
+
+            return ni;
+        }
+
+        struct ChanLess
+        {
+            const ColorMap<Pixel_T> &CMap;
+            int c;
+            ChanLess(const ColorMap<Pixel_T> &CMap_, const int c_) : CMap(CMap_), c(c_) {}
+            bool operator()(const int a, const int b) const { return CMap[a][c] < CMap[b][c]; }
+        };
+
+        void Search(const int ni, const Pixel_T &P, int &BestC, MathType &BestErr) const
+        {
+            const Node &N = Nodes[ni];
+            if(N.Chan < 0) {
+                for(int i=N.Begin; i<N.End; i++) {
+                    int c = Order[i];
+                    MathType Err = ColorDistSqr(P, CMap[c]);
+                    if(Err < BestErr || (Err == BestErr && c < BestC)) {
+                        BestErr = Err;
+                        BestC = c;
+                    }
+                }
+                return;
+            }
+
+            // Look on P's side of the split first, then on the other side if it could have one as close.
+            MathType d = MathType(P[N.Chan]) - N.Split;
+            Search(d < 0 ? N.Lower : N.Upper, P, BestC, BestErr);
+            if(d * d <= BestErr)
+                Search(d < 0 ? N.Upper : N.Lower, P, BestC, BestErr);
+        }
+
+    public:
+        explicit ColorMapTree(const ColorMap<Pixel_T> &CMap_) : CMap(CMap_)
+        {
+            ASSERT_R(CMap.size() > 0);
+            Order.resize(CMap.size());
+            for(size_t i=0; i<Order.size(); i++)
+                Order[i] = int(i);
+            Build(0, int(Order.size()));
+        }
+
+        // Return the index of the color map entry closest to P, and its squared distance in Err.
+        int Closest(const Pixel_T &P, MathType &Err) const
+        {
+            int BestC = int(CMap.size());
+            Err = std::numeric_limits<MathType>::max();
+            Search(0, P, BestC, Err);
+            return BestC;
+        }
+    };
+
+    // Remembers the closest color map entry to recently seen colors. Images have many pixels of the same few colors,
+    // so most pixels are found here instead of in the tree. Each thread has its own.
+    template<class Pixel_T>
+    class ClosestColorCache
+    {
+        typedef typename Pixel_T::FloatMathType MathType;
+        enum {CACHE_BITS = 12};
+
+        const ColorMapTree<Pixel_T> &Tree;
+        std::vector<Pixel_T> Colors;
+        std::vector<int> Inds; // -1 for an empty slot
+        std::vector<MathType> Errs;
+
+        static unsigned int Hash(const Pixel_T &P)
+        {
+            const unsigned char *b = (const unsigned char *)&P;
+            unsigned int h = 2166136261u;
+            for(size_t i=0; i<sizeof(Pixel_T); i++)
+                h = (h ^ b[i]) * 16777619u;
+            return (h ^ (h >> CACHE_BITS)) & ((1u << CACHE_BITS) - 1);
+        }
+
+    public:
+        explicit ClosestColorCache(const ColorMapTree<Pixel_T> &Tree_) : Tree(Tree_),
+            Colors(1 << CACHE_BITS, Pixel_T(0)), Inds(1 << CACHE_BITS, -1), Errs(1 << CACHE_BITS) {}
+
+        int Closest(const Pixel_T &P, MathType &Err)
+        {
+            unsigned int h = Hash(P);
+            if(Inds[h] < 0 || !(Colors[h] == P)) {
+                Colors[h] = P;
+                Inds[h] = Tree.Closest(P, Errs[h]);
+            }
+            Err = Errs[h];
+            return Inds[h];
+        }
+    };
+
+    // The part of a mapping pass done by one chunk.
+    template<class MathPixType, class Pixel_T>
+    struct QuantChunk
+    {
+        typedef typename Pixel_T::FloatMathType MathType;
+
+        std::vector<CountedPixel<MathPixType> > Centroids;
+        MathType Error, WorstErr;
+        Pixel_T WorstErrPix;
+
+        QuantChunk() : Error(0), WorstErr(0), WorstErrPix(0) {}
+    };
+
+    // Add up the chunks of a mapping pass, in order. WorstErr and WorstErrPix start as the values to beat.
+    template<class MathPixType, class Pixel_T>
+    typename Pixel_T::FloatMathType SumChunks(const std::vector<QuantChunk<MathPixType, Pixel_T> > &Chunks, const size_t MaxColors,
+        std::vector<CountedPixel<MathPixType> > &Centroids, typename Pixel_T::FloatMathType &WorstErr, Pixel_T &WorstErrPix)
+    {
+        typename Pixel_T::FloatMathType Error = 0;
+        Centroids.clear();
+        Centroids.resize(MaxColors);
+
+        for(size_t ch=0; ch<Chunks.size(); ch++) {
+            const QuantChunk<MathPixType, Pixel_T> &C = Chunks[ch];
+            Error += C.Error;
+            for(size_t i=0; i<MaxColors; i++) {
+                Centroids[i].count += C.Centroids[i].count;
+                Centroids[i].color += C.Centroids[i].color;
+            }
+
+            if(C.WorstErr > WorstErr) {
+                WorstErr = C.WorstErr;
+                WorstErrPix = C.WorstErrPix;
+            }
+        }
+
+        return Error;
+    }
+};
+
 // See if there are <= MaxColors unique colors. If so, return true and fill in IndexImg.
 template<class Pixel_T, class Index_T>
 bool Quantizer<Pixel_T, Index_T>::TrivialSolution()
 {
     for(size_t y=0; y<size && CMap.size() <= MaxColors; y++) {
+        // Runs of the same color are common.
+        if(y > 0 && Pix[y] == Pix[y-1]) {
+            IndexImg[y] = IndexImg[y-1];
+            continue;
+        }
+
         bool FoundIt = false;
         for(size_t i=0; i<CMap.size(); i++) {
             if(Pix[y] == CMap[i]) {
@@ -103,46 +318,54 @@ void Quantizer<Pixel_T, Index_T>::CentroidsToColorMap(const vector<CountedPixel<
 template<class Pixel_T, class Index_T>
 typename Quantizer<Pixel_T, Index_T>::MathType Quantizer<Pixel_T, Index_T>::Image24to8(vector<CountedPixel<MathPixType> > &Centroids)
 {
-    MathType Error = 0;
-    Centroids.clear();
-    Centroids.resize(MaxColors);
-
-    WorstErrPix = Pix[0]; // This is the value of the pixel that has the most error.
-    WorstErr = 0;
+    ASSERT_R(CMap.size() - 1 <= (size_t) numeric_limits<Index_T>::max());
+
+    const ColorMapTree<Pixel_T> Tree(CMap);
+    const int NumChunks = int((size + QUANT_CHUNK_SIZE - 1) / QUANT_CHUNK_SIZE);
+    vector<QuantChunk<MathPixType, Pixel_T> > Chunks(NumChunks);
+
+#pragma omp parallel
+    {
+        ClosestColorCache<Pixel_T> Cache(Tree);
+
+#pragma omp for schedule(dynamic)
+        for(int ch=0; ch<NumChunks; ch++) {
+            QuantChunk<MathPixType, Pixel_T> &C = Chunks[ch];
+            C.Centroids.resize(MaxColors);
+            C.Error = C.WorstErr = 0;
+            C.WorstErrPix = Pix[0];
+
+            const size_t y1 = std::min(size, (ch+1) * QUANT_CHUNK_SIZE);
+
+            // Set each pixel to closest color in color map.
+            for(size_t y=ch*QUANT_CHUNK_SIZE; y<y1; y++) {
+                MathType BestErr;
+                Index_T BestC = Index_T(Cache.Closest(Pix[y], BestErr));
+
+                IndexImg[y] = BestC;
+                C.Error += BestErr;
+
+                if(MakeArtisticPalette) {
+                    // Weight by distance, so farther ones don't get forgotten
+                    C.Centroids[BestC].count += BestErr;
+                    C.Centroids[BestC].color += MathPixType(Pix[y]) * BestErr;
+                } else {
+                    C.Centroids[BestC].count++;
+                    C.Centroids[BestC].color += MathPixType(Pix[y]);
+                }
 
-    // Set each pixel to closest color in color map.
-    for(size_t y=0; y<size; y++) {
-        MathType BestErr = numeric_limits<MathType>::max();
-        Index_T BestC = 0;
-        for(size_t i=0; i<CMap.size(); i++) {
-            MathType Err = DiffSqr(Pix[y], CMap[i]);
-            if(Err<BestErr) {
-                BestErr = Err;
-                BestC = Index_T(i);
+                if(BestErr > C.WorstErr) {
+                    C.WorstErr = BestErr;
+                    C.WorstErrPix = Pix[y];
+                }
             }
         }
-
-        IndexImg[y] = BestC;
-        Error += BestErr;
-
-        if(MakeArtisticPalette) {
-            // Weight by distance, so farther ones don't get forgotten
-            Centroids[BestC].count += BestErr;
-            Centroids[BestC].color += MathPixType(Pix[y]) * BestErr;
-        } else {
-            Centroids[BestC].count++;
-            Centroids[BestC].color += MathPixType(Pix[y]);
-        }
-
-        if(BestErr > WorstErr) {
-            WorstErr = BestErr;
-            WorstErrPix = Pix[y];
-        }
     }
 
-    ASSERT_R(CMap.size() <= (size_t) numeric_limits<Index_T>::max());
+    WorstErrPix = Pix[0]; // This is the value of the pixel that has the most error.
+    WorstErr = 0;
 
-    return Error;
+    return SumChunks(Chunks, MaxColors, Centroids, WorstErr, WorstErrPix);
 }
 
 // Given a histogram (a list of all the quantized colors and their frequency),
@@ -152,42 +375,47 @@ typename Quantizer<Pixel_T, Index_T>::MathType Quantizer<Pixel_T, Index_T>::Imag
 template<class Pixel_T, class Index_T>
 typename Quantizer<Pixel_T, Index_T>::MathType Quantizer<Pixel_T, Index_T>::Image24to8Fast(const vector<CountedPixel<Pixel_T> > &CHist, vector<CountedPixel<MathPixType> > &Centroids)
 {
-    MathType Error = 0;
-    Centroids.clear();
-    Centroids.resize(MaxColors);
-
-    WorstErrPix = Pix[0]; // This is the index of the pixel that has the most error.
-    WorstErr = 0;
-
-    // Set each histogram entry to the closest color in color map.
-    for(size_t y=0; y<CHist.size(); y++) {
-        MathType BestErr = std::numeric_limits<MathType>::max();
-        Index_T BestC = 0;
-        for(size_t i=0; i<CMap.size(); i++) {
-            MathType Err = DiffSqr(CHist[y].color, CMap[i]);
-            if(Err<BestErr) {
-                BestErr = Err;
-                BestC = Index_T(i);
+    // The histogram entries are all different colors, so they don't need a cache. The chunks are smaller because there are fewer entries.
+    const size_t ChunkSize = QUANT_CHUNK_SIZE >> 4;
+    const ColorMapTree<Pixel_T> Tree(CMap);
+    const int NumChunks = int((CHist.size() + ChunkSize - 1) / ChunkSize);
+    vector<QuantChunk<MathPixType, Pixel_T> > Chunks(NumChunks);
+
+#pragma omp parallel for schedule(dynamic)
+    for(int ch=0; ch<NumChunks; ch++) {
+        QuantChunk<MathPixType, Pixel_T> &C = Chunks[ch];
+        C.Centroids.resize(MaxColors);
+        C.Error = C.WorstErr = 0;
+        C.WorstErrPix = Pix[0];
+
+        const size_t y1 = std::min(CHist.size(), (ch+1) * ChunkSize);
+
+        // Set each histogram entry to the closest color in color map.
+        for(size_t y=ch*ChunkSize; y<y1; y++) {
+            MathType BestErr;
+            Index_T BestC = Index_T(Tree.Closest(CHist[y].color, BestErr));
+
+            C.Error += BestErr * CHist[y].count;
+            if(MakeArtisticPalette) {
+                // Weight by distance, so farther ones don't get forgotten
+                C.Centroids[BestC].count += CHist[y].count * BestErr;
+                C.Centroids[BestC].color += MathPixType(CHist[y].color) * CHist[y].count * BestErr;
+            } else {
+                C.Centroids[BestC].count += CHist[y].count;
+                C.Centroids[BestC].color += MathPixType(CHist[y].color) * CHist[y].count;
             }
-        }
-
-        Error += BestErr * CHist[y].count;
-        if(MakeArtisticPalette) {
-            // Weight by distance, so farther ones don't get forgotten
-            Centroids[BestC].count += CHist[y].count * BestErr;
-            Centroids[BestC].color += MathPixType(CHist[y].color) * CHist[y].count * BestErr;
-        } else {
-            Centroids[BestC].count += CHist[y].count;
-            Centroids[BestC].color += MathPixType(CHist[y].color) * CHist[y].count;
-        }
 
-        if(BestErr > WorstErr) {
-            WorstErr = BestErr;
-            WorstErrPix = CHist[y].color;
+            if(BestErr > C.WorstErr) {
+                C.WorstErr = BestErr;
+                C.WorstErrPix = CHist[y].color;
+            }
         }
     }
 
-    return Error;
+    WorstErrPix = Pix[0]; // This is the value of the histogram entry that has the most error.
+    WorstErr = 0;
+
+    return SumChunks(Chunks, MaxColors, Centroids, WorstErr, WorstErrPix);
 }
 
 // Given an initial colormap, refine it to reduce error.
@@ -275,18 +503,47 @@ void Quantizer<Pixel_T, Index_T>::MakeHist(vector<CountedPixel<Pixel_T> > &CHist
 #endif
 
     int keep = MakeArtisticPalette ? 4 : 5;
+    const int NumEntries = 1<<(Chan * keep);
 
     CHist.clear();
-    CHist.resize(1<<(Chan * keep));
+    CHist.resize(NumEntries);
+
+    // Each thread makes a histogram of a span of the image. The spans are in order, and an entry takes its color
+    // from the first pixel that hashes to it, so the merged histogram is the same as making it in one pass.
+    int NumParts = 1;
+#ifdef _OPENMP
+    NumParts = std::max(1, std::min(omp_get_max_threads(), int(size / QUANT_CHUNK_SIZE)));
+#endif
+    vector<vector<CountedPixel<Pixel_T> > > Parts(NumParts - 1);
 
     // Go through the entire image, building a hash table of colors.
-    for(size_t i=0; i<size; i++) {
-        int ind = PixelHash(Pix[i], keep);
+#pragma omp parallel for schedule(static)
+    for(int p=0; p<NumParts; p++) {
+        vector<CountedPixel<Pixel_T> > &H = p ? Parts[p-1] : CHist;
+        H.resize(NumEntries);
+        const size_t i1 = size * (p+1) / NumParts;
+        for(size_t i=size * p / NumParts; i<i1; i++) {
+            int ind = PixelHash(Pix[i], keep);
+
+            if(H[ind].count == 0) {
+                H[ind].color = Pix[i];
+            }
+            H[ind].count++;
+        }
+    }
 
-        if(CHist[ind].count == 0) {
-            CHist[ind].color = Pix[i];
+    if(NumParts > 1) {
+#pragma omp parallel for schedule(static)
+        for(int ind=0; ind<NumEntries; ind++) {
+            for(int p=0; p<NumParts-1; p++) {
+                const CountedPixel<Pixel_T> &E = Parts[p][ind];
+                if(E.count == 0)
+                    continue;
+                if(CHist[ind].count == 0)
+                    CHist[ind].color = E.color;
+                CHist[ind].count += E.count;
+            }
         }
-        CHist[ind].count++;
     }
 
     // Sort the table to put empty elements at the end.
@@ -305,6 +562,9 @@ void Quantizer<Pixel_T, Index_T>::MakeHist(vector<CountedPixel<Pixel_T> > &CHist
         }
     }
 
+    if(CHist[top].count)
+        top++; // The loop stops when it gets to top, so it hasn't looked at whether top is used.
+
     CHist.resize(top); // Chop it down to only the ones that are used
 
     if(MakeArtisticPalette) {
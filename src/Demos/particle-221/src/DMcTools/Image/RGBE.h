@@ -5,6 +5,10 @@
 
 #include <cmath>
 
+// make_f3Pixel() and rgbePixel(const f3Pixel &) of a row of n pixels at once. These are in ImageConvert.cpp.
+void RGBEToFloatRow(float *D, const unsigned char *S, const int n);
+void FloatToRGBERow(unsigned char *D, const float *S, const int n);
+
 // A subclass for RGBE pixels.
 class rgbePixel : public tPixel<unsigned char, 4>
 {
@@ -7,17 +7,102 @@
 */
 
 #include "Util/Assert.h"
+#include "Image/RGBE.h"
 #include "Image/RGBEio.h"
 
 #include <cstdio>
 #include <cmath>
+#include <cstring>
 #include <malloc.h>
 
+#ifdef DMC_USE_SSE
+#include <emmintrin.h>
+#endif
+
 #define MINELEN 8 /* minimum scanline length for encoding */
 #define MAXELEN 0x7fff /* maximum scanline length for encoding */
 #define MINRUN 4 /* minimum run length */
 
-int fwritergbe(RGBE *scanline, int len, FILE *fp)/* write out a rgbe scanline */
+/* The new scanline format stores each component of the scanline separately. These split a scanline
+ * into its four components, one after another in planes, and join them back into a scanline. */
+
+#ifdef DMC_USE_SSE
+static DMC_INLINE __m128i packlowbytes(__m128i a, __m128i b, __m128i c, __m128i d) /* the low byte of each int of a, b, c, and d */
+{
+    const __m128i M = _mm_set1_epi32(0xff);
+    return _mm_packus_epi16(_mm_packs_epi32(_mm_and_si128(a, M), _mm_and_si128(b, M)),
+        _mm_packs_epi32(_mm_and_si128(c, M), _mm_and_si128(d, M)));
+}
+#endif
+
+static void splitrgbe(BYTE *planes, const RGBE *scanline, int len)
+{
+    int i, j = 0;
+#ifdef DMC_USE_SSE
+    for (; j+16 <= len; j += 16) {
+        const __m128i v0 = _mm_loadu_si128((const __m128i *)(scanline+j));
+        const __m128i v1 = _mm_loadu_si128((const __m128i *)(scanline+j+4));
+        const __m128i v2 = _mm_loadu_si128((const __m128i *)(scanline+j+8));
+        const __m128i v3 = _mm_loadu_si128((const __m128i *)(scanline+j+12));
+        _mm_storeu_si128((__m128i *)(planes+j), packlowbytes(v0, v1, v2, v3));
+        _mm_storeu_si128((__m128i *)(planes+len+j), packlowbytes(_mm_srli_epi32(v0, 8), _mm_srli_epi32(v1, 8),
+            _mm_srli_epi32(v2, 8), _mm_srli_epi32(v3, 8)));
+        _mm_storeu_si128((__m128i *)(planes+2*len+j), packlowbytes(_mm_srli_epi32(v0, 16), _mm_srli_epi32(v1, 16),
+            _mm_srli_epi32(v2, 16), _mm_srli_epi32(v3, 16)));
+        _mm_storeu_si128((__m128i *)(planes+3*len+j), packlowbytes(_mm_srli_epi32(v0, 24), _mm_srli_epi32(v1, 24),
+            _mm_srli_epi32(v2, 24), _mm_srli_epi32(v3, 24)));
+    }
+#endif
+    for (; j < len; j++)
+        for (i = 0; i < 4; i++)
+            planes[i*len+j] = scanline[j][i];
+}
+
+static void joinrgbe(RGBE *scanline, const BYTE *planes, int len)
+{
+    int i, j = 0;
+#ifdef DMC_USE_SSE
+    for (; j+16 <= len; j += 16) {
+        const __m128i r = _mm_loadu_si128((const __m128i *)(planes+j));
+        const __m128i g = _mm_loadu_si128((const __m128i *)(planes+len+j));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(planes+2*len+j));
+        const __m128i e = _mm_loadu_si128((const __m128i *)(planes+3*len+j));
+        const __m128i rglo = _mm_unpacklo_epi8(r, g), rghi = _mm_unpackhi_epi8(r, g);
+        const __m128i belo = _mm_unpacklo_epi8(b, e), behi = _mm_unpackhi_epi8(b, e);
+        _mm_storeu_si128((__m128i *)(scanline+j), _mm_unpacklo_epi16(rglo, belo));
+        _mm_storeu_si128((__m128i *)(scanline+j+4), _mm_unpackhi_epi16(rglo, belo));
+        _mm_storeu_si128((__m128i *)(scanline+j+8), _mm_unpacklo_epi16(rghi, behi));
+        _mm_storeu_si128((__m128i *)(scanline+j+12), _mm_unpackhi_epi16(rghi, behi));
+    }
+#endif
+    for (; j < len; j++)
+        for (i = 0; i < 4; i++)
+            scanline[j][i] = planes[i*len+j];
+}
+
+static DMC_INLINE int runlength(const BYTE *p, int n) /* how many of the first n bytes of p equal p[0] */
+{
+    int cnt = 1;
+
+    /* Most bytes don't start a run, so look at the first few alone. */
+    while (cnt < n && cnt < MINRUN && p[cnt] == p[0])
+        cnt++;
+    if (cnt < MINRUN)
+        return(cnt);
+#ifdef DMC_USE_SSE
+    const __m128i v = _mm_set1_epi8((char)p[0]);
+    for (; cnt+16 <= n; cnt += 16)
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p+cnt)), v)) != 0xffff)
+            break;
+#endif
+    while (cnt < n && p[cnt] == p[0])
+        cnt++;
+    return(cnt);
+}
+
+/* write out a rgbe scanline */
+/* The components are split into the start of scratch, encoded after them, and written at once. */
+int fwritergbe(RGBE *scanline, int len, FILE *fp, BYTE *scratch)
 {
     int i, j, beg, cnt=0;
     int c2;
@@ -28,44 +113,48 @@ int fwritergbe(RGBE *scanline, int len, FILE *fp)/* write out a rgbe scanline */
         len,
         fp))
         - len);
+    BYTE *planes = scratch, *out = scratch + 4*len, *op = out;
     /* put magic header */
-    putc(2, fp);
-    putc(2, fp);
-    putc(len>>8, fp);
-    putc(len&255, fp);
+    *op++ = 2;
+    *op++ = 2;
+    *op++ = BYTE(len>>8);
+    *op++ = BYTE(len&255);
     /* put components seperately */
+    splitrgbe(planes, scanline, len);
     for (i = 0; i < 4; i++) {
+        const BYTE *p = planes + i*len;
         for (j = 0; j < len; j += cnt) { /* find next run */
             for (beg = j; beg < len; beg += cnt) {
-                for (cnt = 1; cnt < 127 && beg+cnt < len &&
-                    scanline[beg+cnt][i] == scanline[beg][i]; cnt++)
-                    ;
+                cnt = runlength(p+beg, len-beg < 127 ? len-beg : 127);
                 if (cnt >= MINRUN)
                     break; /* long enough */
             }
             if (beg-j > 1 && beg-j < MINRUN) {
                 c2 = j+1;
-                while (scanline[c2++][i] == scanline[j][i])
+                while (p[c2++] == p[j])
                     if (c2 == beg) { /* short run */
-                        putc(128+beg-j, fp);
-                        putc(scanline[j][i], fp);
+                        *op++ = BYTE(128+beg-j);
+                        *op++ = p[j];
                         j = beg;
                         break;
                     }
             }
             while (j < beg) { /* write out non-run */
                 if ((c2 = beg-j) > 128) c2 = 128;
-                putc(c2, fp);
-                while (c2--)
-                    putc(scanline[j++][i], fp);
+                *op++ = BYTE(c2);
+                memcpy(op, p+j, c2);
+                op += c2;
+                j += c2;
             }
             if (cnt >= MINRUN) { /* write out run */
-                putc(128+cnt, fp);
-                putc(scanline[beg][i], fp);
+                *op++ = BYTE(128+cnt);
+                *op++ = p[beg];
             } else
                 cnt = 0;
         }
     }
+    if (fwrite(out, 1, op-out, fp) != size_t(op-out))
+        return(-1);
     return(ferror(fp) ? -1 : 0);
 }
 
@@ -145,6 +234,108 @@ int oldreadrgbe(RGBE *scanline, int len, FILE *fp) /* read in an old rgbe scanli
 }
 
 
+/* The m* readers below decode from a file mapped in memory instead of a FILE.
+ * src is advanced past what was read, and nothing is read at or past end.
+ * Each component's runs are decoded into its plane, and the planes are then joined into the scanline. */
+
+int moldreadrgbe(RGBE *scanline, int len, const BYTE *&src, const BYTE *end) /* read in an old rgbe scanline from memory */
+{
+    int rshift;
+    int i;
+
+    rshift = 0;
+
+    while (len > 0) {
+        if (end - src < 4)
+            return(-1);
+        copyrgbe(scanline[0], src);
+        src += 4;
+        if (scanline[0][RED] == 1 &&
+            scanline[0][GRN] == 1 &&
+            scanline[0][BLU] == 1) {
+            for (i = scanline[0][EXP] << rshift; i > 0 && len > 0; i--) {
+                copyrgbe(scanline[0], scanline[-1]);
+                scanline++;
+                len--;
+            }
+            rshift += 8;
+        } else {
+            scanline++;
+            len--;
+            rshift = 0;
+        }
+    }
+    return(0);
+}
+
+
+int mreadrgbe(RGBE *scanline, int len, const BYTE *&src, const BYTE *end, BYTE *planes) /* read in an encoded rgbe scanline from memory */
+{
+    int i, j;
+    int code, val;
+    /* determine scanline type */
+    if (len < MINELEN || len > MAXELEN)
+        return(moldreadrgbe(scanline, len, src, end));
+    if (end - src < 4)
+        return(-1);
+    if (src[0] != 2 || src[1] != 2 || src[2] & 128)
+        return(moldreadrgbe(scanline, len, src, end));
+    if ((src[2]<<8 | src[3]) != len)
+        return(-1); /* length mismatch! */
+    src += 4;
+    /* read each component */
+    for (i = 0; i < 4; i++) {
+        BYTE *p = planes + i*len;
+        for (j = 0; j < len; j += code) {
+            if (src >= end)
+                return(-1);
+            code = *src++;
+            if (code > 128) { /* run */
+                code &= 127;
+                if (src >= end || code > len - j)
+                    return(-1);
+                val = *src++;
+                memset(p+j, val, code);
+            } else { /* non-run */
+                if (end - src < code || code > len - j)
+                    return(-1);
+                memcpy(p+j, src, code);
+                src += code;
+            }
+        }
+    }
+    joinrgbe(scanline, planes, len);
+    return(0);
+}
+
+
+/* setrgbe() of a float color, which gets the mantissa and exponent from the bits of the largest component instead of frexp() */
+static DMC_INLINE void setrgbefloat(RGBE rgbe, float r, float g, float b)
+{
+    float f = r > g ? r : g;
+    if (b > f) f = b;
+
+    unsigned int bits;
+    memcpy(&bits, &f, sizeof(bits));
+    if (f <= 1e-32 || (bits & 0x7f800000) == 0x7f800000) { /* zero, or inf or nan */
+        setrgbe(rgbe, r, g, b);
+        return;
+    }
+
+    /* f is positive and normal, so frexp() would give the same mantissa bits with an exponent of -1. */
+    const int e = int(bits >> 23) - 126;
+    bits = (bits & 0x007fffff) | (126u << 23);
+    float mant;
+    memcpy(&mant, &bits, sizeof(mant));
+    const double d = mant * 255.9999 / f;
+
+    rgbe[RED] = (unsigned char)(r * d);
+    rgbe[GRN] = (unsigned char)(g * d);
+    rgbe[BLU] = (unsigned char)(b * d);
+    rgbe[EXP] = e + COLXS;
+}
+
+
 int fwritescan(COLOR *scanline, RGBE *clrscan, int len, FILE *fp) /* write out a scanline */
 {
     int n;
@@ -153,13 +344,13 @@ int fwritescan(COLOR *scanline, RGBE *clrscan, int len, FILE *fp) /* write out a
     /* convert scanline */
     n = len;
     while (n-- > 0) {
-        setrgbe(sp[0], scanline[0][RED],
+        setrgbefloat(sp[0], scanline[0][RED],
             scanline[0][GRN],
             scanline[0][BLU]);
         scanline++;
         sp++;
     }
-    return(fwritergbe(clrscan, len, fp));
+    return(fwritergbe(clrscan, len, fp, (BYTE *)(clrscan+len)));
 }
 
 
@@ -183,6 +374,16 @@ int freadscan(COLOR *scanline, RGBE *clrscan, int len, FILE *fp) /* read in a sc
 }
 
 
+int mreadscan(COLOR *scanline, RGBE *clrscan, int len, const BYTE *&src, const BYTE *end) /* read in a scanline from memory */
+{
+    if (mreadrgbe(clrscan, len, src, end, (BYTE *)(clrscan+len)) < 0)
+        return(-1);
+    /* convert scanline, the same as rgbe_color() */
+    RGBEToFloatRow((float *)scanline, (const BYTE *)clrscan, len);
+    return(0);
+}
+
+
 DMC_INLINE int setrgbe(RGBE rgbe,double r,double g,double b) /* assign a short color value */
 {
     double d;
@@ -168,7 +168,11 @@ extern COLORMAT xyz2rgbmat; /* XYZ to RGB conversion matrix */
 
 char *tempbuffer(unsigned int len); /* get a temporary buffer */
 
-int fwritergbe(RGBE *scanline, int len, FILE *fp); /* write out a rgbe scanline */
+/* RGBEs of helpit that fwritescan() and mreadscan() need for a scanline of len pixels:
+ * the scanline, its four components one after another, and the encoded scanline */
+#define SCANSCRATCH(len) (3*(len) + (len)/128 + 4)
+
+int fwritergbe(RGBE *scanline, int len, FILE *fp, BYTE *scratch); /* write out a rgbe scanline */
 
 int freadrgbe(RGBE* scanline, int len, FILE *fp); /* read in an encoded rgbe scanline */
 
@@ -178,6 +182,12 @@ int fwritescan(COLOR *scanline, RGBE *helpit, int len, FILE *fp); /* write out a
 
 int freadscan(COLOR *scanline, RGBE *helpit, int len, FILE *fp); /* read in a scanline */
 
+int moldreadrgbe(RGBE *scanline, int len, const BYTE *&src, const BYTE *end); /* read in an old rgbe scanline from memory */
+
+int mreadrgbe(RGBE *scanline, int len, const BYTE *&src, const BYTE *end, BYTE *planes); /* read in an encoded rgbe scanline from memory */
+
+int mreadscan(COLOR *scanline, RGBE *helpit, int len, const BYTE *&src, const BYTE *end); /* read in a scanline from memory */
+
 int setrgbe(RGBE clr,double r,double g,double b); /* assign a short color value */
 
 int rgbe_color(COLOR col, RGBE clr); /* convert short to float color */
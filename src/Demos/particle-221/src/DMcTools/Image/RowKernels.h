@@ -0,0 +1,156 @@
+//////////////////////////////////////////////////////////////////////
+// RowKernels.h - Inner loops over runs of float and unsigned char channels
+//
+// Copyright David K. McAllister, 2008.
+
+// The image algorithms and conversions spend their time in a few simple loops over long runs of channels. An image row
+// of any number of channels is just wid*Chan consecutive elements, so each of these loops handles
+// every pixel type. With SSE they do four channels per instruction, and the remainder one at a time.
+// Each produces exactly the same values as the obvious scalar loop, so callers can switch freely.
+
+#ifndef dmc_rowKernels_h
+#define dmc_rowKernels_h
+
+#include "toolconfig.h"
+
+#ifdef DMC_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// D[i] = the sum over the N x N taps of Rows[yk][i + xk*C] * K[yk*N + xk], for n elements.
+// Rows[yk] is kernel row yk's input row, starting at the input pixel under the kernel's first column.
+// C is the channels per pixel, so the taps of an element are C elements apart.
+// The taps are summed in order in a register, like sample_kernel_full() does, so the results are identical.
+DMC_INLINE void RowConvolve(float *D, const float *const *Rows, const float *K, const int N, const int C, const int n)
+{
+    int i = 0;
+#ifdef DMC_USE_SSE
+    // Two independent sums at a time hide the latency of the adds.
+    for(; i+8<=n; i+=8) {
+        __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+        const float *Kp = K;
+        for(int yk=0; yk<N; yk++) {
+            const float *R = Rows[yk] + i;
+            for(int xk=0; xk<N; xk++, R+=C) {
+                const __m128 Kk = _mm_set1_ps(*Kp++);
+                s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(R), Kk));
+                s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(R+4), Kk));
+            }
+        }
+        _mm_storeu_ps(D+i, s0);
+        _mm_storeu_ps(D+i+4, s1);
+    }
+#endif
+    for(; i<n; i++) {
+        float s = 0;
+        const float *Kp = K;
+        for(int yk=0; yk<N; yk++) {
+            const float *R = Rows[yk] + i;
+            for(int xk=0; xk<N; xk++, R+=C)
+                s += *R * *Kp++;
+        }
+        D[i] = s;
+    }
+}
+
+// D[i] = A[i] + (B[i] - A[i]) * t, for n elements. This is Interpolate() with the same weight on every channel.
+DMC_INLINE void RowLerp(float *D, const float *A, const float *B, const float t, const int n)
+{
+    int i = 0;
+#ifdef DMC_USE_SSE
+    const __m128 t4 = _mm_set1_ps(t);
+    for(; i+4<=n; i+=4) {
+        __m128 a = _mm_loadu_ps(A+i);
+        _mm_storeu_ps(D+i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(B+i), a), t4)));
+    }
+#endif
+    for(; i<n; i++)
+        D[i] = A[i] + (B[i] - A[i]) * t;
+}
+
+// D[i] = S[i] / 255, for n elements. This is channel_cast from unsigned char to float.
+DMC_INLINE void RowUCharToFloat(float *D, const unsigned char *S, const int n)
+{
+    int i = 0;
+#ifdef DMC_USE_SSE
+    const __m128 D255 = _mm_set1_ps(255.0f);
+    const __m128i Z = _mm_setzero_si128();
+    for(; i+16<=n; i+=16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(S+i));
+        __m128i lo = _mm_unpacklo_epi8(b, Z), hi = _mm_unpackhi_epi8(b, Z);
+        _mm_storeu_ps(D+i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, Z)), D255));
+        _mm_storeu_ps(D+i+4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, Z)), D255));
+        _mm_storeu_ps(D+i+8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, Z)), D255));
+        _mm_storeu_ps(D+i+12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, Z)), D255));
+    }
+#endif
+    for(; i<n; i++)
+        D[i] = S[i] / 255.0f;
+}
+
+// D[i] = S[i] * Scale + Bias, clamped to 0..1 and converted to unsigned char, for n elements.
+// This is ToneMapLinear() of one element, including channel_cast's truncation instead of rounding.
+DMC_INLINE void RowFloatToUChar(unsigned char *D, const float *S, const float Scale, const float Bias, const int n)
+{
+    int i = 0;
+#ifdef DMC_USE_SSE
+    const __m128 Sc = _mm_set1_ps(Scale), Bi = _mm_set1_ps(Bias), Zf = _mm_setzero_ps(), F255 = _mm_set1_ps(255.0f);
+    for(; i+16<=n; i+=16) {
+        __m128i q[4];
+        for(int k=0; k<4; k++) {
+            __m128 v = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(S+i+k*4), Sc), Bi), F255);
+            // The same comparisons as Clamp(0, v, 255).
+            v = _mm_max_ps(Zf, _mm_min_ps(F255, v));
+            q[k] = _mm_cvttps_epi32(v);
+        }
+        __m128i w = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+        _mm_storeu_si128((__m128i *)(D+i), w);
+    }
+#endif
+    for(; i<n; i++) {
+        float v = S[i] * Scale;
+        v += Bias;
+        v *= 255.0f;
+        D[i] = static_cast<unsigned char>(v <= 0.0f ? 0.0f : (v >= 255.0f ? 255.0f : v));
+    }
+}
+
+// D[i] = S[i] / 65535, for n elements. This is channel_cast from unsigned short to float.
+DMC_INLINE void RowUShortToFloat(float *D, const unsigned short *S, const int n)
+{
+    int i = 0;
+#ifdef DMC_USE_SSE
+    const __m128 D65535 = _mm_set1_ps(65535.0f);
+    const __m128i Z = _mm_setzero_si128();
+    for(; i+8<=n; i+=8) {
+        __m128i w = _mm_loadu_si128((const __m128i *)(S+i));
+        _mm_storeu_ps(D+i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(w, Z)), D65535));
+        _mm_storeu_ps(D+i+4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(w, Z)), D65535));
+    }
+#endif
+    for(; i<n; i++)
+        D[i] = S[i] / 65535.0f;
+}
+
+// D[i] = S[i] * 65535, clamped and truncated to unsigned short, for n elements. This is channel_cast from float to unsigned short.
+DMC_INLINE void RowFloatToUShort(unsigned short *D, const float *S, const int n)
+{
+    int i = 0;
+#ifdef DMC_USE_SSE
+    // SSE2 can only pack to signed shorts, so pack v - 32768 and flip the top bit back.
+    const __m128 Zf = _mm_setzero_ps(), F65535 = _mm_set1_ps(65535.0f);
+    const __m128i Off = _mm_set1_epi32(32768), Flip = _mm_set1_epi16(short(0x8000));
+    for(; i+8<=n; i+=8) {
+        __m128 v0 = _mm_max_ps(Zf, _mm_min_ps(F65535, _mm_mul_ps(_mm_loadu_ps(S+i), F65535)));
+        __m128 v1 = _mm_max_ps(Zf, _mm_min_ps(F65535, _mm_mul_ps(_mm_loadu_ps(S+i+4), F65535)));
+        __m128i q0 = _mm_sub_epi32(_mm_cvttps_epi32(v0), Off), q1 = _mm_sub_epi32(_mm_cvttps_epi32(v1), Off);
+        _mm_storeu_si128((__m128i *)(D+i), _mm_xor_si128(_mm_packs_epi32(q0, q1), Flip));
+    }
+#endif
+    for(; i<n; i++) {
+        const float v = S[i] * 65535.0f;
+        D[i] = static_cast<unsigned short>(v <= 0.0f ? 0.0f : (v >= 65535.0f ? 65535.0f : v));
+    }
+}
+
+#endif
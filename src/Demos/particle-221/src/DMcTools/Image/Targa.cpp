@@ -4,8 +4,13 @@
 // Modified by David K. McAllister, Aug. 2000.
 
 #include "Image/ImageLoadSave.h"
+#include "Image/ImageStream.h"
+#include "Util/MappedFile.h"
 
 #include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
 using namespace std;
 
 // Header definition.
@@ -44,300 +49,211 @@ typedef struct TGA_Header_
 ////////////////////////////////////////////////////////////////
 // Load Targa
 
+// Pixel decoders. Each converts one Targa pixel of SrcBytes bytes to a pixel of chan bytes.
+
+// One-channel image. A straight copy.
+struct decode_mono
+{
+    enum { SrcBytes = 1 };
+    DMC_INLINE void operator()(unsigned char *dest, const unsigned char *src) const { dest[0] = src[0]; }
+};
+
 // Color mapped image with one-byte indices at each pixel.
-// Unpacks it into a standard raster image with chan channels.
-static int decode_map8(const unsigned char *src0, unsigned char *dest0, const int size,
-                       const int chan, const unsigned char *color_map)
+struct decode_map8
 {
-    const unsigned char *src = src0;
-    unsigned char *dest = dest0;
+    enum { SrcBytes = 1 };
+    const unsigned char *color_map;
+    int chan;
 
-    for(int i=0; i<size; i++)
+    decode_map8(const unsigned char *color_map_, const int chan_) : color_map(color_map_), chan(chan_) {}
+    DMC_INLINE void operator()(unsigned char *dest, const unsigned char *src) const
     {
         for(int c=0; c<chan; c++)
             dest[chan - c - 1] = color_map[src[0] * chan + c];
-        src++;
-        dest += chan;
     }
+};
 
-    return(0);
-}
-
-// Make a 24-bit image out of the 16-bit RGB image
-// Works for X1R5G5B5 images.
-static int decode_rgb16(const unsigned char *src0, unsigned char *dest0,
-                        const int wid, const int hgt, const bool R5G6B5)
+// Make a 24-bit pixel out of a 16-bit RGB pixel.
+// Works for X1R5G5B5 or R5G6B5 images.
+struct decode_rgb16
 {
-    const unsigned char *src = src0;
-    unsigned char *dest = dest0;
+    enum { SrcBytes = 2 };
+    bool R5G6B5;
 
-    if(R5G6B5) {
-        for(int i=0; i<wid*hgt; i++)
-        {
+    decode_rgb16(const bool R5G6B5_) : R5G6B5(R5G6B5_) {}
+    DMC_INLINE void operator()(unsigned char *dest, const unsigned char *src) const
+    {
+        if(R5G6B5) {
             dest[0] = (src[1] << 0) & 0xf8;
             dest[1] = ((src[1] << 5) | (src[0] >> 3)) & 0xfc;
             dest[2] = (src[0] << 3) & 0xf8;
-            src += 2;
-            dest += 3;
-        }
-    } else{
-        for(int i=0; i<wid*hgt; i++)
-        {
+        } else {
             dest[0] = (src[1] << 1) & 0xf8;
             dest[1] = ((src[1] << 6) | (src[0] >> 2)) & 0xf8;
             dest[2] = (src[0] << 3) & 0xf8;
-            src += 2;
-            dest += 3;
         }
     }
+};
 
-    return(0);
-}
-
-static int decode_rgb24(const unsigned char *src0, unsigned char *dest0,
-                        const int wid, const int hgt)
+struct decode_rgb24
 {
-    const unsigned char *src = src0;
-    unsigned char *dest = dest0;
-
-    for(int i=0; i<wid*hgt; i++)
+    enum { SrcBytes = 3 };
+    DMC_INLINE void operator()(unsigned char *dest, const unsigned char *src) const
     {
         dest[0] = src[2]; // Red
         dest[1] = src[1]; // Green
         dest[2] = src[0]; // Blue
-        src += 3;
-        dest += 3;
     }
+};
 
-    return(0);
-}
-
-static int decode_rgb32(const unsigned char *src0, unsigned char *dest0,
-                        const int wid, const int hgt)
+struct decode_rgb32
 {
-    const unsigned char *src = src0;
-    unsigned char *dest = dest0;
-
-    for(int i=0; i<wid*hgt; i++)
+    enum { SrcBytes = 4 };
+    DMC_INLINE void operator()(unsigned char *dest, const unsigned char *src) const
     {
         dest[0] = src[2]; // Red
         dest[1] = src[1]; // Green
         dest[2] = src[0]; // Blue
         dest[3] = src[3]; // Alpha
-        src += 4;
-        dest += 4;
     }
+};
 
-    return(0);
+// Decode the hgt rows of uncompressed Targa pixels at src into Pix.
+// Bottom-up images are decoded into flipped rows, so the origin is always top left.
+template<class Dec_T>
+static void decode_raw(const unsigned char *src, unsigned char *Pix, const int wid, const int hgt,
+                       const int chan, const bool flip, const Dec_T &Dec)
+{
+    for(int y=0; y<hgt; y++) {
+        unsigned char *dest = Pix + (flip ? hgt-1-y : y) * wid * chan;
+        for(int x=0; x<wid; x++, src += Dec_T::SrcBytes, dest += chan)
+            Dec(dest, src);
+    }
 }
 
-// Decode run-length encoded Targa into 24-bit pixels
-// Stores 16-bit RGB source data into a 24-bit dest.
-static int decode_rgb_rle16(const unsigned char *src0, unsigned char *dest0,
-                            const int wid, const int hgt, const bool R5G6B5)
+static void decode_raw(const unsigned char *src, unsigned char *Pix, const int wid, const int hgt,
+                       const int chan, const bool flip, const decode_mono &)
 {
-    int chan = 3;
-    const unsigned char *src = src0;
-    unsigned char *dest = dest0;
+    for(int y=0; y<hgt; y++, src += wid)
+        memcpy(Pix + (flip ? hgt-1-y : y) * wid, src, wid);
+}
 
-    while(dest < dest0 + wid*hgt*chan) {
-        // Pixels encoded in "packets"
-        // First byte is raw/rle flag(upper bit) and count(1-128 as 0-127 in lower 7 bits)
-        // If raw, the next count chan-byte color values in the file are taken verbatim
-        // If rle, the next single chan-byte color value speaks for the next count pixels
+// Where a run-length encoded decode is in the file. Packets may cross scanlines, so this is kept from one row to the next.
+struct tga_rle_state
+{
+    const unsigned char *src; // The next packet, or the rest of a raw packet's pixels
+    int left; // Pixels left in the current packet
+    bool raw;
+    unsigned char color[4]; // The decoded color of an rle packet
+
+    tga_rle_state(const unsigned char *src_) : src(src_), left(0), raw(true) {}
+};
+
+// Decode one row of run-length encoded Targa into dest, or skip over it if dest is NULL.
+// Pixels are encoded in "packets". The first byte is raw/rle flag (upper bit) and count (1-128 as 0-127 in lower 7 bits).
+// If raw, the next count pixels in the file are taken verbatim.
+// If rle, the next single pixel speaks for the next count pixels. It's decoded once and replicated.
+// Packets are split at the end of the row so each piece is a simple loop.
+// Returns false if the file ends before the row is full.
+template<class Dec_T>
+static bool decode_rle_row(tga_rle_state &St, const unsigned char *end, unsigned char *dest, const int wid,
+                           const int chan, const Dec_T &Dec)
+{
+    const int S = Dec_T::SrcBytes;
 
-        int raw = (*src & 0x80) == 0; // Is this packet raw pixels or a repeating color
-        int count = (*src & 0x7f) + 1; // How many raw pixels or color repeats
-        src++; // Advance src beyond first byte to next color
+    for(int x = 0; x < wid; ) {
+        if(St.left == 0) {
+            if(St.src >= end) return false;
+            St.raw = (*St.src & 0x80) == 0; // Is this packet raw pixels or a repeating color
+            St.left = (*St.src & 0x7f) + 1; // How many raw pixels or color repeats
+            St.src++;
 
-        if(dest + count*chan > dest0 + wid*hgt*chan) // prevent from writing out of dest range
-            count = (dest0 + wid*hgt*chan - dest) / chan;
+            if(end - St.src < (St.raw ? St.left : 1) * S) return false;
 
-        if(R5G6B5) {
-            for(int j=0; j<count; j++)
-            {
-                dest[0] = (src[1] << 0) & 0xf8;
-                dest[1] = ((src[1] << 5) | (src[0] >> 3)) & 0xfc;
-                dest[2] = (src[0] << 3) & 0xf8;
-
-                if(raw) // In raw mode, keep advancing "src" to subsequent values
-                    src += 2; // In RLE mode, just repeat the packet[1] RGB color
-                dest += chan;
+            if(!St.raw) {
+                Dec(St.color, St.src);
+                St.src += S;
             }
-        } else {
-            for(int j=0; j<count; j++)
-            {
-                dest[0] = (src[1] << 1) & 0xf8;
-                dest[1] = ((src[1] << 6) | (src[0] >> 2)) & 0xf8;
-                dest[2] = (src[0] << 3) & 0xf8;
+        }
+
+        int n = std::min(St.left, wid - x);
 
-                if(raw) // In raw mode, keep advancing "src" to subsequent values
-                    src += 2; // In RLE mode, just repeat the packet[1] RGB color
-                dest += chan;
+        if(dest == NULL) {
+            if(St.raw) St.src += n * S;
+        } else {
+            unsigned char *dp = dest + x * chan;
+            if(St.raw) {
+                for(int j=0; j<n; j++, St.src += S, dp += chan)
+                    Dec(dp, St.src);
+            } else if(chan == 1) {
+                memset(dp, St.color[0], n);
+            } else {
+                for(int j=0; j<n; j++, dp += chan)
+                    memcpy(dp, St.color, chan);
             }
         }
 
-        if(!raw) // After outputting count RGB values, advance "src" beyond color if rle
-            src += 2;
+        St.left -= n;
+        x += n;
     }
 
-    ASSERT_R(dest <= dest0 + wid*hgt*chan);
-
-    return(0);
+    return true;
 }
 
-// Decode run-length encoded Targa into 8-bit pixels
-// Stores 8-bit source data into a 8-bit dest.
-static int decode_rgb_rle8(const unsigned char *src0, unsigned char *dest0,
-                           const int wid, const int hgt)
+// Decode run-length encoded Targa into Pix. Any pixels past the end of the image are ignored.
+// Returns false if the file ends before the image is full.
+template<class Dec_T>
+static bool decode_rle(const unsigned char *src, const unsigned char *end, unsigned char *Pix, const int wid, const int hgt,
+                       const int chan, const bool flip, const Dec_T &Dec)
 {
-    int chan = 1;
-    const unsigned char *src = src0;
-    unsigned char *dest = dest0;
-
-    while(dest < dest0 + wid*hgt*chan) {
-        // Pixels encoded in "packets"
-        // First byte is raw/rle flag(upper bit) and count(1-128 as 0-127 in lower 7 bits)
-        // If raw, the next count chan-byte color values in the file are taken verbatim
-        // If rle, the next single chan-byte color value speaks for the next count pixels
-
-        int raw = (*src & 0x80) == 0; // Is this packet raw pixels or a repeating color
-        int count = (*src & 0x7f) + 1; // How many raw pixels or color repeats
-        src++; // Advance src beyond first byte to 8-bit color
-
-        if(dest + count*chan > dest0 + wid*hgt*chan) // prevent from writing out of dest range
-            count = (dest0 + wid*hgt*chan - dest) / chan;
-
-        for(int j=0; j<count; j++)
-        {
-            dest[0] = src[0]; // Red
-
-            if(raw) // In raw mode, keep advancing "src" to subsequent values
-                src += chan; // In RLE mode, just repeat the packet[1] RGB color
-            dest += chan;
-        }
-        if(!raw) // After outputting count RGB values, advance "src" beyond color if rle
-            src += chan;
-    }
+    tga_rle_state St(src);
 
-    ASSERT_R(dest <= dest0 + wid*hgt*chan);
+    for(int y=0; y<hgt; y++)
+        if(!decode_rle_row(St, end, Pix + (flip ? hgt-1-y : y) * wid * chan, wid, chan, Dec))
+            return false;
 
-    return(0);
+    return true;
 }
 
-// Decode run-length encoded Targa into 24-bit pixels
-// Stores 24-bit RGB source data into a 24-bit dest.
-static int decode_rgb_rle24(const unsigned char *src0, unsigned char *dest0,
-                            const int wid, const int hgt)
+// Decode the pixels of either kind of file.
+template<class Dec_T>
+static void decode_tga(const unsigned char *src, const unsigned char *end, unsigned char *Pix, const int wid, const int hgt,
+                       const int chan, const bool flip, const bool rle, const Dec_T &Dec)
 {
-    int chan = 3;
-    const unsigned char *src = src0;
-    unsigned char *dest = dest0;
-
-    while(dest < dest0 + wid*hgt*chan) {
-        // Pixels encoded in "packets"
-        // First byte is raw/rle flag(upper bit) and count(1-128 as 0-127 in lower 7 bits)
-        // If raw, the next count chan-byte color values in the file are taken verbatim
-        // If rle, the next single chan-byte color value speaks for the next count pixels
-
-        int raw = (*src & 0x80) == 0; // Is this packet raw pixels or a repeating color
-        int count = (*src & 0x7f) + 1; // How many raw pixels or color repeats
-        src++; // Advance src beyond first byte to 24-bit color
-
-        if(dest + count*chan > dest0 + wid*hgt*chan) // prevent from writing out of dest range
-            count = (dest0 + wid*hgt*chan - dest) / chan;
-
-        for(int j=0; j<count; j++)
-        {
-            dest[0] = src[2]; // Red
-            dest[1] = src[1]; // Green
-            dest[2] = src[0]; // Blue
-
-            if(raw) // In raw mode, keep advancing "src" to subsequent values
-                src += chan; // In RLE mode, just repeat the packet[1] RGB color
-            dest += chan;
-        }
-        if(!raw) // After outputting count RGB values, advance "src" beyond color if rle
-            src += chan;
+    if(rle) {
+        if(!decode_rle(src, end, Pix, wid, hgt, chan, flip, Dec))
+            throw DMcError("Targa file is truncated.");
+    } else {
+        if(end - src < (ptrdiff_t)wid * hgt * Dec_T::SrcBytes)
+            throw DMcError("Targa file is truncated.");
+        decode_raw(src, Pix, wid, hgt, chan, flip, Dec);
     }
-
-    ASSERT_R(dest <= dest0 + wid*hgt*chan);
-
-    return(0);
 }
 
-// Decode run-length encoded Targa into 32-bit pixels
-// This used to assume that RLE runs don't cross scanline boundaries, but our
-// targa encoder in commonGrLib violates this.
-static int decode_rgb_rle32(const unsigned char *src0, unsigned char *dest0,
-                            const int wid, const int hgt)
+// What LoadTGA() and the Targa reader need to know about the file.
+struct TGAInfo
 {
-    int chan = 4;
-    const unsigned char *src = src0;
-    unsigned char *dest = dest0;
-
-    while(dest < dest0 + wid*hgt*chan) {
-        // Pixels encoded in "packets"
-        // First byte is raw/rle flag(upper bit) and count(1-128 as 0-127 in lower 7 bits)
-        // If raw, the next count chan-byte color values in the file are taken verbatim
-        // If rle, the next single chan-byte color value speaks for the next count pixels
-
-        int raw = (*src & 0x80) == 0; // Is this packet raw pixels or a repeating color
-        int count = (*src & 0x7f) + 1; // How many raw pixels or color repeats
-        src++; // Advance src beyond first byte to 32-bit color
-
-        if(dest + count*chan > dest0 + wid*hgt*chan) // prevent from writing out of dest range
-            count = (dest0 + wid*hgt*chan - dest) / chan;
-
-        for(int j=0; j<count; j++)
-        {
-            dest[0] = src[2]; // Red
-            dest[1] = src[1]; // Green
-            dest[2] = src[0]; // Blue
-            dest[3] = src[3]; // Alpha
-
-            if(raw) // In raw mode, keep advancing "src" to subsequent values
-                src += chan; // In RLE mode, just repeat the packet[1] RGB color
-            dest += chan;
-        }
-        if(!raw) // After outputting count RGBA values, advance "src" beyond color if rle
-            src += chan;
-    }
-
-    return(0);
-}
-
-// Returns false on success.
-void ImageLoadSave::LoadTGA(const char *fname, bool R5G6B5)
+    size_t encoded_pixels; // The offset of the pixels
+    int wid, hgt, chan;
+    int ImgType, PixelSize;
+    bool flip, rle, R5G6B5;
+    unsigned char full_map[256 * 4]; // The color map. Indices past the end of a short color map are black.
+};
+
+// Parse and check the header of a Targa file. Data to End is the start of the file, enough of it to hold
+// the header and color map, and FileSize is the size of the whole file.
+static void parse_tga(const unsigned char *Data, const unsigned char *End, const DMCINT64 FileSize, const char *fname,
+                      const bool R5G6B5, TGAInfo &T)
 {
-    // Read whole file "fname" into array.
-    ifstream InFile(fname, ios::in | ios::binary);
-    if(!InFile.is_open()) throw DMcError("Failed to open file " + string(fname));
-
-    InFile.seekg(0, ios::end);
-    int fsize = InFile.tellg();
-    InFile.seekg(0, ios::beg);
-
-    unsigned char *fdata = new unsigned char[fsize];
-    ASSERT_RM(fdata, "memory alloc failed");
-
-    InFile.read((char *)fdata, fsize);
-
-    if(InFile.gcount() != fsize) {
-        InFile.close();
-        throw DMcError("Didn't get the right amount of data.");
-    }
-
-    InFile.close();
-
-    // Decode the contents of fdata.
-    // Put the resulting pixels in *Pix.
+    if(size_t(End - Data) < sizeof(TGA_Header)) throw DMcError("Not a Targa file: " + string(fname));
 
-    TGA_Header *header = (TGA_Header *)fdata; // Header starts at first byte of file
-    unsigned char *color_map = fdata + sizeof(TGA_Header) + header->ImageIDLength;
+    const TGA_Header *header = (const TGA_Header *)Data; // Header starts at first byte of file
+    const size_t cmap_offset = sizeof(TGA_Header) + header->ImageIDLength;
     int cmapsize = header->CoMapType ? (header->CoSize / 8) *
         ((header->Length_hi << 8) | header->Length_lo) : 0;
-    unsigned char *encoded_pixels = color_map + cmapsize;
+    T.encoded_pixels = cmap_offset + cmapsize;
+
+    if((DMCINT64)T.encoded_pixels > FileSize) throw DMcError("Targa file is truncated.");
 
     char itype_names[16][16] = {"NULL", "MAP", "RGB", "MONO", "4", "5", "6", "7", "8",
         "RLE-MAP", "RLE-RGB", "RLE-MONO", "12", "13", "14", "15"};
@@ -346,106 +262,240 @@ void ImageLoadSave::LoadTGA(const char *fname, bool R5G6B5)
 
     if((header->Desc & TGA_DESC_ORG_MASK) != TGA_ORG_TOP_LEFT &&
         (header->Desc & TGA_DESC_ORG_MASK) != TGA_ORG_BOTTOM_LEFT) {
-        delete [] fdata;
         stringstream er; er << "Not top/bottom left origin: image desc " << header->Desc;
         throw DMcError(er.str());
     }
-
-    wid = ((header->Width_hi) << 8) | header->Width_lo;
-    hgt = ((header->Height_hi) << 8) | header->Height_lo;
-    chan = header->PixelSize / 8; // 3 or 4
-    if(chan == 2) chan = 3; // 16-bit means R5G6B5.
-    if(header->ImgType == TGA_MAP)
-        chan = header->CoSize / 8;
-
-    is_uint = false;
-    is_float = false;
-    Pix = ImageAlloc();
-
+    T.flip = (header->Desc & TGA_DESC_ORG_MASK) == TGA_ORG_BOTTOM_LEFT;
+
+    T.wid = ((header->Width_hi) << 8) | header->Width_lo;
+    T.hgt = ((header->Height_hi) << 8) | header->Height_lo;
+    T.chan = header->PixelSize / 8; // 3 or 4
+    if(T.chan == 2) T.chan = 3; // 16-bit means R5G6B5.
+    if(header->ImgType == TGA_MAP || header->ImgType == TGA_RLEMAP)
+        T.chan = header->CoSize / 8;
+    T.ImgType = header->ImgType;
+    T.PixelSize = header->PixelSize;
+    T.R5G6B5 = R5G6B5;
+
+    // Check everything before allocating the image.
+    T.rle = false;
     switch(header->ImgType)
     {
+    case TGA_RLEMAP:
+        T.rle = true; // Fall through.
     case TGA_MAP:
-        if(header->PixelSize == 8)
-            decode_map8(encoded_pixels, Pix, size(), chan, color_map);
-        else {
-            delete [] fdata;
-            stringstream er; er << "Bad color mapped index size: " << header->PixelSize << " bits/pixel";
+        if(header->PixelSize != 8 || T.chan < 1 || T.chan > 4 || cmapsize < T.chan) {
+            stringstream er; er << "Bad color mapped index size: " << int(header->PixelSize) << " bits/pixel";
             throw DMcError(er.str());
         }
+        if(size_t(End - Data) < cmap_offset + std::min(cmapsize, 256 * T.chan)) throw DMcError("Targa file is truncated.");
+        memset(T.full_map, 0, sizeof(T.full_map));
+        memcpy(T.full_map, Data + cmap_offset, std::min(cmapsize, 256 * T.chan));
         break;
+    case TGA_RLEMONO:
+        T.rle = true; // Fall through.
     case TGA_MONO:
-        if(header->PixelSize == 8)
-            memcpy(Pix, encoded_pixels, size_bytes());
-        else {
-            delete [] fdata;
-            stringstream er; er << "Bad pixel size: " << header->PixelSize << " bits/pixel";
+        if(header->PixelSize != 8) {
+            stringstream er; er << "Bad pixel size: " << int(header->PixelSize) << " bits/pixel";
             throw DMcError(er.str());
         }
         break;
+    case TGA_RLERGB:
+        T.rle = true; // Fall through.
     case TGA_RGB:
-        switch(header->PixelSize) {
-        case 16:
-            decode_rgb16(encoded_pixels, Pix, wid, hgt, R5G6B5);
-            break;
-        case 24:
-            decode_rgb24(encoded_pixels, Pix, wid, hgt);
-            break;
-        case 32:
-            decode_rgb32(encoded_pixels, Pix, wid, hgt);
-            break;
-        default:
-            delete [] fdata;
-            stringstream er; er << "Bad pixel size: " << header->PixelSize << " bits/pixel";
+        if(header->PixelSize != 16 && header->PixelSize != 24 && header->PixelSize != 32) {
+            stringstream er; er << "Bad pixel size: " << int(header->PixelSize) << " bits/pixel";
             throw DMcError(er.str());
         }
         break;
+    default:
+        stringstream er; er << "Targa type " << itype_names[0xf & header->ImgType] << " bpp = " << int(header->PixelSize);
+        throw DMcError(er.str());
+    }
+}
+
+// Call Op with the pixel decoder of the file's image type.
+template<class Op_T>
+static void with_decoder(const TGAInfo &T, Op_T &Op)
+{
+    switch(T.ImgType)
+    {
+    case TGA_MAP:
+    case TGA_RLEMAP:
+        Op(decode_map8(T.full_map, T.chan));
+        break;
+    case TGA_MONO:
     case TGA_RLEMONO:
-        if(header->PixelSize == 8) {
-            decode_rgb_rle8(encoded_pixels, Pix, wid, hgt);
-        } else {
-            delete [] fdata;
-            stringstream er; er << "Bad pixel size: " << header->PixelSize << " bits/pixel";
-            throw DMcError(er.str());
-        }
+        Op(decode_mono());
         break;
+    case TGA_RGB:
     case TGA_RLERGB:
-        switch(header->PixelSize) {
+        switch(T.PixelSize) {
         case 16:
-            decode_rgb_rle16(encoded_pixels, Pix, wid, hgt, R5G6B5);
+            Op(decode_rgb16(T.R5G6B5));
             break;
         case 24:
-            decode_rgb_rle24(encoded_pixels, Pix, wid, hgt);
+            Op(decode_rgb24());
             break;
         case 32:
-            decode_rgb_rle32(encoded_pixels, Pix, wid, hgt);
+            Op(decode_rgb32());
             break;
-        default:
-            delete [] fdata;
-            stringstream er; er << "Bad pixel size: " << header->PixelSize << " bits/pixel";
-            throw DMcError(er.str());
         }
         break;
-    default:
-        delete [] fdata;
-        stringstream er; er << "Targa type " << itype_names[0xf & header->ImgType] << " bpp = " << int(header->PixelSize);
-        throw DMcError(er.str());
     }
+}
 
-    // Flip it vertically so that origin is always top left.
-    if((header->Desc & TGA_DESC_ORG_MASK) == TGA_ORG_BOTTOM_LEFT) {
-        int lsize = wid * chan;
-        unsigned char *tbuf = new unsigned char[lsize];
-        ASSERT_RM(tbuf, "memory alloc failed");
+namespace {
+    // Decodes the whole image for LoadTGA().
+    struct decode_image
+    {
+        const TGAInfo &T;
+        const unsigned char *src, *end;
+        unsigned char *Pix;
 
-        for(int y=0; y<hgt/2; y++) {
-            memcpy(tbuf, &Pix[y*lsize], lsize);
-            memcpy(&Pix[y*lsize], &Pix[(hgt-y-1)*lsize], lsize);
-            memcpy(&Pix[(hgt-y-1)*lsize], tbuf, lsize);
+        decode_image(const TGAInfo &T_, const unsigned char *src_, const unsigned char *end_, unsigned char *Pix_)
+            : T(T_), src(src_), end(end_), Pix(Pix_) {}
+        template<class Dec_T> void operator()(const Dec_T &Dec)
+        {
+            decode_tga(src, end, Pix, T.wid, T.hgt, T.chan, T.flip, T.rle, Dec);
         }
-        delete [] tbuf;
-    }
+    };
+};
+
+// The file is mapped rather than read, and decoded straight into the tImage.
+void ImageLoadSave::LoadTGA(const char *fname, bool R5G6B5)
+{
+    MappedFile File(fname);
+    TGAInfo T;
+    parse_tga(File.data(), File.end(), File.size(), fname, R5G6B5, T);
+
+    wid = T.wid;
+    hgt = T.hgt;
+    chan = T.chan;
+    is_uint = false;
+    is_float = false;
+    Pix = ImageAlloc();
+
+    // Decode the contents of the file.
+    // Put the resulting pixels in *Pix.
+    decode_image Op(T, File.data() + T.encoded_pixels, File.end(), Pix);
+    with_decoder(T, Op);
+}
+
+// Decode the run-length encoded row at Off in File, where the decode is in state St, and move Off past it.
+// A row takes at most one byte more per pixel than raw pixels, and a packet is checked for all its pixels
+// when it starts, so a window that can't hold that much means the file is truncated.
+template<class Dec_T>
+static void stream_rle_row(StreamFile &File, DMCINT64 &Off, tga_rle_state &St, unsigned char *dest, const int wid,
+                           const int chan, const Dec_T &Dec)
+{
+    const unsigned char *End, *p = File.Window(Off, size_t(wid + 128) * (Dec_T::SrcBytes + 1), End);
+    St.src = p;
+    if(!decode_rle_row(St, End, dest, wid, chan, Dec))
+        throw DMcError("Targa file is truncated.");
+    Off += St.src - p;
+    St.src = NULL;
+}
+
+namespace {
+    // Reads each band of rows out of the file and decodes it.
+    // The rows of a bottom-up run-length encoded file are stored in the opposite order to the one they're read in,
+    // so where each row starts is found when the file is opened.
+    class TGAReader : public ImageReader
+    {
+        StreamFile File;
+        TGAInfo T;
+        DMCINT64 Off; // Where the next row of a top-down run-length encoded file starts
+        tga_rle_state St; // The decode at Off
+        std::vector<DMCINT64> RowOffs; // Where each row of a bottom-up run-length encoded file starts, in file order
+        std::vector<tga_rle_state> RowStates; // The decode at each of RowOffs
+        std::vector<unsigned char> Band; // The pixels of a band of a raw file
+
+        // Finds where each row starts.
+        struct find_rows
+        {
+            TGAReader &R;
+            find_rows(TGAReader &R_) : R(R_) {}
+            template<class Dec_T> void operator()(const Dec_T &Dec)
+            {
+                DMCINT64 Off = R.T.encoded_pixels;
+                tga_rle_state St(NULL);
+                for(int y=0; y<R.hgt; y++) {
+                    R.RowOffs.push_back(Off);
+                    R.RowStates.push_back(St);
+                    stream_rle_row(R.File, Off, St, (unsigned char *)NULL, R.wid, R.chan, Dec);
+                }
+            }
+        };
+
+        // Decodes n rows starting at yNext.
+        struct decode_rows
+        {
+            TGAReader &R;
+            unsigned char *Rows;
+            int n;
+            decode_rows(TGAReader &R_, unsigned char *Rows_, const int n_) : R(R_), Rows(Rows_), n(n_) {}
+            template<class Dec_T> void operator()(const Dec_T &Dec)
+            {
+                const int wid = R.wid, hgt = R.hgt, chan = R.chan;
+                const int fy0 = R.T.flip ? hgt-R.yNext-n : R.yNext; // The first row of the band in the file
+                const size_t rowbytes = size_t(wid) * Dec_T::SrcBytes;
+
+                if(!R.T.rle) {
+                    // The band's rows are together in the file.
+                    R.Band.resize(n * rowbytes);
+                    R.File.Read(&R.Band[0], R.Band.size(), R.T.encoded_pixels + (DMCINT64)fy0 * rowbytes);
+                    decode_raw(&R.Band[0], Rows, wid, n, chan, R.T.flip, Dec);
+                    return;
+                }
+
+                if(R.T.flip) {
+                    // Read the band in one piece before decoding its rows from the last one back.
+                    const unsigned char *End;
+                    R.File.Window(R.RowOffs[fy0], size_t(R.RowOffs[fy0+n-1] - R.RowOffs[fy0]) + size_t(wid + 128) * (Dec_T::SrcBytes + 1), End);
+                }
+
+                for(int i=0; i<n; i++) {
+                    unsigned char *dest = Rows + size_t(i) * wid * chan;
+                    if(R.T.flip) {
+                        const int fy = fy0 + n-1-i;
+                        DMCINT64 Off = R.RowOffs[fy];
+                        tga_rle_state St = R.RowStates[fy];
+                        stream_rle_row(R.File, Off, St, dest, wid, chan, Dec);
+                    } else
+                        stream_rle_row(R.File, R.Off, R.St, dest, wid, chan, Dec);
+                }
+            }
+        };
 
-    delete [] fdata;
+    public:
+        TGAReader(const char *fname) : File(fname), St(NULL)
+        {
+            const unsigned char *End, *Data = File.Window(0, StreamFile::HEADER_BYTES, End);
+            parse_tga(Data, End, File.size(), fname, false, T);
+            wid = T.wid; hgt = T.hgt; chan = T.chan;
+            Off = T.encoded_pixels;
+
+            if(!T.rle) {
+                if(File.size() - Off < (DMCINT64)wid * hgt * ((T.PixelSize + 7) / 8))
+                    throw DMcError("Targa file is truncated.");
+            } else if(T.flip) {
+                find_rows Op(*this);
+                with_decoder(T, Op);
+            }
+        }
+
+        void ReadRaw(unsigned char *Rows, const int n)
+        {
+            decode_rows Op(*this, Rows, n);
+            with_decoder(T, Op);
+        }
+    };
+};
+
+ImageReader *OpenTGAReader(const char *fname)
+{
+    return new TGAReader(fname);
 }
 
 ////////////////////////////////////////////////////////////////
@@ -468,17 +518,17 @@ DMC_INLINE bool colors_equal(const unsigned char *a, const unsigned char *b, con
 // non-consecutive values are there(not counting value which repeats)
 // Thus: AAAAAAAB returns 0 with count = 7
 // ABCDEFGG returns 1 with count = 6
-// Never scan more than 128 ahead.
-DMC_INLINE bool match(const unsigned char *src, int &count, const int chan)
+// Never scan more than 128 ahead, or past the left pixels that remain.
+DMC_INLINE bool match(const unsigned char *src, int &count, const int chan, const int left)
 {
     const unsigned char *prev_color;
     count = 0;
 
-    if(colors_equal(src, src+chan, chan))
+    if(left > 1 && colors_equal(src, src+chan, chan))
     {
         // RLE
         prev_color = src;
-        while(colors_equal(src, prev_color, chan) && count < 128)
+        while(count < left && count < 128 && colors_equal(src, prev_color, chan))
         {
             src += chan;
             count++;
@@ -490,13 +540,17 @@ DMC_INLINE bool match(const unsigned char *src, int &count, const int chan)
         // Raw
         prev_color = src;
         src += chan;
-        while(!colors_equal(src, prev_color, chan) && count < 128)
+        while(count < left - 1 && count < 128 && !colors_equal(src, prev_color, chan))
         {
             count++;
             prev_color = src;
             src += chan;
         }
 
+        // The last pixel has nothing to run with.
+        if(count == left - 1)
+            count = left;
+
         return true;
     }
 }
@@ -510,7 +564,7 @@ static int encode_rle(const unsigned char *src0, unsigned char *dest,
     do
     {
         int count;
-        bool raw = match(src, count, chan);
+        bool raw = match(src, count, chan, int((src0 + size * chan - src) / chan));
         if(count > 128) count = 128;
 
         if(raw)
@@ -559,7 +613,7 @@ static int encode_rle(const unsigned char *src0, unsigned char *dest,
             src += chan * count;
         }
     }
-    while(src <= src0 + size * chan);
+    while(src < src0 + size * chan);
 
     return dp;
 }
@@ -629,3 +683,99 @@ void ImageLoadSave::SaveTGA(const char *fname) const
 
     delete [] out_data;
 }
+
+namespace {
+    // Writes uncompressed rows with a top left origin, so each band of rows can be written as it comes.
+    class TGAWriter : public ImageWriter
+    {
+        FILE *ft;
+        std::vector<unsigned char> Row;
+
+    public:
+        TGAWriter(const char *fname, const int w, const int h, const int ch) : ft(NULL)
+        {
+            wid = w; hgt = h; chan = ch;
+
+            if(wid > 65535 || wid <= 0 || hgt > 65535 || hgt <= 0)
+            {
+                stringstream er; er << "Write_targa_file " << wid << "x" << hgt << " too big.";
+                throw DMcError(er.str());
+            }
+
+            TGA_Header header;
+            header.ImageIDLength = 0;
+            header.CoMapType = 0; // no colormap
+            header.Index_lo = header.Index_hi = 0; // no colormap
+            header.Length_lo = header.Length_hi = header.CoSize = 0; // no colormap
+            header.X_org_lo = header.X_org_hi = header.Y_org_lo = header.Y_org_hi = 0; // 0,0 origin
+            header.Width_lo = wid;
+            header.Width_hi = wid >> 8;
+            header.Height_lo = hgt;
+            header.Height_hi = hgt >> 8;
+            header.Desc = TGA_ORG_TOP_LEFT;
+
+            switch(chan)
+            {
+            case 1:
+                header.ImgType = TGA_MONO;
+                header.PixelSize = 8;
+                break;
+            case 3:
+                header.ImgType = TGA_RGB;
+                header.PixelSize = 24;
+                break;
+            case 4:
+                header.ImgType = TGA_RGB;
+                header.PixelSize = 32;
+                header.Desc |= 8; // This many alpha bits.
+                break;
+            default:
+                stringstream er; er << "Cannot save file of " << chan << " channels.";
+                throw DMcError(er.str());
+            }
+
+            ft = fopen(fname, "wb");
+            if(ft == NULL)
+            {
+                stringstream er; er << "Failed to open file `" << fname << "' for writing.";
+                throw DMcError(er.str());
+            }
+
+            // Write the header
+            fwrite(&header, sizeof(header), 1, ft);
+
+            Row.resize(size_t(wid) * chan);
+        }
+
+        ~TGAWriter()
+        {
+            fclose(ft);
+        }
+
+        void WriteRaw(const unsigned char *Rows, const int n)
+        {
+            for(int y=0; y<n; y++) {
+                const unsigned char *src = Rows + size_t(y) * wid * chan;
+                if(chan == 1)
+                    memcpy(&Row[0], src, wid);
+                else
+                    for(int x=0; x<wid; x++, src += chan) {
+                        unsigned char *dest = &Row[x * chan];
+                        dest[0] = src[2]; // Blue
+                        dest[1] = src[1]; // Green
+                        dest[2] = src[0]; // Red
+                        if(chan == 4)
+                            dest[3] = src[3]; // Alpha
+                    }
+
+                if(fwrite(&Row[0], 1, Row.size(), ft) != Row.size())
+                    throw DMcError("TGAWriter: write failed.");
+            }
+        }
+    };
+};
+
+ImageWriter *OpenTGAWriter(const char *fname, const int w, const int h, const int chan)
+{
+    return new TGAWriter(fname, w, h, chan);
+}
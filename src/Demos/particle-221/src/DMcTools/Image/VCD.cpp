@@ -4,6 +4,7 @@
 // Copyright David K. McAllister, 2008.
 
 #include "Image/ImageAlgorithms.h"
+#include "Image/ImageTiles.h"
 
 #include <vector>
 using namespace std;
@@ -13,20 +14,20 @@ namespace {
     template<class Gauss_T>
     struct GaussSqFunc_t
     {
-        Gauss_T StDevSq;
-        GaussSqFunc_t(const Gauss_T StDev) : StDevSq(StDev * StDev) {}
-        Gauss_T operator()(const Gauss_T c) const { return static_cast<Gauss_T>(GaussianSq(static_cast<double>(c), StDevSq)); }
+        Gauss_T StDev;
+        GaussSqFunc_t(const Gauss_T StDev_) : StDev(StDev_) {}
+        Gauss_T operator()(const Gauss_T c) const { return static_cast<Gauss_T>(GaussianSq(static_cast<double>(c), StDev)); }
     };
 
     // Functor to evaluate gaussian(sqrt(c)) using a LUT.
     template<class Gauss_T>
     struct GaussSqTable_t
     {
-        Gauss_T StDevSq, ScaleInputToIndex;
-        const int index_bits, table_size;
+        Gauss_T StDev, ScaleInputToIndex;
+        const int table_size;
         vector<Gauss_T> GaussianSquaredTable;
 
-        GaussSqTable_t(const Gauss_T StDev, const Gauss_T ScaleInputToIndex, int table_size) : StDevSq(StDev * StDev), ScaleInputToIndex(ScaleInputToIndex), table_size(table_size)
+        GaussSqTable_t(const Gauss_T StDev, const Gauss_T ScaleInputToIndex, int table_size) : StDev(StDev), ScaleInputToIndex(ScaleInputToIndex), table_size(table_size)
         {
             // Make a lookup table of gaussian(sqrt(index)).
             // If called for squared differences of uc3Pixels the max distance (index) is 255*255*3=195075 < 2^18=262144.
@@ -34,17 +35,16 @@ namespace {
             // Can choose ScaleInputToIndex = 64 so table_size = 262144/64 = 4096.
             GaussianSquaredTable.resize(table_size);
 
-            Gauss_T stdevSq = stdev * stdev;
             for(int i=0; i<table_size; i++) {
-                Gauss_T cG = static_cast<Gauss_T>(c * ScaleInputToIndex);
-                GaussianSquaredTable[i] = static_cast<Gauss_T>(GaussianSq(static_cast<double>(cG), stdevSq));
+                Gauss_T cG = static_cast<Gauss_T>(i * ScaleInputToIndex);
+                GaussianSquaredTable[i] = static_cast<Gauss_T>(GaussianSq(static_cast<double>(cG), StDev));
             }
         }
 
         Gauss_T operator()(const Gauss_T c) const
         {
             int index = static_cast<int>(c / ScaleInputToIndex);
-            return GaussianSquaredTable[index];
+            return GaussianSquaredTable[min(index, table_size - 1)];
         }
     };
 
@@ -143,35 +143,38 @@ namespace {
         return sum / weight;
     }
 
-    // Convolve the parts of the image where the kernel is fully inside. This should be fast.
-    template <class Image_T, class KernelImage_T, class GaussSqFunctor_T>
-    void ConvolveMiddleVCD(Image_T &Out, const Image_T &In, const KernelImage_T &Kernel, const GaussSqFunctor_T &GSq)
-    {
-        const int N = Kernel.w();
-        const int N2 = N/2;
-        const int wid = In.w(), hgt = In.h();
-        for(int y=N2; y<hgt-N2; y++) {
-            for(int x=N2; x<wid-N2; x++) {
-                Out(x,y) = sample_kernel_vcd_full(In, Kernel, GSq, x, y);
-            }
-        }
-    }
-
-    // Kernel width, N, is known at compile time.
+    // Tile operator for ConvolveImageVCD. N is the kernel width if it's known at compile time, or 0.
     template <class Image_T, class KernelImage_T, class GaussSqFunctor_T, int N>
-    void ConvolveMiddleVCDN(Image_T &Out, const Image_T &In, const KernelImage_T &Kernel, const GaussSqFunctor_T &GSq)
+    struct ConvolveVCDOp
     {
-        const int N2 = N/2;
-        ASSERT_R((Kernel.w() == N));
-        const int wid = In.w(), hgt = In.h();
+        Image_T &Out;
+        const Image_T &In;
+        const KernelImage_T &Kernel;
+        const GaussSqFunctor_T &GSq;
 
-        // Do center.
-        for(int y=N2; y<hgt-N2; y++) {
-            for(int x=N2; x<wid-N2; x++) {
-                Out(x,y) = sample_kernel_vcd_fullN<Image_T, KernelImage_T, GaussSqFunctor_T, N>(In, Kernel, GSq, x, y);
+        ConvolveVCDOp(Image_T &Out_, const Image_T &In_, const KernelImage_T &Kernel_, const GaussSqFunctor_T &GSq_) : Out(Out_), In(In_), Kernel(Kernel_), GSq(GSq_)
+        {
+            ASSERT_R(N == 0 || Kernel.w() == N);
+        }
+
+        // Convolve a rectangle of the image where the kernel is fully inside. This should be fast.
+        void Inside(const int x0, const int y0, const int x1, const int y1) const
+        {
+            for(int y=y0; y<y1; y++) {
+                for(int x=x0; x<x1; x++) {
+                    if(N)
+                        Out(x,y) = sample_kernel_vcd_fullN<Image_T, KernelImage_T, GaussSqFunctor_T, N>(In, Kernel, GSq, x, y);
+                    else
+                        Out(x,y) = sample_kernel_vcd_full(In, Kernel, GSq, x, y);
+                }
             }
         }
-    }
+
+        void Edge(const int x, const int y) const
+        {
+            Out(x,y) = sample_kernel_vcd_weighted(In, Kernel, GSq, x, y);
+        }
+    };
 };
 
 template <class Image_T, class KernelImage_T, class GaussSqFunctor_T>
@@ -183,28 +186,13 @@ void ConvolveImageVCD(Image_T &Out, const Image_T &In, const KernelImage_T &Kern
     const int wid = In.w(), hgt = In.h();
     Out.SetSize(wid, hgt);
 
-    // Do top and bottom edges.
-    for(int y=0; y<N2; y++)
-        for(int x=N2; x<wid-N2; x++)
-            Out(x,y) = sample_kernel_vcd_weighted(In, Kernel, GSq, x, y);
-    for(int y=hgt-N2; y<hgt; y++)
-        for(int x=N2; x<wid-N2; x++)
-            Out(x,y) = sample_kernel_vcd_weighted(In, Kernel, GSq, x, y);
-
-    // Do left and right edges.
-    for(int y=0; y<hgt; y++) {
-        for(int x=0; x<N2; x++)
-            Out(x,y) = sample_kernel_vcd_weighted(In, Kernel, GSq, x, y);
-        for(int x=wid-N2; x<wid; x++)
-            Out(x,y) = sample_kernel_vcd_weighted(In, Kernel, GSq, x, y);
-    }
-
+    // ForEachTile does the edges, where the kernel hangs off the image, with sample_kernel_vcd_weighted.
     if(N == 5)
-        ConvolveMiddleVCDN<Image_T, KernelImage_T, GaussSqFunctor_T, 5>(Out, In, Kernel, GSq); // If kernel size is known at compile time.
+        ForEachTile(wid, hgt, N2, ConvolveVCDOp<Image_T, KernelImage_T, GaussSqFunctor_T, 5>(Out, In, Kernel, GSq)); // If kernel size is known at compile time.
     else if(N == 9)
-        ConvolveMiddleVCDN<Image_T, KernelImage_T, GaussSqFunctor_T, 9>(Out, In, Kernel, GSq); // If kernel size is known at compile time.
+        ForEachTile(wid, hgt, N2, ConvolveVCDOp<Image_T, KernelImage_T, GaussSqFunctor_T, 9>(Out, In, Kernel, GSq)); // If kernel size is known at compile time.
     else
-        ConvolveMiddleVCD(Out, In, Kernel, GSq); // If kernel size is not known at compile time.
+        ForEachTile(wid, hgt, N2, ConvolveVCDOp<Image_T, KernelImage_T, GaussSqFunctor_T, 0>(Out, In, Kernel, GSq)); // If kernel size is not known at compile time.
 }
 
 // FiltWid x FiltWid variable conductance diffusion blur for any image type. Each pixel's contribution is
@@ -233,3 +221,259 @@ void VCD(Image_T &Out, const Image_T &In, const int FiltWid, const typename Imag
 
 template void VCD<f1Image>(f1Image &Out, const f1Image &In, const int FiltWid, float ImageStDev, float ColorStDev, int);
 template void VCD<f3Image>(f3Image &Out, const f3Image &In, const int FiltWid, float ImageStDev, float ColorStDev, int);
+
+namespace {
+    // The points of a D-dimensional permutohedral lattice that the image touches, and their indices.
+    // A point has D+1 integer coordinates that sum to zero, so only the first D are kept.
+    template<int D>
+    class LatticeHash
+    {
+    public:
+        LatticeHash() : Mask(0), nPoints(0) { Table.resize(1 << 12, -1); Mask = Table.size() - 1; }
+
+        int size() const { return nPoints; }
+        const int *Key(const int i) const { return &Keys[size_t(i) * D]; }
+
+        // The index of the point, or -1 if it's not there and Create is false.
+        // Can be called from many threads at once if Create is false.
+        int Find(const int *K, const bool Create)
+        {
+            if(Create && size_t(nPoints) * 2 >= Table.size())
+                Grow();
+
+            for(size_t h = Hash(K) & Mask; ; h = (h + 1) & Mask) {
+                const int e = Table[h];
+                if(e < 0) {
+                    if(!Create)
+                        return -1;
+                    Keys.insert(Keys.end(), K, K + D);
+                    Table[h] = nPoints;
+                    return nPoints++;
+                }
+                if(std::equal(K, K + D, &Keys[size_t(e) * D]))
+                    return e;
+            }
+        }
+
+        int Find(const int *K) const { return const_cast<LatticeHash *>(this)->Find(K, false); }
+
+    private:
+        std::vector<int> Keys; // D per point
+        std::vector<int> Table; // Index of the point in each slot, or -1
+        size_t Mask;
+        int nPoints;
+
+        static size_t Hash(const int *K)
+        {
+            size_t h = 0;
+            for(int i=0; i<D; i++)
+                h = (h + K[i]) * 2531011;
+            return h ^ (h >> 15);
+        }
+
+        void Grow()
+        {
+            Table.assign(Table.size() * 2, -1);
+            Mask = Table.size() - 1;
+            for(int e=0; e<nPoints; e++) {
+                size_t h = Hash(Key(e)) & Mask;
+                while(Table[h] >= 0)
+                    h = (h + 1) & Mask;
+                Table[h] = e;
+            }
+        }
+    };
+
+    // Find the D+1 lattice points of the simplex around the position Pos, and their barycentric weights.
+    // Keys gets D coordinates for each of the D+1 points. This is Adams, Baek, and Davis's permutohedral lattice.
+    template<int D>
+    void EnclosingSimplex(int *Keys, float *Bary, const float *Pos, const float *Scale)
+    {
+        float Elevated[D+1];
+        int Greedy[D+1], Rank[D+1];
+        float B[D+2];
+
+        // Elevate the position onto the plane whose coordinates sum to zero.
+        float sm = 0;
+        for(int i=D; i>0; i--) {
+            const float cf = Pos[i-1] * Scale[i-1];
+            Elevated[i] = sm - i * cf;
+            sm += cf;
+        }
+        Elevated[0] = sm;
+
+        // The closest remainder-zero point, and how far it is from being one.
+        const float Inv = 1.0f / (D + 1);
+        int sum = 0;
+        for(int i=0; i<=D; i++) {
+            const float v = Elevated[i] * Inv;
+            const int up = int(ceilf(v)) * (D + 1), down = int(floorf(v)) * (D + 1);
+            Greedy[i] = (up - Elevated[i] < Elevated[i] - down) ? up : down;
+            sum += Greedy[i];
+        }
+        sum /= D + 1;
+
+        // Sort the differences from it to find the simplex.
+        for(int i=0; i<=D; i++)
+            Rank[i] = 0;
+        for(int i=0; i<D; i++)
+            for(int j=i+1; j<=D; j++)
+                if(Elevated[i] - Greedy[i] < Elevated[j] - Greedy[j]) Rank[i]++; else Rank[j]++;
+
+        if(sum > 0) {
+            for(int i=0; i<=D; i++) {
+                if(Rank[i] >= D + 1 - sum) { Greedy[i] -= D + 1; Rank[i] += sum - (D + 1); }
+                else Rank[i] += sum;
+            }
+        } else if(sum < 0) {
+            for(int i=0; i<=D; i++) {
+                if(Rank[i] < -sum) { Greedy[i] += D + 1; Rank[i] += (D + 1) + sum; }
+                else Rank[i] += sum;
+            }
+        }
+
+        for(int i=0; i<D+2; i++)
+            B[i] = 0;
+        for(int i=0; i<=D; i++) {
+            const float d = (Elevated[i] - Greedy[i]) * Inv;
+            B[D - Rank[i]] += d;
+            B[D + 1 - Rank[i]] -= d;
+        }
+        B[0] += 1.0f + B[D+1];
+
+        // Vertex r of the simplex is the closest point plus the canonical simplex's vertex r, permuted by Rank.
+        for(int r=0; r<=D; r++) {
+            for(int i=0; i<D; i++)
+                Keys[r * D + i] = Greedy[i] + (Rank[i] <= D - r ? r : r - (D + 1));
+            Bary[r] = B[r];
+        }
+    }
+
+    // One iteration of the lattice filter. Chan channels plus the homogeneous weight are kept at each point.
+    template<class Image_T, int Chan>
+    void LatticeFilter(Image_T &Out, const Image_T &In, const float ImageStDev, const float ColorStDev, const float Quality)
+    {
+        const int D = Chan + 2, V = Chan + 1;
+        const int N = In.size(), wid = In.w();
+        const int BAND = 1 << 14; // Pixels whose simplices are found at once, in parallel, before they are added to the hash table
+
+        // Positions are scaled so that one standard deviation is one unit in every direction. The lattice
+        // itself is then scaled so that blurring once with [1 2 1]/4 along each of its D+1 axes is that Gaussian.
+        float Scale[D];
+        const float InvStdDev = sqrtf(2.0f / 3.0f) * (D + 1);
+        for(int i=0; i<D; i++)
+            Scale[i] = InvStdDev / sqrtf(float((i + 1) * (i + 2)));
+
+        LatticeHash<D> Lat;
+        std::vector<int> PixPoint(size_t(N) * (D + 1));
+        std::vector<float> PixBary(size_t(N) * (D + 1));
+        std::vector<int> BandKeys(size_t(BAND) * (D + 1) * D);
+        std::vector<float> Val;
+
+        // Splat
+        for(int b0=0; b0<N; b0+=BAND) {
+            const int b1 = std::min(b0 + BAND, N);
+#pragma omp parallel for schedule(static)
+            for(int i=b0; i<b1; i++) {
+                float Pos[D];
+                Pos[0] = (i % wid) * Quality / ImageStDev;
+                Pos[1] = (i / wid) * Quality / ImageStDev;
+                for(int c=0; c<Chan; c++)
+                    Pos[2+c] = In[i][c] * Quality / ColorStDev;
+                EnclosingSimplex<D>(&BandKeys[size_t(i - b0) * (D + 1) * D], &PixBary[size_t(i) * (D + 1)], Pos, Scale);
+            }
+
+            for(int i=b0; i<b1; i++)
+                for(int r=0; r<=D; r++)
+                    PixPoint[size_t(i) * (D + 1) + r] = Lat.Find(&BandKeys[(size_t(i - b0) * (D + 1) + r) * D], true);
+
+            Val.resize(size_t(Lat.size()) * V, 0.0f);
+            for(int i=b0; i<b1; i++) {
+                for(int r=0; r<=D; r++) {
+                    const float w = PixBary[size_t(i) * (D + 1) + r];
+                    float *P = &Val[size_t(PixPoint[size_t(i) * (D + 1) + r]) * V];
+                    for(int c=0; c<Chan; c++)
+                        P[c] += w * In[i][c];
+                    P[Chan] += w;
+                }
+            }
+        }
+
+        // Blur along each axis of the lattice with [a 1-2a a], whose variance is 2a. A coarser lattice blurs less far.
+        const int M = Lat.size();
+        const float a = Quality * Quality / 4.0f;
+        std::vector<float> NewVal(Val.size());
+        std::vector<int> Nbr(size_t(M) * 2);
+        for(int j=0; j<=D; j++) {
+            // The neighbors along axis j are the point minus and plus (1, ..., 1, -D, 1, ..., 1) with -D at j.
+#pragma omp parallel for schedule(static)
+            for(int e=0; e<M; e++) {
+                const int *K = Lat.Key(e);
+                int Km[D], Kp[D];
+                for(int i=0; i<D; i++) {
+                    Km[i] = K[i] - 1;
+                    Kp[i] = K[i] + 1;
+                }
+                if(j < D) {
+                    Km[j] = K[j] + D;
+                    Kp[j] = K[j] - D;
+                }
+                Nbr[size_t(e) * 2] = Lat.Find(Km);
+                Nbr[size_t(e) * 2 + 1] = Lat.Find(Kp);
+            }
+
+#pragma omp parallel for schedule(static)
+            for(int e=0; e<M; e++) {
+                const int m = Nbr[size_t(e) * 2], n = Nbr[size_t(e) * 2 + 1];
+                const float *C = &Val[size_t(e) * V];
+                float *O = &NewVal[size_t(e) * V];
+                for(int c=0; c<V; c++)
+                    O[c] = (1.0f - 2.0f * a) * C[c];
+                if(m >= 0)
+                    for(int c=0; c<V; c++)
+                        O[c] += a * Val[size_t(m) * V + c];
+                if(n >= 0)
+                    for(int c=0; c<V; c++)
+                        O[c] += a * Val[size_t(n) * V + c];
+            }
+            Val.swap(NewVal);
+        }
+
+        // Slice
+        Out.SetSize(In.w(), In.h());
+#pragma omp parallel for schedule(static)
+        for(int i=0; i<N; i++) {
+            float Acc[V];
+            for(int c=0; c<V; c++)
+                Acc[c] = 0;
+            for(int r=0; r<=D; r++) {
+                const float w = PixBary[size_t(i) * (D + 1) + r];
+                const float *P = &Val[size_t(PixPoint[size_t(i) * (D + 1) + r]) * V];
+                for(int c=0; c<V; c++)
+                    Acc[c] += w * P[c];
+            }
+            // The pixel itself is always in its own simplex, so the weight is never 0.
+            for(int c=0; c<Chan; c++)
+                Out[i][c] = Acc[c] / Acc[Chan];
+        }
+    }
+};
+
+// Approximates VCD() with a permutohedral lattice, so the cost doesn't depend on how wide the kernel is.
+// A finer lattice than Quality 1 wouldn't help: the points between the pixels' simplices aren't there to blur through.
+template <class Image_T>
+void VCDLattice(Image_T &Out, const Image_T &In, const typename Image_T::PixType::MathType ImageStDev,
+                const typename Image_T::PixType::MathType ColorStDev, const int iterations, const float Quality)
+{
+    ASSERT_R(ImageStDev > 0 && ColorStDev > 0 && Quality > 0 && Quality <= 1);
+
+    LatticeFilter<Image_T, Image_T::PixType::Chan>(Out, In, ImageStDev, ColorStDev, Quality);
+
+    for(int i=1; i<iterations; i++) {
+        Image_T Tmp(Out);
+        LatticeFilter<Image_T, Image_T::PixType::Chan>(Out, Tmp, ImageStDev, ColorStDev, Quality);
+    }
+}
+
+template void VCDLattice<f1Image>(f1Image &Out, const f1Image &In, float ImageStDev, float ColorStDev, int, float);
+template void VCDLattice<f3Image>(f3Image &Out, const f3Image &In, float ImageStDev, float ColorStDev, int, float);
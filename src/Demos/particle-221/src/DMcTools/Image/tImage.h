@@ -18,6 +18,8 @@
 
 // Copy constructor and assignment operator are templated on the argument type, creating a full cross-product of image
 // conversion functions. MSVC 2005 is pretty savvy about not doing slow conversions if the pixel types actually match.
+// The common conversions between float and the other channel types are done instead by a table of row kernels in
+// ImageConvert.cpp, which do the same thing much faster.
 
 // ImageAlgorithms.cpp has a lot of algorithms that operate on templated tImage types.
 // ImageLoadSave.cpp has most of the image loading/saving stuff. tLoadSave.cpp has the rest.
@@ -33,8 +35,15 @@
 
 #include "Image/tPixel.h"
 #include "Image/RGBE.h"
+#include "Image/RowKernels.h"
 
 #include <iostream>
+#include <typeinfo>
+
+// Convert n pixels from SrcType to DstType using the table of fast kernels in ImageConvert.cpp, in parallel if Parallel.
+// Gives exactly the same pixels as the generic conversion. Returns false without touching Dst if the pair isn't in the table.
+bool ConvertPixelsFast(void *Dst, const std::type_info &DstType, const void *Src, const std::type_info &SrcType, const size_t n,
+                       const bool Parallel = true);
 
 // baseImage is used to give commonality to all images. This lets them be passed around as a baseImage *.
 // The functions in the base class should be sufficient to allow all operations that don't depend on the image's datatype.
@@ -155,6 +164,8 @@ private:
         if(SrcIm.size() > 0) {
             SetSize(SrcIm.w(), SrcIm.h(), false, false);
             int sz = SrcIm.size();
+            if(ConvertPixelsFast(Pix, typeid(Pixel_T), SrcIm.pp(), typeid(SrcPixel_T), sz))
+                return;
             for(int i=0; i<sz; i++)
                 (*this)[i] = static_cast<Pixel_T>(SrcIm[i]); // Doesn't call the tPixel copy constructor if Pixel_T == SrcPixel_T. Cool!
         } else {
@@ -778,6 +789,20 @@ DMC_INLINE tImage<Pixel_T> Interpolate(const tImage<Pixel_T> &p1, const tImage<P
     return r;
 }
 
+// Float images with the same weight on every channel interpolate as one long run of channels.
+template<int Chan_>
+DMC_INLINE tImage<tPixel<float, Chan_> > Interpolate(const tImage<tPixel<float, Chan_> > &p1, const tImage<tPixel<float, Chan_> > &p2,
+                             typename tPixel<float, Chan_>::FloatMathPixType weight)
+{
+    ASSERT_R(p1.size() == p2.size());
+    tImage<tPixel<float, Chan_> > r(p1.w(), p1.h());
+    if(weight == tPixel<float, Chan_>(weight[0]))
+        RowLerp((float *)r.pp(), (const float *)p1.pp(), (const float *)p2.pp(), weight[0], p1.size() * Chan_);
+    else
+        for(int i=0; i<p1.size(); i++) r[i] = Interpolate(p1[i], p2[i], weight);
+    return r;
+}
+
 // Pixel-wise max.
 template<class Pixel_T>
 DMC_INLINE tImage<Pixel_T> Max(const tImage<Pixel_T> &p1, const tImage<Pixel_T> &p2)
@@ -884,6 +909,7 @@ template<> DMC_INLINE void ui1Image::Load(const char *fname) {tLoad(fname, this)
 template<> DMC_INLINE void f1Image::Load(const char *fname) {tLoad(fname, this);}
 //template<> DMC_INLINE void f2Image::Load(const char *fname) {tLoad(fname, this);}
 template<> DMC_INLINE void f3Image::Load(const char *fname) {tLoad(fname, this);}
+template<> DMC_INLINE void h3Image::Load(const char *fname) {tLoad(fname, this);}
 //template<> DMC_INLINE void f4Image::Load(const char *fname) {tLoad(fname, this);}
 
 // List here the image types for which tSave is instantiated.
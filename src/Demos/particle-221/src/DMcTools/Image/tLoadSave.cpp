@@ -24,9 +24,45 @@
 // If a converted image was created, it is deleted.
 
 #include "Image/ImageLoadSave.h"
+#include "Image/ImageStream.h"
 //#include "Image/RGBEio.h"
+#include "Util/MappedFile.h"
 #include "Util/Utils.h"
 
+namespace {
+    // Load the image a band of rows at a time, converting each band to outImg's type, for the file formats and
+    // image types where it pays. Returns false to have tLoad() load the whole image in the file's type and convert it.
+    template <class Image_T>
+    bool LoadInBands(const char *fname, Image_T *outImg)
+    {
+        return false;
+    }
+
+    // HDR files are loaded into half images without ever making a float image of twice the size.
+    bool LoadInBands(const char *fname, h3Image *outImg)
+    {
+        if(GetExtensionVal(fname) != HDR_)
+            return false;
+
+        ImageReader *Reader = OpenRGBEReader(fname);
+        try {
+            outImg->SetSize(Reader->w(), Reader->h());
+            f3Image Band;
+            for(int y=0, k; (k = Reader->ReadRows(Band, 64)) > 0; y += k) {
+                const bool Converted = ConvertPixelsFast(outImg->pp(0, y), typeid(h3Pixel), Band.pp(), typeid(f3Pixel), size_t(k) * Band.w());
+                ASSERT_R(Converted);
+            }
+        }
+        catch(DMcError &) {
+            delete Reader;
+            throw;
+        }
+        delete Reader;
+
+        return true;
+    }
+};
+
 // Load an image file into whatever kind of tImage is most appropriate.
 // Returns a pointer to the baseImage. dynamic_cast will tell you what kind it really is.
 // Throws a DMcError on failure.
@@ -50,6 +86,9 @@ void tLoad(const char *fname, Image_T *outImg)
     // Delete the old contents of the target image.
     outImg->SetSize();
 
+    if(LoadInBands(fname, outImg))
+        return;
+
     // Load the image and keep it in its disk file format inside loader.baseImg.
     ImageLoadSave loader;
     loader.Load(fname);
@@ -106,9 +145,60 @@ template void tLoad(const char *fname, f3Image *outImg);
 //template void tLoad(const char *fname, f4Image *outImg);
 //template void tLoad(const char *fname, h1Image *outImg);
 //template void tLoad(const char *fname, h2Image *outImg);
-//template void tLoad(const char *fname, h3Image *outImg);
+template void tLoad(const char *fname, h3Image *outImg);
 //template void tLoad(const char *fname, h4Image *outImg);
 
+// Map the file if its pixels can be used in place. Otherwise load it.
+template <class Image_T>
+MappedImage<Image_T>::MappedImage(const char *fname) : File(NULL)
+{
+    const bool isUC = !Image.is_signed() && Image.is_integer() && Image.size_element()==1;
+    const int exts = GetExtensionVal(fname);
+
+    if(isUC && (exts==PPM_ || exts==PGM_ || exts==PAM_)) {
+        MappedFile *F = new MappedFile(fname);
+        ImageLoadSave loader;
+        const unsigned char *src = NULL;
+        try {
+            src = F->data() + loader.ParsePPM(F->data(), F->end(), F->size(), fname);
+        }
+        catch(DMcError &) {
+            src = NULL; // Let Load() report it.
+        }
+
+        if(src && loader.chan == Image_T::PixType::Chan && !loader.is_float && !loader.is_ushort) {
+            // The image doesn't own the pixels. The destructor detaches them before unmapping.
+            Image.SetImage(reinterpret_cast<typename Image_T::PixType *>(const_cast<unsigned char *>(src)), loader.wid, loader.hgt);
+            File = F;
+            return;
+        }
+        delete F;
+    }
+
+    Image.Load(fname);
+}
+
+template <class Image_T>
+MappedImage<Image_T>::~MappedImage()
+{
+    if(File) {
+        Image.SetImage(); // Detach the mapped pixels so the image doesn't delete them.
+        delete File;
+    }
+}
+
+template class MappedImage<uc1Image>;
+template class MappedImage<uc2Image>;
+template class MappedImage<uc3Image>;
+template class MappedImage<uc4Image>;
+template class MappedImage<us1Image>;
+template class MappedImage<us2Image>;
+template class MappedImage<us3Image>;
+template class MappedImage<us4Image>;
+template class MappedImage<ui1Image>;
+template class MappedImage<f1Image>;
+template class MappedImage<f3Image>;
+
 // Save a tImage. Need to know all the details about it.
 template <class Image_T>
 void tSave(const char *fname, const Image_T &Img)
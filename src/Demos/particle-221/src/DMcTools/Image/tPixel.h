@@ -14,6 +14,11 @@
 #include <iostream>
 #include <limits>
 #include <typeinfo>
+#include <cstring>
+
+#ifdef DMC_USE_SSE
+#include <emmintrin.h>
+#endif
 
 // Various things we need to know about the pixel elements types
 template <class Elem_T>
@@ -341,6 +346,96 @@ template<> DMC_INLINE tPixel<half, 1>::operator half() const { return els[0]; }
 template<> DMC_INLINE tPixel<float, 1>::operator float() const { return els[0]; }
 template<> DMC_INLINE tPixel<double, 1>::operator double() const { return els[0]; }
 
+// uc4Pixel add and subtract all four channels at once in an int, wrapping each channel like the loops do.
+// The high bit of each channel is done separately so that carries don't cross into the next channel.
+template<> DMC_INLINE tPixel<unsigned char, 4> &tPixel<unsigned char, 4>::operator+=(const tPixel<unsigned char, 4> &p)
+{
+    unsigned int a, b;
+    memcpy(&a, &els[0], 4); memcpy(&b, &p[0], 4);
+    a = ((a & 0x7f7f7f7fu) + (b & 0x7f7f7f7fu)) ^ ((a ^ b) & 0x80808080u);
+    memcpy(&els[0], &a, 4);
+    return *this;
+}
+template<> DMC_INLINE tPixel<unsigned char, 4> &tPixel<unsigned char, 4>::operator-=(const tPixel<unsigned char, 4> &p)
+{
+    unsigned int a, b;
+    memcpy(&a, &els[0], 4); memcpy(&b, &p[0], 4);
+    a = ((a | 0x80808080u) - (b & 0x7f7f7f7fu)) ^ ((a ^ ~b) & 0x80808080u);
+    memcpy(&els[0], &a, 4);
+    return *this;
+}
+
+#ifdef DMC_USE_SSE
+// f4Pixel math in SSE registers.
+// Pixels are loaded unaligned because new[] doesn't promise 16-byte alignment everywhere. On aligned data it's just as fast.
+template<> DMC_INLINE tPixel<float, 4> &tPixel<float, 4>::operator+=(const tPixel<float, 4> &p)
+{
+    _mm_storeu_ps(&els[0], _mm_add_ps(_mm_loadu_ps(&els[0]), _mm_loadu_ps(&p[0])));
+    return *this;
+}
+template<> DMC_INLINE tPixel<float, 4> &tPixel<float, 4>::operator-=(const tPixel<float, 4> &p)
+{
+    _mm_storeu_ps(&els[0], _mm_sub_ps(_mm_loadu_ps(&els[0]), _mm_loadu_ps(&p[0])));
+    return *this;
+}
+template<> DMC_INLINE tPixel<float, 4> &tPixel<float, 4>::operator*=(const tPixel<float, 4> &p)
+{
+    _mm_storeu_ps(&els[0], _mm_mul_ps(_mm_loadu_ps(&els[0]), _mm_loadu_ps(&p[0])));
+    return *this;
+}
+template<> DMC_INLINE tPixel<float, 4> &tPixel<float, 4>::operator/=(const tPixel<float, 4> &p)
+{
+    _mm_storeu_ps(&els[0], _mm_div_ps(_mm_loadu_ps(&els[0]), _mm_loadu_ps(&p[0])));
+    return *this;
+}
+template<> DMC_INLINE tPixel<float, 4> &tPixel<float, 4>::operator+=(const float s)
+{
+    _mm_storeu_ps(&els[0], _mm_add_ps(_mm_loadu_ps(&els[0]), _mm_set1_ps(s)));
+    return *this;
+}
+template<> DMC_INLINE tPixel<float, 4> &tPixel<float, 4>::operator-=(const float s)
+{
+    _mm_storeu_ps(&els[0], _mm_sub_ps(_mm_loadu_ps(&els[0]), _mm_set1_ps(s)));
+    return *this;
+}
+template<> DMC_INLINE tPixel<float, 4> &tPixel<float, 4>::operator*=(const float s)
+{
+    _mm_storeu_ps(&els[0], _mm_mul_ps(_mm_loadu_ps(&els[0]), _mm_set1_ps(s)));
+    return *this;
+}
+template<> DMC_INLINE tPixel<float, 4> &tPixel<float, 4>::operator/=(const float s)
+{
+    _mm_storeu_ps(&els[0], _mm_div_ps(_mm_loadu_ps(&els[0]), _mm_set1_ps(s)));
+    return *this;
+}
+
+// uc4Pixel multiply in 16-bit lanes, with the same rounding as mult_asgn<unsigned char>.
+// a*b+0x80 is at most 65153, so it and the rounding sum fit in 16 bits.
+DMC_INLINE void mult_asgn_uc4(unsigned char *a, const __m128i b)
+{
+    int ai;
+    memcpy(&ai, a, 4);
+    const __m128i Z = _mm_setzero_si128();
+    __m128i t = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(ai), Z), b);
+    t = _mm_add_epi16(t, _mm_set1_epi16(0x80));
+    t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    ai = _mm_cvtsi128_si32(_mm_packus_epi16(t, Z));
+    memcpy(a, &ai, 4);
+}
+template<> DMC_INLINE tPixel<unsigned char, 4> &tPixel<unsigned char, 4>::operator*=(const tPixel<unsigned char, 4> &p)
+{
+    int bi;
+    memcpy(&bi, &p[0], 4);
+    mult_asgn_uc4(&els[0], _mm_unpacklo_epi8(_mm_cvtsi32_si128(bi), _mm_setzero_si128()));
+    return *this;
+}
+template<> DMC_INLINE tPixel<unsigned char, 4> &tPixel<unsigned char, 4>::operator*=(const unsigned char s)
+{
+    mult_asgn_uc4(&els[0], _mm_set1_epi16(s));
+    return *this;
+}
+#endif
+
 // Apply an arbitrary function to each channel.
 template<class Elem_T, int Chan_, class Pred_F>
 DMC_INLINE tPixel<Elem_T, Chan_> func(const tPixel<Elem_T, Chan_> &p, Pred_F fnc)
@@ -489,6 +584,24 @@ DMC_INLINE tPixel<Elem_T, Chan_> Min(const tPixel<Elem_T, Chan_> &p1, const tPix
     return r;
 }
 
+#ifdef DMC_USE_SSE
+// The operand order makes these match std::max and std::min exactly, even for NaNs.
+template<>
+DMC_INLINE tPixel<float, 4> Max(const tPixel<float, 4> &p1, const tPixel<float, 4> &p2)
+{
+    tPixel<float, 4> r;
+    _mm_storeu_ps(&r[0], _mm_max_ps(_mm_loadu_ps(&p2[0]), _mm_loadu_ps(&p1[0])));
+    return r;
+}
+template<>
+DMC_INLINE tPixel<float, 4> Min(const tPixel<float, 4> &p1, const tPixel<float, 4> &p2)
+{
+    tPixel<float, 4> r;
+    _mm_storeu_ps(&r[0], _mm_min_ps(_mm_loadu_ps(&p2[0]), _mm_loadu_ps(&p1[0])));
+    return r;
+}
+#endif
+
 // Channel-wise absolute value.
 template<class Elem_T, int Chan_>
 DMC_INLINE tPixel<Elem_T, Chan_> Abs(const tPixel<Elem_T, Chan_> &p)
@@ -526,6 +639,16 @@ DMC_INLINE tPixel<Elem_T, Chan_> Clamp(const tPixel<Elem_T, Chan_> &cmin, const
     return r;
 }
 
+#ifdef DMC_USE_SSE
+template<>
+DMC_INLINE tPixel<float, 4> Clamp(const tPixel<float, 4> &cmin, const tPixel<float, 4> &d, const tPixel<float, 4> &cmax)
+{
+    tPixel<float, 4> r;
+    _mm_storeu_ps(&r[0], _mm_max_ps(_mm_loadu_ps(&cmin[0]), _mm_min_ps(_mm_loadu_ps(&cmax[0]), _mm_loadu_ps(&d[0]))));
+    return r;
+}
+#endif
+
 // Sum of squared channel differences.
 template<class Elem_T, int Chan_>
 DMC_INLINE typename tPixel<Elem_T, Chan_>::MathType DiffSqr(const tPixel<Elem_T, Chan_> &A, const tPixel<Elem_T, Chan_> &B)
@@ -0,0 +1,626 @@
+//////////////////////////////////////////////////////////////////////
+// ImageBatch.cpp - Convert, resize, tone map, and quantize whole directory trees of images.
+//
+// Copyright David K. McAllister, 2008.
+
+// This is the texture bake step. It takes the place of running a process per image from a script.
+// Each image goes through three stages:
+//     Read:    Load the file into an f3Image.
+//     Compute: Resize it, tone map it, and quantize it.
+//     Write:   Save it in the output tree, at the same relative path as it had in the input tree.
+// The stages run at the same time on different images. Reader threads and writer threads mostly wait on the disk,
+// and the worker threads do the math. They hand images to each other through bounded queues, so a fast stage can
+// only get a few images ahead of a slow one and the memory used stays bounded no matter how many images there are.
+//
+// The threads are OpenMP threads, like the rest of DMcTools. Built without OpenMP, it does the images one at a time.
+
+#include "Image/ImageAlgorithms.h"
+#include "Image/ImageLoadSave.h"
+#include "Image/Quant.h"
+#include "Image/tImage.h"
+#include "Util/Assert.h"
+#include "Util/Timer.h"
+#include "Util/Utils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef DMC_MACHINE_win
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    //////////////////////////////////////////////////////////////////////
+    // Options
+
+    string OutDir = "."; // The root of the output tree
+    string OutExt;       // The extension of the output files, like "png", or empty to keep each input's extension
+    int OutWid = 0, OutHgt = 0; // Resize to exactly this size
+    float OutScale = 0;  // Resize by this factor
+    int OutMaxSize = 0;  // Shrink so the longer side is at most this
+    bool ToneMap = false;
+    float ToneScale = 1.0f, ToneBias = 0.0f; // Output = Input * ToneScale + ToneBias, where 1.0 is white
+    int QuantColors = 0; // Quantize to this many colors, or 0 not to
+    int NumReaders = 2, NumWorkers = 0, NumWriters = 2, QueueSize = 0; // 0 means choose based on how many CPUs there are
+    bool Quiet = false;
+
+    //////////////////////////////////////////////////////////////////////
+    // Files and directories
+
+    struct BatchItem
+    {
+        string InName, OutName;
+        double InBytes, OutBytes;
+        f3Image *Img;     // Loaded by a reader. Replaced with the result by a worker if the output is float.
+        uc3Image *Img8;   // The worker's result if the output is 8 bits.
+
+        BatchItem(const string &In, const string &Out) : InName(In), OutName(Out)
+        {
+            InBytes = OutBytes = 0;
+            Img = NULL;
+            Img8 = NULL;
+        }
+
+        ~BatchItem()
+        {
+            delete Img;
+            delete Img8;
+        }
+    };
+
+    double FileSize(const string &fname)
+    {
+        FILE *f = fopen(fname.c_str(), "rb");
+        if(f == NULL)
+            return 0;
+        fseek(f, 0, SEEK_END);
+        double sz = double(ftell(f));
+        fclose(f);
+        return sz;
+    }
+
+    bool IsDirectory(const string &path)
+    {
+#ifdef DMC_MACHINE_win
+        DWORD Attr = GetFileAttributesA(path.c_str());
+        return Attr != INVALID_FILE_ATTRIBUTES && (Attr & FILE_ATTRIBUTE_DIRECTORY);
+#else
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+    }
+
+    // Append the names of the entries of directory Dir to Names, not including "." and "..".
+    void ListDirectory(const string &Dir, vector<string> &Names)
+    {
+#ifdef DMC_MACHINE_win
+        WIN32_FIND_DATAA FD;
+        HANDLE H = FindFirstFileA((Dir + "/*").c_str(), &FD);
+        if(H == INVALID_HANDLE_VALUE)
+            throw DMcError("Can't read directory " + Dir);
+        do {
+            string N = FD.cFileName;
+            if(N != "." && N != "..")
+                Names.push_back(N);
+        } while(FindNextFileA(H, &FD));
+        FindClose(H);
+#else
+        DIR *D = opendir(Dir.c_str());
+        if(D == NULL)
+            throw DMcError("Can't read directory " + Dir);
+        while(struct dirent *E = readdir(D)) {
+            string N = E->d_name;
+            if(N != "." && N != "..")
+                Names.push_back(N);
+        }
+        closedir(D);
+#endif
+    }
+
+    // Make directory Dir and any of its parents that don't exist yet. Several threads may make the same one.
+    void MakeDirectories(const string &Dir)
+    {
+        if(Dir.empty() || IsDirectory(Dir))
+            return;
+
+        string::size_type Slash = Dir.find_last_of("/\\");
+        if(Slash != string::npos && Slash > 0)
+            MakeDirectories(Dir.substr(0, Slash));
+
+#ifdef DMC_MACHINE_win
+        _mkdir(Dir.c_str());
+#else
+        mkdir(Dir.c_str(), 0777);
+#endif
+        if(!IsDirectory(Dir))
+            throw DMcError("Can't make directory " + Dir);
+    }
+
+    bool IsImageFile(const string &fname)
+    {
+        switch(GetExtensionVal(fname.c_str())) {
+        case BMP_: case GIF_: case HDR_: case JPG_: case PAM_: case PFM_: case PGM_:
+        case PNG_: case PPM_: case PSM_: case PZM_: case RAS_: case RGB_: case TGA_: case TIF_:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // The output file name for input file Rel, which is relative to the input root.
+    string OutputName(const string &Rel)
+    {
+        string Out = OutDir + "/" + Rel;
+        if(!OutExt.empty()) {
+            string::size_type Dot = Out.find_last_of('.');
+            string::size_type Slash = Out.find_last_of("/\\");
+            if(Dot != string::npos && (Slash == string::npos || Dot > Slash))
+                Out.erase(Dot);
+            Out += "." + OutExt;
+        }
+        return Out;
+    }
+
+    // Add the image files under Path to Items. Rel is Path relative to the input root.
+    void FindImages(const string &Path, const string &Rel, vector<BatchItem *> &Items)
+    {
+        if(!IsDirectory(Path)) {
+            if(IsImageFile(Path))
+                Items.push_back(new BatchItem(Path, OutputName(Rel)));
+            return;
+        }
+
+        vector<string> Names;
+        ListDirectory(Path, Names);
+        sort(Names.begin(), Names.end());
+        for(size_t i=0; i<Names.size(); i++)
+            FindImages(Path + "/" + Names[i], Rel.empty() ? Names[i] : Rel + "/" + Names[i], Items);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    // The stages
+
+    // Whether the result is stored as float. Only float file formats get float results, and only if nothing made it 8 bits.
+    bool FloatOutput(const string &OutName)
+    {
+        int Ext = GetExtensionVal(OutName.c_str());
+        return (Ext == HDR_ || Ext == PFM_) && !ToneMap && QuantColors <= 0;
+    }
+
+    void ReadStage(BatchItem *It)
+    {
+        It->InBytes = FileSize(It->InName);
+        It->Img = new f3Image;
+        It->Img->Load(It->InName.c_str());
+    }
+
+    void ComputeStage(BatchItem *It)
+    {
+        f3Image *Img = It->Img;
+        const int w = Img->w(), h = Img->h();
+
+        // Choose the size.
+        int w1 = w, h1 = h;
+        if(OutWid > 0 && OutHgt > 0) {
+            w1 = OutWid;
+            h1 = OutHgt;
+        } else if(OutScale > 0) {
+            w1 = std::max(1, int(w * OutScale + 0.5f));
+            h1 = std::max(1, int(h * OutScale + 0.5f));
+        }
+        if(OutMaxSize > 0 && std::max(w1, h1) > OutMaxSize) {
+            float s = OutMaxSize / float(std::max(w1, h1));
+            w1 = std::max(1, int(w1 * s + 0.5f));
+            h1 = std::max(1, int(h1 * s + 0.5f));
+        }
+
+        // Resample4() is good for enlarging and for shrinking by less than half, and Downsample() is for shrinking more.
+        if(w1 != w || h1 != h) {
+            f3Image *Sized = new f3Image;
+            if(w1 * 2 <= w && h1 * 2 <= h)
+                Downsample(*Sized, *Img, w1, h1);
+            else
+                Resample4(*Sized, *Img, w1, h1);
+            delete Img;
+            It->Img = Img = Sized;
+        }
+
+        if(FloatOutput(It->OutName))
+            return;
+
+        It->Img8 = new uc3Image;
+        ToneMapLinear(*It->Img8, *Img, ToneScale, ToneBias);
+        delete Img;
+        It->Img = NULL;
+
+        if(QuantColors > 0) {
+            Quantizer<uc3Pixel, unsigned char> Qnt(It->Img8->pp(), It->Img8->size());
+            Qnt.SetParams(QuantColors);
+            Qnt.GetQuantizedTrueColorImage(It->Img8->pp());
+        }
+    }
+
+    void WriteStage(BatchItem *It)
+    {
+        string::size_type Slash = It->OutName.find_last_of("/\\");
+        if(Slash != string::npos)
+            MakeDirectories(It->OutName.substr(0, Slash));
+
+        if(It->Img8) {
+            It->Img8->Save(It->OutName.c_str());
+            delete It->Img8;
+            It->Img8 = NULL;
+        } else {
+            It->Img->Save(It->OutName.c_str());
+            delete It->Img;
+            It->Img = NULL;
+        }
+
+        It->OutBytes = FileSize(It->OutName);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    // Running the stages
+
+    struct BatchStats
+    {
+        int NumDone, NumFailed;
+        double InBytes, OutBytes;
+        double ReadSec, ComputeSec, WriteSec; // Summed over all the threads doing each stage
+
+        BatchStats() { NumDone = NumFailed = 0; InBytes = OutBytes = ReadSec = ComputeSec = WriteSec = 0; }
+    };
+
+    BatchStats Stats;
+
+    // Run a stage on an image. If it fails, say so and return false. The threads share Stats.
+    bool RunStage(void (*Stage)(BatchItem *), BatchItem *It, double &StageSec)
+    {
+        Timer T;
+        T.Start();
+        string Err;
+        try {
+            Stage(It);
+        }
+        catch(DMcError &E) {
+            Err = E.Er;
+        }
+        catch(...) {
+            Err = "Unknown error";
+        }
+        double Sec = T.Read();
+
+#pragma omp critical (ImageBatchStats)
+        {
+            StageSec += Sec;
+            if(!Err.empty()) {
+                Stats.NumFailed++;
+                cerr << It->InName << ": " << Err << endl;
+            }
+        }
+
+        return Err.empty();
+    }
+
+    void FinishItem(BatchItem *It)
+    {
+#pragma omp critical (ImageBatchStats)
+        {
+            Stats.NumDone++;
+            Stats.InBytes += It->InBytes;
+            Stats.OutBytes += It->OutBytes;
+            if(!Quiet)
+                cerr << It->InName << " -> " << It->OutName << endl;
+        }
+        delete It;
+    }
+
+    // One image at a time on this thread.
+    void RunSerial(vector<BatchItem *> &Items)
+    {
+        for(size_t i=0; i<Items.size(); i++) {
+            BatchItem *It = Items[i];
+            if(RunStage(ReadStage, It, Stats.ReadSec) && RunStage(ComputeStage, It, Stats.ComputeSec) && RunStage(WriteStage, It, Stats.WriteSec))
+                FinishItem(It);
+            else
+                delete It;
+        }
+    }
+
+#ifdef _OPENMP
+    // Pause a waiting thread for a moment.
+    void Nap()
+    {
+#ifdef DMC_MACHINE_win
+        Sleep(1);
+#else
+        usleep(1000);
+#endif
+    }
+
+    // A queue of at most Capacity items between two stages. Push() waits while it's full and Pop() waits while it's empty.
+    // OpenMP has locks but no condition variables, so the waits poll. An image takes much longer than a Nap().
+    template<class T>
+    class BoundedQueue
+    {
+        deque<T> Items;
+        size_t Capacity;
+        int Producers; // How many threads may still Push(). When none can and the queue is empty, Pop() fails.
+        omp_lock_t Lock;
+
+        // Not copyable.
+        BoundedQueue(const BoundedQueue &);
+        BoundedQueue &operator=(const BoundedQueue &);
+
+    public:
+        BoundedQueue(const size_t Capacity_, const int NumProducers) : Capacity(Capacity_), Producers(NumProducers)
+        {
+            omp_init_lock(&Lock);
+        }
+
+        ~BoundedQueue() { omp_destroy_lock(&Lock); }
+
+        void Push(const T &Item)
+        {
+            while(true) {
+                omp_set_lock(&Lock);
+                if(Items.size() < Capacity) {
+                    Items.push_back(Item);
+                    omp_unset_lock(&Lock);
+                    return;
+                }
+                omp_unset_lock(&Lock);
+                Nap();
+            }
+        }
+
+        // Return false once the producers are all done and the queue is empty.
+        bool Pop(T &Item)
+        {
+            while(true) {
+                omp_set_lock(&Lock);
+                if(!Items.empty()) {
+                    Item = Items.front();
+                    Items.pop_front();
+                    omp_unset_lock(&Lock);
+                    return true;
+                }
+                bool Finished = Producers <= 0;
+                omp_unset_lock(&Lock);
+                if(Finished)
+                    return false;
+                Nap();
+            }
+        }
+
+        // Each producer calls this when it won't Push() any more.
+        void ProducerDone()
+        {
+            omp_set_lock(&Lock);
+            Producers--;
+            omp_unset_lock(&Lock);
+        }
+    };
+
+    // Each thread of the team takes one role, by its thread number: reader, worker, or writer.
+    // Readers take the next file from Items, workers go between LoadedQ and DoneQ, and writers drain DoneQ.
+    void RunPipelined(vector<BatchItem *> &Items)
+    {
+        const int NumThreads = NumReaders + NumWorkers + NumWriters;
+        BoundedQueue<BatchItem *> LoadedQ(QueueSize, NumReaders), DoneQ(QueueSize, NumWorkers);
+        int NextItem = 0;
+
+        omp_set_dynamic(0); // Each role needs its own thread.
+        bool GotThreads = true;
+
+#pragma omp parallel num_threads(NumThreads)
+        {
+#pragma omp master
+            GotThreads = omp_get_num_threads() == NumThreads;
+#pragma omp barrier
+
+            const int t = omp_get_thread_num();
+            if(!GotThreads) {
+                // Without a thread per role the queues could wait on each other forever.
+#pragma omp master
+                RunSerial(Items);
+            } else if(t < NumReaders) {
+                while(true) {
+                    int i;
+#pragma omp critical (ImageBatchNext)
+                    i = NextItem++;
+                    if(i >= int(Items.size()))
+                        break;
+
+                    BatchItem *It = Items[i];
+                    if(RunStage(ReadStage, It, Stats.ReadSec))
+                        LoadedQ.Push(It);
+                    else
+                        delete It;
+                }
+                LoadedQ.ProducerDone();
+            } else if(t < NumReaders + NumWorkers) {
+                BatchItem *It;
+                while(LoadedQ.Pop(It)) {
+                    if(RunStage(ComputeStage, It, Stats.ComputeSec))
+                        DoneQ.Push(It);
+                    else
+                        delete It;
+                }
+                DoneQ.ProducerDone();
+            } else {
+                BatchItem *It;
+                while(DoneQ.Pop(It)) {
+                    if(RunStage(WriteStage, It, Stats.WriteSec))
+                        FinishItem(It);
+                    else
+                        delete It;
+                }
+            }
+        }
+    }
+#endif
+
+    //////////////////////////////////////////////////////////////////////
+    // The command line
+
+    void Usage(const char *message = NULL, const bool Exit = true)
+    {
+        if(message)
+            cerr << "\nERROR: " << message << endl;
+
+        cerr << "Usage: ImageBatch [options] <input files and directories>\n";
+        cerr << "Each input directory is searched for images, recursively.\n";
+        cerr << "The images are RGB. Alpha channels are dropped.\n";
+        cerr << "Program options:\n";
+        cerr << "-o <dir>                Root of the output tree (default .)\n";
+        cerr << "-ext <ext>              Convert to this format, like png or jpg (default keep the input format)\n";
+        cerr << "-size <w> <h>           Resize to w x h\n";
+        cerr << "-scale <s>              Resize by factor s\n";
+        cerr << "-maxsize <n>            Shrink so neither side is bigger than n\n";
+        cerr << "-tonemap <scale> <bias> Output = Input * scale + bias, where 1 is white (default 1 0)\n";
+        cerr << "-quant <ncolors>        Quantize to ncolors colors\n";
+        cerr << "-readers <n>            Threads reading images (default 2)\n";
+        cerr << "-workers <n>            Threads computing (default the number of CPUs)\n";
+        cerr << "-writers <n>            Threads writing images (default 2)\n";
+        cerr << "-queue <n>              Images waiting between stages, at most (default two per worker)\n";
+        cerr << "-q                      Don't list the images\n";
+
+        if(Exit)
+            exit(1);
+    }
+
+    // Take a whack at the argument vector. Leaves only the inputs.
+    void Args(int &argc, char **argv)
+    {
+        for(int i=1; i<argc; i++) {
+            string Opt = argv[i];
+            int NumArgs = 0;
+            if(Opt == "-o") NumArgs = 1;
+            else if(Opt == "-ext") NumArgs = 1;
+            else if(Opt == "-size") NumArgs = 2;
+            else if(Opt == "-scale") NumArgs = 1;
+            else if(Opt == "-maxsize") NumArgs = 1;
+            else if(Opt == "-tonemap") NumArgs = 2;
+            else if(Opt == "-quant") NumArgs = 1;
+            else if(Opt == "-readers" || Opt == "-workers" || Opt == "-writers" || Opt == "-queue") NumArgs = 1;
+
+            if(i + NumArgs >= argc)
+                Usage("Missing argument");
+
+            if(Opt == "-h" || Opt == "-help") {
+                Usage();
+            } else if(Opt == "-o") {
+                OutDir = argv[i+1];
+            } else if(Opt == "-ext") {
+                OutExt = argv[i+1];
+                if(!OutExt.empty() && OutExt[0] == '.')
+                    OutExt.erase(0, 1);
+            } else if(Opt == "-size") {
+                OutWid = atoi(argv[i+1]);
+                OutHgt = atoi(argv[i+2]);
+                if(OutWid < 1 || OutHgt < 1) Usage("Bad size");
+            } else if(Opt == "-scale") {
+                OutScale = float(atof(argv[i+1]));
+                if(OutScale <= 0) Usage("Bad scale");
+            } else if(Opt == "-maxsize") {
+                OutMaxSize = atoi(argv[i+1]);
+                if(OutMaxSize < 1) Usage("Bad maxsize");
+            } else if(Opt == "-tonemap") {
+                ToneMap = true;
+                ToneScale = float(atof(argv[i+1]));
+                ToneBias = float(atof(argv[i+2]));
+            } else if(Opt == "-quant") {
+                QuantColors = atoi(argv[i+1]);
+                if(QuantColors < 2 || QuantColors > 256) Usage("Can quantize to 2 to 256 colors");
+            } else if(Opt == "-readers") {
+                NumReaders = atoi(argv[i+1]);
+            } else if(Opt == "-workers") {
+                NumWorkers = atoi(argv[i+1]);
+            } else if(Opt == "-writers") {
+                NumWriters = atoi(argv[i+1]);
+            } else if(Opt == "-queue") {
+                QueueSize = atoi(argv[i+1]);
+            } else if(Opt == "-q") {
+                Quiet = true;
+            } else if(Opt[0] == '-') {
+                Usage("Invalid option!");
+            } else {
+                continue;
+            }
+
+            RemoveArgs(argc, argv, i, NumArgs + 1);
+        }
+
+        if(argc < 2)
+            Usage("No input files");
+
+#ifdef _OPENMP
+        if(NumWorkers <= 0) NumWorkers = omp_get_num_procs();
+#else
+        if(NumWorkers <= 0) NumWorkers = 1;
+#endif
+        NumReaders = std::max(NumReaders, 1);
+        NumWriters = std::max(NumWriters, 1);
+        if(QueueSize <= 0) QueueSize = 2 * NumWorkers;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    Args(argc, argv);
+
+    vector<BatchItem *> Items;
+    try {
+        for(int i=1; i<argc; i++) {
+            string In = argv[i];
+            while(In.size() > 1 && (In[In.size()-1] == '/' || In[In.size()-1] == '\\'))
+                In.erase(In.size()-1);
+            // A directory's contents go in the output root. A file goes there by its name.
+            string::size_type Slash = In.find_last_of("/\\");
+            FindImages(In, IsDirectory(In) ? string("") : In.substr(Slash == string::npos ? 0 : Slash + 1), Items);
+        }
+    }
+    catch(DMcError &E) {
+        cerr << E.Er << endl;
+        return 1;
+    }
+
+    if(!Quiet)
+        cerr << "Found " << Items.size() << " images.\n";
+
+    Timer T;
+    T.Start();
+
+#ifdef _OPENMP
+    RunPipelined(Items);
+#else
+    RunSerial(Items);
+#endif
+
+    double Sec = T.Read();
+    const double MB = 1024.0 * 1024.0;
+    cerr << Stats.NumDone << " images done, " << Stats.NumFailed << " failed, in " << Sec << " sec\n";
+    cerr << Stats.NumDone / Sec << " images/sec, " << Stats.InBytes / MB / Sec << " MB/sec read, "
+        << Stats.OutBytes / MB / Sec << " MB/sec written\n";
+    cerr << "Thread seconds: read " << Stats.ReadSec << ", compute " << Stats.ComputeSec << ", write " << Stats.WriteSec << endl;
+
+    return Stats.NumFailed ? 1 : 0;
+}
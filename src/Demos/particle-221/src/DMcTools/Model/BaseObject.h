@@ -21,7 +21,7 @@
 #define OBJ_TANGENTS 8
 #define OBJ_ALL (OBJ_COLORS | OBJ_NORMALS | OBJ_TEXCOORDS | OBJ_TANGENTS)
 
-typedef enum {DMC_BASE_OBJECT, DMC_TRI_OBJECT, DMC_MESH_OBJECT, DMC_RENDER_OBJECT} ObjectTypes;
+typedef enum {DMC_BASE_OBJECT, DMC_TRI_OBJECT, DMC_MESH_OBJECT, DMC_RENDER_OBJECT, DMC_HALF_EDGE_OBJECT} ObjectTypes;
 
 struct BaseObject
 {
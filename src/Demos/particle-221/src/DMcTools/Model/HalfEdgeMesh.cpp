@@ -0,0 +1,690 @@
+//////////////////////////////////////////////////////////////////////
+// HalfEdgeMesh.cpp - A triangle mesh in flat arrays with half-edge connectivity.
+//
+// Copyright David K. McAllister, 2008.
+
+#include "Model/HalfEdgeMesh.h"
+#include "Model/AElements.h"
+#include "Model/OrientFaces.h"
+#include "Model/WeldVertices.h"
+
+#include <algorithm>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+    const int MESH_PAR_MIN = 1 << 14; // Fewer elements than this aren't worth starting threads for.
+
+    // The three vertex indices of a face in increasing order, for finding faces with the same vertices.
+    struct FaceKey
+    {
+        int v[3], f;
+
+        bool operator<(const FaceKey &B) const
+        {
+            if(v[0] != B.v[0]) return v[0] < B.v[0];
+            if(v[1] != B.v[1]) return v[1] < B.v[1];
+            if(v[2] != B.v[2]) return v[2] < B.v[2];
+            return f < B.f;
+        }
+        bool SameVerts(const FaceKey &B) const { return v[0] == B.v[0] && v[1] == B.v[1] && v[2] == B.v[2]; }
+    };
+
+    vector<FaceKey> SortedFaceKeys(const vector<int> &Indices)
+    {
+        const int nF = int(Indices.size() / 3);
+        vector<FaceKey> K(nF);
+        for(int f=0; f<nF; f++) {
+            K[f].v[0] = Indices[3*f]; K[f].v[1] = Indices[3*f+1]; K[f].v[2] = Indices[3*f+2];
+            sort(K[f].v, K[f].v + 3);
+            K[f].f = f;
+        }
+        sort(K.begin(), K.end());
+        return K;
+    }
+
+    // Return true if vector is bad.
+    DMC_INLINE bool CheckVec(const Vector &V)
+    {
+        double len2 = V.length2();
+        return (len2 < 0.97 || len2 > 1.03 || !Finite(V.x) || !Finite(V.y) || !Finite(V.z));
+    }
+
+    DMC_INLINE Vector Normalized(Vector V)
+    {
+        if(V.length2() > 0)
+            V.normalize();
+        return V;
+    }
+
+    // Copy the attributes that exist from vertex s to vertex d.
+    DMC_INLINE void CopyAttribs(HalfEdgeMesh &M, const int d, const int s)
+    {
+        M.verts[d] = M.verts[s];
+        if(M.normals.size()) M.normals[d] = M.normals[s];
+        if(M.tangents.size()) M.tangents[d] = M.tangents[s];
+        if(M.texcoords.size()) M.texcoords[d] = M.texcoords[s];
+        if(M.dcolors.size()) M.dcolors[d] = M.dcolors[s];
+    }
+
+    // Each vertex's faces, as the list of the half-edges that start at it, in order.
+    void VertexCorners(const HalfEdgeMesh &M, vector<int> &Start, vector<int> &Corners)
+    {
+        const int nV = int(M.verts.size()), nH = int(M.Indices.size());
+        Start.assign(nV + 1, 0);
+        for(int h=0; h<nH; h++)
+            Start[M.Indices[h] + 1]++;
+        for(int v=0; v<nV; v++)
+            Start[v+1] += Start[v];
+
+        vector<int> Fill(Start.begin(), Start.end() - 1);
+        Corners.resize(nH);
+        for(int h=0; h<nH; h++)
+            Corners[Fill[M.Indices[h]]++] = h;
+    }
+};
+
+HalfEdgeMesh::HalfEdgeMesh(const TriObject &Ob, const double MeshDistFactor)
+{
+    ImportTriObject(Ob, MeshDistFactor);
+}
+
+HalfEdgeMesh::HalfEdgeMesh(const RenderObject &Ob)
+{
+    ImportRenderObject(Ob);
+}
+
+void HalfEdgeMesh::Dump() const
+{
+    cerr << "HalfEdgeMesh vert count: " << VertexCount << " edge count: "
+         << EdgeCount << " face count: " << FaceCount << endl;
+}
+
+void HalfEdgeMesh::ImportTriObject(const TriObject &Ob, const double MeshDistFactor)
+{
+    WARN_R(Ob.verts.size() % 3 == 0, "TriObject must be multiple of three vertices.");
+    ASSERT_R(Ob.PrimType == L_TRIANGLES);
+
+    *(BaseObject *)this = Ob;
+    ObjectType = DMC_HALF_EDGE_OBJECT;
+    FacesAreFixed = false;
+
+    const int n = int(Ob.verts.size() / 3) * 3;
+    const bool DoingColor = Ob.dcolors.size() == Ob.verts.size();
+    const bool DoingNormals = Ob.normals.size() == Ob.verts.size();
+    const bool DoingTexcoords = Ob.texcoords.size() == Ob.verts.size();
+    const bool DoingTangents = Ob.tangents.size() == Ob.verts.size();
+
+    VertexType = HAS_ATTRIBS;
+    VertexType |= DoingColor ? OBJ_COLORS : 0;
+    VertexType |= DoingNormals ? OBJ_NORMALS : 0;
+    VertexType |= DoingTexcoords ? OBJ_TEXCOORDS : 0;
+    VertexType |= DoingTangents ? OBJ_TANGENTS : 0;
+    EdgeType = FaceType = HAS_ATTRIBS;
+
+    double Eps = 0;
+    if(n) {
+        BBox<Vector> ObBox(Ob.verts[0], Ob.verts[0]);
+        for(int i=1; i<n; i++)
+            ObBox += Ob.verts[i];
+        Eps = (ObBox.MaxV - ObBox.MinV).length() * MeshDistFactor;
+    }
+
+    vector<int> Remap, FirstIndex;
+    if(n == (int)Ob.verts.size())
+        WeldVertices(Remap, FirstIndex, Ob.verts, Eps);
+    else
+        WeldVertices(Remap, FirstIndex, vector<Vector>(Ob.verts.begin(), Ob.verts.begin() + n), Eps);
+    const int nV = int(FirstIndex.size());
+
+    verts.resize(nV);
+    dcolors.resize(DoingColor ? nV : 0);
+    normals.resize(DoingNormals ? nV : 0);
+    texcoords.resize(DoingTexcoords ? nV : 0);
+    tangents.resize(DoingTangents ? nV : 0);
+    for(int v=0; v<nV; v++) {
+        const int i = FirstIndex[v];
+        verts[v] = Ob.verts[i];
+        if(DoingColor) dcolors[v] = Ob.dcolors[i];
+        if(DoingNormals) normals[v] = Ob.normals[i];
+        if(DoingTexcoords) texcoords[v] = Ob.texcoords[i];
+        if(DoingTangents) tangents[v] = Ob.tangents[i];
+    }
+
+    // Make the faces, leaving out degenerate ones.
+    Indices.clear();
+    Indices.reserve(n);
+    for(int i=0; i<n; i+=3) {
+        const int i0 = Remap[i], i1 = Remap[i+1], i2 = Remap[i+2];
+        if(i0 == i1 || i1 == i2 || i0 == i2)
+            continue;
+        Indices.push_back(i0);
+        Indices.push_back(i1);
+        Indices.push_back(i2);
+    }
+
+    // Leave out faces with the same three vertices as an earlier face.
+    vector<FaceKey> K = SortedFaceKeys(Indices);
+    vector<char> Dup(K.size(), 0);
+    int nDup = 0;
+    for(int k=1; k<(int)K.size(); k++)
+        if(K[k].SameVerts(K[k-1])) {
+            Dup[K[k].f] = 1;
+            nDup++;
+        }
+    if(nDup) {
+        int d = 0;
+        for(int f=0; f<(int)K.size(); f++) {
+            if(Dup[f])
+                continue;
+            for(int c=0; c<3; c++)
+                Indices[d++] = Indices[3*f+c];
+        }
+        Indices.resize(d);
+    }
+
+    FaceNormals.clear();
+    VertexCount = nV;
+    FaceCount = int(Indices.size() / 3);
+
+    BuildConnectivity();
+    RebuildBBox();
+}
+
+void HalfEdgeMesh::ImportRenderObject(const RenderObject &Ob)
+{
+    ASSERT_R(Ob.indices.size() % 3 == 0);
+
+    *(BaseObject *)this = Ob;
+    ObjectType = DMC_HALF_EDGE_OBJECT;
+    FacesAreFixed = false;
+
+    const int nV = int(Ob.verts.size());
+    VertexType = HAS_ATTRIBS;
+    EdgeType = FaceType = HAS_ATTRIBS;
+
+    verts.resize(nV);
+    for(int i=0; i<nV; i++)
+        verts[i] = Vector(Ob.verts[i]);
+
+    dcolors.clear();
+    if((int)Ob.dcolors.size() == nV) {
+        dcolors.assign(Ob.dcolors.begin(), Ob.dcolors.end());
+        VertexType |= OBJ_COLORS;
+    }
+    normals.clear();
+    if((int)Ob.normals.size() == nV) {
+        normals.assign(Ob.normals.begin(), Ob.normals.end());
+        VertexType |= OBJ_NORMALS;
+    }
+    texcoords.clear();
+    if((int)Ob.texcoords.size() == nV) {
+        texcoords.assign(Ob.texcoords.begin(), Ob.texcoords.end());
+        VertexType |= OBJ_TEXCOORDS;
+    }
+    tangents.clear();
+    if((int)Ob.tangents.size() == nV) {
+        tangents.assign(Ob.tangents.begin(), Ob.tangents.end());
+        VertexType |= OBJ_TANGENTS;
+    }
+
+    for(int i=0; i<(int)Ob.indices.size(); i++)
+        ASSERT_RM(Ob.indices[i] >= 0 && Ob.indices[i] < nV, "Index out of range");
+    Indices = Ob.indices;
+
+    FaceNormals.clear();
+    VertexCount = nV;
+    FaceCount = int(Indices.size() / 3);
+
+    BuildConnectivity();
+    RebuildBBox();
+}
+
+void HalfEdgeMesh::ExportTriObject(TriObject &Ob, unsigned int AcceptedAttribs) const
+{
+    *(BaseObject *)&Ob = *((BaseObject *)this);
+    Ob.ObjectType = DMC_TRI_OBJECT;
+    Ob.PrimType = L_TRIANGLES;
+    Ob.VertexType = VertexType & AcceptedAttribs & OBJ_ALL;
+
+    const int nH = int(Indices.size());
+    Ob.verts.resize(nH);
+    Ob.dcolors.resize((Ob.VertexType & OBJ_COLORS) ? nH : 0);
+    Ob.normals.resize((Ob.VertexType & OBJ_NORMALS) ? nH : 0);
+    Ob.texcoords.resize((Ob.VertexType & OBJ_TEXCOORDS) ? nH : 0);
+    Ob.tangents.resize((Ob.VertexType & OBJ_TANGENTS) ? nH : 0);
+    Ob.alphas.clear();
+
+#pragma omp parallel for schedule(static) if(nH > MESH_PAR_MIN)
+    for(int h=0; h<nH; h++) {
+        const int v = Indices[h];
+        Ob.verts[h] = verts[v];
+        if(Ob.VertexType & OBJ_COLORS) Ob.dcolors[h] = dcolors[v];
+        if(Ob.VertexType & OBJ_NORMALS) Ob.normals[h] = normals[v];
+        if(Ob.VertexType & OBJ_TEXCOORDS) Ob.texcoords[h] = texcoords[v];
+        if(Ob.VertexType & OBJ_TANGENTS) Ob.tangents[h] = tangents[v];
+    }
+
+    Ob.VertexCount = nH;
+    Ob.FaceCount = FaceCount;
+    Ob.RebuildBBox();
+}
+
+void HalfEdgeMesh::ExportRenderObject(RenderObject &Ob, unsigned int AcceptedAttribs) const
+{
+    *(BaseObject *)&Ob = *((BaseObject *)this);
+    Ob.ObjectType = DMC_RENDER_OBJECT;
+    Ob.VertexType = (VertexType & AcceptedAttribs) | HAS_ATTRIBS;
+    Ob.EdgeType = HAS_ATTRIBS;
+    Ob.FaceType = HAS_ATTRIBS;
+
+    const int nV = int(verts.size());
+    Ob.verts.resize(nV);
+    Ob.dcolors.resize((Ob.VertexType & OBJ_COLORS) ? nV : 0);
+    Ob.normals.resize((Ob.VertexType & OBJ_NORMALS) ? nV : 0);
+    Ob.texcoords.resize((Ob.VertexType & OBJ_TEXCOORDS) ? nV : 0);
+    Ob.tangents.resize((Ob.VertexType & OBJ_TANGENTS) ? nV : 0);
+
+#pragma omp parallel for schedule(static) if(nV > MESH_PAR_MIN)
+    for(int v=0; v<nV; v++) {
+        Ob.verts[v] = f3Vector(verts[v]);
+        if(Ob.VertexType & OBJ_COLORS) Ob.dcolors[v] = f3Vector(dcolors[v]);
+        if(Ob.VertexType & OBJ_NORMALS) Ob.normals[v] = CheckVec(normals[v]) ? f3Vector(0,0,0) : f3Vector(normals[v]);
+        if(Ob.VertexType & OBJ_TEXCOORDS) Ob.texcoords[v] = f3Vector(texcoords[v]);
+        if(Ob.VertexType & OBJ_TANGENTS) Ob.tangents[v] = CheckVec(tangents[v]) ? f3Vector(0,0,0) : f3Vector(tangents[v]);
+    }
+
+    Ob.indices = Indices;
+    Ob.VertexCount = nV;
+    Ob.FaceCount = FaceCount;
+}
+
+// Pair up the half-edges on each edge by bucketing them by their lower numbered vertex,
+// then sorting each bucket by the other vertex.
+void HalfEdgeMesh::BuildConnectivity()
+{
+    const int nV = int(verts.size()), nH = int(Indices.size());
+
+    vector<int> Start(nV + 1, 0);
+    for(int h=0; h<nH; h++)
+        Start[min(From(h), To(h)) + 1]++;
+    for(int v=0; v<nV; v++)
+        Start[v+1] += Start[v];
+
+    // Each entry is the higher numbered vertex and the half-edge.
+    vector<pair<int, int> > Bucket(nH);
+    {
+        vector<int> Fill(Start.begin(), Start.end() - 1);
+        for(int h=0; h<nH; h++) {
+            const int a = From(h), b = To(h);
+            Bucket[Fill[min(a, b)]++] = make_pair(max(a, b), h);
+        }
+    }
+
+    Twin.resize(nH);
+    int nEdges = 0;
+
+#pragma omp parallel for schedule(dynamic, 1024) reduction(+:nEdges) if(nV > MESH_PAR_MIN)
+    for(int v=0; v<nV; v++) {
+        const int b0 = Start[v], b1 = Start[v+1];
+        if(b1 - b0 > 1)
+            sort(Bucket.begin() + b0, Bucket.begin() + b1);
+
+        for(int i=b0; i<b1; ) {
+            int j = i + 1;
+            while(j < b1 && Bucket[j].first == Bucket[i].first)
+                j++;
+
+            if(j - i == 1)
+                Twin[Bucket[i].second] = BOUNDARY;
+            else if(j - i == 2) {
+                Twin[Bucket[i].second] = Bucket[i+1].second;
+                Twin[Bucket[i+1].second] = Bucket[i].second;
+            } else
+                for(int k=i; k<j; k++)
+                    Twin[Bucket[k].second] = NONMANIFOLD;
+
+            nEdges++;
+            i = j;
+        }
+    }
+
+    EdgeCount = nEdges;
+    VertexCount = nV;
+    FaceCount = nH / 3;
+    FindVertHalfEdges();
+}
+
+void HalfEdgeMesh::FindVertHalfEdges()
+{
+    VertHalfEdge.assign(verts.size(), -1);
+    for(int h=0; h<(int)Indices.size(); h++) {
+        int &vh = VertHalfEdge[Indices[h]];
+        if(vh < 0 || (Twin[h] == BOUNDARY && Twin[vh] != BOUNDARY))
+            vh = h;
+    }
+}
+
+// The flips are all decided by OrientFaces() first, so the twins only have to be fixed once.
+int HalfEdgeMesh::FixFacing()
+{
+    if(FacesAreFixed)
+        return 0;
+
+    const int nF = FaceCount, nH = int(Indices.size());
+    ASSERT_R(nH == nF * 3 && (int)Twin.size() == nH);
+
+    // A neighbor with the same winding goes the opposite way along the edge.
+    vector<int> AdjStart(nF + 1, 0), Adj;
+    Adj.reserve(nH);
+    int nNonManifold = 0;
+    for(int f=0; f<nF; f++) {
+        for(int h=3*f; h<3*f+3; h++) {
+            const int t = Twin[h];
+            if(t >= 0)
+                Adj.push_back((FaceOf(t) << 1) | (From(t) == From(h)));
+            else if(t == NONMANIFOLD)
+                nNonManifold++;
+        }
+        AdjStart[f+1] = int(Adj.size());
+    }
+
+    vector<char> Flip;
+    int nConflicts;
+    const int nFlipped = OrientFaces(Flip, nConflicts, AdjStart, Adj);
+
+    if(nNonManifold)
+        cerr << "FixFacing: " << Name << " " << nNonManifold << " half-edges are on non-manifold edges, which don't pass on a winding.\n";
+    if(nConflicts)
+        cerr << "FixFacing: " << Name << " " << nConflicts << " edges can't agree. It's not orientable.\n";
+
+    // Flipping a face swaps its last two vertices, which makes its first half-edge the old third one reversed.
+    if(nFlipped == 0) {
+        FacesAreFixed = true;
+        return 0;
+    }
+
+    vector<int> NewTwin(nH);
+#pragma omp parallel for schedule(static) if(nH > MESH_PAR_MIN)
+    for(int h=0; h<nH; h++) {
+        const int t = Twin[h];
+        const int hN = Flip[FaceOf(h)] ? 3*FaceOf(h) + 2 - h%3 : h;
+        NewTwin[hN] = (t >= 0 && Flip[FaceOf(t)]) ? 3*FaceOf(t) + 2 - t%3 : t;
+    }
+    Twin.swap(NewTwin);
+
+    for(int f=0; f<nF; f++)
+        if(Flip[f]) {
+            swap(Indices[3*f+1], Indices[3*f+2]);
+            if(FaceNormals.size())
+                FaceNormals[f] = -FaceNormals[f];
+        }
+
+    FindVertHalfEdges();
+    FacesAreFixed = true;
+
+    return nFlipped;
+}
+
+void HalfEdgeMesh::RemoveUnusedVertices()
+{
+    const int nV = int(verts.size());
+    vector<int> NewInd(nV, -1);
+    int n = 0;
+    for(int v=0; v<nV; v++) {
+        if(VertHalfEdge[v] >= 0) {
+            NewInd[v] = n;
+            if(n != v) {
+                CopyAttribs(*this, n, v);
+                VertHalfEdge[n] = VertHalfEdge[v];
+            }
+            n++;
+        }
+    }
+
+    if(n == nV)
+        return;
+
+    verts.resize(n);
+    if(normals.size()) normals.resize(n);
+    if(tangents.size()) tangents.resize(n);
+    if(texcoords.size()) texcoords.resize(n);
+    if(dcolors.size()) dcolors.resize(n);
+    VertHalfEdge.resize(n);
+
+    for(int h=0; h<(int)Indices.size(); h++)
+        Indices[h] = NewInd[Indices[h]];
+
+    VertexCount = n;
+}
+
+int HalfEdgeMesh::CheckIntegrity(const bool Detailed) const
+{
+    const int nV = int(verts.size()), nH = int(Indices.size());
+    int nProblems = 0;
+
+    // Counts of each kind of problem
+    int BadIndex = 0, RepeatedVert = 0, BadTwin = 0, Unused = 0, BadVertHalfEdge = 0;
+    int NonManifold = 0, Boundary = 0, OppositeWinding = 0;
+
+    // Array sizes
+    WARN_R(nH == FaceCount * 3, "Bad face count");
+    WARN_R(nV == VertexCount, "Bad vertex count");
+    WARN_R((int)Twin.size() == nH, "Twin must have one entry per half-edge");
+    WARN_R((int)VertHalfEdge.size() == nV, "VertHalfEdge must have one entry per vertex");
+    WARN_R((int)dcolors.size() == ((VertexType & OBJ_COLORS) ? nV : 0), "Bad dcolors.size()");
+    WARN_R((int)normals.size() == ((VertexType & OBJ_NORMALS) ? nV : 0), "Bad normals.size()");
+    WARN_R((int)texcoords.size() == ((VertexType & OBJ_TEXCOORDS) ? nV : 0), "Bad texcoords.size()");
+    WARN_R((int)tangents.size() == ((VertexType & OBJ_TANGENTS) ? nV : 0), "Bad tangents.size()");
+    WARN_R(FaceNormals.size() == 0 || (int)FaceNormals.size() == FaceCount, "Bad FaceNormals.size()");
+    if(nH != FaceCount * 3 || nV != VertexCount || (int)Twin.size() != nH || (int)VertHalfEdge.size() != nV)
+        return 1;
+
+    for(int h=0; h<nH; h++) {
+        if(Indices[h] < 0 || Indices[h] >= nV) {
+            BadIndex++;
+            continue;
+        }
+        if(h % 3 == 0 && (Indices[h] == Indices[h+1] || Indices[h+1] == Indices[h+2] || Indices[h] == Indices[h+2]))
+            RepeatedVert++;
+    }
+    if(BadIndex) {
+        cerr << "CheckIntegrity: " << BadIndex << " vertex indices out of range.\n";
+        return BadIndex;
+    }
+
+    // The twins must point back and be on the same edge of another face.
+    for(int h=0; h<nH; h++) {
+        const int t = Twin[h];
+        if(t == BOUNDARY)
+            Boundary++;
+        else if(t == NONMANIFOLD)
+            NonManifold++;
+        else if(t < 0 || t >= nH || Twin[t] != h || FaceOf(t) == FaceOf(h))
+            BadTwin++;
+        else if(From(t) == From(h) && To(t) == To(h))
+            OppositeWinding++;
+        else if(From(t) != To(h) || To(t) != From(h))
+            BadTwin++;
+    }
+
+    for(int v=0; v<nV; v++) {
+        const int vh = VertHalfEdge[v];
+        if(vh == -1)
+            Unused++;
+        else if(vh < 0 || vh >= nH || From(vh) != v)
+            BadVertHalfEdge++;
+    }
+
+    if(RepeatedVert) cerr << "CheckIntegrity: " << RepeatedVert << " faces use the same vertex twice.\n";
+    if(BadTwin) cerr << "CheckIntegrity: " << BadTwin << " half-edges have a bad twin.\n";
+    if(BadVertHalfEdge) cerr << "CheckIntegrity: " << BadVertHalfEdge << " vertices point to a half-edge that doesn't start at them.\n";
+    if(Unused) cerr << "CheckIntegrity: " << Unused << " vertices aren't part of any face.\n";
+    if(FacesAreFixed && OppositeWinding) cerr << "CheckIntegrity: " << OppositeWinding / 2 << " edges have faces of opposite winding after FixFacing.\n";
+    nProblems += RepeatedVert + BadTwin + BadVertHalfEdge + Unused;
+
+    if(Detailed) {
+        vector<FaceKey> K = SortedFaceKeys(Indices);
+        int DupFaces = 0;
+        for(int k=1; k<(int)K.size(); k++)
+            if(K[k].SameVerts(K[k-1]))
+                DupFaces++;
+        if(DupFaces) cerr << "CheckIntegrity: " << DupFaces << " faces have the same vertices as another face.\n";
+        nProblems += DupFaces;
+    }
+
+    if(NonManifold)
+        cerr << "CheckIntegrity: " << NonManifold << " half-edges are on non-manifold edges.\n";
+    if(Detailed)
+        cerr << "CheckIntegrity: " << Boundary << " boundary half-edges, " << OppositeWinding / 2 << " edges with opposite windings.\n";
+
+    Dump();
+
+    return nProblems;
+}
+
+/////////////////////////////////////////////////////////////////////
+
+void HalfEdgeMesh::GenFaceNormals()
+{
+    const int nF = FaceCount;
+    FaceNormals.resize(nF);
+
+#pragma omp parallel for schedule(static) if(nF > MESH_PAR_MIN)
+    for(int f=0; f<nF; f++) {
+        const Vector &V1 = verts[Indices[3*f+1]];
+        Vector P0 = verts[Indices[3*f]] - V1;
+        Vector P1 = verts[Indices[3*f+2]] - V1;
+
+        FaceNormals[f] = Normalized(Cross(P1, P0));
+    }
+
+    FaceType = FaceType | OBJ_NORMALS;
+}
+
+// Like Mesh::GenNormals, each vertex's faces are taken in order, and each face whose normal is within
+// creaseAngle of the sum so far is added to it. The faces that aren't go to a copy of the vertex,
+// whose faces are then done the same way. The copies are added to the end of the vertex list.
+void HalfEdgeMesh::GenNormals()
+{
+    ASSERT_RM(creaseAngle >= 0 && creaseAngle <= M_PI, "Bad creaseAngle.");
+
+    if(VertexType & OBJ_NORMALS)
+        return;
+
+    GenFaceNormals();
+
+    const double CosCrease = cos(creaseAngle);
+    const int nV = int(verts.size());
+
+    vector<int> Start, Corners;
+    VertexCorners(*this, Start, Corners);
+
+    // Which copy of its vertex each corner goes to, in the same order as Corners
+    vector<int> Copy(Corners.size(), -1);
+    vector<int> NumCopies(nV, 0);
+
+#pragma omp parallel for schedule(dynamic, 1024) if(nV > MESH_PAR_MIN)
+    for(int v=0; v<nV; v++) {
+        const int c0 = Start[v], c1 = Start[v+1];
+        int nCopies = 0;
+        for(int s=c0; s<c1; s++) {
+            if(Copy[s] >= 0)
+                continue;
+
+            Copy[s] = nCopies;
+            Vector AccNorm = FaceNormals[FaceOf(Corners[s])];
+            for(int c=s+1; c<c1; c++) {
+                if(Copy[c] >= 0)
+                    continue;
+                const Vector &FN = FaceNormals[FaceOf(Corners[c])];
+                if(Dot(Normalized(AccNorm), FN) > CosCrease) {
+                    AccNorm += FN;
+                    Copy[c] = nCopies;
+                }
+            }
+            nCopies++;
+        }
+        NumCopies[v] = nCopies;
+    }
+
+    // Number the new vertices.
+    vector<int> FirstNew(nV);
+    int nNew = nV;
+    for(int v=0; v<nV; v++) {
+        FirstNew[v] = nNew - 1;
+        if(NumCopies[v] > 1)
+            nNew += NumCopies[v] - 1;
+    }
+
+    verts.resize(nNew);
+    normals.resize(nNew);
+    if(tangents.size()) tangents.resize(nNew);
+    if(texcoords.size()) texcoords.resize(nNew);
+    if(dcolors.size()) dcolors.resize(nNew);
+
+#pragma omp parallel for schedule(dynamic, 1024) if(nV > MESH_PAR_MIN)
+    for(int v=0; v<nV; v++) {
+        const int c0 = Start[v], c1 = Start[v+1];
+        for(int k=0; k<max(NumCopies[v], 1); k++) {
+            const int d = k ? FirstNew[v] + k : v;
+            if(k)
+                CopyAttribs(*this, d, v);
+
+            // Summing the copy's faces in order gives the same sum as above.
+            Vector AccNorm(0,0,0);
+            for(int c=c0; c<c1; c++) {
+                if(Copy[c] != k)
+                    continue;
+                AccNorm += FaceNormals[FaceOf(Corners[c])];
+                Indices[Corners[c]] = d;
+            }
+            normals[d] = Normalized(AccNorm);
+        }
+    }
+
+    VertexType = VertexType | OBJ_NORMALS;
+    VertexCount = nNew;
+
+    if(nNew > nV)
+        BuildConnectivity();
+}
+
+void HalfEdgeMesh::RebuildBBox()
+{
+    Box.Reset();
+
+    for(int i=0; i<(int)verts.size(); i++)
+        Box += verts[i];
+}
+
+void HalfEdgeMesh::ApplyTransform(Matrix44 &Mat)
+{
+    Box.Reset();
+
+    int i;
+    for(i=0; i<(int)verts.size(); i++) {
+        verts[i] = Mat * verts[i];
+        Box += verts[i];
+    }
+
+    for(i=0; i<(int)normals.size(); i++)
+        normals[i] = Mat.ProjectDirection(normals[i]);
+
+    for(i=0; i<(int)tangents.size(); i++)
+        tangents[i] = Mat.ProjectDirection(tangents[i]);
+
+    for(i=0; i<(int)FaceNormals.size(); i++)
+        FaceNormals[i] = Mat.ProjectDirection(FaceNormals[i]);
+}
+
+void HalfEdgeMesh::ApplyTextureTransform(Matrix44 &Mat)
+{
+    ASSERT_R(VertexType & OBJ_TEXCOORDS);
+
+    for(int i=0; i<(int)texcoords.size(); i++)
+        texcoords[i] = Mat * texcoords[i];
+}
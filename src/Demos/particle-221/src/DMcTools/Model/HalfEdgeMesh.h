@@ -0,0 +1,168 @@
+//////////////////////////////////////////////////////////////////////
+// HalfEdgeMesh.h - A triangle mesh in flat arrays with half-edge connectivity.
+//
+// Copyright David K. McAllister, 2008.
+//
+// This holds the same kind of object as Mesh, but as a few arrays of
+// vertex attributes and indices instead of linked lists of separately
+// allocated vertices, edges, and faces that each keep their own lists
+// of neighbors. A million triangles is a few dozen megabytes in a dozen
+// allocations.
+//
+// Face f has the three half-edges 3f, 3f+1, and 3f+2. Half-edge h goes
+// from vertex Indices[h] to the start of the next half-edge of its face,
+// so Indices is also the three vertex indices of each face, like
+// RenderObject::indices.
+//
+// Twin[h] is the half-edge of the other face on the same edge. It is
+// BOUNDARY if no other face has that edge and NONMANIFOLD if more than
+// two do. A neighbor with the opposite winding is still a twin, going the
+// same direction as h instead of the opposite one. FixFacing() makes the
+// windings agree.
+//
+// VertHalfEdge[v] is a half-edge that starts at v, and is a boundary one
+// if v is on a boundary. It is -1 if no face uses v.
+
+#ifndef half_edge_mesh_h
+#define half_edge_mesh_h
+
+#include "Model/TriObject.h"
+#include "Model/RenderObject.h"
+
+#include <vector>
+
+struct HalfEdgeMesh : public BaseObject
+{
+    enum {BOUNDARY = -1, NONMANIFOLD = -2};
+
+    std::vector<Vector> verts;
+    std::vector<Vector> normals; // Must have a length of 0 or verts.size().
+    std::vector<Vector> tangents; // Must have a length of 0 or verts.size().
+    std::vector<Vector> texcoords; // Must have a length of 0 or verts.size().
+    std::vector<Vector> dcolors; // Must have a length of 0 or verts.size().
+
+    std::vector<Vector> FaceNormals; // Must have a length of 0 or FaceCount.
+
+    std::vector<int> Indices; // The starting vertex of each half-edge; three per face.
+    std::vector<int> Twin; // One per half-edge.
+    std::vector<int> VertHalfEdge; // One per vertex.
+
+    bool FacesAreFixed; // True when FixFacing() has been run and nothing has changed since then.
+
+    DMC_INLINE HalfEdgeMesh()
+    {
+        ObjectType = DMC_HALF_EDGE_OBJECT;
+        FacesAreFixed = false;
+    }
+
+    // Make a HalfEdgeMesh from the given TriObject or RenderObject.
+    explicit HalfEdgeMesh(const TriObject &Ob, const double MeshDistFactor = 0);
+    explicit HalfEdgeMesh(const RenderObject &Ob);
+
+    /////////////////////////////////////////////////////////////////
+    // All subclasses of BaseObject must implement these:
+
+    virtual void Dump() const;
+
+    // Sets the OBJ_WHATEVER flag.
+    virtual void GenColors() {ASSERT_R(0);}
+    virtual void GenNormals();
+    virtual void GenTexCoords() {ASSERT_R(0);}
+    virtual void GenTangents() {ASSERT_R(0);}
+
+    // Clears the OBJ_WHATEVER flag.
+    virtual void RemoveColors()
+    {
+        dcolors.clear();
+        VertexType = VertexType & (~OBJ_COLORS);
+    }
+    virtual void RemoveNormals()
+    {
+        normals.clear();
+        VertexType = VertexType & (~OBJ_NORMALS);
+    }
+    virtual void RemoveTexCoords()
+    {
+        texcoords.clear();
+        VertexType = VertexType & (~OBJ_TEXCOORDS);
+    }
+    virtual void RemoveTangents()
+    {
+        tangents.clear();
+        VertexType = VertexType & (~OBJ_TANGENTS);
+    }
+
+    virtual void RebuildBBox();
+
+    // Transform all vertices by this matrix.
+    // Also rebuilds the BBox.
+    virtual void ApplyTransform(Matrix44 &Mat);
+
+    // Transform all texcoords by this matrix.
+    virtual void ApplyTextureTransform(Matrix44 &Mat);
+
+    void GenFaceNormals();
+
+    /////////////////////////////////////////////////////////////////
+
+    // Replace the contents of this mesh with the given TriObject.
+    // Each corner becomes the first earlier vertex within MeshDistFactor
+    // times the size of the bounding box of it, and gets its attributes.
+    // The default of 0 only welds corners at exactly the same position.
+    // Faces that use a vertex twice and faces with the same three vertices
+    // as an earlier face are dropped.
+    void ImportTriObject(const TriObject &Ob, const double MeshDistFactor = 0);
+
+    // Replace the contents of this mesh with the given RenderObject.
+    // The vertices and faces are used as they are, so a vertex that was
+    // split to give it two normals or texcoords is two vertices here, and
+    // the split is a boundary.
+    void ImportRenderObject(const RenderObject &Ob);
+
+    // AcceptedAttribs tells what attributes to export if they exist.
+    // The mask is defined in BaseObject.h.
+    void ExportTriObject(TriObject &Ob, unsigned int AcceptedAttribs = OBJ_ALL) const;
+    void ExportRenderObject(RenderObject &Ob, unsigned int AcceptedAttribs = OBJ_ALL) const;
+
+    // Find the twin of every half-edge and a half-edge out of every vertex.
+    // Call this after changing Indices.
+    void BuildConnectivity();
+
+    // Give every face the winding of the lowest numbered face that it is
+    // connected to by manifold edges. Returns the number of faces flipped.
+    int FixFacing();
+
+    // Remove vertices that no face uses, and renumber the rest.
+    void RemoveUnusedVertices();
+
+    // Makes sure the mesh is sane, and prints a line about each kind of
+    // problem. Detailed also looks for duplicate faces.
+    // Returns the number of problems found.
+    int CheckIntegrity(const bool Detailed = false) const;
+
+    /////////////////////////////////////////////////////////////////
+    // Getting around
+
+    static DMC_INLINE int FaceOf(const int h) {return h / 3;}
+    static DMC_INLINE int Next(const int h) {return (h % 3 == 2) ? h - 2 : h + 1;}
+    static DMC_INLINE int Prev(const int h) {return (h % 3 == 0) ? h + 2 : h - 1;}
+
+    // The vertices at the start and end of half-edge h
+    DMC_INLINE int From(const int h) const {return Indices[h];}
+    DMC_INLINE int To(const int h) const {return Indices[Next(h)];}
+
+    // The half-edge after h going counter-clockwise around the vertex that h
+    // starts at, or a negative value at a boundary or non-manifold edge or
+    // a neighbor with the opposite winding.
+    DMC_INLINE int NextAroundVertex(const int h) const
+    {
+        const int t = Twin[Prev(h)];
+        return (t >= 0 && From(t) == From(h)) ? t : BOUNDARY;
+    }
+
+private:
+    // Point each vertex at one of its half-edges, for after the half-edges have changed.
+    void FindVertHalfEdges();
+};
+
+#endif
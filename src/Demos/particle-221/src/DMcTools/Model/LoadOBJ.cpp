@@ -4,17 +4,36 @@
 // Changes Copyright David K. McAllister, Aug. 1999.
 // Partly based on code written by Peter-Pike Sloan, 1997.
 
+// The file is mapped and cut into chunks that end at line breaks. Each
+// chunk is parsed on its own, in parallel, into its own vertex lists and
+// its faces' indices as written. Indices are relative to the whole file,
+// so once every chunk has been counted each chunk's faces are checked and
+// rebased, again in parallel. Groups, materials and smoothing are state
+// that carries from line to line, so the changes to them are replayed in
+// order, which says which object each run of faces goes to. Then the runs
+// of triangles are copied out in parallel.
+
 #include "Model/Model.h"
 #include "Model/TriObject.h"
+#include "Util/MappedFile.h"
 
+#include <algorithm>
+#include <cfloat>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <map>
+#include <string>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
 struct MatInfo
 {
-    char *Name;
+    string Name;
     TexInfo *TexPtr; // This points to the texture database record.
     double Shininess;
     Vector D, S, A, E;
@@ -22,28 +41,63 @@ struct MatInfo
 
     DMC_INLINE MatInfo()
     {
-        Name = NULL; TexPtr = NULL; // There is no texture with this material.
+        TexPtr = NULL; // There is no texture with this material.
         DColorValid = SColorValid = AColorValid = EColorValid = ShininessValid = false;
     }
 };
 
 class MaterialDB
 {
+    vector<int> Slots; // Open addressing hash table of indices into MatList
+    unsigned int Mask;
+
+    static DMC_INLINE unsigned int HashName(const char *name)
+    {
+        unsigned int h = 2166136261u; // FNV-1a
+        for(; *name; name++)
+            h = (h ^ (unsigned char)*name) * 16777619u;
+        return h;
+    }
+
 public:
     vector<MatInfo> MatList;
 
-    // Inserts if not found.
-    DMC_INLINE int FindByName(const char *name)
+    DMC_INLINE MaterialDB() : Slots(16, -1), Mask(15) {}
+
+    // Returns -1 if not found.
+    DMC_INLINE int FindByName(const char *name) const
     {
-        for(int mind=0; mind<(int)MatList.size(); mind++)
-        {
-            if(!strcmp(MatList[mind].Name, name))
-                return mind;
-        }
+        for(unsigned int s = HashName(name) & Mask; Slots[s] >= 0; s = (s + 1) & Mask)
+            if(MatList[Slots[s]].Name == name)
+                return Slots[s];
 
         return -1;
     }
 
+    // A material that's already there keeps its first definition.
+    void Add(const MatInfo &M)
+    {
+        if(FindByName(M.Name.c_str()) >= 0)
+            return;
+
+        MatList.push_back(M);
+        if(MatList.size() * 2 > Slots.size()) {
+            Slots.assign(Slots.size() * 2, -1);
+            Mask = (unsigned int)Slots.size() - 1;
+            for(int i=0; i<(int)MatList.size(); i++) {
+                unsigned int s = HashName(MatList[i].Name.c_str()) & Mask;
+                while(Slots[s] >= 0)
+                    s = (s + 1) & Mask;
+                Slots[s] = i;
+            }
+        } else {
+            unsigned int s = HashName(M.Name.c_str()) & Mask;
+            while(Slots[s] >= 0)
+                s = (s + 1) & Mask;
+            Slots[s] = int(MatList.size()) - 1;
+        }
+    }
+
     DMC_INLINE void Dump()
     {
         for(int i=0; i<(int)MatList.size(); i++)
@@ -53,354 +107,583 @@ public:
 
 static MaterialDB Mats;
 
-DMC_INLINE Vector Get2D(char* buf)
-{
-    double x, y;
-    if (2 != sscanf(buf,"%lf %lf",&x,&y))
-    {
-        fprintf(stderr, "Error, couldn't parse 2D!\n");
-    }
+namespace {
+    const size_t OBJ_CHUNK_SIZE = 1 << 20; // Bytes per chunk of the file
 
-    return Vector(x, y, 0);
-}
+    // The exact fast path of ParseDouble needs the multiply or divide to round once, to double.
+    // x87 math rounds to extended precision first, and then again when it's stored.
+#if (defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0) || defined(__SSE2_MATH__) || defined(_M_X64)
+#define DMC_OBJ_FAST_DOUBLE
 
-DMC_INLINE Vector Get3D(char* buf)
-{
-    double x, y, z;
+    // Powers of ten that doubles hold exactly
+    const double Pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+#endif
 
-    if (3 != sscanf(buf,"%lf %lf %lf",&x,&y,&z))
+    DMC_INLINE void SkipSpace(const char *&p, const char *e)
     {
-        fprintf(stderr,"Error, couldn't parse 3d!\n");
+        while(p < e && (*p == ' ' || *p == '\t' || *p == '\r'))
+            p++;
     }
 
-    return Vector(x, y, z);
-}
-
-// Add this file to the global material database.
-void LoadMTL(const char *fname)
-{
-    cerr << fname << endl;
-    FILE *f = fopen(fname, "r");
-    ASSERT_RM(f, "Error opening material file");
-    MatInfo M;
-    char TmpBuf[4096];
-
-    while(fgets(TmpBuf,4096,f)) {
-        // size_t l = strlen(TmpBuf);
-        if(!strncmp(TmpBuf, "newmtl", 6)) {
-            if(M.Name)
-                Mats.MatList.push_back(M);
+    DMC_INLINE bool IsDigit(const char c)
+    {
+        return c >= '0' && c <= '9';
+    }
 
-            M = MatInfo();
-            M.Name = strdup(&TmpBuf[7]);
-            *strchr(M.Name, '\n') = '\0';
-        } else if(TmpBuf[0]=='K') {
-            if(TmpBuf[1]=='a') {
-                M.A = Get3D(&TmpBuf[2]);
-                M.AColorValid = true;
-            } else if(TmpBuf[1]=='d') {
-                M.D = Get3D(&TmpBuf[2]);
-                M.DColorValid = true;
-                // cerr << "Diffuse = " << M.D << endl;
-            } else if(TmpBuf[1]=='s') {
-                M.S = Get3D(&TmpBuf[2]);
-                M.SColorValid = true;
-            } else if(TmpBuf[1]=='e') {
-                M.E = Get3D(&TmpBuf[2]);
-                M.EColorValid = true;
+    // Parse a double at p and move p past it. Returns false if there isn't one.
+    // When the digits and the power of ten are both exact as doubles one multiply or divide rounds correctly,
+    // so the result is the same as strtod's. Anything else, or everything with x87 math, goes to strtod.
+    bool ParseDouble(const char *&p, const char *e, double &d)
+    {
+        SkipSpace(p, e);
+        const char *s = p;
+
+#ifdef DMC_OBJ_FAST_DOUBLE
+        bool Neg = false;
+        if(p < e && (*p == '-' || *p == '+'))
+            Neg = *p++ == '-';
+
+        unsigned DMCINT64 m = 0;
+        int nDig = 0, Exp10 = 0;
+        bool AnyDigits = false, Exact = true;
+        for(; p < e && IsDigit(*p); p++) {
+            AnyDigits = true;
+            if(nDig < 19) {
+                m = m * 10 + (*p - '0');
+                if(m) nDig++;
+            } else {
+                Exp10++;
+                Exact = Exact && *p == '0';
+            }
+        }
+        if(p < e && *p == '.') {
+            for(p++; p < e && IsDigit(*p); p++) {
+                AnyDigits = true;
+                if(nDig < 19) {
+                    m = m * 10 + (*p - '0');
+                    if(m) nDig++;
+                    Exp10--;
+                } else
+                    Exact = Exact && *p == '0';
+            }
+        }
+        if(AnyDigits && p < e && (*p == 'e' || *p == 'E')) {
+            const char *q = p + 1;
+            bool ENeg = false;
+            if(q < e && (*q == '-' || *q == '+'))
+                ENeg = *q++ == '-';
+            if(q < e && IsDigit(*q)) {
+                int x = 0;
+                for(; q < e && IsDigit(*q); q++)
+                    if(x < 10000) x = x * 10 + (*q - '0');
+                Exp10 += ENeg ? -x : x;
+                p = q;
             }
-        } else if(!strncmp(TmpBuf, "Ns", 2)) {
-            // Ns ranges from 0 to 200.0.
-            M.Shininess = Clamp(1.0, atof(&TmpBuf[3]), 200.0) * (127.0 / 200.0);
-            M.ShininessValid = true;
-            // cerr << "Shininess = " << M.Shininess << endl;
-        } else if(!strncmp(TmpBuf, "illum", 5)) {
-            // cerr << "Illum should be 2.\n";
-        } else if(!strncmp(TmpBuf, "map_Kd", 6)) {
-            // XXX Replace this: Just store the name and load all textures later.
-            *strchr(&TmpBuf[7], '\n') = '\0';
-            char *texFName = strdup(&TmpBuf[7]);
-            cerr << "Texture FName = " << texFName << endl;
-
-            M.TexPtr = Model::TexDB.FindByNameOrAdd(texFName);
         }
-    }
-
-    if(M.Name)
-        Mats.MatList.push_back(M);
-
-    fclose(f);
-}
-
-DMC_INLINE bool GetFace(char *OBuf, vector<Vector> &tverts, vector<Vector> &tnormals,
-                    vector<Vector> &ttexcoords, vector<Vector> &verts, vector<Vector> &normals,
-                    vector<Vector> &texcoords)
-{
-#define MAX_VERTS 128
 
-    char *buf = OBuf;
+        if(AnyDigits && Exact && m <= (unsigned DMCINT64)1 << 53 && Exp10 >= -22 && Exp10 <= 22) {
+            d = Exp10 < 0 ? double(m) / Pow10[-Exp10] : double(m) * Pow10[Exp10];
+            if(Neg) d = -d;
+            return true;
+        }
+#endif
 
-    int uv[MAX_VERTS], v[MAX_VERTS], n[MAX_VERTS], i=0, j=0;
-    bool HasNormals = true, HasTexcoords = true;
+        // The mapped file isn't null terminated, so give strtod a copy of the word.
+        char Buf[128];
+        int n = 0;
+        for(const char *q = s; q < e && n < 127 && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n'; q++)
+            Buf[n++] = *q;
+        Buf[n] = '\0';
+        char *End;
+        d = strtod(Buf, &End);
+        p = s + (End - Buf);
+        return End != Buf;
+    }
 
-    while(3 == sscanf(buf, " %d/%d/%d%n", &v[i], &uv[i], &n[i], &j))
+    // Parse a signed int at p and move p past it. Returns false if there isn't one.
+    DMC_INLINE bool ParseInt(const char *&p, const char *e, int &i)
     {
-        // cerr << "xx " << v[i] << " " << uv[i] << " " << n[i] << " XXX:" << buf << endl;
-
-        v[i]--; uv[i]--; n[i]--;
-
-        ASSERT_RM(v[i]>=0, "Vertex index underflow.");
-        ASSERT_RM(uv[i]>=0, "Texcoord index underflow.");
-        ASSERT_RM(n[i]>=0, "Normal index underflow.");
-
-        ASSERT_RM(v[i]<(int)tverts.size(), "Vertex index overflow.");
-        ASSERT_RM(uv[i]<(int)ttexcoords.size(), "Texcoord index overflow.");
-        ASSERT_RM(n[i]<(int)tnormals.size(), "Normal index overflow.");
-
-        buf += j;
-        i++;
+        SkipSpace(p, e);
+        bool Neg = false;
+        if(p < e && (*p == '-' || *p == '+'))
+            Neg = *p++ == '-';
+        if(p >= e || !IsDigit(*p))
+            return false;
+        int x = 0;
+        for(; p < e && IsDigit(*p); p++)
+            x = x * 10 + (*p - '0');
+        i = Neg ? -x : x;
+        return true;
     }
 
-    // cerr << i << endl;
-
-    if(!i)
+    // Fill the missing components with zero, like the uninitialized ones in the past but predictable.
+    DMC_INLINE Vector ParseVector(const char *p, const char *e, const int n)
     {
-        while(2 == sscanf(buf, " %d//%d%n", &v[i], &n[i], &j))
-        {
-            // cerr << "xx " << v[i] << " " << n[i] << " XXX:" << buf << endl;
+        double c[3] = {0, 0, 0};
+        int k = 0;
+        while(k < n && ParseDouble(p, e, c[k]))
+            k++;
+        if(k < n)
+            cerr << "Error, couldn't parse " << n << "D!\n";
+        return Vector(c[0], c[1], c[2]);
+    }
 
-            v[i]--; n[i]--;
+    // The rest of the line without surrounding white space
+    DMC_INLINE string RestOfLine(const char *p, const char *e)
+    {
+        SkipSpace(p, e);
+        while(e > p && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r'))
+            e--;
+        return string(p, e);
+    }
 
-            ASSERT_RM(v[i]>=0, "Vertex index underflow.");
-            ASSERT_RM(n[i]>=0, "Normal index underflow.");
+    // The line starting at p, for error messages
+    DMC_INLINE string LineText(const char *p, const char *e)
+    {
+        const char *n = (const char *)memchr(p, '\n', e - p);
+        return RestOfLine(p, n ? n : e);
+    }
 
-            ASSERT_RM(v[i]<(int)tverts.size(), "Vertex index overflow.");
-            ASSERT_RM(n[i]<(int)tnormals.size(), "Normal index overflow.");
+    // How a face's corners were written
+    enum {CORNER_V, CORNER_VT, CORNER_VN, CORNER_VTN};
 
-            buf += j;
-            HasTexcoords = false;
-            i++;
+    // Parse a face corner: v, v/t, v//n or v/t/n. Returns its form, or -1.
+    DMC_INLINE int ParseCorner(const char *&p, const char *e, int Ind[3])
+    {
+        if(!ParseInt(p, e, Ind[0]))
+            return -1;
+        if(p >= e || *p != '/')
+            return CORNER_V;
+        p++;
+        if(p < e && *p == '/') {
+            p++;
+            return ParseInt(p, e, Ind[2]) ? CORNER_VN : -1;
         }
+        if(!ParseInt(p, e, Ind[1]))
+            return -1;
+        if(p >= e || *p != '/')
+            return CORNER_VT;
+        p++;
+        return ParseInt(p, e, Ind[2]) ? CORNER_VTN : -1;
     }
 
-    if(!i)
+    struct ObjPoly
     {
-        while(2 == sscanf(buf, " %d/%d%n", &v[i], &uv[i], &j))
-        {
-            // cerr << "xx " << v[i] << " " << uv[i] << " XXX:" << buf << endl;
-
-            v[i]--; uv[i]--;
+        const char *Line; // For error messages
+        int Corner0, NumCorners; // Its corners' indices start at Corners[3*Corner0].
+        int nV, nT, nN; // How many of each kind of vertex this chunk had before this face
+        int Form;
+        bool HasT, HasN; // Set when rebasing
+    };
+
+    // A line that changes the state for the faces after it
+    struct ObjEvent
+    {
+        enum {GROUP, USEMTL, MTLLIB, SMOOTH};
 
-            ASSERT_RM(v[i]>=0, "Vertex index underflow.");
-            ASSERT_RM(uv[i]>=0, "Texcoord index underflow.");
+        int Poly; // It goes before this face of the chunk.
+        int Type;
+        string Arg;
+    };
 
-            ASSERT_RM(v[i]<(int)tverts.size(), "Vertex index overflow.");
-            ASSERT_RM(uv[i]<(int)ttexcoords.size(), "Texcoord index overflow.");
+    struct ObjChunk
+    {
+        const char *Begin, *End;
+        vector<Vector> Verts, Normals, TexCoords;
+        vector<int> Corners; // Three per corner. First as written, then rebased to the whole file.
+        vector<ObjPoly> Polys;
+        vector<ObjEvent> Events;
+        vector<int> TriSum, TTriSum, NTriSum; // Triangles before each face, and those with texcoords and normals
+        string Error;
+        int BaseV, BaseT, BaseN;
+    };
+
+    // A run of a chunk's faces that all go to one object, and where their vertices go in it
+    struct ObjRun
+    {
+        int Chunk, Poly0, Poly1;
+        TriObject *Obj;
+        int V0, T0, N0;
+    };
 
-            buf += j;
-            HasNormals = false;
-            i++;
+    void ParseChunk(ObjChunk &C)
+    {
+        const char *p = C.Begin;
+        while(p < C.End) {
+            const char *e = (const char *)memchr(p, '\n', C.End - p);
+            if(!e) e = C.End;
+            const char *Line = p, *q = p;
+            p = e + 1;
+
+            SkipSpace(q, e);
+            if(q >= e)
+                continue;
+
+            const char c0 = q[0], c1 = q + 1 < e ? q[1] : '\n';
+            const bool Sep1 = c1 == ' ' || c1 == '\t' || c1 == '\r' || c1 == '\n';
+            if(c0 == 'v') {
+                // some type of vertex
+                if(Sep1)
+                    C.Verts.push_back(ParseVector(q + 1, e, 3));
+                else if(c1 == 't')
+                    C.TexCoords.push_back(ParseVector(q + 2, e, 2));
+                else if(c1 == 'n')
+                    C.Normals.push_back(ParseVector(q + 2, e, 3));
+            } else if(c0 == 'f' && Sep1) {
+                ObjPoly P;
+                P.Line = Line;
+                P.Corner0 = int(C.Corners.size()) / 3;
+                P.nV = int(C.Verts.size());
+                P.nT = int(C.TexCoords.size());
+                P.nN = int(C.Normals.size());
+                P.Form = -1;
+                P.HasT = P.HasN = false;
+
+                // The first corner says what form they all have to be in.
+                q++;
+                int Ind[3] = {0, 0, 0};
+                for(int Form; (Form = ParseCorner(q, e, Ind)) >= 0 && (P.Form < 0 || Form == P.Form); ) {
+                    P.Form = Form;
+                    C.Corners.push_back(Ind[0]);
+                    C.Corners.push_back(Ind[1]);
+                    C.Corners.push_back(Ind[2]);
+                }
+                P.NumCorners = int(C.Corners.size()) / 3 - P.Corner0;
+
+                if(!P.NumCorners) {
+                    C.Error = "What kind of face is this, anyway? " + LineText(Line, C.End);
+                    return;
+                }
+                C.Polys.push_back(P);
+            } else if(c0 == 'g' && Sep1) {
+                ObjEvent E;
+                E.Poly = int(C.Polys.size());
+                E.Type = ObjEvent::GROUP;
+                // Just the first name
+                const char *n = q + 1, *ne;
+                SkipSpace(n, e);
+                for(ne = n; ne < e && *ne != ' ' && *ne != '\t' && *ne != '\r'; ne++) ;
+                E.Arg = string(n, ne);
+                C.Events.push_back(E);
+            } else if(e - q > 6 && (!strncmp(q, "mtllib", 6) || !strncmp(q, "usemtl", 6))) {
+                ObjEvent E;
+                E.Poly = int(C.Polys.size());
+                E.Type = q[0] == 'm' ? ObjEvent::MTLLIB : ObjEvent::USEMTL;
+                E.Arg = RestOfLine(q + 6, e);
+                C.Events.push_back(E);
+            } else if(c0 == 's' && Sep1) {
+                // This is a smoothing group. It doesn't really fit our paradigm, except
+                // for smoothing = off.
+                ObjEvent E;
+                E.Poly = int(C.Polys.size());
+                E.Type = ObjEvent::SMOOTH;
+                E.Arg = RestOfLine(q + 1, e);
+                C.Events.push_back(E);
+            } else {
+                // cerr << "Unknown:" << string(Line, e) << endl;
+            }
         }
     }
 
-    if(!i)
+    // Make an index from the file 0-based and relative to the whole file. Negative ones count back from the
+    // last one so far. Returns false if it isn't one of the Count so far.
+    DMC_INLINE bool Rebase(int &i, const int Count)
     {
-        while(1 == sscanf(buf, " %d%n", &v[i], &j))
-        {
-            // cerr << "xx " << v[i] << " XXX:" << buf << endl;
-            v[i]--;
-
-            ASSERT_RM(v[i]>=0, "Vertex index underflow.");
-            ASSERT_RM(v[i]<(int)tverts.size(), "Vertex index overflow.");
-
-            if((int)ttexcoords.size() > v[i])
-            {
-                // It implies a texcoord also.
-                uv[i] = v[i];
-                ASSERT_RM(uv[i]>=0, "Implied Texcoord index underflow.");
-                ASSERT_RM(uv[i]<(int)ttexcoords.size(), "Implied Texcoord index overflow.");
-            }
-            else
-                HasTexcoords = false;
-
-            if((int)tnormals.size() > v[i])
-            {
-                // It implies a normal also.
-                n[i] = v[i];
-                ASSERT_RM(n[i]>=0, "Implied Normal index underflow.");
-                ASSERT_RM(n[i]<(int)tnormals.size(), "Implied Normal index overflow.");
+        i = i < 0 ? Count + i : i - 1;
+        return i >= 0 && i < Count;
+    }
+
+    // Rebase the chunk's face indices, see which faces have texcoords and normals, and count the triangles.
+    void RebaseChunk(ObjChunk &C)
+    {
+        const int nP = int(C.Polys.size());
+        C.TriSum.resize(nP + 1);
+        C.TTriSum.resize(nP + 1);
+        C.NTriSum.resize(nP + 1);
+        C.TriSum[0] = C.TTriSum[0] = C.NTriSum[0] = 0;
+
+        for(int f=0; f<nP; f++) {
+            ObjPoly &P = C.Polys[f];
+            const int nV = C.BaseV + P.nV, nT = C.BaseT + P.nT, nN = C.BaseN + P.nN;
+            P.HasT = P.Form == CORNER_VT || P.Form == CORNER_VTN || P.Form == CORNER_V;
+            P.HasN = P.Form == CORNER_VN || P.Form == CORNER_VTN || P.Form == CORNER_V;
+
+            for(int k=P.Corner0; k<P.Corner0+P.NumCorners && C.Error.empty(); k++) {
+                int *Ind = &C.Corners[3*k];
+                if(!Rebase(Ind[0], nV))
+                    C.Error = "Vertex index out of range: " + LineText(P.Line, C.End);
+                if(P.Form == CORNER_V) {
+                    // It implies a texcoord and a normal, if there are that many.
+                    Ind[1] = Ind[2] = Ind[0];
+                    P.HasT = P.HasT && Ind[0] < nT;
+                    P.HasN = P.HasN && Ind[0] < nN;
+                } else {
+                    if(P.HasT && !Rebase(Ind[1], nT))
+                        C.Error = "Texcoord index out of range: " + LineText(P.Line, C.End);
+                    if(P.HasN && !Rebase(Ind[2], nN))
+                        C.Error = "Normal index out of range: " + LineText(P.Line, C.End);
+                }
             }
-            else
-                HasNormals = false;
+            if(!C.Error.empty())
+                return;
 
-            buf += j;
-            i++;
+            const int nTris = P.NumCorners > 2 ? P.NumCorners - 2 : 0;
+            C.TriSum[f+1] = C.TriSum[f] + nTris;
+            C.TTriSum[f+1] = C.TTriSum[f] + (P.HasT ? nTris : 0);
+            C.NTriSum[f+1] = C.NTriSum[f] + (P.HasN ? nTris : 0);
         }
     }
 
-    if(!i)
+    // Save a run of polygons as triangles.
+    void CopyRun(const ObjRun &R, const ObjChunk &C, const vector<Vector> &tverts, const vector<Vector> &ttexcoords,
+                 const vector<Vector> &tnormals)
     {
-        cerr << "What kind of face is this, anyway? " << OBuf << endl;
-        return false;
+        TriObject *Obj = R.Obj;
+        int v = R.V0, t = R.T0, n = R.N0;
+        for(int f=R.Poly0; f<R.Poly1; f++) {
+            const ObjPoly &P = C.Polys[f];
+            const int *I0 = &C.Corners[3*P.Corner0];
+            for(int k=2; k<P.NumCorners; k++) {
+                // Emit a triangle.
+                const int *I1 = I0 + 3*(k-1), *I2 = I0 + 3*k;
+                Obj->verts[v++] = tverts[I0[0]];
+                Obj->verts[v++] = tverts[I1[0]];
+                Obj->verts[v++] = tverts[I2[0]];
+
+                if(P.HasT) {
+                    Obj->texcoords[t++] = ttexcoords[I0[1]];
+                    Obj->texcoords[t++] = ttexcoords[I1[1]];
+                    Obj->texcoords[t++] = ttexcoords[I2[1]];
+                }
+
+                if(P.HasN) {
+                    Obj->normals[n++] = tnormals[I0[2]];
+                    Obj->normals[n++] = tnormals[I1[2]];
+                    Obj->normals[n++] = tnormals[I2[2]];
+                }
+            }
+        }
     }
+};
 
-    // Save the polygon as triangles.
-    for(int k=2; k<i; k++)
-    {
-        // Emit a triangle.
-        verts.push_back(tverts[v[0]]);
-        verts.push_back(tverts[v[k-1]]);
-        verts.push_back(tverts[v[k]]);
-
-        if(HasTexcoords)
-        {
-            texcoords.push_back(ttexcoords[uv[0]]);
-            texcoords.push_back(ttexcoords[uv[k-1]]);
-            texcoords.push_back(ttexcoords[uv[k]]);
-        }
+// Add this file to the global material database.
+void LoadMTL(const char *fname)
+{
+    cerr << fname << endl;
+    MappedFile F(fname);
+    const char *p = (const char *)F.data(), *End = (const char *)F.end();
+    MatInfo M;
+    bool HaveM = false;
+
+    while(p < End) {
+        const char *e = (const char *)memchr(p, '\n', End - p);
+        if(!e) e = End;
+        const char *q = p;
+        p = e + 1;
+
+        SkipSpace(q, e);
+        if(e - q >= 6 && !strncmp(q, "newmtl", 6)) {
+            if(HaveM)
+                Mats.Add(M);
+
+            M = MatInfo();
+            M.Name = RestOfLine(q + 6, e);
+            HaveM = true;
+        } else if(e - q >= 2 && q[0] == 'K') {
+            if(q[1] == 'a') {
+                M.A = ParseVector(q + 2, e, 3);
+                M.AColorValid = true;
+            } else if(q[1] == 'd') {
+                M.D = ParseVector(q + 2, e, 3);
+                M.DColorValid = true;
+            } else if(q[1] == 's') {
+                M.S = ParseVector(q + 2, e, 3);
+                M.SColorValid = true;
+            } else if(q[1] == 'e') {
+                M.E = ParseVector(q + 2, e, 3);
+                M.EColorValid = true;
+            }
+        } else if(e - q >= 2 && !strncmp(q, "Ns", 2)) {
+            // Ns ranges from 0 to 200.0.
+            const char *n = q + 2;
+            double Ns = 0;
+            ParseDouble(n, e, Ns);
+            M.Shininess = Clamp(1.0, Ns, 200.0) * (127.0 / 200.0);
+            M.ShininessValid = true;
+        } else if(e - q >= 6 && !strncmp(q, "map_Kd", 6)) {
+            // XXX Replace this: Just store the name and load all textures later.
+            char *texFName = strdup(RestOfLine(q + 6, e).c_str());
+            cerr << "Texture FName = " << texFName << endl;
 
-        if(HasNormals)
-        {
-            normals.push_back(tnormals[n[0]]);
-            normals.push_back(tnormals[n[k-1]]);
-            normals.push_back(tnormals[n[k]]);
+            M.TexPtr = Model::TexDB.FindByNameOrAdd(texFName);
         }
     }
 
-    return true;
+    if(HaveM)
+        Mats.Add(M);
 }
 
 // Returns false on success.
 bool Model::LoadOBJ(const char *fname, const unsigned int RequiredAttribs,
         const unsigned int AcceptedAttribs)
 {
-    FILE *f = fopen(fname, "r");
-    ASSERT_RM(f, "Error opening input file");
+    MappedFile F(fname);
+    const char *FBegin = (const char *)F.data(), *FEnd = (const char *)F.end();
+
+    // Cut the file into chunks that end at line breaks.
+    vector<ObjChunk> Chunks;
+    for(const char *b = FBegin; b < FEnd; ) {
+        const char *e = b + min(size_t(FEnd - b), OBJ_CHUNK_SIZE);
+        if(e < FEnd) {
+            e = (const char *)memchr(e, '\n', FEnd - e);
+            e = e ? e + 1 : FEnd;
+        }
+        Chunks.push_back(ObjChunk());
+        Chunks.back().Begin = b;
+        Chunks.back().End = e;
+        b = e;
+    }
+    const int nC = int(Chunks.size());
+
+#pragma omp parallel for schedule(dynamic, 1) if(nC > 1)
+    for(int c=0; c<nC; c++)
+        ParseChunk(Chunks[c]);
+
+    // Where each chunk's vertices start in the whole file
+    int nV = 0, nT = 0, nN = 0;
+    for(int c=0; c<nC; c++) {
+        Chunks[c].BaseV = nV; nV += int(Chunks[c].Verts.size());
+        Chunks[c].BaseT = nT; nT += int(Chunks[c].TexCoords.size());
+        Chunks[c].BaseN = nN; nN += int(Chunks[c].Normals.size());
+    }
+
+    // These are used over all the groups in the object.
+    vector<Vector> tverts(nV), ttexcoords(nT), tnormals(nN);
+
+#pragma omp parallel for schedule(dynamic, 1) if(nC > 1)
+    for(int c=0; c<nC; c++) {
+        ObjChunk &C = Chunks[c];
+        if(C.Error.empty())
+            RebaseChunk(C);
+        copy(C.Verts.begin(), C.Verts.end(), tverts.begin() + C.BaseV);
+        copy(C.TexCoords.begin(), C.TexCoords.end(), ttexcoords.begin() + C.BaseT);
+        copy(C.Normals.begin(), C.Normals.end(), tnormals.begin() + C.BaseN);
+        vector<Vector>().swap(C.Verts);
+        vector<Vector>().swap(C.TexCoords);
+        vector<Vector>().swap(C.Normals);
+    }
+
+    for(int c=0; c<nC; c++)
+        if(!Chunks[c].Error.empty())
+            throw DMcError(Chunks[c].Error);
 
     Objs.clear();
     TriObject *Obj = new TriObject;
     Objs.push_back(Obj);
     strcpy(Obj->Name, "default");
-
-    // These are used over all the groups in the object.
-    vector<Vector> ttexcoords, tnormals, tverts;
-
-    char TmpBuf[4096];
-    while(fgets(TmpBuf,4096,f)) {
-        if(TmpBuf[0] == 'v') {
-         // some type of vertex
-            switch(TmpBuf[1]) {
-            case 't': // texture coordinate
-                ttexcoords.push_back(Get2D(&TmpBuf[2]));
-                break;
-            case 'n': // normal...
-                tnormals.push_back(Get3D(&TmpBuf[2]));
-                break;
-            case ' ': // vertex
-            default: // vertex?
-                const Vector &V = Get3D(&TmpBuf[2]);
-                // cerr << V << endl;
-                tverts.push_back(V);
-                break;
-            }
-        } else if(TmpBuf[0] == 'f') {
-            // a face
-            bool OK = GetFace(&TmpBuf[1], tverts, tnormals, ttexcoords,
-                Obj->verts, Obj->normals, Obj->texcoords);
-            ASSERT_RM(OK, "Couldn't get the vertex indices.");
-        } else if(TmpBuf[0] == 'g') {
-            char GName[64];
-            char X[64];
-            GName[0] = '\0';
-            sscanf(TmpBuf, "%s %s", X, GName);
-            if(GName[0] == '\0')
-                strcpy(GName, "default");
-            // cerr << "Group: " << GName << endl;
-
-            // See if the group name exists.
-            int ii;
-            for(ii=0; ii<(int)Objs.size(); ii++) {
-                if(!strcmp(Objs[ii]->Name, GName))
-                    break;
+    map<string, TriObject *> Groups;
+    Groups["default"] = Obj;
+
+    // How many vertices, texcoords and normals each object has so far
+    map<TriObject *, int> ObjV, ObjT, ObjN;
+
+    // Replay the state changes in order to see which object each run of faces goes to.
+    vector<ObjRun> Runs;
+    for(int c=0; c<nC; c++) {
+        const ObjChunk &C = Chunks[c];
+        for(int k=0; k<=(int)C.Events.size(); k++) {
+            const int f0 = k ? C.Events[k-1].Poly : 0;
+            const int f1 = k < (int)C.Events.size() ? C.Events[k].Poly : int(C.Polys.size());
+            if(f1 > f0) {
+                ObjRun R;
+                R.Chunk = c; R.Poly0 = f0; R.Poly1 = f1; R.Obj = Obj;
+                R.V0 = ObjV[Obj]; ObjV[Obj] += 3 * (C.TriSum[f1] - C.TriSum[f0]);
+                R.T0 = ObjT[Obj]; ObjT[Obj] += 3 * (C.TTriSum[f1] - C.TTriSum[f0]);
+                R.N0 = ObjN[Obj]; ObjN[Obj] += 3 * (C.NTriSum[f1] - C.NTriSum[f0]);
+                Runs.push_back(R);
             }
+            if(k == (int)C.Events.size())
+                break;
 
-            if(ii == (int)Objs.size()) {
-                // Group is new. Set it up.
-                // cerr << "Another group.\n";
-                TriObject *Obj2 = new TriObject;
-                Objs.push_back(Obj2);
-                strncpy(Obj2->Name, GName, 64);
-
-                // Copy the current material.
-                if(Obj->SColorValid) { Obj2->SColorValid = true; Obj2->scolor = Obj->scolor; }
-                if(Obj->AColorValid) { Obj2->AColorValid = true; Obj2->acolor = Obj->acolor; }
-                if(Obj->EColorValid) { Obj2->EColorValid = true; Obj2->ecolor = Obj->ecolor; }
-                if(Obj->ShininessValid) { Obj2->ShininessValid = true; Obj2->shininess = Obj->shininess; }
-                if(Obj->dcolors.size()) { Obj2->dcolors.clear(); Obj2->dcolors.push_back(Obj->dcolors[0]); }
-                Obj2->TexPtr = Obj->TexPtr;
-                Obj2->Name[63] = true;
-                Obj = Obj2;
-            } else
-                Obj = (TriObject *) Objs[ii];
-        } else if(!strncmp(TmpBuf, "mtllib", 6)) {
-            *strchr(&TmpBuf[7], '\n') = '\0';
-            LoadMTL(&TmpBuf[7]);
-        } else if(!strncmp(TmpBuf, "usemtl", 6)) {
-            char *MatName = &TmpBuf[7];
-            *strchr(MatName, '\n') = '\0';
-            int mind = Mats.FindByName(MatName);
-
-            if(mind < 0) {
-                cerr << "Unknown material '" << MatName << "'" << endl;
-                Mats.Dump();
-            } else {
-                // Set the group material to be this material.
-                MatInfo &M = Mats.MatList[mind];
-                if(M.SColorValid) { Obj->SColorValid = true; Obj->scolor = M.S; }
-                if(M.AColorValid) { Obj->AColorValid = true; Obj->acolor = M.A; }
-                if(M.EColorValid) { Obj->EColorValid = true; Obj->ecolor = M.E; }
-                if(M.ShininessValid) { Obj->ShininessValid = true; Obj->shininess = M.Shininess; }
-                if(M.DColorValid) { Obj->dcolors.clear(); Obj->dcolors.push_back(M.D); }
-                Obj->TexPtr = M.TexPtr;
-                // cerr << "Got material " << MatName << endl;
+            const ObjEvent &E = C.Events[k];
+            if(E.Type == ObjEvent::GROUP) {
+                string GName = E.Arg.empty() ? string("default") : E.Arg.substr(0, 63);
+
+                map<string, TriObject *>::iterator G = Groups.find(GName);
+                if(G == Groups.end()) {
+                    // Group is new. Set it up.
+                    TriObject *Obj2 = new TriObject;
+                    Objs.push_back(Obj2);
+                    Groups[GName] = Obj2;
+                    strcpy(Obj2->Name, GName.c_str());
+
+                    // Copy the current material.
+                    if(Obj->SColorValid) { Obj2->SColorValid = true; Obj2->scolor = Obj->scolor; }
+                    if(Obj->AColorValid) { Obj2->AColorValid = true; Obj2->acolor = Obj->acolor; }
+                    if(Obj->EColorValid) { Obj2->EColorValid = true; Obj2->ecolor = Obj->ecolor; }
+                    if(Obj->ShininessValid) { Obj2->ShininessValid = true; Obj2->shininess = Obj->shininess; }
+                    if(Obj->dcolors.size()) { Obj2->dcolors.clear(); Obj2->dcolors.push_back(Obj->dcolors[0]); }
+                    Obj2->TexPtr = Obj->TexPtr;
+                    Obj = Obj2;
+                } else
+                    Obj = G->second;
+            } else if(E.Type == ObjEvent::MTLLIB) {
+                LoadMTL(E.Arg.c_str());
+                Dependencies.push_back(E.Arg);
+            } else if(E.Type == ObjEvent::USEMTL) {
+                int mind = Mats.FindByName(E.Arg.c_str());
+
+                if(mind < 0) {
+                    cerr << "Unknown material '" << E.Arg << "'" << endl;
+                    Mats.Dump();
+                } else {
+                    // Set the group material to be this material.
+                    MatInfo &M = Mats.MatList[mind];
+                    if(M.SColorValid) { Obj->SColorValid = true; Obj->scolor = M.S; }
+                    if(M.AColorValid) { Obj->AColorValid = true; Obj->acolor = M.A; }
+                    if(M.EColorValid) { Obj->EColorValid = true; Obj->ecolor = M.E; }
+                    if(M.ShininessValid) { Obj->ShininessValid = true; Obj->shininess = M.Shininess; }
+                    if(M.DColorValid) { Obj->dcolors.clear(); Obj->dcolors.push_back(M.D); }
+                    Obj->TexPtr = M.TexPtr;
+                }
+            } else if(E.Type == ObjEvent::SMOOTH) {
+                Obj->creaseAngle = atoi(E.Arg.c_str()) > 0 ? M_PI : 0;
             }
-        } else if(TmpBuf[0] == 's') {
-            // This is a smoothing group. It doesn't really fit our paradigm, except
-            // for smoothing = off.
-            // Hide the smoothing on/off flag in the name string. Scary!
-            Obj->creaseAngle = atoi(&TmpBuf[2]) > 0 ? M_PI : 0;
-            // cerr << "Blah " << (Obj->Name[63] ? "Yes" : "No") << endl;
-        } else {
-            // cerr << "Unknown:" << TmpBuf;
         }
     }
 
-    fclose(f);
+    for(int i=0; i<(int)Objs.size(); i++) {
+        TriObject *Ob = (TriObject *) Objs[i];
+        Ob->verts.resize(ObjV[Ob]);
+        Ob->texcoords.resize(ObjT[Ob]);
+        Ob->normals.resize(ObjN[Ob]);
+    }
+
+    const int nR = int(Runs.size());
+#pragma omp parallel for schedule(dynamic, 1) if(nR > 1)
+    for(int r=0; r<nR; r++)
+        CopyRun(Runs[r], Chunks[Runs[r].Chunk], tverts, ttexcoords, tnormals);
 
-#if 1
-    ASSERT_R(0);
-    // There is a problem with the .erase call in VC2005.
-#else
     // We've read it all. Now we need to post-process it.
+    vector<BaseObject *> Kept;
     for(int j=0; j<(int)Objs.size(); j++) {
         Obj = (TriObject *) Objs[j];
 
         if((int)Obj->verts.size() < 1) {
             delete Obj;
-            std::vector<BaseObject *>::iterator bob(&Objs[j]);
-            Objs.erase(bob);
-            j--;
             continue;
         }
 
-        // Build the BBox.
-        for(int i=0; i<(int)Obj->verts.size(); i++)
-            Obj->Box += Obj->verts[i];
-
+        Obj->RebuildBBox();
         Box += Obj->Box;
 
         Obj->PrimType = L_TRIANGLES;
+        Obj->VertexCount = int(Obj->verts.size());
+        Obj->FaceCount = Obj->VertexCount / 3;
+        Kept.push_back(Obj);
     }
-#endif
+    Objs.swap(Kept);
+
     return false;
 }
@@ -5,7 +5,10 @@
 
 #include "Model/Mesh.h"
 #include "Model/AElements.h"
+#include "Model/OrientFaces.h"
+#include "Model/WeldVertices.h"
 
+#include <algorithm>
 #include <map>
 using namespace std;
 
@@ -59,21 +62,6 @@ DMC_INLINE bool CompareVecs(const Vector &V0, const Vector &V1, double Eps = 1e-
 
 // The single-element interface.
 
-// Given a vertex, find a vertex in the edge list that should be adjacent.
-Vertex *Mesh::FindVertexInEdgeList(const vector<Edge *> &Edg, const Vector &V, Edge * &e) const
-{
-    for(int j=0; j<(int)Edg.size(); j++) {
-        if(VecEq(Edg[j]->v0->V, V, Sqr(MeshMaxDist))) {
-            e = Edg[j]; return Edg[j]->v0;
-        } else if(VecEq(Edg[j]->v1->V, V, Sqr(MeshMaxDist))) {
-            e = Edg[j]; return Edg[j]->v1;
-        }
-    }
-
-    e = NULL;
-    return NULL;
-}
-
 // Returns a pointer to this edge. Creates it if necessary.
 Edge *Mesh::FindEdge(Vertex *v0, Vertex *v1, Edge *(*EF)())
 {
@@ -124,19 +112,15 @@ Mesh::~Mesh()
         else
             delete tmp;
     }
-
-    if(VertTree)
-        delete VertTree;
 }
 
 // Import the incoming TriObject into this Mesh.
 // This Mesh may either be populated or not.
+// The vertices are welded first, which gives the vertex of each corner.
+// The faces are then made from those, sharing the edges they have in common.
 void Mesh::ImportTriObject(const TriObject &Ob, double MeshDistFactor,
                            Vertex *(*VF)(), Edge *(*EF)(), Face *(*FF)())
 {
-    // ASSERT_RM(0, "There's a bug in here.");
-    //cerr << "Converting TriObject to Mesh.\n";
-
     // Set the MeshMaxDist relative to the bounding box.
     if(MeshDistFactor >= 0)
         MeshMaxDist = (Ob.Box.MaxV - Ob.Box.MinV).length() * MeshDistFactor;
@@ -144,10 +128,6 @@ void Mesh::ImportTriObject(const TriObject &Ob, double MeshDistFactor,
     WARN_R(Ob.verts.size() % 3 == 0, "TriObject must be multiple of three vertices.");
     ASSERT_R(Ob.VertexCount == (int)Ob.verts.size());
 
-    if(VertTree == NULL)
-        VertTree = new KDBoxTree<KDVertex>;
-    ASSERT_RM(VertTree, "memory alloc failed");
-
     // These tell whether we are extracting attributes from the TriObject.
     bool DoingColor = false, DoingNormals = false, DoingTexcoords = false;
 
@@ -165,11 +145,6 @@ void Mesh::ImportTriObject(const TriObject &Ob, double MeshDistFactor,
         VertexType |= (VertexType & OBJ_ALL) ? HAS_ATTRIBS : 0;
     }
 
-    if(VertexType & OBJ_COLORS) cerr << "Mesh has color.\n";
-    if(VertexType & OBJ_NORMALS) cerr << "Mesh has normals.\n";
-    if(VertexType & OBJ_TEXCOORDS) cerr << "Mesh has texcoords.\n";
-    if(VertexType & OBJ_TANGENTS) cerr << "Mesh has tangents.\n";
-
     if((VertexType & HAS_ATTRIBS) && VF==NULL)
         VF = AVertexFactory;
     if((EdgeType & HAS_ATTRIBS) && EF==NULL)
@@ -177,134 +152,78 @@ void Mesh::ImportTriObject(const TriObject &Ob, double MeshDistFactor,
     if((FaceType & HAS_ATTRIBS) && FF==NULL)
         FF = AFaceFactory;
 
-    // cerr << ((int)Ob.verts.size() / 3) << " triangles.\n";
-    for(int i=0; i<(int)Ob.verts.size(); i+=3) {
-        cerr << Ob.verts[i] << endl;
-
-        bool AddedVert = false;
-        Edge *e0 = NULL, *e1 = NULL, *e2 = NULL;
-
-        Vertex *v0 = NULL;
-        if(!(v0 = FindVertex(Ob.verts[i])))
-        {
-            cerr << "Couldn't find it.\n";
-            if(VertexType & HAS_ATTRIBS)
-            {
-                v0 = VF();
-                if(DoingColor) ((AVertex *)v0)->Col = Ob.dcolors[i+0];
-                if(DoingNormals) ((AVertex *)v0)->Nor = Ob.normals[i+0];
-                if(DoingTexcoords) ((AVertex *)v0)->Tex = Ob.texcoords[i+0];
-            }
-            cerr << 'o';
-            /// XXX There's a bug in the KD Tree.
-            v0 = AddVertex(Ob.verts[i], v0);
-            VertTree->insert(KDVertex(v0));
-            AddedVert = true;
-        }
-        cerr << 'q';
-
-        Vertex *v1 = FindVertexInEdgeList(v0->Edges, Ob.verts[i+1], e0);
-
-        if(v0 == v1) // Degenerate triangle.
+    // Weld the existing vertices and the incoming ones together, existing ones first,
+    // so that an incoming vertex becomes an existing one if it can.
+    vector<Vertex *> OldVerts;
+    for(Vertex *V = Verts; V; V = V->next)
+        OldVerts.push_back(V);
+    const int nOld = (int)OldVerts.size(), n = (int)Ob.verts.size() / 3 * 3;
+
+    vector<Vector> Pts(nOld + n);
+    for(int i=0; i<nOld; i++)
+        Pts[i] = OldVerts[i]->V;
+    for(int i=0; i<n; i++)
+        Pts[nOld + i] = Ob.verts[i];
+
+    vector<int> Remap, FirstIndex;
+    WeldVertices(Remap, FirstIndex, Pts, MeshMaxDist);
+    vector<Vector>().swap(Pts);
+
+    // Make the new vertices.
+    vector<Vertex *> VertOf(FirstIndex.size());
+    for(int u=0; u<(int)FirstIndex.size(); u++) {
+        const int i = FirstIndex[u] - nOld;
+        if(i < 0) {
+            VertOf[u] = OldVerts[FirstIndex[u]];
             continue;
-        cerr << 'a';
-        if(v1 == NULL)
-        {
-            if(!(v1 = FindVertex(Ob.verts[i+1])))
-            {
-                if(VertexType & HAS_ATTRIBS)
-                {
-                    v1 = VF();
-                    if(DoingColor) ((AVertex *)v1)->Col = Ob.dcolors[i+1];
-                    if(DoingNormals) ((AVertex *)v1)->Nor = Ob.normals[i+1];
-                    if(DoingTexcoords) ((AVertex *)v1)->Tex = Ob.texcoords[i+1];
-                }
-
-                v1 = AddVertex(Ob.verts[i+1], v1);
-                VertTree->insert(KDVertex(v1));
-                AddedVert = true;
-            }
-
-            if(v0 == v1) // Degenerate triangle.
-                continue;
-
-            // Need to add e01 to all lists.
-            e0 = FindEdge(v0, v1, EF);
         }
-        cerr << 'b';
 
-        Vertex *v2 = FindVertexInEdgeList(v0->Edges, Ob.verts[i+2], e1);
+        Vertex *V = NULL;
+        if(VertexType & HAS_ATTRIBS) {
+            V = VF();
+            if(DoingColor) ((AVertex *)V)->Col = Ob.dcolors[i];
+            if(DoingNormals) ((AVertex *)V)->Nor = Ob.normals[i];
+            if(DoingTexcoords) ((AVertex *)V)->Tex = Ob.texcoords[i];
+        } else if(VF)
+            V = VF();
+        VertOf[u] = AddVertex(Ob.verts[i], V);
+    }
 
-        Vertex *vt = FindVertexInEdgeList(v1->Edges, Ob.verts[i+2], e2);
-        cerr << 'c';
+    // Make the faces.
+    int nDegenerate = 0, nDuplicate = 0;
+    for(int i=0; i<n; i+=3) {
+        Vertex *v0 = VertOf[Remap[nOld + i]];
+        Vertex *v1 = VertOf[Remap[nOld + i + 1]];
+        Vertex *v2 = VertOf[Remap[nOld + i + 2]];
 
-        if(v2 == NULL)
-            v2 = vt;
-        if(v2 == NULL)
-        {
-            if(!(v2 = FindVertex(Ob.verts[i+2])))
-            {
-                if(VertexType & HAS_ATTRIBS)
-                {
-                    v2 = VF();
-
-                    if(DoingColor) ((AVertex *)v2)->Col = Ob.dcolors[i+2];
-                    if(DoingNormals) ((AVertex *)v2)->Nor = Ob.normals[i+2];
-                    if(DoingTexcoords) ((AVertex *)v2)->Tex = Ob.texcoords[i+2];
-                }
-
-                v2 = AddVertex(Ob.verts[i+2], v2);
-                VertTree->insert(KDVertex(v2));
-                AddedVert = true;
-            }
+        if(v0 == v1 || v1 == v2 || v0 == v2) {
+            nDegenerate++;
+            continue;
         }
-        cerr << 'd';
 
-        if(v2 == v1 || v2 == v0) // Degenerate triangle.
+        // Look for a duplicate face among the faces of my first vertex.
+        int p;
+        for(p = 0; p< (int)v0->Faces.size(); p++) {
+            Face *F = v0->Faces[p];
+            if((F->v0 == v1 || F->v1 == v1 || F->v2 == v1) &&
+                (F->v0 == v2 || F->v1 == v2 || F->v2 == v2))
+                break;
+        }
+        if(p < (int)v0->Faces.size()) {
+            nDuplicate++;
             continue;
-
-        // All three vertices now exist. e1 and e2 might not exist yet.
-        if(e1 == NULL)
-            // Need to add e02 to all lists.
-            e1 = FindEdge(v0, v2, EF);
-
-        if(e2 == NULL)
-            // Need to add e12 to all lists.
-            e2 = FindEdge(v1, v2, EF);
-
-        WARN_R(v0 != v1 && v1 != v2 && v0 != v2, "Degenerate triangle vertices.");
-        WARN_R(e0 != e1 && e1 != e2 && e0 != e2, "Degenerate triangle edges.");
-        cerr << 'e';
-
-        // Need some check for unique face.
-        if(!AddedVert) {
-            // Probably a duplicate face. Check it out, boys.
-            // Perform the check by looking at the faces of my first vertex.
-            // cerr << "Checking for duplicate face.\n";
-            int p;
-            for(p = 0; p< (int)v0->Faces.size(); p++) {
-                Face *F = v0->Faces[p];
-                if((F->v0 == v0 || F->v0 == v1 || F->v0 == v2) &&
-                    (F->v1 == v0 || F->v1 == v1 || F->v1 == v2) &&
-                    (F->v2 == v0 || F->v2 == v1 || F->v2 == v2)) {
-                    cerr << "Duplicate face!\n";
-                    break;
-                }
-            }
-            if(p < (int)v0->Faces.size())
-                continue;
         }
-        cerr << 'f';
+
+        Edge *e0 = FindEdge(v0, v1, EF);
+        Edge *e1 = FindEdge(v0, v2, EF);
+        Edge *e2 = FindEdge(v1, v2, EF);
 
         Face *newF = FF ? FF() : NULL;
         AddFace(v0, v1, v2, e0, e1, e2, newF);
-        cerr << 'g';
-
-#ifdef DMC_MESH_DEBUG
-        CheckIntegrity(true);
-#endif
     }
-    cerr << "Done\n";
+
+    if(nDegenerate || nDuplicate)
+        cerr << "ImportTriObject: skipped " << nDegenerate << " degenerate and " << nDuplicate << " duplicate faces.\n";
 
 #ifdef DMC_DEBUG
     CheckIntegrity(true);
@@ -438,77 +357,85 @@ void Mesh::ExportRenderObject(RenderObject &Ob, unsigned int AcceptedAttribs)
     ASSERT_R((int)Ob.indices.size() % 3 == 0);
 }
 
-// This is recursive.
-int Mesh::FlipMe(Face *F, set<Face *> &Visited,
-                 Vertex *v0, Vertex *v1, Vertex *v2)
-{
-    if(Visited.find(F) == Visited.end())
-        return 0;
-
-    Visited.insert(F);
-    int flipcnt = 0;
-
-    WARN_R(((F->v0 == v0) + (F->v1 == v0) + (F->v2 == v0) + (F->v0 == v1) + (F->v1 == v1) + (F->v2 == v1) + (F->v0 == v2) + (F->v1 == v2) + (F->v2 == v2)) >= 2, "Faces should share exactly two vertices.");
-
-    if((F->v0 == v0 && (F->v1 != v1 && F->v2 != v2)) ||
-        (F->v1 == v0 && (F->v2 != v1 && F->v0 != v2)) ||
-        (F->v2 == v0 && (F->v0 != v1 && F->v1 != v2)) ||
-
-        (F->v0 == v1 && (F->v1 != v2 && F->v2 != v0)) ||
-        (F->v1 == v1 && (F->v2 != v2 && F->v0 != v0)) ||
-        (F->v2 == v1 && (F->v0 != v2 && F->v1 != v0)) ||
-
-        (F->v0 == v2 && (F->v1 != v0 && F->v2 != v1)) ||
-        (F->v1 == v2 && (F->v2 != v0 && F->v0 != v1)) ||
-        (F->v2 == v2 && (F->v0 != v0 && F->v1 != v1)))
-    {
-        // Swap the winding.
-        // cerr << "Swapping.\n";
-        Vertex *T = F->v1;
-        F->v1 = F->v2;
-        F->v2 = T;
-        flipcnt++;
-    }
-
-    // Fix my neighbors.
-    int i;
-    for(i=0; i<(int)F->e0->Faces.size(); i++)
-    {
-        if(F->e0->Faces[i] != F)
-            flipcnt += FlipMe(F->e0->Faces[i], Visited, F->v0, F->v2, F->v1);
-    }
-
-    for(i=0; i<(int)F->e1->Faces.size(); i++)
-    {
-        if(F->e1->Faces[i] != F)
-            flipcnt += FlipMe(F->e1->Faces[i], Visited, F->v0, F->v2, F->v1);
-    }
-
-    for(i=0; i<(int)F->e2->Faces.size(); i++)
+namespace {
+    // 1 if face F goes from E->v0 to E->v1, 0 if it goes the other way.
+    DMC_INLINE int EdgeDir(const Face *F, const Edge *E)
     {
-        if(F->e2->Faces[i] != F)
-            flipcnt += FlipMe(F->e2->Faces[i], Visited, F->v0, F->v2, F->v1);
+        return (F->v0 == E->v0 && F->v1 == E->v1) || (F->v1 == E->v0 && F->v2 == E->v1) || (F->v2 == E->v0 && F->v0 == E->v1);
     }
-
-    return flipcnt;
-}
+};
 
 // Give all faces in each manifold the same winding.
-// Should specify a starting face with proper winding.
-// Should make it not recursive. Use bits and own stack.
+// The faces are numbered in list order, and each face's neighbors across
+// edges with two faces go in a flat list for OrientFaces(), which does the
+// rest without recursing. Edges with more than two faces are reported and
+// don't pass a winding on.
 void Mesh::FixFacing()
 {
     if(FacesAreFixed)
         return;
 
-    set<Face *> Visited;
-
-    int flipcnt = 0;
-
+    vector<Face *> FaceList;
     for(Face *F = Faces; F; F = F->next)
-        flipcnt += FlipMe(F, Visited, F->v0, F->v1, F->v2);
+        FaceList.push_back(F);
+    const int nF = (int)FaceList.size();
+
+    // Sorted so a face's number can be found from its pointer.
+    vector<pair<Face *, int> > FaceNum(nF);
+    for(int f=0; f<nF; f++)
+        FaceNum[f] = make_pair(FaceList[f], f);
+    sort(FaceNum.begin(), FaceNum.end());
+
+    vector<int> AdjStart(nF + 1), Adj(3 * nF);
+    vector<char> Count(nF, 0);
+
+#pragma omp parallel for schedule(static) if(nF > (1 << 14))
+    for(int f=0; f<nF; f++) {
+        Face *F = FaceList[f];
+        Edge *E[3] = {F->e0, F->e1, F->e2};
+        for(int k=0; k<3; k++) {
+            if(E[k]->Faces.size() != 2)
+                continue;
+            Face *G = E[k]->Faces[0] == F ? E[k]->Faces[1] : E[k]->Faces[0];
+            const int g = lower_bound(FaceNum.begin(), FaceNum.end(), make_pair(G, 0))->second;
+            Adj[3*f + Count[f]++] = (g << 1) | (EdgeDir(F, E[k]) == EdgeDir(G, E[k]));
+        }
+    }
+
+    // Squeeze out the unused slots.
+    int n = 0;
+    for(int f=0; f<nF; f++) {
+        AdjStart[f] = n;
+        for(int k=0; k<Count[f]; k++)
+            Adj[n++] = Adj[3*f + k];
+    }
+    AdjStart[nF] = n;
+    Adj.resize(n);
+
+    int NonManifold = 0;
+    for(Edge *E = Edges; E; E = E->next)
+        if(E->Faces.size() > 2)
+            NonManifold++;
+
+    vector<char> Flip;
+    int nConflicts;
+    const int flipcnt = OrientFaces(Flip, nConflicts, AdjStart, Adj);
+
+    for(int f=0; f<nF; f++) {
+        if(Flip[f]) {
+            // Swap the winding.
+            Face *F = FaceList[f];
+            Vertex *T = F->v1;
+            F->v1 = F->v2;
+            F->v2 = T;
+        }
+    }
 
     cerr << "Flipped " << flipcnt << endl;
+    if(NonManifold)
+        cerr << "FixFacing: " << NonManifold << " non-manifold edges\n";
+    if(nConflicts)
+        cerr << "FixFacing: " << nConflicts << " edges can't agree. It's not orientable.\n";
 
     FacesAreFixed = true;
 }
@@ -14,12 +14,9 @@
 #define DMC_MESH_DEBUG
 
 #include "Model/MeshElements.h"
-#include "Model/KDVertex.h"
-#include "Math/KDBoxTree.h"
 #include "Model/TriObject.h"
 #include "Model/RenderObject.h"
 
-#include <set>
 #include <vector>
 #include <iostream>
 
@@ -29,14 +26,8 @@ struct Mesh : public BaseObject
     Edge *Edges;
     Face *Faces;
 
-    // This tree of pointers is used for quickly matching a vertex,
-    // especially when adding a new vertex to the mesh.
-    // It is a pointer so that it won't automatically get copied
-    // when I copy a mesh.
-    KDBoxTree<KDVertex> *VertTree;
-
     // When making a mesh, this tells how close two vertices must
-    // be to be considered the same.
+    // be to be considered the same. See WeldVertices.h.
     double MeshMaxDist;
 
     bool FacesAreFixed; // True when FixFacing() has been run and nothing has changed since then.
@@ -47,7 +38,6 @@ struct Mesh : public BaseObject
         Verts = NULL;
         Edges = NULL;
         Faces = NULL;
-        VertTree = NULL;
         ObjectType = DMC_MESH_OBJECT;
         FacesAreFixed = false;
     }
@@ -61,7 +51,6 @@ struct Mesh : public BaseObject
         Verts = NULL;
         Edges = NULL;
         Faces = NULL;
-        VertTree = NULL;
         EdgeCount = VertexCount = FaceCount = 0;
         EdgeType = VertexType = FaceType = 0;
         ImportTriObject(M, -1.0, VF, EF, FF);
@@ -128,6 +117,8 @@ struct Mesh : public BaseObject
     // If you want the MeshMaxDist to be set as a multiple of the
     // bounding box size then pass in that multiple here.
     // Otherwise it uses the existing value of MeshMaxDist.
+    // Each incoming vertex becomes the first vertex within MeshMaxDist
+    // of it, either one already in the mesh or an earlier incoming one.
     //
     // The elements created are base Vertex, Edge, and Face unless
     // the incoming TriObject has normals, colors, or texture
@@ -149,8 +140,8 @@ struct Mesh : public BaseObject
     // Doesn't generate non-existing required attribs. Do that beforehand.
     void ExportRenderObject(RenderObject &Ob, unsigned int AcceptedAttribs = OBJ_ALL);
 
-    // Make every face in the mesh get the same winding as the
-    // face listed first in the linked list.
+    // Make every face in the mesh get the same winding as the first
+    // face in the linked list that it is connected to by manifold edges.
     void FixFacing();
 
     // Remove vertices that have no edges or faces.
@@ -239,24 +230,6 @@ struct Mesh : public BaseObject
         return F;
     }
 
-    DMC_INLINE Vertex *FindVertex(const Vector &V)
-    {
-        Vertex Ver;
-        Ver.V = V;
-        KDVertex InV(&Ver);
-        std::cerr << "F";
-        KDVertex OutV;
-        if(VertTree->find(InV, OutV))
-        {
-            return OutV.Vert;
-        }
-        else
-            return NULL;
-    }
-
-    Vertex *FindVertexInEdgeList(const std::vector<Edge *> &EdgeList, const Vector &V,
-        Edge * &FoundEdge) const;
-
     // Searches these vertices to find an edge between them.
     // Returns NULL if the edge doesn't exist.
     Edge *FindEdge(Vertex *v0, Vertex *v1, Edge *(*EF)()=NULL);
@@ -280,10 +253,6 @@ struct Mesh : public BaseObject
     }
 
 private:
-    // Returns a count of flipped faces.
-    int FlipMe(Face *F, std::set<Face *> &Visited,
-        Vertex *v0, Vertex *v1, Vertex *v2);
-
     // Called by SplitVertexAtFace.
     Edge *DoEdge(Edge *E, Vertex *V, Vertex *SplitV);
 
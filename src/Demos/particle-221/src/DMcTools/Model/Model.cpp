@@ -5,6 +5,7 @@
 
 #include "Model/Model.h"
 #include "Model/Mesh.h"
+#include "Model/HalfEdgeMesh.h"
 #include "Model/RenderObject.h"
 #include "Model/LightDB.h"
 #include "Model/CameraDB.h"
@@ -60,6 +61,7 @@ bool Model::Load(const char *fname, const unsigned int RequiredAttribs,
 {
     ASSERT_RM(fname, "NULL filename");
     bool status = true;
+    Dependencies.clear();
 
     const char *extc = strrchr(fname, '.');
     extc++;
@@ -98,8 +100,8 @@ bool Model::Load(const char *fname, const unsigned int RequiredAttribs,
     return status;
 }
 
-// Converts DMC_MESH_OBJECTs in this Model into DestType objects,
-// which is DMC_RENDER_OBJECT or DMC_TRI_OBJECT.
+// Converts DMC_MESH_OBJECTs and DMC_HALF_EDGE_OBJECTs in this Model
+// into DestType objects, which is DMC_RENDER_OBJECT or DMC_TRI_OBJECT.
 void Model::ObjectConvert(ObjectTypes DestType, unsigned int AcceptedAttribs)
 {
     for(int i=0; i< (int)Objs.size(); i++) {
@@ -122,6 +124,24 @@ void Model::ObjectConvert(ObjectTypes DestType, unsigned int AcceptedAttribs)
             default:
                 ASSERT_R(0);
             }
+        } else if(Objs[i]->ObjectType == DMC_HALF_EDGE_OBJECT) {
+            BaseObject *Ob;
+            switch(DestType) {
+            case DMC_RENDER_OBJECT:
+                Ob = new RenderObject;
+                ((HalfEdgeMesh *)Objs[i])->ExportRenderObject(*((RenderObject *)Ob), AcceptedAttribs);
+                delete (HalfEdgeMesh *)Objs[i];
+                Objs[i] = Ob;
+                break;
+            case DMC_TRI_OBJECT:
+                Ob = new TriObject;
+                ((HalfEdgeMesh *)Objs[i])->ExportTriObject(*((TriObject *)Ob), AcceptedAttribs);
+                delete (HalfEdgeMesh *)Objs[i];
+                Objs[i] = Ob;
+                break;
+            default:
+                ASSERT_R(0);
+            }
         }
     }
 }
@@ -344,5 +364,7 @@ void Model::FixFacing()
     for(int i=0; i< (int)Objs.size(); i++) {
         if(Objs[i]->ObjectType == DMC_MESH_OBJECT)
             ((Mesh *)Objs[i])->FixFacing();
+        else if(Objs[i]->ObjectType == DMC_HALF_EDGE_OBJECT)
+            ((HalfEdgeMesh *)Objs[i])->FixFacing();
     }
 }
@@ -9,6 +9,7 @@
 #include "Model/TextureDB.h"
 #include "Model/BaseObject.h"
 
+#include <string>
 #include <vector>
 
 class Model
@@ -21,6 +22,9 @@ public:
     std::vector<BaseObject *> Objs;
     int ObjID;
 
+    // The other files that the last Load() read, like an OBJ's .mtl files.
+    std::vector<std::string> Dependencies;
+
     DMC_INLINE Model() {ObjID = -1;}
 
     // Indicate what PER VERTEX attribs to require and what to allow.
@@ -81,8 +85,8 @@ public:
     // Flip facing of all faces to match the first face.
     void FixFacing();
 
-    // Converts DMC_MESH_OBJECTs in this Model into DestType objects,
-    // which is DMC_RENDER_OBJECT or DMC_TRI_OBJECT.
+    // Converts DMC_MESH_OBJECTs and DMC_HALF_EDGE_OBJECTs in this Model
+    // into DestType objects, which is DMC_RENDER_OBJECT or DMC_TRI_OBJECT.
     void ObjectConvert(ObjectTypes DestType, unsigned int AcceptedAttribs = OBJ_ALL);
 
     // Generate a bounding box of all subobjects.
@@ -128,6 +132,26 @@ public:
     bool LoadPLY(const char *fname, const unsigned int RequiredAttribs = OBJ_ALL,
         const unsigned int AcceptedAttribs = OBJ_ALL);
     bool SavePLY(const char *fname);
+
+    // Load fname through a binary cache of it kept next to it as fname.dmc.
+    // If the cache was made from this version of the file and its
+    // Dependencies with the same attribs it's loaded without parsing
+    // anything. Otherwise the file is loaded, any Mesh or HalfEdgeMesh
+    // objects are converted to RenderObjects, and the cache is written.
+    // TriObjects, like the ones LoadOBJ makes, are cached as they are. The
+    // cache can't hold the lights and cameras that LoadVRML adds to LitDB
+    // and CamDB, so a file that has any isn't cached.
+    bool LoadCached(const char *fname, const unsigned int RequiredAttribs = OBJ_ALL,
+        const unsigned int AcceptedAttribs = OBJ_ALL);
+
+    // The cache file itself. Only TriObjects and RenderObjects can be saved.
+    // SourceName is the file it's a cache of, or NULL. The Dependencies are
+    // saved too. LoadCache() fails if the source or any of the Dependencies
+    // has changed or the attribs don't match the ones it was saved with.
+    bool SaveCache(const char *fname, const char *SourceName = NULL,
+        const unsigned int RequiredAttribs = OBJ_ALL, const unsigned int AcceptedAttribs = OBJ_ALL);
+    bool LoadCache(const char *fname, const char *SourceName = NULL,
+        const unsigned int RequiredAttribs = OBJ_ALL, const unsigned int AcceptedAttribs = OBJ_ALL);
 };
 
 #endif
@@ -0,0 +1,476 @@
+//////////////////////////////////////////////////////////////////////
+// ModelCache.cpp - Save and load a Model as a flat binary file, to skip parsing.
+//
+// Copyright David K. McAllister, 2008.
+
+// The file is a CacheHeader, a CacheObject for each object, the texture
+// file names and then the dependency file names, each null terminated,
+// and then the arrays: the size and time stamp of each dependency and the
+// arrays of each object. Each array starts on a 16 byte boundary and is
+// laid out just like the std::vector it came from, so loading is a copy
+// out of the mapped file.
+// Change CACHE_VERSION when any of this changes and old caches will be
+// ignored and rewritten.
+
+#include "Model/Model.h"
+#include "Model/CameraDB.h"
+#include "Model/LightDB.h"
+#include "Model/RenderObject.h"
+#include "Model/TriObject.h"
+#include "Util/MappedFile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+
+using namespace std;
+
+extern LightDB LitDB;
+extern CameraDB CamDB;
+
+namespace {
+    const unsigned int CACHE_VERSION = 3;
+    const char CACHE_MAGIC[8] = {'D', 'M', 'c', 'M', 'o', 'd', 'e', 'l'};
+    const unsigned int CACHE_BYTE_ORDER = 0x01020304; // Reads back differently on the other endianness.
+    const size_t CACHE_ALIGN = 16;
+
+    // The arrays of each object. For a TriObject the last one is alphas and for a RenderObject it's indices.
+    enum {ARR_VERTS, ARR_NORMALS, ARR_TANGENTS, ARR_TEXCOORDS, ARR_DCOLORS, ARR_LAST, CACHE_NUM_ARRAYS};
+
+    struct CacheHeader
+    {
+        char Magic[8];
+        unsigned int Version, ByteOrder;
+        DMCINT64 SourceSize, SourceTime; // Of the file this is a cache of, or 0. The time is in ns where the OS has it.
+        unsigned int RequiredAttribs, AcceptedAttribs; // What it was loaded with
+        int NumObjects, NumTextures;
+        DMCINT64 TexNamesOffset, TexNamesSize;
+        double Box[6];
+        unsigned int BoxValid;
+        int NumDeps; // The dependency names follow the texture names.
+        DMCINT64 DepNamesSize, DepStampsOffset;
+    };
+
+    struct CacheObject
+    {
+        char Name[64];
+        double Transform[16], TexTransform[16];
+        double Box[6];
+        double dcolor[3], scolor[3], ecolor[3], acolor[3];
+        double alpha, shininess, creaseAngle;
+        float RenderPriority;
+        int ObjectType, PrimType;
+        int TexIndex; // Into the texture names, or -1
+        int FaceCount, VertexCount, EdgeCount;
+        unsigned int FaceType, VertexType, EdgeType;
+        unsigned char DColorValid, AlphaValid, SColorValid, EColorValid, AColorValid, ShininessValid;
+        unsigned char CullBack, RenderOnOff, RenderAsSBRDF, BoxValid, Pad[6];
+        DMCINT64 Offset[CACHE_NUM_ARRAYS], Count[CACHE_NUM_ARRAYS];
+    };
+
+    DMC_INLINE size_t AlignUp(const size_t n)
+    {
+        return (n + CACHE_ALIGN - 1) & ~(CACHE_ALIGN - 1);
+    }
+
+    template<class Valid_T>
+    DMC_INLINE void PutBox(double D[6], Valid_T &Valid, const BBox<Vector> &B)
+    {
+        D[0] = B.MinV.x; D[1] = B.MinV.y; D[2] = B.MinV.z;
+        D[3] = B.MaxV.x; D[4] = B.MaxV.y; D[5] = B.MaxV.z;
+        Valid = B.is_valid();
+    }
+
+    DMC_INLINE BBox<Vector> GetBox(const double D[6], const bool Valid)
+    {
+        BBox<Vector> B(Vector(D[0], D[1], D[2]), Vector(D[3], D[4], D[5]));
+        if(!Valid)
+            B.Reset();
+        return B;
+    }
+
+    // The size and modification time of the file. Returns false if it doesn't exist.
+    bool SourceStamp(const char *fname, DMCINT64 &Size, DMCINT64 &Time)
+    {
+#ifdef _WIN32
+        struct _stat64 st;
+        if(_stat64(fname, &st))
+            return false;
+#else
+        struct stat st;
+        if(stat(fname, &st))
+            return false;
+#endif
+        Size = (DMCINT64)st.st_size;
+        Time = (DMCINT64)st.st_mtime * 1000000000;
+        // An edit within the same second that keeps the size only shows in the nanoseconds.
+#if defined(__APPLE__)
+        Time += (DMCINT64)st.st_mtimespec.tv_nsec;
+#elif !defined(_WIN32)
+        Time += (DMCINT64)st.st_mtim.tv_nsec;
+#endif
+        return true;
+    }
+
+    // An array to write and where it goes
+    struct CacheArray
+    {
+        const void *Data;
+        size_t Bytes;
+    };
+
+    template<class T>
+    DMC_INLINE CacheArray ArrayOf(const vector<T> &V)
+    {
+        CacheArray A;
+        A.Data = V.empty() ? NULL : &V[0];
+        A.Bytes = V.size() * sizeof(T);
+        return A;
+    }
+
+    // The stamp of a file that doesn't exist is -1, so it has to still not exist.
+    DMC_INLINE void DepStamp(const string &fname, DMCINT64 &Size, DMCINT64 &Time)
+    {
+        if(!SourceStamp(fname.c_str(), Size, Time))
+            Size = Time = -1;
+    }
+
+    // Copy Count elements at Offset in the file into V, if they're inside the file.
+    template<class T>
+    bool ReadArray(vector<T> &V, const MappedFile &F, const DMCINT64 Offset, const DMCINT64 Count)
+    {
+        if(Offset < 0 || Count < 0 || (unsigned DMCINT64)Offset > F.size() ||
+            (unsigned DMCINT64)Count > (F.size() - Offset) / sizeof(T))
+            return false;
+        const T *P = (const T *)(F.data() + Offset);
+        V.assign(P, P + Count);
+        return true;
+    }
+};
+
+// Returns false on success.
+bool Model::SaveCache(const char *fname, const char *SourceName, const unsigned int RequiredAttribs,
+    const unsigned int AcceptedAttribs)
+{
+    ASSERT_RM(fname, "NULL filename");
+
+    CacheHeader H;
+    memset(&H, 0, sizeof(H));
+    H.Version = CACHE_VERSION;
+    H.ByteOrder = CACHE_BYTE_ORDER;
+    if(SourceName && !SourceStamp(SourceName, H.SourceSize, H.SourceTime)) {
+        cerr << "Can't find " << SourceName << " to cache it.\n";
+        return true;
+    }
+    H.RequiredAttribs = RequiredAttribs;
+    H.AcceptedAttribs = AcceptedAttribs;
+    H.NumObjects = int(Objs.size());
+    PutBox(H.Box, H.BoxValid, Box);
+
+    vector<CacheObject> COs(Objs.size());
+    vector<CacheArray> Arrays;
+    vector<TexInfo *> Texs;
+    string TexNames;
+
+    for(int i=0; i<(int)Objs.size(); i++) {
+        BaseObject *Ob = Objs[i];
+        CacheObject &C = COs[i];
+        memset(&C, 0, sizeof(C));
+
+        if(Ob->ObjectType == DMC_TRI_OBJECT) {
+            const TriObject *T = (const TriObject *)Ob;
+            C.PrimType = T->PrimType;
+            Arrays.push_back(ArrayOf(T->verts));
+            Arrays.push_back(ArrayOf(T->normals));
+            Arrays.push_back(ArrayOf(T->tangents));
+            Arrays.push_back(ArrayOf(T->texcoords));
+            Arrays.push_back(ArrayOf(T->dcolors));
+            Arrays.push_back(ArrayOf(T->alphas));
+        } else if(Ob->ObjectType == DMC_RENDER_OBJECT) {
+            const RenderObject *R = (const RenderObject *)Ob;
+            Arrays.push_back(ArrayOf(R->verts));
+            Arrays.push_back(ArrayOf(R->normals));
+            Arrays.push_back(ArrayOf(R->tangents));
+            Arrays.push_back(ArrayOf(R->texcoords));
+            Arrays.push_back(ArrayOf(R->dcolors));
+            Arrays.push_back(ArrayOf(R->indices));
+        } else {
+            cerr << "Can only cache TriObjects and RenderObjects. Call ObjectConvert() first.\n";
+            return true;
+        }
+
+        memcpy(C.Name, Ob->Name, sizeof(C.Name));
+        Ob->Transform.Get(C.Transform);
+        Ob->TexTransform.Get(C.TexTransform);
+        PutBox(C.Box, C.BoxValid, Ob->Box);
+        for(int k=0; k<3; k++) {
+            C.dcolor[k] = Ob->dcolor[k];
+            C.scolor[k] = Ob->scolor[k];
+            C.ecolor[k] = Ob->ecolor[k];
+            C.acolor[k] = Ob->acolor[k];
+        }
+        C.alpha = Ob->alpha;
+        C.shininess = Ob->shininess;
+        C.creaseAngle = Ob->creaseAngle;
+        C.RenderPriority = Ob->RenderPriority;
+        C.ObjectType = Ob->ObjectType;
+        C.FaceCount = Ob->FaceCount;
+        C.VertexCount = Ob->VertexCount;
+        C.EdgeCount = Ob->EdgeCount;
+        C.FaceType = Ob->FaceType;
+        C.VertexType = Ob->VertexType;
+        C.EdgeType = Ob->EdgeType;
+        C.DColorValid = Ob->DColorValid;
+        C.AlphaValid = Ob->AlphaValid;
+        C.SColorValid = Ob->SColorValid;
+        C.EColorValid = Ob->EColorValid;
+        C.AColorValid = Ob->AColorValid;
+        C.ShininessValid = Ob->ShininessValid;
+        C.CullBack = Ob->CullBack;
+        C.RenderOnOff = Ob->RenderOnOff;
+        C.RenderAsSBRDF = Ob->RenderAsSBRDF;
+
+        // The textures are saved by name and looked up in TexDB when loading.
+        C.TexIndex = -1;
+        if(Ob->TexPtr && Ob->TexPtr->TexFName) {
+            int t;
+            for(t=0; t<(int)Texs.size() && Texs[t] != Ob->TexPtr; t++) ;
+            if(t == (int)Texs.size()) {
+                Texs.push_back(Ob->TexPtr);
+                TexNames.append(Ob->TexPtr->TexFName);
+                TexNames.push_back('\0');
+            }
+            C.TexIndex = t;
+        }
+    }
+
+    H.NumTextures = int(Texs.size());
+    H.TexNamesOffset = (DMCINT64)(sizeof(H) + COs.size() * sizeof(CacheObject));
+    H.TexNamesSize = (DMCINT64)TexNames.size();
+
+    string DepNames;
+    vector<DMCINT64> DepStamps(2 * Dependencies.size());
+    for(int d=0; d<(int)Dependencies.size(); d++) {
+        DepNames.append(Dependencies[d]);
+        DepNames.push_back('\0');
+        DepStamp(Dependencies[d], DepStamps[2*d], DepStamps[2*d+1]);
+    }
+    H.NumDeps = int(Dependencies.size());
+    H.DepNamesSize = (DMCINT64)DepNames.size();
+
+    // Lay out the arrays. The dependency stamps are the first.
+    Arrays.insert(Arrays.begin(), ArrayOf(DepStamps));
+    const size_t NamesEnd = size_t(H.TexNamesOffset) + TexNames.size() + DepNames.size();
+    size_t Pos = AlignUp(NamesEnd);
+    vector<size_t> ArrOffset(Arrays.size());
+    for(int a=0; a<(int)Arrays.size(); a++) {
+        ArrOffset[a] = Pos;
+        Pos = AlignUp(Pos + Arrays[a].Bytes);
+    }
+    H.DepStampsOffset = (DMCINT64)ArrOffset[0];
+    for(int i=0; i<(int)COs.size(); i++) {
+        for(int k=0; k<CACHE_NUM_ARRAYS; k++) {
+            const int a = 1 + i * CACHE_NUM_ARRAYS + k;
+            const size_t ElSize = Objs[i]->ObjectType == DMC_TRI_OBJECT ?
+                (k == ARR_LAST ? sizeof(double) : sizeof(Vector)) : (k == ARR_LAST ? sizeof(int) : sizeof(f3Vector));
+            COs[i].Offset[k] = (DMCINT64)ArrOffset[a];
+            COs[i].Count[k] = (DMCINT64)(Arrays[a].Bytes / ElSize);
+        }
+    }
+
+    FILE *out = fopen(fname, "wb");
+    if(!out) {
+        cerr << "Couldn't open " << fname << " to write the model cache.\n";
+        return true;
+    }
+
+    // The header is written with its magic number last, so a cache that didn't get finished won't be loaded.
+    bool OK = fwrite(&H, sizeof(H), 1, out) == 1;
+    if(!COs.empty())
+        OK = OK && fwrite(&COs[0], sizeof(CacheObject), COs.size(), out) == COs.size();
+    OK = OK && fwrite(TexNames.data(), 1, TexNames.size(), out) == TexNames.size();
+    OK = OK && fwrite(DepNames.data(), 1, DepNames.size(), out) == DepNames.size();
+
+    const char Zeros[CACHE_ALIGN] = {0};
+    size_t Written = NamesEnd;
+    for(int a=0; a<(int)Arrays.size() && OK; a++) {
+        OK = fwrite(Zeros, 1, ArrOffset[a] - Written, out) == ArrOffset[a] - Written;
+        if(Arrays[a].Bytes)
+            OK = OK && fwrite(Arrays[a].Data, 1, Arrays[a].Bytes, out) == Arrays[a].Bytes;
+        Written = ArrOffset[a] + Arrays[a].Bytes;
+    }
+
+    memcpy(H.Magic, CACHE_MAGIC, sizeof(H.Magic));
+    OK = OK && fflush(out) == 0 && fseek(out, 0, SEEK_SET) == 0 && fwrite(&H, sizeof(H), 1, out) == 1;
+    OK = (fclose(out) == 0) && OK;
+
+    if(!OK) {
+        cerr << "Failed writing the model cache " << fname << endl;
+        remove(fname);
+    }
+
+    return !OK;
+}
+
+// Returns false on success.
+bool Model::LoadCache(const char *fname, const char *SourceName, const unsigned int RequiredAttribs,
+    const unsigned int AcceptedAttribs)
+{
+    ASSERT_RM(fname, "NULL filename");
+    DMCINT64 CSize, CTime;
+    if(!SourceStamp(fname, CSize, CTime) || CSize < (DMCINT64)sizeof(CacheHeader))
+        return true;
+
+    MappedFile F(fname);
+    if(F.size() < sizeof(CacheHeader))
+        return true;
+
+    // It has to be finished, from this version, and made from this version of the source with these attribs.
+    CacheHeader H;
+    memcpy(&H, F.data(), sizeof(H));
+    if(memcmp(H.Magic, CACHE_MAGIC, sizeof(H.Magic)) || H.Version != CACHE_VERSION || H.ByteOrder != CACHE_BYTE_ORDER)
+        return true;
+    if(H.RequiredAttribs != RequiredAttribs || H.AcceptedAttribs != AcceptedAttribs)
+        return true;
+    if(SourceName) {
+        DMCINT64 SSize, STime;
+        if(!SourceStamp(SourceName, SSize, STime) || SSize != H.SourceSize || STime != H.SourceTime)
+            return true;
+    }
+
+    if(H.NumObjects < 0 || H.NumTextures < 0 || H.TexNamesSize < 0 || H.NumDeps < 0 || H.DepNamesSize < 0 ||
+        H.TexNamesOffset != (DMCINT64)(sizeof(H) + H.NumObjects * sizeof(CacheObject)) ||
+        (unsigned DMCINT64)(H.TexNamesOffset + H.TexNamesSize + H.DepNamesSize) > F.size())
+        return true;
+
+    // The other files it was loaded from can't have changed either.
+    vector<string> Deps;
+    vector<DMCINT64> DepStamps;
+    if(!ReadArray(DepStamps, F, H.DepStampsOffset, 2 * (DMCINT64)H.NumDeps))
+        return true;
+    const char *DN = (const char *)F.data() + H.TexNamesOffset + H.TexNamesSize, *DNEnd = DN + H.DepNamesSize;
+    for(int d=0; d<H.NumDeps; d++) {
+        const char *e = (const char *)memchr(DN, '\0', DNEnd - DN);
+        if(!e)
+            return true;
+        Deps.push_back(string(DN, e));
+        DN = e + 1;
+
+        DMCINT64 DSize, DTime;
+        DepStamp(Deps[d], DSize, DTime);
+        if(DSize != DepStamps[2*d] || DTime != DepStamps[2*d+1])
+            return true;
+    }
+
+    // Find the textures.
+    vector<TexInfo *> Texs;
+    const char *TN = (const char *)F.data() + H.TexNamesOffset, *TNEnd = TN + H.TexNamesSize;
+    for(int t=0; t<H.NumTextures; t++) {
+        const char *e = (const char *)memchr(TN, '\0', TNEnd - TN);
+        if(!e)
+            return true;
+        Texs.push_back(TexDB.FindByNameOrAdd(strdup(TN)));
+        TN = e + 1;
+    }
+
+    vector<BaseObject *> NewObjs;
+    bool OK = true;
+    for(int i=0; i<H.NumObjects && OK; i++) {
+        CacheObject C;
+        memcpy(&C, F.data() + sizeof(H) + i * sizeof(CacheObject), sizeof(C));
+
+        BaseObject *Ob;
+        if(C.ObjectType == DMC_TRI_OBJECT) {
+            TriObject *T = new TriObject;
+            Ob = T;
+            T->PrimType = C.PrimType;
+            OK = ReadArray(T->verts, F, C.Offset[ARR_VERTS], C.Count[ARR_VERTS]) &&
+                ReadArray(T->normals, F, C.Offset[ARR_NORMALS], C.Count[ARR_NORMALS]) &&
+                ReadArray(T->tangents, F, C.Offset[ARR_TANGENTS], C.Count[ARR_TANGENTS]) &&
+                ReadArray(T->texcoords, F, C.Offset[ARR_TEXCOORDS], C.Count[ARR_TEXCOORDS]) &&
+                ReadArray(T->dcolors, F, C.Offset[ARR_DCOLORS], C.Count[ARR_DCOLORS]) &&
+                ReadArray(T->alphas, F, C.Offset[ARR_LAST], C.Count[ARR_LAST]);
+        } else if(C.ObjectType == DMC_RENDER_OBJECT) {
+            RenderObject *R = new RenderObject;
+            Ob = R;
+            OK = ReadArray(R->verts, F, C.Offset[ARR_VERTS], C.Count[ARR_VERTS]) &&
+                ReadArray(R->normals, F, C.Offset[ARR_NORMALS], C.Count[ARR_NORMALS]) &&
+                ReadArray(R->tangents, F, C.Offset[ARR_TANGENTS], C.Count[ARR_TANGENTS]) &&
+                ReadArray(R->texcoords, F, C.Offset[ARR_TEXCOORDS], C.Count[ARR_TEXCOORDS]) &&
+                ReadArray(R->dcolors, F, C.Offset[ARR_DCOLORS], C.Count[ARR_DCOLORS]) &&
+                ReadArray(R->indices, F, C.Offset[ARR_LAST], C.Count[ARR_LAST]);
+        } else
+            break;
+        NewObjs.push_back(Ob);
+
+        memcpy(Ob->Name, C.Name, sizeof(Ob->Name));
+        Ob->Name[sizeof(Ob->Name) - 1] = '\0';
+        Ob->Transform.Set(C.Transform);
+        Ob->TexTransform.Set(C.TexTransform);
+        Ob->Box = GetBox(C.Box, C.BoxValid != 0);
+        Ob->dcolor = Vector(C.dcolor[0], C.dcolor[1], C.dcolor[2]);
+        Ob->scolor = Vector(C.scolor[0], C.scolor[1], C.scolor[2]);
+        Ob->ecolor = Vector(C.ecolor[0], C.ecolor[1], C.ecolor[2]);
+        Ob->acolor = Vector(C.acolor[0], C.acolor[1], C.acolor[2]);
+        Ob->alpha = C.alpha;
+        Ob->shininess = C.shininess;
+        Ob->creaseAngle = C.creaseAngle;
+        Ob->RenderPriority = C.RenderPriority;
+        Ob->FaceCount = C.FaceCount;
+        Ob->VertexCount = C.VertexCount;
+        Ob->EdgeCount = C.EdgeCount;
+        Ob->FaceType = C.FaceType;
+        Ob->VertexType = C.VertexType;
+        Ob->EdgeType = C.EdgeType;
+        Ob->DColorValid = C.DColorValid != 0;
+        Ob->AlphaValid = C.AlphaValid != 0;
+        Ob->SColorValid = C.SColorValid != 0;
+        Ob->EColorValid = C.EColorValid != 0;
+        Ob->AColorValid = C.AColorValid != 0;
+        Ob->ShininessValid = C.ShininessValid != 0;
+        Ob->CullBack = C.CullBack != 0;
+        Ob->RenderOnOff = C.RenderOnOff != 0;
+        Ob->RenderAsSBRDF = C.RenderAsSBRDF != 0;
+        Ob->TexPtr = (C.TexIndex >= 0 && C.TexIndex < (int)Texs.size()) ? Texs[C.TexIndex] : NULL;
+    }
+
+    if(!OK || (int)NewObjs.size() != H.NumObjects) {
+        for(int i=0; i<(int)NewObjs.size(); i++)
+            delete NewObjs[i];
+        return true;
+    }
+
+    for(int i=0; i<(int)Objs.size(); i++)
+        delete Objs[i];
+    Objs.swap(NewObjs);
+    Box = GetBox(H.Box, H.BoxValid != 0);
+    Dependencies.swap(Deps);
+
+    return false;
+}
+
+// Returns false on success.
+bool Model::LoadCached(const char *fname, const unsigned int RequiredAttribs, const unsigned int AcceptedAttribs)
+{
+    ASSERT_RM(fname, "NULL filename");
+    const string CacheName = string(fname) + ".dmc";
+
+    if(!LoadCache(CacheName.c_str(), fname, RequiredAttribs, AcceptedAttribs))
+        return false;
+
+    const size_t NumLights = LitDB.LightList.size(), NumCameras = CamDB.CameraList.size();
+    if(Load(fname, RequiredAttribs, AcceptedAttribs))
+        return true;
+
+    ObjectConvert(DMC_RENDER_OBJECT, AcceptedAttribs);
+    if(LitDB.LightList.size() != NumLights || CamDB.CameraList.size() != NumCameras) {
+        cerr << "Not caching " << fname << " because the cache can't hold its lights and cameras.\n";
+        return false;
+    }
+
+    if(SaveCache(CacheName.c_str(), fname, RequiredAttribs, AcceptedAttribs))
+        cerr << "Couldn't cache " << fname << endl;
+
+    return false;
+}
@@ -0,0 +1,120 @@
+//////////////////////////////////////////////////////////////////////
+// OrientFaces.cpp - Give connected faces the same winding.
+//
+// Copyright David K. McAllister, 2008.
+
+#include "Model/OrientFaces.h"
+#include "toolconfig.h"
+
+#include <vector>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+    const int ORIENT_PAR_MIN = 1 << 14; // Fewer faces than this aren't worth starting threads for.
+
+    DMC_INLINE int FindRoot(vector<int> &Parent, int f)
+    {
+        while(Parent[f] != f) {
+            Parent[f] = Parent[Parent[f]]; // Path halving
+            f = Parent[f];
+        }
+        return f;
+    }
+};
+
+int OrientFaces(vector<char> &Flip, int &NumConflicts, const vector<int> &AdjStart, const vector<int> &Adj, const bool Parallel)
+{
+    const int nF = int(AdjStart.size()) - 1;
+    Flip.assign(nF, 0);
+    NumConflicts = 0;
+    if(nF <= 0)
+        return 0;
+
+    // Find the connected parts. The lower numbered root always wins, so each part's root is its lowest face.
+    vector<int> Parent(nF);
+    for(int f=0; f<nF; f++)
+        Parent[f] = f;
+    for(int f=0; f<nF; f++) {
+        for(int k=AdjStart[f]; k<AdjStart[f+1]; k++) {
+            const int a = FindRoot(Parent, f), b = FindRoot(Parent, Adj[k] >> 1);
+            if(a < b) Parent[b] = a;
+            else if(b < a) Parent[a] = b;
+        }
+    }
+
+    // List each part's faces together, in order, with the root first.
+    vector<int> PartOf(nF), PartStart(1, 0);
+    for(int f=0; f<nF; f++) {
+        const int r = FindRoot(Parent, f);
+        if(r == f) {
+            PartOf[f] = int(PartStart.size()) - 1;
+            PartStart.push_back(0);
+        } else
+            PartOf[f] = PartOf[r];
+        PartStart[PartOf[f] + 1]++;
+    }
+    const int nParts = int(PartStart.size()) - 1;
+    for(int p=0; p<nParts; p++)
+        PartStart[p+1] += PartStart[p];
+
+    // Faces[PartStart[p] + Local[f]] is f.
+    vector<int> Faces(nF), Local(nF);
+    {
+        vector<int> Fill(PartStart.begin(), PartStart.end() - 1);
+        for(int f=0; f<nF; f++) {
+            const int p = PartOf[f];
+            Local[f] = Fill[p] - PartStart[p];
+            Faces[Fill[p]++] = f;
+        }
+    }
+    vector<int>().swap(Parent);
+    vector<int>().swap(PartOf);
+
+    int nConflicts = 0;
+
+#pragma omp parallel if(Parallel && nF > ORIENT_PAR_MIN) reduction(+:nConflicts)
+    {
+        // Each thread reuses these for all its parts.
+        vector<bool> Visited;
+        vector<int> Queue;
+
+#pragma omp for schedule(dynamic, 64)
+        for(int p=0; p<nParts; p++) {
+            const int p0 = PartStart[p], nInPart = PartStart[p+1] - p0;
+            if(nInPart == 1)
+                continue;
+
+            Visited.assign(nInPart, false);
+            Queue.clear();
+            Visited[0] = true;
+            Queue.push_back(Faces[p0]);
+
+            for(int q=0; q<(int)Queue.size(); q++) {
+                const int f = Queue[q];
+                for(int k=AdjStart[f]; k<AdjStart[f+1]; k++) {
+                    const int g = Adj[k] >> 1;
+                    const char FlipG = Flip[f] ^ char(Adj[k] & 1);
+                    if(!Visited[Local[g]]) {
+                        Visited[Local[g]] = true;
+                        Flip[g] = FlipG;
+                        Queue.push_back(g);
+                    } else if(Flip[g] != FlipG)
+                        nConflicts++;
+                }
+            }
+        }
+    }
+
+    // Each conflict was seen from both sides.
+    NumConflicts = nConflicts / 2;
+
+    int nFlipped = 0;
+    for(int f=0; f<nF; f++)
+        nFlipped += Flip[f];
+
+    return nFlipped;
+}
@@ -0,0 +1,33 @@
+//////////////////////////////////////////////////////////////////////
+// OrientFaces.h - Give connected faces the same winding.
+//
+// Copyright David K. McAllister, 2008.
+//
+// This is the part of FixFacing() that Mesh and HalfEdgeMesh share. It
+// works on a flat list of each face's neighbors, so it doesn't recurse
+// and doesn't need a set of visited faces.
+//
+// The faces are first split into connected parts with a union-find.
+// Then each part is done breadth-first from its lowest numbered face,
+// which keeps its winding, with a bitset of the part's visited faces.
+// The parts are done in parallel.
+
+#ifndef dmc_orient_faces_h
+#define dmc_orient_faces_h
+
+#include <vector>
+
+// The neighbors of face f are Adj[AdjStart[f]] up to Adj[AdjStart[f+1]].
+// Each is (g << 1) | Same, where g is the neighboring face and Same is 1
+// if g goes the same direction along their shared edge as f, which means
+// that one of them needs to be flipped. Only list neighbors across
+// manifold edges.
+//
+// Flip gets 1 for each face that should be flipped. Returns the number
+// of faces to flip. NumConflicts gets the number of neighbor pairs that
+// can't agree, which happens on a surface that isn't orientable, like a
+// Moebius strip.
+int OrientFaces(std::vector<char> &Flip, int &NumConflicts, const std::vector<int> &AdjStart,
+                const std::vector<int> &Adj, const bool Parallel = true);
+
+#endif
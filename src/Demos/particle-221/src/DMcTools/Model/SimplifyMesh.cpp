@@ -0,0 +1,468 @@
+//////////////////////////////////////////////////////////////////////
+// SimplifyMesh.cpp - Simplify a HalfEdgeMesh by quadric error edge collapse.
+//
+// Copyright David K. McAllister, 2008.
+
+#include "Model/SimplifyMesh.h"
+#include "Model/WeldVertices.h"
+#include "Math/Quadric.h"
+
+#include <algorithm>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+    const int SIMPLIFY_PAR_MIN = 1 << 14; // Fewer edges than this aren't worth starting threads for.
+    const double BOUNDARY_WEIGHT = 100; // How much more a boundary plane counts than a face plane
+    const double SING_THRESH = 1e-4; // Smaller pivots mean the summed quadric has no single minimum.
+    const double MIN_FACE_COS = 0.1; // A collapse can't turn a face by more than about 84 degrees.
+
+    struct Collapse
+    {
+        double Cost;
+        int a, b;
+        int StampA, StampB; // The vertices' stamps when it was made. It's stale if either has changed.
+
+        // The heap functions put the largest on top, so the cheapest has to be the largest.
+        bool operator<(const Collapse &C) const { return Cost > C.Cost; }
+    };
+
+    DMC_INLINE Vector Normalized(Vector V)
+    {
+        if(V.length2() > 0)
+            V.normalize();
+        return V;
+    }
+
+    class Simplifier
+    {
+        const HalfEdgeMesh &Src;
+        Vector Center;
+        double Scale; // The mesh is moved and scaled to a unit box so the float quadrics keep their precision.
+        double AttribW;
+
+        vector<Vector> P, N, T, C, Tan; // The positions in the unit box and the attributes
+        vector<Quadric3> Q;
+        vector<int> Stamp; // Changes when the vertex does. -1 once it's collapsed away.
+        vector<char> OnBoundary, Moved;
+        vector<char> Pinned; // It has a copy at the same position across a seam, so it can't move.
+        vector<int> Mark;
+        int CurMark;
+
+        vector<int> F; // Three vertices per face
+        vector<char> FaceAlive;
+        vector<vector<int> > VFaces; // The faces of each vertex. Some may be dead.
+        int nFaces;
+
+        vector<Collapse> Heap;
+
+    public:
+        double MaxCost; // The largest cost so far, in the unit box
+
+        Simplifier(const HalfEdgeMesh &M, const double AttribWeight);
+
+        // Collapse edges until the mesh gets down to Target.
+        void Run(const SimplifyTarget &Target);
+
+        // The mesh as it is now.
+        void Extract(HalfEdgeMesh &Out) const;
+
+        DMC_INLINE double ToMeshUnits(const double Cost) const { return Cost / (Scale * Scale); }
+
+    private:
+        double EdgeCost(const int a, const int b, Vector &Pos, double &t) const;
+        void PushEdge(const int a, const int b);
+        bool CanCollapse(const int a, const int b, const Vector &Pos);
+        void DoCollapse(const int a, const int b, const Vector &Pos, const double t);
+
+        DMC_INLINE bool FaceHas(const int f, const int v) const
+        {
+            return F[3*f] == v || F[3*f+1] == v || F[3*f+2] == v;
+        }
+    };
+
+    Simplifier::Simplifier(const HalfEdgeMesh &M, const double AttribWeight) : Src(M), AttribW(AttribWeight)
+    {
+        const int nV = int(M.verts.size()), nF = int(M.Indices.size()) / 3;
+
+        const BBox<Vector> &Box = M.Box;
+        Center = nV && Box.is_valid() ? (Box.MinV + Box.MaxV) * 0.5 : Vector(0, 0, 0);
+        const double Dim = nV && Box.is_valid() ? Box.MaxDim() : 0;
+        Scale = Dim > 0 ? 1.0 / Dim : 1.0;
+
+        P.resize(nV);
+        for(int v=0; v<nV; v++)
+            P[v] = (M.verts[v] - Center) * Scale;
+        if((int)M.normals.size() == nV) N = M.normals;
+        if((int)M.texcoords.size() == nV) T = M.texcoords;
+        if((int)M.dcolors.size() == nV) C = M.dcolors;
+        if((int)M.tangents.size() == nV) Tan = M.tangents;
+
+        Q.resize(nV);
+        for(int v=0; v<nV; v++)
+            Q[v].zero();
+        Stamp.assign(nV, 0);
+        OnBoundary.assign(nV, 0);
+        Moved.assign(nV, 0);
+        Mark.assign(nV, 0);
+        CurMark = 0;
+        MaxCost = 0;
+
+        // Vertices split for their normals or texcoords. Both sides of the seam have to stay where they are or it cracks.
+        Pinned.assign(nV, 0);
+        {
+            vector<int> Remap, FirstIndex;
+            WeldVertices(Remap, FirstIndex, M.verts);
+            vector<int> Copies(FirstIndex.size(), 0);
+            for(int v=0; v<nV; v++)
+                Copies[Remap[v]]++;
+            for(int v=0; v<nV; v++)
+                Pinned[v] = Copies[Remap[v]] > 1;
+        }
+
+        F = M.Indices;
+        FaceAlive.assign(nF, 1);
+        nFaces = nF;
+
+        // The planes of the faces, and the planes along the boundaries
+        for(int f=0; f<nF; f++) {
+            const Vector &P0 = P[F[3*f]], &P1 = P[F[3*f+1]], &P2 = P[F[3*f+2]];
+            const Vector Nf = Normalized(Cross(P1 - P0, P2 - P0));
+            if(Nf.length2() == 0)
+                continue;
+
+            Quadric3 Qf;
+            Qf.DoSym(Nf, -Dot(Nf, P0));
+            for(int k=0; k<3; k++)
+                Q[F[3*f+k]] += Qf;
+
+            for(int h=3*f; h<3*f+3; h++) {
+                if(M.Twin[h] >= 0)
+                    continue;
+                const int a = M.From(h), b = M.To(h);
+                const Vector Nb = Normalized(Cross(P[b] - P[a], Nf));
+                if(Nb.length2() == 0)
+                    continue;
+                Quadric3 Qb;
+                Qb.DoSym(Nb, -Dot(Nb, P[a]));
+                Qb.Scale(BOUNDARY_WEIGHT);
+                Q[a] += Qb;
+                Q[b] += Qb;
+                OnBoundary[a] = OnBoundary[b] = 1;
+            }
+        }
+
+        VFaces.resize(nV);
+        {
+            vector<int> Cnt(nV, 0);
+            for(int i=0; i<3*nF; i++)
+                Cnt[F[i]]++;
+            for(int v=0; v<nV; v++)
+                VFaces[v].reserve(Cnt[v]);
+        }
+        for(int i=0; i<3*nF; i++)
+            VFaces[F[i]].push_back(i / 3);
+
+        // Each edge once. A non-manifold one is in a few times, which is harmless. One between two pinned vertices never collapses.
+        vector<int> Edges;
+        for(int h=0; h<3*nF; h++)
+            if((M.Twin[h] < 0 || h < M.Twin[h]) && !(Pinned[M.From(h)] && Pinned[M.To(h)]))
+                Edges.push_back(h);
+        const int nE = int(Edges.size());
+
+        Heap.resize(nE);
+#pragma omp parallel for schedule(static) if(nE > SIMPLIFY_PAR_MIN)
+        for(int e=0; e<nE; e++) {
+            Collapse &Co = Heap[e];
+            Co.a = M.From(Edges[e]);
+            Co.b = M.To(Edges[e]);
+            Co.StampA = Co.StampB = 0;
+            Vector Pos;
+            double t;
+            Co.Cost = EdgeCost(Co.a, Co.b, Pos, t);
+        }
+        make_heap(Heap.begin(), Heap.end());
+    }
+
+    // The cost of collapsing a and b together. Pos gets where the vertex goes and t how far that is from a to b.
+    double Simplifier::EdgeCost(const int a, const int b, Vector &Pos, double &t) const
+    {
+        const Quadric3 Qab = Q[a] + Q[b];
+        const Vector &Pa = P[a], &Pb = P[b];
+        const Vector E = Pb - Pa, Mid = (Pa + Pb) * 0.5;
+        const double L2 = E.length2();
+
+        // A pinned vertex stays put, so the other one comes to it.
+        // A minimum far from the edge comes from a nearly singular quadric, like on a flat or a crease.
+        double Err;
+        if(Pinned[a] || Pinned[b]) {
+            Pos = Pinned[a] ? Pa : Pb;
+            Err = Qab.MulPt(Pos);
+        } else if(Qab.FindMin(Pos, SING_THRESH) && (Pos - Mid).length2() <= L2)
+            Err = Qab.MulPt(Pos);
+        else {
+            const Vector Cands[3] = {Pa, Pb, Mid};
+            Err = DBL_MAX;
+            for(int k=0; k<3; k++) {
+                const double e = Qab.MulPt(Cands[k]);
+                if(e < Err) {
+                    Err = e;
+                    Pos = Cands[k];
+                }
+            }
+        }
+        if(Err < 0) // Rounding
+            Err = 0;
+
+        if(Pinned[a] || Pinned[b])
+            t = Pinned[a] ? 0 : 1;
+        else
+            t = L2 > 0 ? Clamp(0.0, Dot(Pos - Pa, E) / L2, 1.0) : 0.5;
+
+        double AttrErr = 0;
+        if(N.size()) {
+            const Vector Nt = Normalized(N[a] + (N[b] - N[a]) * t);
+            AttrErr += (N[a] - Nt).length2() + (N[b] - Nt).length2();
+        }
+        if(T.size()) {
+            const Vector Tt = T[a] + (T[b] - T[a]) * t;
+            AttrErr += (T[a] - Tt).length2() + (T[b] - Tt).length2();
+        }
+
+        return Err + AttribW * L2 * AttrErr;
+    }
+
+    void Simplifier::PushEdge(const int a, const int b)
+    {
+        if(Pinned[a] && Pinned[b])
+            return;
+
+        Collapse Co;
+        Co.a = a;
+        Co.b = b;
+        Co.StampA = Stamp[a];
+        Co.StampB = Stamp[b];
+        Vector Pos;
+        double t;
+        Co.Cost = EdgeCost(a, b, Pos, t);
+        Heap.push_back(Co);
+        push_heap(Heap.begin(), Heap.end());
+    }
+
+    // Collapsing an edge keeps the mesh manifold if the only vertices next to both ends are the third vertices of
+    // the faces on the edge. It also can't join two boundaries through the inside or fold a face over.
+    bool Simplifier::CanCollapse(const int a, const int b, const Vector &Pos)
+    {
+        CurMark++;
+        for(int i=0; i<(int)VFaces[a].size(); i++) {
+            const int f = VFaces[a][i];
+            if(FaceAlive[f])
+                for(int k=0; k<3; k++)
+                    Mark[F[3*f+k]] = CurMark;
+        }
+
+        int nShared = 0, nCommon = 0;
+        for(int i=0; i<(int)VFaces[b].size(); i++) {
+            const int f = VFaces[b][i];
+            if(!FaceAlive[f])
+                continue;
+            if(FaceHas(f, a))
+                nShared++;
+            for(int k=0; k<3; k++) {
+                const int v = F[3*f+k];
+                if(v != a && v != b && Mark[v] == CurMark) {
+                    Mark[v] = -CurMark; // Count it once.
+                    nCommon++;
+                }
+            }
+        }
+
+        if(nShared == 0 || nShared > 2 || nCommon != nShared)
+            return false;
+        if(nShared == 2 && OnBoundary[a] && OnBoundary[b])
+            return false;
+
+        // Faces that stay can't turn much.
+        for(int e=0; e<2; e++) {
+            const int v = e ? b : a, w = e ? a : b;
+            for(int i=0; i<(int)VFaces[v].size(); i++) {
+                const int f = VFaces[v][i];
+                if(!FaceAlive[f] || FaceHas(f, w))
+                    continue;
+                Vector V[3], W[3];
+                for(int k=0; k<3; k++) {
+                    V[k] = P[F[3*f+k]];
+                    W[k] = F[3*f+k] == v ? Pos : V[k];
+                }
+                const Vector Nold = Cross(V[1] - V[0], V[2] - V[0]), Nnew = Cross(W[1] - W[0], W[2] - W[0]);
+                if(Nold.length2() == 0)
+                    continue;
+                if(Dot(Nold, Nnew) <= MIN_FACE_COS * sqrt(Nold.length2() * Nnew.length2()))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    // b goes away and a moves to Pos. A pinned vertex is always a, and keeps its exact position.
+    void Simplifier::DoCollapse(const int a, const int b, const Vector &Pos, const double t)
+    {
+        Q[a] += Q[b];
+        if(!Pinned[a]) {
+            P[a] = Pos;
+            Moved[a] = 1;
+        }
+        if(N.size()) N[a] = Normalized(N[a] + (N[b] - N[a]) * t);
+        if(T.size()) T[a] = T[a] + (T[b] - T[a]) * t;
+        if(C.size()) C[a] = C[a] + (C[b] - C[a]) * t;
+        if(Tan.size()) Tan[a] = Normalized(Tan[a] + (Tan[b] - Tan[a]) * t);
+        OnBoundary[a] = OnBoundary[a] || OnBoundary[b];
+        Stamp[a]++;
+        Stamp[b] = -1;
+
+        for(int i=0; i<(int)VFaces[b].size(); i++) {
+            const int f = VFaces[b][i];
+            if(!FaceAlive[f])
+                continue;
+            if(FaceHas(f, a)) {
+                FaceAlive[f] = 0;
+                nFaces--;
+            } else {
+                for(int k=0; k<3; k++)
+                    if(F[3*f+k] == b)
+                        F[3*f+k] = a;
+                VFaces[a].push_back(f);
+            }
+        }
+        vector<int>().swap(VFaces[b]);
+
+        vector<int> &Fa = VFaces[a];
+        int n = 0;
+        for(int i=0; i<(int)Fa.size(); i++)
+            if(FaceAlive[Fa[i]])
+                Fa[n++] = Fa[i];
+        Fa.resize(n);
+
+        // The edges out of a have new costs.
+        CurMark++;
+        Mark[a] = CurMark;
+        for(int i=0; i<(int)Fa.size(); i++) {
+            for(int k=0; k<3; k++) {
+                const int v = F[3*Fa[i]+k];
+                if(Mark[v] != CurMark) {
+                    Mark[v] = CurMark;
+                    PushEdge(a, v);
+                }
+            }
+        }
+    }
+
+    void Simplifier::Run(const SimplifyTarget &Target)
+    {
+        const double MaxErr = Target.MaxError * Scale * Scale;
+
+        while(nFaces > Target.MaxFaces && !Heap.empty()) {
+            const Collapse Co = Heap.front();
+            if(Stamp[Co.a] != Co.StampA || Stamp[Co.b] != Co.StampB) {
+                pop_heap(Heap.begin(), Heap.end());
+                Heap.pop_back();
+                continue;
+            }
+
+            // Leave it for the next target.
+            if(Co.Cost > MaxErr)
+                break;
+
+            pop_heap(Heap.begin(), Heap.end());
+            Heap.pop_back();
+
+            const int a = Pinned[Co.b] ? Co.b : Co.a, b = Pinned[Co.b] ? Co.a : Co.b;
+            Vector Pos;
+            double t;
+            EdgeCost(a, b, Pos, t);
+            if(!CanCollapse(a, b, Pos))
+                continue;
+
+            DoCollapse(a, b, Pos, t);
+            MaxCost = max(MaxCost, Co.Cost);
+        }
+    }
+
+    void Simplifier::Extract(HalfEdgeMesh &Out) const
+    {
+        *(BaseObject *)&Out = Src;
+        Out.ObjectType = DMC_HALF_EDGE_OBJECT;
+        Out.FacesAreFixed = Src.FacesAreFixed;
+
+        // Renumber the vertices that are still used.
+        const int nV = int(P.size());
+        vector<int> NewInd(nV, -1);
+        int n = 0;
+        for(int f=0; f<(int)FaceAlive.size(); f++)
+            if(FaceAlive[f])
+                for(int k=0; k<3; k++)
+                    NewInd[F[3*f+k]] = 0;
+        for(int v=0; v<nV; v++)
+            if(NewInd[v] == 0)
+                NewInd[v] = n++;
+
+        const double InvScale = 1.0 / Scale;
+        Out.verts.resize(n);
+        Out.normals.resize(N.size() ? n : 0);
+        Out.texcoords.resize(T.size() ? n : 0);
+        Out.dcolors.resize(C.size() ? n : 0);
+        Out.tangents.resize(Tan.size() ? n : 0);
+        for(int v=0; v<nV; v++) {
+            const int i = NewInd[v];
+            if(i < 0)
+                continue;
+            Out.verts[i] = Moved[v] ? P[v] * InvScale + Center : Src.verts[v];
+            if(N.size()) Out.normals[i] = N[v];
+            if(T.size()) Out.texcoords[i] = T[v];
+            if(C.size()) Out.dcolors[i] = C[v];
+            if(Tan.size()) Out.tangents[i] = Tan[v];
+        }
+
+        Out.Indices.clear();
+        Out.Indices.reserve(3 * nFaces);
+        for(int f=0; f<(int)FaceAlive.size(); f++)
+            if(FaceAlive[f])
+                for(int k=0; k<3; k++)
+                    Out.Indices.push_back(NewInd[F[3*f+k]]);
+
+        Out.FaceNormals.clear();
+        Out.VertexCount = n;
+        Out.FaceCount = nFaces;
+        Out.BuildConnectivity();
+        Out.RebuildBBox();
+    }
+};
+
+double SimplifyMesh(HalfEdgeMesh &M, const SimplifyTarget &Target, const double AttribWeight)
+{
+    HalfEdgeMesh Out;
+    Simplifier S(M, AttribWeight);
+    S.Run(Target);
+    S.Extract(Out);
+    M = Out;
+
+    return S.ToMeshUnits(S.MaxCost);
+}
+
+void SimplifyMesh(vector<HalfEdgeMesh> &LODs, vector<double> &Errors, const HalfEdgeMesh &M,
+                  const vector<SimplifyTarget> &Targets, const double AttribWeight)
+{
+    LODs.resize(Targets.size());
+    Errors.resize(Targets.size());
+
+    Simplifier S(M, AttribWeight);
+    for(int i=0; i<(int)Targets.size(); i++) {
+        S.Run(Targets[i]);
+        S.Extract(LODs[i]);
+        Errors[i] = S.ToMeshUnits(S.MaxCost);
+    }
+}
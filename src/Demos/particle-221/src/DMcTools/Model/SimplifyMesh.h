@@ -0,0 +1,57 @@
+//////////////////////////////////////////////////////////////////////
+// SimplifyMesh.h - Simplify a HalfEdgeMesh by quadric error edge collapse.
+//
+// Copyright David K. McAllister, 2008.
+//
+// This is Garland and Heckbert's simplification, with Quadric3. Each
+// vertex gets the sum of the quadrics of the planes of its faces, plus
+// planes perpendicular to its faces along its boundary edges, to hold
+// the boundaries in place. Then the cheapest edge is collapsed to the
+// point that minimizes the sum of the quadrics of its two vertices, over
+// and over, keeping the edges in a heap by cost.
+//
+// Vertices that were split to give them two normals or texcoords leave a
+// seam of boundary edges on each side. The two sides have to stay
+// together, so a vertex with a copy at the same position is pinned. An
+// edge with one pinned vertex collapses onto that one, and an edge with
+// two never collapses. The seams stay exactly as they were.
+//
+// The cost of a collapse is its quadric error, which is the sum of the
+// squared distances to the planes, plus AttribWeight times the squared
+// change in the normals and texcoords of its two vertices times the
+// squared length of the edge, so that the two are in the same units. The
+// new vertex gets the attributes interpolated along the edge. Collapses
+// that would make the mesh non-manifold or fold a face over are skipped.
+
+#ifndef dmc_simplify_mesh_h
+#define dmc_simplify_mesh_h
+
+#include "Model/HalfEdgeMesh.h"
+
+#include <cfloat>
+#include <vector>
+
+// How far to simplify: until there are at most MaxFaces faces, or until
+// the next collapse would cost more than MaxError, whichever comes first.
+// MaxError is in the squared units of the mesh.
+struct SimplifyTarget
+{
+    int MaxFaces;
+    double MaxError;
+
+    DMC_INLINE SimplifyTarget(const int MaxFaces_ = 0, const double MaxError_ = DBL_MAX)
+        : MaxFaces(MaxFaces_), MaxError(MaxError_) {}
+};
+
+// Simplify M to Target. Returns the largest cost of the collapses done.
+// M.Box must be up to date, since it sets the scale of the quadrics.
+double SimplifyMesh(HalfEdgeMesh &M, const SimplifyTarget &Target, const double AttribWeight = 1);
+
+// Make a chain of levels of detail in one pass. LODs[i] is M simplified to
+// Targets[i], and Errors[i] is the largest cost of the collapses that made
+// it. Each level goes on from the one before it, so the targets should go
+// from the most detailed to the least.
+void SimplifyMesh(std::vector<HalfEdgeMesh> &LODs, std::vector<double> &Errors, const HalfEdgeMesh &M,
+                  const std::vector<SimplifyTarget> &Targets, const double AttribWeight = 1);
+
+#endif
@@ -0,0 +1,303 @@
+//////////////////////////////////////////////////////////////////////
+// WeldVertices.cpp - Find which of a list of points are the same vertex.
+//
+// Copyright David K. McAllister, 2008.
+
+#include "Model/WeldVertices.h"
+
+#include <algorithm>
+#include <cstring>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+    const int WELD_PAR_MIN = 1 << 14; // Fewer points than this aren't worth starting threads for.
+
+    typedef unsigned DMCINT64 WeldKey;
+
+    struct KeyIndex
+    {
+        WeldKey Key;
+        int Ind;
+
+        bool operator<(const KeyIndex &B) const { return Key < B.Key || (Key == B.Key && Ind < B.Ind); }
+    };
+
+    // Scramble the bits so that nearby keys land far apart.
+    DMC_INLINE WeldKey Mix(WeldKey h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // The bits of d, with -0 the same as 0 since they compare equal
+    DMC_INLINE WeldKey Bits(double d)
+    {
+        if(d == 0)
+            d = 0;
+        WeldKey b;
+        memcpy(&b, &d, sizeof(b));
+        return b;
+    }
+
+    DMC_INLINE WeldKey PositionKey(const Vector &P)
+    {
+        return Mix(Bits(P.x) ^ Mix(Bits(P.y) ^ Mix(Bits(P.z))));
+    }
+
+    // Cells of the spatial hash. The coordinates wrap around at 2^21, which only puts far apart points in the same
+    // cell, where the distance test skips them.
+    const WeldKey CELL_MASK = (WeldKey(1) << 21) - 1;
+
+    DMC_INLINE DMCINT64 CellCoord(const double c, const double InvEps)
+    {
+        const double f = floor(c * InvEps);
+        const double Lim = 4e18;
+        if(!(f > -Lim)) // Also NaN
+            return (DMCINT64)-Lim;
+        return (DMCINT64)(f > Lim ? Lim : f);
+    }
+
+    DMC_INLINE WeldKey CellKey(const DMCINT64 x, const DMCINT64 y, const DMCINT64 z)
+    {
+        return (WeldKey(x) & CELL_MASK) | ((WeldKey(y) & CELL_MASK) << 21) | ((WeldKey(z) & CELL_MASK) << 42);
+    }
+
+    // Sort equal parts in parallel, then merge pairs of them.
+    void ParallelSort(vector<KeyIndex> &A, const bool Parallel)
+    {
+        const int n = int(A.size());
+        int nParts = 1;
+#ifdef _OPENMP
+        if(Parallel && n > WELD_PAR_MIN)
+            nParts = omp_get_max_threads();
+#endif
+        if(nParts <= 1) {
+            sort(A.begin(), A.end());
+            return;
+        }
+
+        vector<int> Bound(nParts + 1);
+        for(int p=0; p<=nParts; p++)
+            Bound[p] = int((DMCINT64)n * p / nParts);
+
+#pragma omp parallel for schedule(static)
+        for(int p=0; p<nParts; p++)
+            sort(A.begin() + Bound[p], A.begin() + Bound[p+1]);
+
+        for(int w=1; w<nParts; w*=2) {
+            const int nMerges = (nParts + 2*w - 1) / (2*w);
+#pragma omp parallel for schedule(static)
+            for(int m=0; m<nMerges; m++) {
+                const int p = m * 2 * w;
+                if(p + w < nParts)
+                    inplace_merge(A.begin() + Bound[p], A.begin() + Bound[p+w], A.begin() + Bound[min(p + 2*w, nParts)]);
+            }
+        }
+    }
+
+    // A hash table from a cell key to where its run starts in the sorted cells.
+    class CellTable
+    {
+        const vector<KeyIndex> &C;
+        vector<int> Slots;
+        WeldKey Mask;
+
+    public:
+        CellTable(const vector<KeyIndex> &C_) : C(C_)
+        {
+            size_t nCells = 0;
+            for(size_t k=0; k<C.size(); k++)
+                if(k == 0 || C[k].Key != C[k-1].Key)
+                    nCells++;
+
+            size_t sz = 16;
+            while(sz < nCells * 2)
+                sz *= 2;
+            Slots.assign(sz, -1);
+            Mask = sz - 1;
+
+            for(size_t k=0; k<C.size(); k++) {
+                if(k > 0 && C[k].Key == C[k-1].Key)
+                    continue;
+                WeldKey s = Mix(C[k].Key) & Mask;
+                while(Slots[s] >= 0)
+                    s = (s + 1) & Mask;
+                Slots[s] = int(k);
+            }
+        }
+
+        // The start of the cell's run in C, or -1 if it is empty
+        int Find(const WeldKey Key) const
+        {
+            for(WeldKey s = Mix(Key) & Mask; Slots[s] >= 0; s = (s + 1) & Mask)
+                if(C[Slots[s]].Key == Key)
+                    return Slots[s];
+            return -1;
+        }
+    };
+
+    // Calls Near(w) for each point w of U before u that is within Eps of point u. Returns how many there were.
+    template<class Near_T>
+    int ForNearPoints(const int u, const vector<int> &U, const vector<Vector> &Pts, const vector<KeyIndex> &C,
+                      const CellTable &Table, const double Eps, Near_T &Near)
+    {
+        const double InvEps = 1.0 / Eps, Eps2 = Eps * Eps;
+        const Vector &P = Pts[U[u]];
+        const DMCINT64 cx = CellCoord(P.x, InvEps), cy = CellCoord(P.y, InvEps), cz = CellCoord(P.z, InvEps);
+
+        int cnt = 0;
+        for(int dz=-1; dz<=1; dz++) {
+            for(int dy=-1; dy<=1; dy++) {
+                for(int dx=-1; dx<=1; dx++) {
+                    const WeldKey Key = CellKey(cx + dx, cy + dy, cz + dz);
+                    const int k0 = Table.Find(Key);
+                    if(k0 < 0)
+                        continue;
+                    // The run is sorted by point, so stop at u.
+                    for(int k=k0; k<(int)C.size() && C[k].Key == Key && C[k].Ind < u; k++) {
+                        if(VecEq(Pts[U[C[k].Ind]], P, Eps2)) {
+                            Near(C[k].Ind);
+                            cnt++;
+                        }
+                    }
+                }
+            }
+        }
+
+        return cnt;
+    }
+
+    struct NoOp
+    {
+        void operator()(const int w) {}
+    };
+
+    struct AppendTo
+    {
+        int *Out;
+        AppendTo(int *Out_) : Out(Out_) {}
+        void operator()(const int w) { *Out++ = w; }
+    };
+};
+
+void WeldVertices(vector<int> &Remap, vector<int> &FirstIndex, const vector<Vector> &Pts, const double Eps, const bool Parallel)
+{
+    const int n = int(Pts.size());
+    const bool Par = Parallel && n > WELD_PAR_MIN;
+
+    // Points at exactly the same position have the same key, and are sorted by index within the key.
+    vector<KeyIndex> K(n);
+#pragma omp parallel for schedule(static) if(Par)
+    for(int i=0; i<n; i++) {
+        K[i].Key = PositionKey(Pts[i]);
+        K[i].Ind = i;
+    }
+    ParallelSort(K, Par);
+
+    // Same[i] is the first point at exactly the same position as point i.
+    // Different positions can have the same key, so compare the points in each run of a key.
+    vector<int> Same(n);
+#pragma omp parallel for schedule(static) if(Par)
+    for(int k=0; k<n; k++) {
+        if(k > 0 && K[k].Key == K[k-1].Key)
+            continue;
+        int k1 = k + 1;
+        while(k1 < n && K[k1].Key == K[k].Key)
+            k1++;
+
+        for(int a=k; a<k1; a++) {
+            const int i = K[a].Ind;
+            Same[i] = i;
+            for(int b=k; b<a; b++) {
+                if(Pts[K[b].Ind] == Pts[i]) {
+                    Same[i] = Same[K[b].Ind];
+                    break;
+                }
+            }
+        }
+    }
+    vector<KeyIndex>().swap(K);
+
+    // The distinct positions, in order
+    vector<int> U, UInd(n);
+    for(int i=0; i<n; i++) {
+        if(Same[i] == i) {
+            UInd[i] = int(U.size());
+            U.push_back(i);
+        }
+    }
+    const int m = int(U.size());
+
+    // Rep[u] is the distinct position that u becomes.
+    vector<int> Rep(m);
+    for(int u=0; u<m; u++)
+        Rep[u] = u;
+
+    if(Eps > 0 && m > 1) {
+        const double InvEps = 1.0 / Eps;
+        vector<KeyIndex> C(m);
+#pragma omp parallel for schedule(static) if(Par)
+        for(int u=0; u<m; u++) {
+            const Vector &P = Pts[U[u]];
+            C[u].Key = CellKey(CellCoord(P.x, InvEps), CellCoord(P.y, InvEps), CellCoord(P.z, InvEps));
+            C[u].Ind = u;
+        }
+        ParallelSort(C, Par);
+        CellTable Table(C);
+
+        // The lists of earlier near points, counted and then filled
+        vector<int> Start(m + 1, 0);
+#pragma omp parallel for schedule(dynamic, 1024) if(Par)
+        for(int u=0; u<m; u++) {
+            NoOp Count;
+            Start[u+1] = ForNearPoints(u, U, Pts, C, Table, Eps, Count);
+        }
+        for(int u=0; u<m; u++)
+            Start[u+1] += Start[u];
+
+        vector<int> Near(Start[m]);
+        if(Start[m]) {
+#pragma omp parallel for schedule(dynamic, 1024) if(Par)
+            for(int u=0; u<m; u++) {
+                if(Start[u+1] == Start[u])
+                    continue;
+                AppendTo Fill(&Near[Start[u]]);
+                ForNearPoints(u, U, Pts, C, Table, Eps, Fill);
+                sort(Near.begin() + Start[u], Near.begin() + Start[u+1]);
+            }
+
+            // Each point becomes the first of its near points that is still a vertex.
+            for(int u=0; u<m; u++) {
+                for(int k=Start[u]; k<Start[u+1]; k++) {
+                    if(Rep[Near[k]] == Near[k]) {
+                        Rep[u] = Near[k];
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // Number the vertices.
+    vector<int> VertOf(m);
+    FirstIndex.clear();
+    for(int u=0; u<m; u++) {
+        if(Rep[u] == u) {
+            VertOf[u] = int(FirstIndex.size());
+            FirstIndex.push_back(U[u]);
+        }
+    }
+
+    Remap.resize(n);
+#pragma omp parallel for schedule(static) if(Par)
+    for(int i=0; i<n; i++)
+        Remap[i] = VertOf[Rep[UInd[Same[i]]]];
+}
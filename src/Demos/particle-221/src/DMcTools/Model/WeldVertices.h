@@ -0,0 +1,32 @@
+//////////////////////////////////////////////////////////////////////
+// WeldVertices.h - Find which of a list of points are the same vertex.
+//
+// Copyright David K. McAllister, 2008.
+//
+// This is the welding step of making a mesh out of separate triangles.
+// Each point becomes the first earlier vertex that it is within Eps of,
+// or if there is none, a new vertex. This is the same as adding the
+// points one at a time, but isn't done that way.
+//
+// Points at exactly the same position are found first by sorting them by
+// a hash of their bits. If Eps > 0, the distinct positions are then put
+// in a spatial hash with cells Eps wide, so that the points near each one
+// are in the 27 cells around it. The hashing, sorting, and searching are
+// done in parallel. Only the final pass that picks the vertex each point
+// becomes is serial, and it only looks at the lists of near points.
+
+#ifndef dmc_weld_vertices_h
+#define dmc_weld_vertices_h
+
+#include "Math/Vector.h"
+
+#include <vector>
+
+// Remap gets the vertex that each point becomes. The vertices are
+// numbered in the order that they first appear in Pts. FirstIndex gets
+// the point that each vertex came from, which is the first point that
+// became it, so FirstIndex.size() is the number of vertices.
+void WeldVertices(std::vector<int> &Remap, std::vector<int> &FirstIndex, const std::vector<Vector> &Pts,
+                  const double Eps = 0, const bool Parallel = true);
+
+#endif
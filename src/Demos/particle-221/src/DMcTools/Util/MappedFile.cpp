@@ -0,0 +1,107 @@
+//////////////////////////////////////////////////////////////////////
+// MappedFile.cpp - Map a whole file into memory, read-only.
+//
+// Copyright David K. McAllister, 2008.
+
+#include "toolconfig.h"
+#include "Util/MappedFile.h"
+#include "Util/Assert.h"
+
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // Read the file the old way, for when it can't be mapped.
+    unsigned char *ReadWholeFile(const char *fname, size_t &Size)
+    {
+        FILE *fp = fopen(fname, "rb");
+        if(!fp) throw DMcError("Failed to open file '" + std::string(fname) + "'");
+
+        std::string Buf;
+        char Chunk[65536];
+        size_t n;
+        while((n = fread(Chunk, 1, sizeof(Chunk), fp)) > 0)
+            Buf.append(Chunk, n);
+        fclose(fp);
+
+        Size = Buf.size();
+        unsigned char *D = new unsigned char[Size + 1];
+        Buf.copy((char *)D, Size);
+        return D;
+    }
+};
+
+MappedFile::MappedFile(const char *fname)
+{
+    ASSERT_R(fname);
+    Data = NULL;
+    Size = 0;
+    Mapped = false;
+
+#ifdef _WIN32
+    FileH = MapH = NULL;
+    HANDLE F = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(F == INVALID_HANDLE_VALUE) throw DMcError("Failed to open file '" + std::string(fname) + "'");
+
+    LARGE_INTEGER FSize;
+    if(GetFileSizeEx(F, &FSize) && FSize.QuadPart > 0) {
+        HANDLE M = CreateFileMappingA(F, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(M) {
+            Data = (const unsigned char *)MapViewOfFile(M, FILE_MAP_READ, 0, 0, 0);
+            if(Data) {
+                Size = size_t(FSize.QuadPart);
+                Mapped = true;
+                FileH = F;
+                MapH = M;
+                return;
+            }
+            CloseHandle(M);
+        }
+    }
+    CloseHandle(F);
+#else
+    int fd = open(fname, O_RDONLY);
+    if(fd < 0) throw DMcError("Failed to open file '" + std::string(fname) + "'");
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *M = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if(M != MAP_FAILED) {
+            // The loaders read front to back, so have the OS read ahead.
+            madvise(M, size_t(st.st_size), MADV_SEQUENTIAL);
+            Data = (const unsigned char *)M;
+            Size = size_t(st.st_size);
+            Mapped = true;
+        }
+    }
+    close(fd); // The mapping stays valid.
+    if(Mapped) return;
+#endif
+
+    Data = ReadWholeFile(fname, Size);
+}
+
+MappedFile::~MappedFile()
+{
+    if(!Mapped) {
+        delete [] Data;
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(Data);
+    CloseHandle((HANDLE)MapH);
+    CloseHandle((HANDLE)FileH);
+#else
+    munmap((void *)Data, Size);
+#endif
+}
@@ -0,0 +1,40 @@
+//////////////////////////////////////////////////////////////////////
+// MappedFile.h - Map a whole file into memory, read-only.
+//
+// Copyright David K. McAllister, 2008.
+
+// The loaders of uncompressed and run-length encoded images parse straight out of the mapped bytes
+// instead of reading the file through stdio into a buffer. The OS pages the file in as it's touched,
+// and nothing is copied until the pixels land in the tImage. LoadOBJ and LoadMTL parse text models
+// out of the mapped bytes the same way, with LoadOBJ splitting them into chunks for its threads.
+
+#ifndef dmc_mappedfile_h
+#define dmc_mappedfile_h
+
+#include <cstddef>
+
+class MappedFile
+{
+    const unsigned char *Data; // The first byte of the file.
+    size_t Size; // In bytes.
+    bool Mapped; // False if Data is a new [] buffer because the file couldn't be mapped.
+#ifdef _WIN32
+    void *FileH, *MapH;
+#endif
+
+    // Not copyable.
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+public:
+    // Map the file. Throws a DMcError if it can't be opened.
+    // Files that can't be mapped, like empty files and pipes, are read into memory instead.
+    MappedFile(const char *fname);
+    ~MappedFile();
+
+    const unsigned char *data() const { return Data; }
+    const unsigned char *end() const { return Data + Size; }
+    size_t size() const { return Size; }
+};
+
+#endif
@@ -19,15 +19,7 @@
 #endif
 
 #if defined(DMC_MACHINE_gcc)
-#include <sys/times.h>
-#include <limits.h>
-#include <unistd.h>
-
-#ifdef CLK_TCK
-static double clock_interval = 1./double(CLK_TCK);
-#else
-static double clock_interval = 1./double(CLOCKS_PER_SEC);
-#endif
+#include <sys/time.h>
 #endif
 
 #ifdef DMC_USE_PENTIUM_TIMER
@@ -82,10 +74,12 @@ double Timer::GetCurTime()
 
 #elif defined(DMC_MACHINE_gcc)
 
+// times() counts in sysconf(_SC_CLK_TCK) ticks, not CLOCKS_PER_SEC, so use gettimeofday(), which is also finer.
 double Timer::GetCurTime()
 {
-    struct tms buffer;
-    double dtime=double(times(&buffer)) * clock_interval;
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    double dtime = double(tv.tv_sec) + double(tv.tv_usec) * 0.000001;
     return dtime;
 }
 
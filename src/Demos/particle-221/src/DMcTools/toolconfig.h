@@ -46,4 +46,14 @@
 
 #endif
 
+// Use SSE2 intrinsics for f4Pixel, uc4Pixel, and the row kernels if the compiler is generating SSE2 code.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DMC_USE_SSE
+#endif
+
+// Use the F16C instructions to convert between half and float if the compiler is generating them. Every CPU with AVX2 has them.
+#if defined(DMC_USE_SSE) && (defined(__F16C__) || defined(__AVX2__))
+#define DMC_USE_F16C
+#endif
+
 #endif
@@ -79,6 +79,7 @@ int ParticleEffects::CallDemo(int DemoNum, bool FirstTime, bool Immediate)
     case 21: Waterfall1(FirstTime, Immediate); break;
     case 22: Sphere(FirstTime, Immediate); break;
     case 23: Experimental(FirstTime, Immediate); break;
+    case 24: Pool(FirstTime, Immediate); break;
     default:
         while(DemoNum < 0) DemoNum+= NumEffects;
         return CallDemo(DemoNum % NumEffects, FirstTime, Immediate);
@@ -603,6 +604,50 @@ void ParticleEffects::Orbit2(bool FirstTime, bool Immediate)
     }
 }
 
+// Water pouring into a pool, simulated as a fluid
+void ParticleEffects::Pool(bool FirstTime, bool Immediate)
+{
+    P.Velocity(PDBlob(pVec(0.02, 0, -0.05), 0.01));
+    P.Color(PDLine(pVec(0.1, 0.3, 0.9), pVec(0.6, 0.8, 1.0)));
+    P.Size(1.5);
+    P.StartingAge(0);
+
+    if(FirstTime) {
+        EffectName = "Pool";
+        ChangesEachFrame = false;
+        P.NewActionList(action_handle);
+    }
+
+    // Make the pool big enough that all the particles fill it about three units deep.
+    // At rest there are about 12 particles per unit volume.
+    float W = sqrtf(maxParticles / (4.0f * 12.0f * 3.0f));
+    if(W < 3.0f) W = 3.0f;
+
+    P.Source(maxParticles / 400.0f, PDDisc(pVec(-0.5f * W, 0, 7), pVec(0, 0, 1), 0.6));
+
+    P.Gravity(GravityVec);
+
+    // The particles are about half a unit apart, so the radius is twice that.
+    P.FluidDensity(1.0f);
+    P.FluidPressure(1.0f, 8.0f, 0.3f);
+    P.FluidViscosity(1.0f, 0.3f);
+
+    // The floor and walls of the pool
+    P.Bounce(0, 0.2, 0, PDPlane(pVec(0, 0, 0), pVec(0, 0, 1)));
+    P.Bounce(0, 0.2, 0, PDPlane(pVec(-W, 0, 0), pVec(1, 0, 0)));
+    P.Bounce(0, 0.2, 0, PDPlane(pVec(W, 0, 0), pVec(-1, 0, 0)));
+    P.Bounce(0, 0.2, 0, PDPlane(pVec(0, -W, 0), pVec(0, 1, 0)));
+    P.Bounce(0, 0.2, 0, PDPlane(pVec(0, W, 0), pVec(0, -1, 0)));
+
+    P.Move(true, false);
+
+    // Anything that gets out of the pool falls off the edge of the world.
+    P.Sink(false, PDBox(pVec(-W - 1, -W - 1, -1), pVec(W + 1, W + 1, 20)));
+
+    if(FirstTime)
+        P.EndActionList();
+}
+
 // It kinda looks like rain hitting a parking lot
 void ParticleEffects::Rain(bool FirstTime, bool Immediate)
 {
@@ -19,7 +19,7 @@ private:
     void MakeFakeImage();
 
 public:
-    static const int NumEffects = 24;
+    static const int NumEffects = 25;
 
     int maxParticles; // The number of particles the app wants in this demo
     int numSteps; // The number of simulation time steps per rendered frame
@@ -74,6 +74,9 @@ public:
     // A bunch of particles in the shape of a photo
     void PhotoShape(bool FirstTime, bool Immediate);
 
+    // Water pouring into a pool, simulated as a fluid
+    void Pool(bool FirstTime, bool Immediate);
+
     // It kinda looks like rain hitting a parking lot
     void Rain(bool FirstTime, bool Immediate);
 
@@ -27,6 +27,9 @@ namespace PAPI {
     /// This is the type of the particle death callback function that you can register.
     typedef void (*P_PARTICLE_CALLBACK)(struct Particle_t &particle, puint64 data);
 
+    /// This is the type of the deferred particle birth and death callback functions that you can register.
+    typedef void (*P_PARTICLE_SPAN_CALLBACK)(struct Particle_t *particles, size_t count, puint64 data);
+
     class PInternalState_t; // The API-internal struct containing the context's state. Don't try to use it.
     class PInternalSourceState_t; // The API-internal struct containing the context's source state. Don't try to use it.
 
@@ -420,6 +423,23 @@ namespace PAPI {
             size_t &mass1Ofs, ///< the number of floats from returned ptr to the first particle's mass parameter
             size_t &data1Ofs ///< the number of floats from returned ptr to the first particle's data parameter, which is a 64-bit integer, not a float
         );
+        /// Return a pointer to the trail positions stored in API memory.
+        ///
+        /// Trails must first be enabled with TrailLength(). Each particle slot owns stride consecutive positions of three floats each. The trail
+        /// of particle i, oldest position first, is the count[i] positions that end at position i * stride + newest. So the first vertex of
+        /// particle i's trail is i * stride + newest + 1 - count[i], and the trail can be drawn directly as a line strip of count[i] vertices
+        /// starting there, for example with glMultiDrawArrays(). A ribbon can be made by offsetting each vertex perpendicular to the view
+        /// direction, or by computing the offsets in a vertex shader.
+        ///
+        /// The returned pointers are only valid until the next action or call that changes the group. Writing to the returned memory is unsafe.
+        ///
+        /// Returns the number of particles in the group, which is the number of valid entries in count.
+        size_t GetTrailPointer(float *&position, ///< the returned pointer to the trail positions
+            unsigned int *&count, ///< the returned pointer to the number of positions in each particle's trail
+            size_t &stride, ///< the number of positions from one particle's trail storage to the next
+            size_t &newest ///< the index within each particle's trail storage of its newest position
+            );
+
 
         /// Change the maximum number of particles in the current group.
         ///
@@ -427,6 +447,14 @@ namespace PAPI {
         /// The DeathCallback() of deleted particles WILL be called.
         /// Call SetMaxParticles(0) to empty the group.
         void SetMaxParticles(const size_t max_count);
+        /// Remember the recent positions of each particle in the current group.
+        ///
+        /// After this call each Move() action records the new position of every particle in the current group in a ring buffer of the last
+        /// length positions of that particle. Use GetTrailPointer() to draw the trails as line strips or ribbons. This is much cheaper than
+        /// making a new particle for each trail segment, and it doesn't make the particles themselves bigger. The trails of particles that are
+        /// created after this call start out empty. Calling TrailLength() empties all trails. Call TrailLength(0) to turn trails off.
+        void TrailLength(const size_t length);
+
 
         /// Specify a particle creation callback.
         ///
@@ -452,6 +480,29 @@ namespace PAPI {
             puint64 group_data = 0 ///< Arbitrary per-group data of yours to pass into your function
             );
 
+        /// Specify a deferred particle creation callback.
+        ///
+        /// Like BirthCallback(), but instead of being called in the middle of the actions for each particle, your function is called after the
+        /// action list finishes (or after an action in immediate mode) with arrays of copies of all the particles that were created. It may be
+        /// called several times per action list, with one array per thread that created particles. This is much faster than BirthCallback()
+        /// when many particles are created, and lets the actions run without stopping for your code.
+        ///
+        /// The copies reflect each particle as it was created, so changing them doesn't change the particles in the group. Use BirthCallback()
+        /// if you need to modify new particles. You can use both kinds of callback on the same group. Pass NULL to turn it off.
+        void BirthSpanCallback(P_PARTICLE_SPAN_CALLBACK callback, ///< Pointer to function of yours to call
+            puint64 group_data = 0 ///< Arbitrary per-group data of yours to pass into your function
+            );
+
+        /// Specify a deferred particle death callback.
+        ///
+        /// Like DeathCallback(), but instead of being called in the middle of the actions for each particle, your function is called after the
+        /// action list finishes (or after an action in immediate mode) with arrays of copies of all the particles that were killed, as they were
+        /// when they died. It may be called several times per action list, with one array per thread that killed particles. This is the fast
+        /// way to spawn sounds or decals where particles die. Pass NULL to turn it off.
+        void DeathSpanCallback(P_PARTICLE_SPAN_CALLBACK callback, ///< Pointer to function of yours to call
+            puint64 group_data = 0 ///< Arbitrary per-group data of yours to pass into your function
+            );
+
         /// Set the number of particles that fit in the CPU's cache
         ///
         /// You probably don't need to call this function. It is the number of bytes in the working set. Most action lists apply several actions to
@@ -536,11 +587,42 @@ namespace PAPI {
             puint64 call_data = 0 ///< Arbitrary data of yours to pass into your function
             );
 
+        /// Collide particles with each other.
+        ///
+        /// Each particle is treated as a sphere whose diameter is the x component of its size. Particles that overlap are pushed apart and, if
+        /// they are approaching each other, they bounce off each other. The particle masses are used in the collision response; a particle with
+        /// zero mass is immovable. This is useful for granular effects like sand and debris.
+        ///
+        /// The particles are binned into a grid whose cells are the size of the largest particle, so only nearby particles are tested
+        /// against each other. This works best when the particles are of similar size. Contacts are resolved one pair at a time, so a
+        /// tightly packed pile may need a few Collide() actions per time step to fully separate.
+        ///
+        /// This action must be applied to the whole particle group at once.
+        void Collide(const float resilience = 0.5f, ///< The normal component of the relative velocity of two colliding particles is reflected and scaled by resilience. Use 1 for perfectly elastic collisions and 0 for inelastic ones.
+            const bool parallel = true ///< If true and the library was built with OpenMP, grid cells are processed by multiple threads. Set this to false when calling from several threads of your own.
+            );
+
         /// Set the secondary position and velocity from current.
         void CopyVertexB(const bool copy_pos = true, ///< If true, sets the PositionB of each particle to the current position of that particle. This makes each particle remember this position so it can later return to it using the Restore() action.
             const bool copy_vel = false ///< If true, sets the velocityB of each particle to the current velocity of that particle. This can be useful for computing the orientation of the particle by copying a particle's velocity at the beginning of each time step. Then when drawing a particle, the cross-product velocity and velocityB yields a tangent vector.
             );
 
+        /// Accelerate particles along a swirling, divergence-free noise field.
+        ///
+        /// This is a smoother alternative to RandomAccel() for smoke and other turbulent effects. The acceleration comes from the curl of a
+        /// smooth noise field, so neighboring particles are pushed in similar directions and particles neither clump together nor spread apart.
+        /// The noise is precomputed once per context into a small volume that tiles throughout space, so the cost per particle is one
+        /// trilinear lookup.
+        ///
+        /// The field is translated by offset. If scroll is nonzero the offset advances by scroll * dt each time the action executes, which
+        /// makes the turbulence evolve over time. Within an action list this happens automatically. In immediate mode a new action is
+        /// created on each call, so it is up to the application to advance offset.
+        void CurlNoise(const float magnitude, ///< scales each particle's acceleration. The field has unit root-mean-square magnitude.
+            const float feature_size = 1.0f, ///< the distance between swirls of the coarsest octave of the noise
+            const pVec &offset = pVec(0.0f), ///< translation of the noise field
+            const pVec &scroll = pVec(0.0f) ///< velocity at which the noise field is translated over time
+            );
+
         /// Simulate air by dampening particle velocities.
         ///
         /// If a particle's velocity magnitude is within vlow and vhigh, then multiply each component of the velocity by the respective damping constant.
@@ -577,6 +659,49 @@ namespace PAPI {
             const float epsilon = P_EPS ///< The amount of acceleration falls off inversely with the squared distance to the edge of the domain. But when that distance is small, the acceleration would be infinite, so epsilon is always added to the distance.
             );
 
+        /// Compute the density of a fluid at each particle.
+        ///
+        /// This is the first of the fluid actions, which simulate a liquid using smoothed particle hydrodynamics (SPH). Each particle is a
+        /// blob of fluid with the particle's mass. The density at each particle is the sum of the masses of the particles within radius of it,
+        /// weighted by a smooth kernel. The result is stored in each particle's tmp0 field, where FluidPressure(), FluidViscosity() and
+        /// FluidSurfaceTension() use it. So FluidDensity() should come first, and it needs to be called each time step after the particles
+        /// move. Don't put Sort() between FluidDensity() and the other fluid actions because Sort() also uses tmp0.
+        ///
+        /// A typical action list is Gravity(), FluidDensity(), FluidPressure(), FluidViscosity(), then Bounce() for the container, then Move().
+        /// The same radius should be used for all of the fluid actions. It should be about twice the spacing of the particles in the fluid
+        /// at rest. The rest density of that fluid is roughly the particle mass divided by the cube of the spacing.
+        ///
+        /// The fluid actions use a grid to find each particle's neighbors and use multiple threads if the library was built with OpenMP.
+        /// They must be applied to the whole particle group at once.
+        void FluidDensity(const float radius ///< the smoothing radius. Only particles this close to each other interact.
+            );
+
+        /// Push fluid particles apart where the fluid is compressed.
+        ///
+        /// The pressure at each particle is stiffness times how much its density, as computed by FluidDensity(), exceeds rest_density. The
+        /// pressure is never negative, so particles at the free surface of the fluid don't clump together. The pressure gradient accelerates
+        /// the particles. Stiffer fluids are less compressible but need smaller time steps to stay stable.
+        void FluidPressure(const float radius, ///< the smoothing radius. Use the same radius as in FluidDensity().
+            const float rest_density, ///< the density at which the fluid is at rest and the pressure is zero
+            const float stiffness ///< how much pressure results from each unit of density above rest_density
+            );
+
+        /// Pull neighboring fluid particles together.
+        ///
+        /// This is a cohesion force between each pair of particles within radius of each other, scaled by their masses. It makes the fluid
+        /// form drops and keeps the surface of a pool smooth.
+        void FluidSurfaceTension(const float radius, ///< the smoothing radius. Use the same radius as in FluidDensity().
+            const float tension ///< scales the acceleration
+            );
+
+        /// Smooth out the velocities of neighboring fluid particles.
+        ///
+        /// Each particle's velocity is accelerated toward the velocities of the particles within radius of it. This makes the fluid flow
+        /// smoothly and damps sloshing. Large values need smaller time steps to stay stable. Uses the densities from FluidDensity().
+        void FluidViscosity(const float radius, ///< the smoothing radius. Use the same radius as in FluidDensity().
+            const float viscosity ///< scales the acceleration
+            );
+
         /// Accelerate toward the next particle in the list.
         ///
         /// This allows snaky effects where the particles follow each other. Each particle is accelerated toward the next particle in the group.
@@ -576,6 +576,122 @@ namespace PAPI {
         }
     }
 
+    // Resolve contact between two overlapping spheres. Each particle's diameter is its size.x().
+    static inline void CollidePair(Particle_t &a, Particle_t &b, const float resilience)
+    {
+        pVec d(b.pos - a.pos);
+        float r = 0.5f * (fabsf(a.size.x()) + fabsf(b.size.x()));
+        float dist2 = d.length2();
+
+        // Coincident particles have no contact normal, so leave them alone.
+        if(dist2 >= r * r || dist2 <= 0.0f)
+            return;
+
+        // A massless particle is treated as immovable.
+        float invMa = a.mass > 0.0f ? 1.0f / a.mass : 0.0f;
+        float invMb = b.mass > 0.0f ? 1.0f / b.mass : 0.0f;
+        float invMsum = invMa + invMb;
+        if(invMsum <= 0.0f)
+            return;
+
+        float dist = sqrtf(dist2);
+        pVec n(d / dist);
+
+        // Push them apart so they no longer overlap, in inverse proportion to mass.
+        float pen = (r - dist) / invMsum;
+        a.pos -= n * (pen * invMa);
+        b.pos += n * (pen * invMb);
+
+        // If they are approaching, exchange momentum along the contact normal.
+        float vn = dot(b.vel - a.vel, n);
+        if(vn < 0.0f) {
+            float j = -(1.0f + resilience) * vn / invMsum;
+            a.vel -= n * (j * invMa);
+            b.vel += n * (j * invMb);
+        }
+    }
+
+    // Collide the particles in this cell with each other and with those in the
+    // 13 neighboring cells that come after it, so each pair is visited once.
+    void PACollide::CollideCell(Particle_t *P, const int cx, const int cy, const int cz)
+    {
+        static const int Fwd[13][3] = {
+            {1,0,0}, {-1,1,0}, {0,1,0}, {1,1,0},
+            {-1,-1,1}, {0,-1,1}, {1,-1,1}, {-1,0,1}, {0,0,1}, {1,0,1}, {-1,1,1}, {0,1,1}, {1,1,1}
+        };
+
+        const int *Dims = Grid.Dims;
+        const int *CellParticles = &Grid.CellParticles[0];
+
+        int c = Grid.CellIndex(cx, cy, cz);
+        int ib = Grid.CellStart[c], ie = Grid.CellStart[c+1];
+        if(ib == ie)
+            return;
+
+        for(int a = ib; a < ie; a++)
+            for(int b = a + 1; b < ie; b++)
+                CollidePair(P[CellParticles[a]], P[CellParticles[b]], resilience);
+
+        for(int f = 0; f < 13; f++) {
+            int nx = cx + Fwd[f][0], ny = cy + Fwd[f][1], nz = cz + Fwd[f][2];
+            if(nx < 0 || nx >= Dims[0] || ny < 0 || ny >= Dims[1] || nz >= Dims[2])
+                continue;
+
+            int nc = Grid.CellIndex(nx, ny, nz);
+            int jb = Grid.CellStart[nc], je = Grid.CellStart[nc+1];
+
+            for(int a = ib; a < ie; a++)
+                for(int b = jb; b < je; b++)
+                    CollidePair(P[CellParticles[a]], P[CellParticles[b]], resilience);
+        }
+    }
+
+    // Inter-particle collision. The particles are binned into a uniform grid whose cells are as wide as the
+    // largest particle, so all contacts of a particle are within the 3x3x3 block of cells around it.
+    void PACollide::Execute(ParticleGroup &group, ParticleList::iterator ibegin, ParticleList::iterator iend)
+    {
+        PASSERT(ibegin == group.begin() && iend == group.end(), "Can only be done on whole list");
+
+        int n = int(group.size());
+        if(n < 2)
+            return;
+
+        Particle_t *P = &(*ibegin);
+
+        // Find the largest diameter.
+        float cell = 0.0f;
+        for(int i = 0; i < n; i++)
+            cell = std::max(cell, fabsf(P[i].size.x()));
+
+        if(cell <= 0.0f)
+            return;
+
+        Grid.Build(P, n, cell);
+        const int *Dims = Grid.Dims;
+
+        if(parallel) {
+            // A cell writes only to particles in itself and its immediate neighbors. Cells whose coordinates are
+            // equal mod 3 on every axis are at least three cells apart on some axis, so they can be processed
+            // concurrently without races. Doing the 27 such colors in turn visits every cell.
+            for(int color = 0; color < 27; color++) {
+                int ox = color % 3, oy = (color / 3) % 3, oz = color / 9;
+                int nx = (Dims[0] - ox + 2) / 3, ny = (Dims[1] - oy + 2) / 3, nz = (Dims[2] - oz + 2) / 3;
+                int ncolor = nx * ny * nz;
+
+#pragma omp parallel for schedule(dynamic, 64)
+                for(int k = 0; k < ncolor; k++) {
+                    int cx = ox + 3 * (k % nx), cy = oy + 3 * ((k / nx) % ny), cz = oz + 3 * (k / (nx * ny));
+                    CollideCell(P, cx, cy, cz);
+                }
+            }
+        } else {
+            for(int cz = 0; cz < Dims[2]; cz++)
+                for(int cy = 0; cy < Dims[1]; cy++)
+                    for(int cx = 0; cx < Dims[0]; cx++)
+                        CollideCell(P, cx, cy, cz);
+        }
+    }
+
     // Set the secondary position and velocity from current.
     void PACopyVertexB::Execute(ParticleGroup &group, ParticleList::iterator ibegin, ParticleList::iterator iend)
     {
@@ -600,6 +716,29 @@ namespace PAPI {
         }
     }
 
+    // Accelerate particles along a divergence-free noise field
+    void PACurlNoise::Execute(ParticleGroup &group, ParticleList::iterator ibegin, ParticleList::iterator iend)
+    {
+        PNoiseVolume_t &Vol = PS->CurlNoiseVol;
+        if(!Vol.IsBuilt())
+            Vol.Build();
+
+        float magdt = magnitude * dt;
+        float latScale = Vol.LatticeScale(feature_size);
+        pVec latOfs = offset * latScale;
+
+        for (ParticleList::iterator it = ibegin; it != iend; it++) {
+            Particle_t &m = (*it);
+
+            // Step velocity with acceleration
+            m.vel += Vol.Sample(m.pos * latScale + latOfs) * magdt;
+        }
+
+        // Scroll the field once per time step, after the last working set.
+        if(iend == group.end())
+            offset += scroll * dt;
+    }
+
     // Dampen velocities
     void PADamping::Execute(ParticleGroup &group, ParticleList::iterator ibegin, ParticleList::iterator iend)
     {
@@ -658,6 +797,217 @@ namespace PAPI {
         }
     }
 
+    // The fluid actions are smoothed particle hydrodynamics, using the kernels of Muller et al.,
+    // "Particle-Based Fluid Simulation for Interactive Applications", SCA 2003. FluidDensity() stores
+    // each particle's density in tmp0 for the other fluid actions to use. Each particle gathers
+    // from its neighbors and writes only itself, so the particles can be processed in parallel.
+    // The loops run in grid order, with a being a particle's index in the grid's sorted arrays.
+    // The poly6 kernels are cheap enough that clamping them to zero beyond the radius is faster than
+    // branching around the particles that are too far away. The kernels that need a square root branch.
+
+    // Coefficient of the poly6 kernel, W(r) = coef * (h^2 - r^2)^3
+    static inline float Poly6Coef(const float h)
+    {
+        return 315.0f / (64.0f * M_PI * powf(h, 9.0f));
+    }
+
+    // Coefficient of the spiky kernel gradient magnitude and the viscosity kernel laplacian, coef * (h - r)^2 and coef * (h - r)
+    static inline float SpikyCoef(const float h)
+    {
+        return 45.0f / (M_PI * powf(h, 6.0f));
+    }
+
+    struct PFluidDensitySum
+    {
+        const float *Mass;
+        float h2;
+        float sum;
+
+        inline void operator()(const int b, const pVec &d, const float r2)
+        {
+            float x = std::max(h2 - r2, 0.0f);
+            sum += Mass[b] * x * x * x;
+        }
+    };
+
+    struct PFluidPressureSum
+    {
+        const float *Mass;
+        const float *PoverRho2;
+        float h, h2;
+        float pa; // Pressure over density squared of this particle
+        pVec acc;
+
+        inline void operator()(const int b, const pVec &d, const float r2)
+        {
+            if(r2 >= h2 || r2 <= 0.0f)
+                return; // Out of range, or itself with no direction to push
+
+            float r = sqrtf(r2);
+            float x = h - r;
+            acc += d * (Mass[b] * (pa + PoverRho2[b]) * x * x / r);
+        }
+    };
+
+    struct PFluidSurfaceTensionSum
+    {
+        const float *Mass;
+        float h2;
+        pVec acc;
+
+        inline void operator()(const int b, const pVec &d, const float r2)
+        {
+            float x = std::max(h2 - r2, 0.0f);
+            acc -= d * (Mass[b] * x * x * x);
+        }
+    };
+
+    struct PFluidViscositySum
+    {
+        const pVec *Vel;
+        const float *MoverRho;
+        float h, h2;
+        pVec vel;
+        pVec acc;
+
+        inline void operator()(const int b, const pVec &d, const float r2)
+        {
+            if(r2 < h2)
+                acc += (Vel[b] - vel) * (MoverRho[b] * (h - sqrtf(r2)));
+        }
+    };
+
+    // Compute the density of the fluid at each particle
+    void PAFluidDensity::Execute(ParticleGroup &group, ParticleList::iterator ibegin, ParticleList::iterator iend)
+    {
+        PASSERT(ibegin == group.begin() && iend == group.end(), "Can only be done on whole list");
+
+        int n = int(group.size());
+        if(n < 1)
+            return;
+
+        Particle_t *P = &(*ibegin);
+        Grid.Build(P, n, radius);
+        int nb = Grid.NumBinned;
+        if(nb < 1)
+            return;
+
+        const int *Idx = &Grid.CellParticles[0];
+        float h2 = radius * radius;
+        float coef = Poly6Coef(radius);
+
+#pragma omp parallel for schedule(static, 256)
+        for(int a = 0; a < nb; a++) {
+            PFluidDensitySum f = {&Grid.Mass[0], h2, 0.0f};
+            Grid.ForEachNeighbor(a, f);
+            P[Idx[a]].tmp0 = f.sum * coef;
+        }
+    }
+
+    // Push particles apart where the fluid is denser than its rest density
+    void PAFluidPressure::Execute(ParticleGroup &group, ParticleList::iterator ibegin, ParticleList::iterator iend)
+    {
+        PASSERT(ibegin == group.begin() && iend == group.end(), "Can only be done on whole list");
+
+        int n = int(group.size());
+        if(n < 2)
+            return;
+
+        Particle_t *P = &(*ibegin);
+        Grid.Build(P, n, radius);
+        int nb = Grid.NumBinned;
+        if(nb < 2)
+            return;
+
+        const int *Idx = &Grid.CellParticles[0];
+        float h2 = radius * radius;
+        float coefdt = SpikyCoef(radius) * dt;
+
+        // The pressure is clamped to zero so particles at the surface don't clump.
+        PoverRho2.resize(nb);
+        for(int a = 0; a < nb; a++) {
+            float rho = P[Idx[a]].tmp0;
+            PoverRho2[a] = rho > 0.0f ? std::max(0.0f, stiffness * (rho - rest_density)) / (rho * rho) : 0.0f;
+        }
+
+#pragma omp parallel for schedule(static, 256)
+        for(int a = 0; a < nb; a++) {
+            PFluidPressureSum f = {&Grid.Mass[0], &PoverRho2[0], radius, h2, PoverRho2[a], pVec(0.0f)};
+            Grid.ForEachNeighbor(a, f);
+            P[Idx[a]].vel += f.acc * coefdt;
+        }
+    }
+
+    // Pull neighboring particles together
+    void PAFluidSurfaceTension::Execute(ParticleGroup &group, ParticleList::iterator ibegin, ParticleList::iterator iend)
+    {
+        PASSERT(ibegin == group.begin() && iend == group.end(), "Can only be done on whole list");
+
+        int n = int(group.size());
+        if(n < 2)
+            return;
+
+        Particle_t *P = &(*ibegin);
+        Grid.Build(P, n, radius);
+        int nb = Grid.NumBinned;
+        if(nb < 2)
+            return;
+
+        const int *Idx = &Grid.CellParticles[0];
+        float h2 = radius * radius;
+        float coefdt = tension * Poly6Coef(radius) * dt;
+
+#pragma omp parallel for schedule(static, 256)
+        for(int a = 0; a < nb; a++) {
+            if(Grid.Mass[a] <= 0.0f)
+                continue;
+
+            PFluidSurfaceTensionSum f = {&Grid.Mass[0], h2, pVec(0.0f)};
+            Grid.ForEachNeighbor(a, f);
+            P[Idx[a]].vel += f.acc * (coefdt / Grid.Mass[a]);
+        }
+    }
+
+    // Smooth the velocities of neighboring particles
+    void PAFluidViscosity::Execute(ParticleGroup &group, ParticleList::iterator ibegin, ParticleList::iterator iend)
+    {
+        PASSERT(ibegin == group.begin() && iend == group.end(), "Can only be done on whole list");
+
+        int n = int(group.size());
+        if(n < 2)
+            return;
+
+        Particle_t *P = &(*ibegin);
+        Grid.Build(P, n, radius);
+        int nb = Grid.NumBinned;
+        if(nb < 2)
+            return;
+
+        const int *Idx = &Grid.CellParticles[0];
+        float h2 = radius * radius;
+        float coefdt = viscosity * SpikyCoef(radius) * dt;
+
+        // Copy the velocities first since they change as we go.
+        Vel.resize(nb);
+        MoverRho.resize(nb);
+        for(int a = 0; a < nb; a++) {
+            const Particle_t &m = P[Idx[a]];
+            Vel[a] = m.vel;
+            MoverRho[a] = m.tmp0 > 0.0f ? m.mass / m.tmp0 : 0.0f;
+        }
+
+#pragma omp parallel for schedule(static, 256)
+        for(int a = 0; a < nb; a++) {
+            Particle_t &m = P[Idx[a]];
+            if(m.tmp0 <= 0.0f)
+                continue;
+
+            PFluidViscositySum f = {&Vel[0], &MoverRho[0], radius, h2, Vel[a], pVec(0.0f)};
+            Grid.ForEachNeighbor(a, f);
+            m.vel += f.acc * (coefdt / m.tmp0);
+        }
+    }
+
     // Follow the next particle in the list
     void PAFollow::Execute(ParticleGroup &group, ParticleList::iterator ibegin, ParticleList::iterator iend)
     {
@@ -970,6 +1320,17 @@ namespace PAPI {
             }
 #endif
         }
+
+        // Record the new positions in the trails. The first working set starts the new trail entry.
+        ParticleTrails &trails = group.GetTrails();
+        if(trails.Enabled()) {
+            if(ibegin == group.begin())
+                trails.Advance();
+
+            size_t slot = ibegin - group.begin();
+            for (ParticleList::iterator it = ibegin; it != iend; it++)
+                trails.Append(slot++, it->pos);
+        }
     }
 
     // Accelerate particles towards a line
@@ -1216,6 +1577,14 @@ namespace PAPI {
         }
     }
 
+    // Compares the sort keys of two particles given their indices in the list
+    struct PTmp0Less
+    {
+        const ParticleList &L;
+        PTmp0Less(const ParticleList &list) : L(list) {}
+        bool operator()(const size_t a, const size_t b) const { return L[a] < L[b]; }
+    };
+
     // Sort the particles by their projection onto the Look vector
     void PASort::Execute(ParticleGroup &group, ParticleList::iterator ibegin, ParticleList::iterator iend)
     {
@@ -1231,7 +1600,24 @@ namespace PAPI {
             if(clamp_negative && m.tmp0 < 0) m.tmp0 = 0.0f;
         }
 
-        std::sort<ParticleList::iterator>(ibegin, iend);
+        ParticleTrails &trails = group.GetTrails();
+        if(trails.Enabled()) {
+            // Sort indices instead so the trails can be reordered the same way as the particles.
+            ParticleList &list = group.GetList();
+            std::vector<size_t> order(list.size());
+            for(size_t i = 0; i < order.size(); i++)
+                order[i] = i;
+
+            std::sort(order.begin(), order.end(), PTmp0Less(list));
+
+            ParticleList sorted(list.size());
+            for(size_t i = 0; i < order.size(); i++)
+                sorted[i] = list[order[i]];
+
+            std::copy(sorted.begin(), sorted.end(), list.begin());
+            trails.Permute(order);
+        } else
+            std::sort<ParticleList::iterator>(ibegin, iend);
     }
 
     // Randomly add particles to the system
@@ -12,6 +12,7 @@
 #include "pDomain.h"
 #include "PInternalSourceState.h"
 #include "ParticleGroup.h"
+#include "PNeighborGrid.h"
 
 namespace PAPI {
 
@@ -103,6 +104,18 @@ struct PACallActionList : public PActionBase
     EXEC_METHOD;
 };
 
+struct PACollide : public PActionBase
+{
+    float resilience;	// Fraction of approaching normal velocity that is reflected
+    bool parallel;		// True to process grid cells in parallel
+
+    PNeighborGrid_t Grid;   // Kept here so action lists reuse its memory
+
+    EXEC_METHOD;
+
+    void CollideCell(Particle_t *P, const int cx, const int cy, const int cz);
+};
+
 struct PACopyVertexB : public PActionBase
 {
     bool copy_pos;		// True to copy pos to posB.
@@ -111,6 +124,16 @@ struct PACopyVertexB : public PActionBase
     EXEC_METHOD;
 };
 
+struct PACurlNoise : public PActionBase
+{
+    float magnitude;	// Scales acceleration
+    float feature_size;	// World-space distance between noise features
+    pVec offset;	    // Translation of the noise field
+    pVec scroll;	    // Amount to add to offset per unit time
+
+    EXEC_METHOD;
+};
+
 struct PADamping : public PActionBase
 {
     pVec damping;	    // Damping constant applied to velocity
@@ -140,6 +163,45 @@ struct PAExplosion : public PActionBase
     EXEC_METHOD;
 };
 
+struct PAFluidDensity : public PActionBase
+{
+    float radius;		// Smoothing radius of the SPH kernels
+    PNeighborGrid_t Grid;
+
+    EXEC_METHOD;
+};
+
+struct PAFluidPressure : public PActionBase
+{
+    float radius;		// Smoothing radius of the SPH kernels
+    float rest_density;	// Density at which the pressure is zero
+    float stiffness;	// Pressure per unit of density above rest_density
+    PNeighborGrid_t Grid;
+    std::vector<float> PoverRho2; // Pressure over density squared, sorted by grid cell
+
+    EXEC_METHOD;
+};
+
+struct PAFluidSurfaceTension : public PActionBase
+{
+    float radius;		// Smoothing radius of the SPH kernels
+    float tension;		// Strength of the cohesion between neighboring particles
+    PNeighborGrid_t Grid;
+
+    EXEC_METHOD;
+};
+
+struct PAFluidViscosity : public PActionBase
+{
+    float radius;		// Smoothing radius of the SPH kernels
+    float viscosity;	// Scales the smoothing of neighboring velocities
+    PNeighborGrid_t Grid;
+    std::vector<pVec> Vel;        // Velocities sorted by grid cell
+    std::vector<float> MoverRho;  // Mass over density, sorted by grid cell
+
+    EXEC_METHOD;
+};
+
 struct PAFollow : public PActionBase
 {
     float magnitude;	// The grav of each particle
@@ -53,6 +53,19 @@ void PContextActions_t::Callback(P_PARTICLE_CALLBACK callback, puint64 data)
     PS->SendAction(A);
 }
 
+void PContextActions_t::Collide(const float resilience, const bool parallel)
+{
+    PACollide *A = new PACollide;
+
+    A->resilience = resilience;
+    A->parallel = parallel;
+
+    A->SetKillsParticles(false);
+    A->SetDoNotSegment(true);
+
+    PS->SendAction(A);
+}
+
 void PContextActions_t::CopyVertexB(const bool copy_pos, const bool copy_vel)
 {
     PACopyVertexB *A = new PACopyVertexB;
@@ -66,6 +79,23 @@ void PContextActions_t::CopyVertexB(const bool copy_pos, const bool copy_vel)
     PS->SendAction(A);
 }
 
+void PContextActions_t::CurlNoise(const float magnitude, const float feature_size, const pVec &offset, const pVec &scroll)
+{
+    if(feature_size <= 0.0f) throw PErrInvalidValue("CurlNoise feature_size must be positive.");
+
+    PACurlNoise *A = new PACurlNoise;
+
+    A->magnitude = magnitude;
+    A->feature_size = feature_size;
+    A->offset = offset;
+    A->scroll = scroll;
+
+    A->SetKillsParticles(false);
+    A->SetDoNotSegment(false);
+
+    PS->SendAction(A);
+}
+
 void PContextActions_t::Damping(const pVec &damping,
                                 const float vlow, const float vhigh)
 {
@@ -116,6 +146,66 @@ void PContextActions_t::Explosion(const pVec &center, const float radius,
     PS->SendAction(A);
 }
 
+void PContextActions_t::FluidDensity(const float radius)
+{
+    if(radius <= 0.0f) throw PErrInvalidValue("FluidDensity radius must be positive.");
+
+    PAFluidDensity *A = new PAFluidDensity;
+
+    A->radius = radius;
+
+    A->SetKillsParticles(false);
+    A->SetDoNotSegment(true);
+
+    PS->SendAction(A);
+}
+
+void PContextActions_t::FluidPressure(const float radius, const float rest_density, const float stiffness)
+{
+    if(radius <= 0.0f) throw PErrInvalidValue("FluidPressure radius must be positive.");
+
+    PAFluidPressure *A = new PAFluidPressure;
+
+    A->radius = radius;
+    A->rest_density = rest_density;
+    A->stiffness = stiffness;
+
+    A->SetKillsParticles(false);
+    A->SetDoNotSegment(true);
+
+    PS->SendAction(A);
+}
+
+void PContextActions_t::FluidSurfaceTension(const float radius, const float tension)
+{
+    if(radius <= 0.0f) throw PErrInvalidValue("FluidSurfaceTension radius must be positive.");
+
+    PAFluidSurfaceTension *A = new PAFluidSurfaceTension;
+
+    A->radius = radius;
+    A->tension = tension;
+
+    A->SetKillsParticles(false);
+    A->SetDoNotSegment(true);
+
+    PS->SendAction(A);
+}
+
+void PContextActions_t::FluidViscosity(const float radius, const float viscosity)
+{
+    if(radius <= 0.0f) throw PErrInvalidValue("FluidViscosity radius must be positive.");
+
+    PAFluidViscosity *A = new PAFluidViscosity;
+
+    A->radius = radius;
+    A->viscosity = viscosity;
+
+    A->SetKillsParticles(false);
+    A->SetDoNotSegment(true);
+
+    PS->SendAction(A);
+}
+
 void PContextActions_t::Follow(const float magnitude, const float epsilon, const float max_radius)
 {
     PAFollow *A = new PAFollow;
@@ -462,6 +552,7 @@ void PContextActions_t::Vertex(const pVec &pos, const puint64 data)
     // We don't pass the PS->SrcSt data. Note that this creates an inconsistency if building an action list.
 
     PS->PGroups[PS->pgroup_id].Add(P);
+    PS->PGroups[PS->pgroup_id].FlushCallbacks();
 }
 
 void PContextActions_t::Vortex(
@@ -248,6 +248,14 @@ namespace PAPI {
         // This can kill them and call their death callback.
         PS->PGroups[PS->pgroup_id].SetMaxParticles(max_count);
     }
+    // Turn on trails for the current group.
+    void PContextParticleGroup_t::TrailLength(const size_t length)
+    {
+        if(PS->in_new_list) throw PErrInNewActionList("Can't call TrailLength while in NewActionList.");
+
+        PS->PGroups[PS->pgroup_id].SetTrailLength(length);
+    }
+
 
     // Copy from the specified group to the current group.
     void PContextParticleGroup_t::CopyGroup(const int p_src_group_num, const size_t index, const size_t copy_count)
@@ -273,6 +281,7 @@ namespace PAPI {
         for(size_t i=0; i<ccount; i++) {
             destgrp.Add(srcgrp.GetList()[index+i]);
         }
+        destgrp.FlushCallbacks();
     }
 
     // Copy from the current group to application memory.
@@ -376,6 +385,23 @@ namespace PAPI {
 
         return pg.size();
     }
+    size_t PContextParticleGroup_t::GetTrailPointer(float *&position, unsigned int *&count, size_t &stride, size_t &newest)
+    {
+        if(PS->in_new_list) throw PErrInNewActionList("Can't call GetTrailPointer while in NewActionList.");
+
+        ParticleGroup &pg = PS->PGroups[PS->pgroup_id];
+        ParticleTrails &trails = pg.GetTrails();
+
+        if(!trails.Enabled()) throw PErrParticleGroup("GetTrailPointer called on a group without trails.");
+
+        position = trails.Positions();
+        count = trails.Counts();
+        stride = trails.Stride();
+        newest = trails.Newest();
+
+        return pg.size();
+    }
+
 
     // Returns the number of particles currently in the group.
     size_t PContextParticleGroup_t::GetGroupCount()
@@ -407,6 +433,20 @@ namespace PAPI {
         PS->PGroups[PS->pgroup_id].SetDeathCallback(callback, data);
     }
 
+    void PContextParticleGroup_t::BirthSpanCallback(P_PARTICLE_SPAN_CALLBACK callback, puint64 data)
+    {
+        if(PS->in_new_list) throw PErrInNewActionList("Can't call BirthSpanCallback while in NewActionList.");
+
+        PS->PGroups[PS->pgroup_id].SetBirthSpanCallback(callback, data);
+    }
+
+    void PContextParticleGroup_t::DeathSpanCallback(P_PARTICLE_SPAN_CALLBACK callback, puint64 data)
+    {
+        if(PS->in_new_list) throw PErrInNewActionList("Can't call DeathSpanCallback while in NewActionList.");
+
+        PS->PGroups[PS->pgroup_id].SetDeathSpanCallback(callback, data);
+    }
+
     /// Set the number of particles that fit in the CPU's cache
     ///
     /// You probably don't need to call this function. It is the number of bytes in the working set. Most action lists apply several actions to the working set of particles, then load the next working set of particles and apply the same actions to them. This allows particles to stay resident in the CPU's cache for a longer period of time, potentially increasing performance dramatically.
@@ -0,0 +1,104 @@
+/// PCallbackQueue.h
+///
+/// Copyright 1997-2007 by David K. McAllister
+/// http://www.ParticleSystems.org
+///
+/// Particles waiting to be passed to a deferred birth or death callback
+///
+/// Defines these classes: PCallbackQueue_t
+
+#ifndef PCallbackQueue_h
+#define PCallbackQueue_h
+
+#include "Particle.h"
+
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace PAPI {
+
+    typedef void (*P_PARTICLE_SPAN_CALLBACK)(struct Particle_t *particles, size_t count, puint64 data); // Also defined in pAPI.h.
+
+    // Each thread appends to its own queue, so pushing needs no locks and no atomics.
+    // Threads with no queue of their own, and threads in nested parallel regions, whose
+    // numbers aren't unique, share the overflow queue under a lock.
+    // The queues are only delivered and resized between actions, when no other thread is pushing.
+    class PCallbackQueue_t
+    {
+        std::vector<std::vector<Particle_t> > Queues; // One per thread
+        std::vector<Particle_t> Overflow;
+
+        // The queue this thread owns, or -1 if it has to use the overflow queue.
+        inline int OwnQueue() const
+        {
+#ifdef _OPENMP
+            if(omp_get_level() > 1)
+                return -1;
+            int t = omp_get_thread_num();
+            return t < (int)Queues.size() ? t : -1;
+#else
+            return 0;
+#endif
+        }
+
+        inline static int MaxThreads()
+        {
+#ifdef _OPENMP
+            return omp_get_max_threads();
+#else
+            return 1;
+#endif
+        }
+
+    public:
+        PCallbackQueue_t() : Queues(MaxThreads()) {}
+
+        // Copies of a group don't inherit its undelivered particles.
+        PCallbackQueue_t(const PCallbackQueue_t &) : Queues(MaxThreads()) {}
+        PCallbackQueue_t &operator=(const PCallbackQueue_t &) { return *this; }
+
+        inline void Push(const Particle_t &P)
+        {
+            int t = OwnQueue();
+            if(t >= 0) {
+                Queues[t].push_back(P);
+            } else {
+#ifdef _OPENMP
+#pragma omp critical (PCallbackQueue)
+#endif
+                Overflow.push_back(P);
+            }
+        }
+
+        inline bool Empty() const
+        {
+            for(size_t t = 0; t < Queues.size(); t++)
+                if(!Queues[t].empty())
+                    return false;
+            return Overflow.empty();
+        }
+
+        // Pass each thread's particles, then the overflow, to the callback as one span each,
+        // then empty the queues. The queues keep their memory for next time.
+        inline void Deliver(P_PARTICLE_SPAN_CALLBACK callback, puint64 data)
+        {
+            for(size_t t = 0; t <= Queues.size(); t++) {
+                std::vector<Particle_t> &Q = t < Queues.size() ? Queues[t] : Overflow;
+                if(!Q.empty()) {
+                    if(callback)
+                        (*callback)(&Q[0], Q.size(), data);
+                    Q.clear();
+                }
+            }
+
+            if((int)Queues.size() < MaxThreads())
+                Queues.resize(MaxThreads());
+        }
+    };
+
+};
+
+#endif
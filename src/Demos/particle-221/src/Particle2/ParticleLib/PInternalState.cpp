@@ -108,6 +108,7 @@ namespace PAPI {
             ParticleGroup &pg = PGroups[pgroup_id];
             S->Execute(pg, pg.begin(), pg.end());
             delete S;
+            pg.FlushCallbacks();
         }
     }
 
@@ -115,6 +116,7 @@ namespace PAPI {
     void PInternalState_t::ExecuteActionList(ActionList &AList)
     {
         ParticleGroup &pg = PGroups[pgroup_id];
+        bool outermost = !in_call_list; // CallActionList() can be an action in a list
         in_call_list = true;
 
         ActionList::iterator it = AList.begin();
@@ -154,7 +156,12 @@ namespace PAPI {
             } while ((!one_pass) && pbeg != pg.end());
             it = ait;
         }
-        in_call_list = false;
+
+        // Deliver the births and deaths once the whole list is done, instead of in the middle of the actions.
+        if(outermost) {
+            in_call_list = false;
+            pg.FlushCallbacks();
+        }
     }
 
 };
@@ -11,6 +11,7 @@
 #include "pAPI.h"
 #include "Actions.h"
 #include "ParticleGroup.h"
+#include "PNoiseVolume.h"
 
 #include <vector>
 #include <string>
@@ -42,6 +43,9 @@ namespace PAPI {
         // How many particles will fit in cache? You can set this if you don't like the default value.
         int PWorkingSetSize;
 
+        // The curl noise volume shared by all CurlNoise actions. It is built the first time it's used.
+        PNoiseVolume_t CurlNoiseVol;
+
         PInternalState_t();
 
         int GeneratePGroups(int pgroups_requested);
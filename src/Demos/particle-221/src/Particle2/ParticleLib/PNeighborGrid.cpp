@@ -0,0 +1,109 @@
+/// PNeighborGrid.cpp
+///
+/// Copyright 1997-2007 by David K. McAllister
+/// http://www.ParticleSystems.org
+///
+/// This file bins particles into a uniform grid for the actions that need each particle's neighbors.
+
+#include "pAPI.h"
+#include "PNeighborGrid.h"
+
+#include <algorithm>
+
+namespace PAPI {
+
+    namespace {
+        inline bool IsFinite(const pVec &p)
+        {
+            // Inf - Inf and NaN - NaN are both NaN.
+            return p.x() - p.x() == 0.0f && p.y() - p.y() == 0.0f && p.z() - p.z() == 0.0f;
+        }
+
+        // The cell of a coordinate on one axis, clamped to the grid. It's done in double so that it can't overflow.
+        inline int CellCoord(const float p, const float lo, const double invCell, const int dim)
+        {
+            double g = (double(p) - double(lo)) * invCell;
+            return g < double(dim - 1) ? (g > 0.0 ? int(g) : 0) : dim - 1;
+        }
+    };
+
+    void PNeighborGrid_t::Build(const Particle_t *P, const int n, const float cell_size)
+    {
+        // Find the bounding box. Particles at infinity or NaN have no cell and are left out.
+        pVec lo(P_MAXFLOAT), hi(-P_MAXFLOAT);
+        int nb = 0;
+        for(int i = 0; i < n; i++) {
+            const pVec &p = P[i].pos;
+            if(!IsFinite(p))
+                continue;
+            lo = pVec(std::min(lo.x(), p.x()), std::min(lo.y(), p.y()), std::min(lo.z(), p.z()));
+            hi = pVec(std::max(hi.x(), p.x()), std::max(hi.y(), p.y()), std::max(hi.z(), p.z()));
+            nb++;
+        }
+        if(nb == 0)
+            lo = hi = pVec(0.0f);
+
+        // Widen the cells if the particles are so spread out that the grid would be mostly empty.
+        // The counts are doubles until they fit, since the particles can be too far apart for an int.
+        double cell = cell_size > 0.0f ? double(cell_size) : 1.0;
+        double ext[3] = {double(hi.x()) - double(lo.x()), double(hi.y()) - double(lo.y()), double(hi.z()) - double(lo.z())};
+        double MaxCells = 4.0 * nb + 64.0;
+        double D[3];
+        for(;;) {
+            for(int k = 0; k < 3; k++)
+                D[k] = floor(ext[k] / cell) + 1.0;
+            double NCells = D[0] * D[1] * D[2];
+            if(NCells <= MaxCells)
+                break;
+            cell *= std::max(1.01, pow(NCells / MaxCells, 1.0 / 3.0));
+        }
+        for(int k = 0; k < 3; k++)
+            Dims[k] = int(std::min(std::max(D[k], 1.0), MaxCells));
+
+        Lo = lo;
+        CellSize = float(cell);
+        NumBinned = nb;
+
+        int NCells = NumCells();
+        double invCell = 1.0 / cell;
+
+        // Counting sort the particles by cell.
+        ParticleCell.resize(n);
+        CellStart.assign(NCells + 1, 0);
+        CellParticles.resize(nb);
+        Pos.resize(nb);
+        Mass.resize(nb);
+
+        for(int i = 0; i < n; i++) {
+            const pVec &p = P[i].pos;
+            if(!IsFinite(p)) {
+                ParticleCell[i] = -1;
+                continue;
+            }
+            int cx = CellCoord(p.x(), lo.x(), invCell, Dims[0]);
+            int cy = CellCoord(p.y(), lo.y(), invCell, Dims[1]);
+            int cz = CellCoord(p.z(), lo.z(), invCell, Dims[2]);
+            int c = CellIndex(cx, cy, cz);
+            ParticleCell[i] = c;
+            CellStart[c+1]++;
+        }
+
+        for(int c = 0; c < NCells; c++)
+            CellStart[c+1] += CellStart[c];
+
+        for(int i = 0; i < n; i++) {
+            if(ParticleCell[i] < 0)
+                continue;
+            int a = CellStart[ParticleCell[i]]++;
+            CellParticles[a] = i;
+            Pos[a] = P[i].pos;
+            Mass[a] = P[i].mass;
+        }
+
+        // The fill advanced each start to the next cell's start, so shift them back.
+        for(int c = NCells; c > 0; c--)
+            CellStart[c] = CellStart[c-1];
+        CellStart[0] = 0;
+    }
+
+};
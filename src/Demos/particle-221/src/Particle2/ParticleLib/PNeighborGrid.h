@@ -0,0 +1,75 @@
+/// PNeighborGrid.h
+///
+/// Copyright 1997-2007 by David K. McAllister
+/// http://www.ParticleSystems.org
+///
+/// A uniform grid for finding the nearby particles of each particle
+///
+/// Defines these classes: PNeighborGrid_t
+
+#ifndef PNeighborGrid_h
+#define PNeighborGrid_h
+
+#include "Particle.h"
+
+#include <vector>
+
+namespace PAPI {
+
+    // The particles are counting-sorted by grid cell, so the particles in a cell are consecutive in CellParticles
+    // and their positions and masses are consecutive in Pos and Mass. Reading those instead of the particles
+    // themselves keeps neighbor loops in cache. Actions that need neighbors rebuild the grid each time they run.
+    class PNeighborGrid_t
+    {
+    public:
+        std::vector<int> CellStart;     // Index in CellParticles of the first particle of each cell; one extra at the end
+        std::vector<int> CellParticles; // Particle indices sorted by cell
+        std::vector<int> ParticleCell;  // The cell of each particle, by particle index; -1 if it isn't in the grid
+        std::vector<pVec> Pos;          // Particle positions sorted by cell
+        std::vector<float> Mass;        // Particle masses sorted by cell
+        int Dims[3];                    // Cells on each axis
+        pVec Lo;                        // Corner of cell 0,0,0
+        float CellSize;                 // Width of a cell
+        int NumBinned;                  // Particles in the grid, which is all but those at infinity or NaN
+
+        PNeighborGrid_t() { Dims[0] = Dims[1] = Dims[2] = 0; CellSize = 0.0f; NumBinned = 0; }
+
+        /// Bin the n particles into cells that are at least cell_size wide. The cells are widened if the
+        /// particles are so spread out that most cells would be empty. Particles whose positions aren't finite are
+        /// left out, so the sorted arrays have NumBinned entries.
+        void Build(const Particle_t *P, const int n, const float cell_size);
+
+        inline int NumCells() const { return Dims[0] * Dims[1] * Dims[2]; }
+        inline int CellIndex(const int cx, const int cy, const int cz) const { return (cz * Dims[1] + cy) * Dims[0] + cx; }
+
+        /// Call f(b, d, r2) for each particle b, as an index in sorted order, in the 3x3x3 cells around sorted particle a,
+        /// including a itself. d is Pos[a] - Pos[b] and r2 is its squared length. Most of these particles are farther away than
+        /// CellSize, and f must ignore them. Whether a particle is in range is unpredictable, so for cheap kernels it's faster
+        /// for f to clamp its weight to zero than to branch.
+        template<class F> inline void ForEachNeighbor(const int a, F &f) const
+        {
+            const pVec &pa = Pos[a];
+            int c = ParticleCell[CellParticles[a]];
+            int cx = c % Dims[0], cy = (c / Dims[0]) % Dims[1], cz = c / (Dims[0] * Dims[1]);
+
+            // The particles of three cells in a row along x are consecutive, so loop over nine runs.
+            int x0 = cx > 0 ? cx - 1 : cx, x1 = cx < Dims[0] - 1 ? cx + 1 : cx;
+
+            for(int nz = cz - 1; nz <= cz + 1; nz++) {
+                if(nz < 0 || nz >= Dims[2]) continue;
+                for(int ny = cy - 1; ny <= cy + 1; ny++) {
+                    if(ny < 0 || ny >= Dims[1]) continue;
+
+                    int bend = CellStart[CellIndex(x1, ny, nz) + 1];
+                    for(int b = CellStart[CellIndex(x0, ny, nz)]; b < bend; b++) {
+                        pVec d(pa - Pos[b]);
+                        f(b, d, d.length2());
+                    }
+                }
+            }
+        }
+    };
+
+};
+
+#endif
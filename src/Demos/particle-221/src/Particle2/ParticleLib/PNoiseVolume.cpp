@@ -0,0 +1,107 @@
+/// PNoiseVolume.cpp
+///
+/// Copyright 1997-2007 by David K. McAllister
+/// http://www.ParticleSystems.org
+///
+/// This file precomputes the curl noise volume.
+///
+/// The vector potential is the same smoothstep-interpolated value noise as DMcTools' Perlin class,
+/// but in float and on a lattice that wraps, so the volume tiles seamlessly. The curl of the
+/// potential is a velocity field that is divergence free, so particles swirl like smoke instead
+/// of clumping or jittering like they do with RandomAccel().
+
+#include "PNoiseVolume.h"
+#include "pError.h"
+
+namespace PAPI {
+
+    // Return a repeatable random number on -1.0 -> 1.0 based on the lattice point and salt.
+    static inline float LatticeRand(unsigned int x, unsigned int y, unsigned int z, unsigned int salt)
+    {
+        unsigned int n = (x * 73856093u) ^ (y * 19349663u) ^ (z * 83492791u) ^ (salt * 2654435761u);
+        n = (n << 13) ^ n;
+        n = n * (n * n * 15731u + 789221u) + 1376312589u;
+        return float(n & 0x7fffffff) / 1073741823.5f - 1.0f;
+    }
+
+    // Smoothly interpolates between a and b.
+    static inline float Interp(float a, float b, float t)
+    {
+        float f = t*t*(3.0f-2.0f*t);
+
+        return a + (b - a) * f;
+    }
+
+    void PNoiseVolume_t::Build(const int log2_size, const int cells_per_feature, const int octaves, const unsigned int seed)
+    {
+        if(log2_size < 1 || log2_size > 8) throw PErrInvalidValue("Noise volume size must be between 2 and 256 cells.");
+        if(cells_per_feature < 1 || cells_per_feature > (1 << log2_size)) throw PErrInvalidValue("Invalid noise feature size.");
+
+        N = 1 << log2_size;
+        Mask = N - 1;
+        CellsPerFeature = cells_per_feature;
+
+        const int NCells = N * N * N;
+
+        // The vector potential. The fourth float of each cell is padding.
+        Cells.assign(NCells * 4, 0.0f);
+
+        float ampl = 1.0f;
+        int spacing = cells_per_feature;
+        for(int o = 0; o < octaves && spacing > 0; o++, spacing >>= 1, ampl *= 0.5f) {
+            // The lattice for this octave has period N / spacing so it wraps with the volume.
+            int period = N / spacing;
+            float invSpacing = 1.0f / float(spacing);
+
+            for(int c = 0; c < 3; c++) {
+                unsigned int salt = seed * 31u + o * 3u + c;
+
+                for(int z = 0; z < N; z++) {
+                    int zi = z / spacing;
+                    float zf = float(z % spacing) * invSpacing;
+                    int zi0 = zi % period, zi1 = (zi + 1) % period;
+
+                    for(int y = 0; y < N; y++) {
+                        int yi = y / spacing;
+                        float yf = float(y % spacing) * invSpacing;
+                        int yi0 = yi % period, yi1 = (yi + 1) % period;
+
+                        for(int x = 0; x < N; x++) {
+                            int xi = x / spacing;
+                            float xf = float(x % spacing) * invSpacing;
+                            int xi0 = xi % period, xi1 = (xi + 1) % period;
+
+                            float v00 = Interp(LatticeRand(xi0, yi0, zi0, salt), LatticeRand(xi0, yi0, zi1, salt), zf);
+                            float v01 = Interp(LatticeRand(xi0, yi1, zi0, salt), LatticeRand(xi0, yi1, zi1, salt), zf);
+                            float v10 = Interp(LatticeRand(xi1, yi0, zi0, salt), LatticeRand(xi1, yi0, zi1, salt), zf);
+                            float v11 = Interp(LatticeRand(xi1, yi1, zi0, salt), LatticeRand(xi1, yi1, zi1, salt), zf);
+
+                            float v0 = Interp(v00, v01, yf);
+                            float v1 = Interp(v10, v11, yf);
+
+                            Cells[((z * N + y) * N + x) * 4 + c] += Interp(v0, v1, xf) * ampl;
+                        }
+                    }
+                }
+            }
+        }
+
+        // Normalize to unit RMS magnitude so the action's magnitude means the same thing for any volume.
+        // The curl is linear in the potential, so scaling the potential scales the field.
+        double sumSqr = 0.0;
+        for(int z = 0; z < N; z++)
+            for(int y = 0; y < N; y++)
+                for(int x = 0; x < N; x++) {
+                    pVec v = Sample(pVec(x + 0.5f, y + 0.5f, z + 0.5f));
+                    sumSqr += v.length2();
+                }
+
+        float rms = float(sqrt(sumSqr / double(NCells)));
+        if(rms > 0.0f) {
+            float invRms = 1.0f / rms;
+            for(size_t i = 0; i < Cells.size(); i++)
+                Cells[i] *= invRms;
+        }
+    }
+
+};
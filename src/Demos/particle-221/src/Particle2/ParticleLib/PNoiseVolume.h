@@ -0,0 +1,121 @@
+/// PNoiseVolume.h
+///
+/// Copyright 1997-2007 by David K. McAllister
+/// http://www.ParticleSystems.org
+///
+/// A tileable, precomputed 3D volume of curl noise used by the CurlNoise action.
+///
+/// Defines these classes: PNoiseVolume_t
+
+#ifndef PNoiseVolume_h
+#define PNoiseVolume_h
+
+#include "pVec.h"
+
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define P_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace PAPI {
+
+    // The volume stores a smooth, periodic vector potential at each lattice cell. The curl is computed
+    // from the gradient of the trilinear interpolant of the potential, so it is exactly divergence free
+    // within each cell. Each cell is four floats (x, y, z, pad) so a corner is one SSE load, and the
+    // gradients of all three components come out of the same SIMD lerps.
+    class PNoiseVolume_t
+    {
+        std::vector<float> Cells; // 4 floats per cell: potential x, y, z, and padding
+        int N;                    // Cells per axis; a power of two so the lattice wraps with a mask
+        int Mask;                 // N - 1
+        int CellsPerFeature;      // Lattice cells between features of the coarsest octave
+
+        inline const float *Cell(int x, int y, int z) const
+        {
+            return &Cells[((((z & Mask) * N) + (y & Mask)) * N + (x & Mask)) * 4];
+        }
+
+        // Return the gradient of each component of the potential at the given point, in lattice units.
+        // Gx holds d/dx of the x, y and z components of the potential, and so on.
+        inline void Gradient(const pVec &p, float Gx[4], float Gy[4], float Gz[4]) const
+        {
+            float fx = floorf(p.x()), fy = floorf(p.y()), fz = floorf(p.z());
+            int x = int(fx), y = int(fy), z = int(fz);
+            float tx = p.x() - fx, ty = p.y() - fy, tz = p.z() - fz;
+
+            const float *c000 = Cell(x, y, z), *c100 = Cell(x+1, y, z);
+            const float *c010 = Cell(x, y+1, z), *c110 = Cell(x+1, y+1, z);
+            const float *c001 = Cell(x, y, z+1), *c101 = Cell(x+1, y, z+1);
+            const float *c011 = Cell(x, y+1, z+1), *c111 = Cell(x+1, y+1, z+1);
+
+#ifdef P_USE_SSE
+            __m128 vtx = _mm_set_ps1(tx), vty = _mm_set_ps1(ty), vtz = _mm_set_ps1(tz);
+
+            // Differences and lerps along x for the four x-parallel cell edges
+            __m128 a = _mm_loadu_ps(c000), b = _mm_loadu_ps(c100);
+            __m128 d00 = _mm_sub_ps(b, a), e00 = _mm_add_ps(a, _mm_mul_ps(d00, vtx));
+            a = _mm_loadu_ps(c010); b = _mm_loadu_ps(c110);
+            __m128 d10 = _mm_sub_ps(b, a), e10 = _mm_add_ps(a, _mm_mul_ps(d10, vtx));
+            a = _mm_loadu_ps(c001); b = _mm_loadu_ps(c101);
+            __m128 d01 = _mm_sub_ps(b, a), e01 = _mm_add_ps(a, _mm_mul_ps(d01, vtx));
+            a = _mm_loadu_ps(c011); b = _mm_loadu_ps(c111);
+            __m128 d11 = _mm_sub_ps(b, a), e11 = _mm_add_ps(a, _mm_mul_ps(d11, vtx));
+
+            __m128 dx0 = _mm_add_ps(d00, _mm_mul_ps(_mm_sub_ps(d10, d00), vty));
+            __m128 dx1 = _mm_add_ps(d01, _mm_mul_ps(_mm_sub_ps(d11, d01), vty));
+            _mm_storeu_ps(Gx, _mm_add_ps(dx0, _mm_mul_ps(_mm_sub_ps(dx1, dx0), vtz)));
+
+            __m128 dy0 = _mm_sub_ps(e10, e00), dy1 = _mm_sub_ps(e11, e01);
+            _mm_storeu_ps(Gy, _mm_add_ps(dy0, _mm_mul_ps(_mm_sub_ps(dy1, dy0), vtz)));
+
+            __m128 f0 = _mm_add_ps(e00, _mm_mul_ps(dy0, vty));
+            __m128 f1 = _mm_add_ps(e01, _mm_mul_ps(dy1, vty));
+            _mm_storeu_ps(Gz, _mm_sub_ps(f1, f0));
+#else
+            for(int i=0; i<3; i++) {
+                float d00 = c100[i] - c000[i], e00 = c000[i] + d00 * tx;
+                float d10 = c110[i] - c010[i], e10 = c010[i] + d10 * tx;
+                float d01 = c101[i] - c001[i], e01 = c001[i] + d01 * tx;
+                float d11 = c111[i] - c011[i], e11 = c011[i] + d11 * tx;
+
+                float dx0 = d00 + (d10 - d00) * ty;
+                float dx1 = d01 + (d11 - d01) * ty;
+                Gx[i] = dx0 + (dx1 - dx0) * tz;
+
+                float dy0 = e10 - e00, dy1 = e11 - e01;
+                Gy[i] = dy0 + (dy1 - dy0) * tz;
+
+                Gz[i] = (e01 + dy1 * ty) - (e00 + dy0 * ty);
+            }
+#endif
+        }
+
+    public:
+        PNoiseVolume_t() : N(0), Mask(0), CellsPerFeature(1) {}
+
+        /// Fill the volume. log2_size is log2 of the cells per axis. octaves is how many
+        /// octaves of value noise are summed into the vector potential, starting with
+        /// features cells_per_feature cells apart and halving each octave.
+        void Build(const int log2_size = 5, const int cells_per_feature = 4, const int octaves = 2, const unsigned int seed = 1);
+
+        bool IsBuilt() const { return N > 0; }
+
+        /// Lattice cells per world unit for features that are feature_size apart.
+        float LatticeScale(const float feature_size) const { return float(CellsPerFeature) / feature_size; }
+
+        /// Return the curl of the potential at the given point, in lattice units.
+        /// The field has roughly unit RMS magnitude.
+        inline pVec Sample(const pVec &p) const
+        {
+            float Gx[4], Gy[4], Gz[4];
+            Gradient(p, Gx, Gy, Gz);
+
+            return pVec(Gy[2] - Gz[1], Gz[0] - Gx[2], Gx[1] - Gy[0]);
+        }
+    };
+
+};
+
+#endif
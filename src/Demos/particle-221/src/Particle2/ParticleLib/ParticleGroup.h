@@ -12,6 +12,8 @@
 
 // Particle.h includes pVec.h.
 #include "Particle.h"
+#include "ParticleTrails.h"
+#include "PCallbackQueue.h"
 
 #include <vector>
 
@@ -30,6 +32,13 @@ class ParticleGroup
     P_PARTICLE_CALLBACK cb_death; // Call this function for each destroyed particle
     puint64 group_birth_data; // Pass this to the birth callback
     puint64 group_death_data; // Pass this to the death callback
+    P_PARTICLE_SPAN_CALLBACK cb_birth_span; // Call this function with the created particles after the actions
+    P_PARTICLE_SPAN_CALLBACK cb_death_span; // Call this function with the destroyed particles after the actions
+    puint64 span_birth_data; // Pass this to the deferred birth callback
+    puint64 span_death_data; // Pass this to the deferred death callback
+    PCallbackQueue_t births; // Created particles not yet passed to cb_birth_span
+    PCallbackQueue_t deaths; // Destroyed particles not yet passed to cb_death_span
+    ParticleTrails trails; // Recent positions of each particle, if enabled
 
 public:
     ParticleGroup()
@@ -39,6 +48,10 @@ public:
         cb_death = NULL;
         group_birth_data = NULL;
         group_death_data = NULL;
+        cb_birth_span = NULL;
+        cb_death_span = NULL;
+        span_birth_data = 0;
+        span_death_data = 0;
     }
 
     ParticleGroup(size_t maxp) : max_particles(maxp)
@@ -48,6 +61,10 @@ public:
         cb_death = NULL;
         group_birth_data = NULL;
         group_death_data = NULL;
+        cb_birth_span = NULL;
+        cb_death_span = NULL;
+        span_birth_data = 0;
+        span_death_data = 0;
     }
 
     ParticleGroup(const ParticleGroup &rhs) : list(rhs.list)
@@ -57,37 +74,54 @@ public:
         cb_death = rhs.cb_death;
         group_birth_data = rhs.group_birth_data;
         group_death_data = rhs.group_death_data;
+        cb_birth_span = rhs.cb_birth_span;
+        cb_death_span = rhs.cb_death_span;
+        span_birth_data = rhs.span_birth_data;
+        span_death_data = rhs.span_death_data;
+        trails = rhs.trails;
     }
 
     ~ParticleGroup()
     {
+        FlushCallbacks();
         if (cb_death) {
             ParticleList::iterator it;
             for (it = list.begin(); it != list.end(); ++it)
                 (*cb_death)((*it), group_death_data);
         }
+        if (cb_death_span && !list.empty())
+            (*cb_death_span)(&list[0], list.size(), span_death_data);
     }
 
     ParticleGroup &operator=(const ParticleGroup &rhs)
     {
         if (this != &rhs) {
+            FlushCallbacks();
             if (cb_death) {
                 ParticleList::iterator it;
                 for (it = list.begin(); it != list.end(); ++it)
                     (*cb_death)((*it), group_death_data);
             }
+            if (cb_death_span && !list.empty())
+                (*cb_death_span)(&list[0], list.size(), span_death_data);
             list = rhs.list;
             cb_birth = rhs.cb_birth;
             cb_death = rhs.cb_death;
             group_birth_data = rhs.group_birth_data;
             group_death_data = rhs.group_death_data;
+            cb_birth_span = rhs.cb_birth_span;
+            cb_death_span = rhs.cb_death_span;
+            span_birth_data = rhs.span_birth_data;
+            span_death_data = rhs.span_death_data;
             max_particles = rhs.max_particles;
+            trails = rhs.trails;
         }
         return *this;
     }
 
     inline size_t GetMaxParticles() { return max_particles; }
     inline ParticleList &GetList() { return list; }
+    inline ParticleTrails &GetTrails() { return trails; }
 
     inline void SetBirthCallback(P_PARTICLE_CALLBACK callback, puint64 group_data)
     {
@@ -101,6 +135,29 @@ public:
         group_death_data = group_data;
     }
 
+    // Particles that are still queued go to the old callback.
+    inline void SetBirthSpanCallback(P_PARTICLE_SPAN_CALLBACK callback, puint64 group_data)
+    {
+        FlushCallbacks();
+        cb_birth_span = callback;
+        span_birth_data = group_data;
+    }
+
+    inline void SetDeathSpanCallback(P_PARTICLE_SPAN_CALLBACK callback, puint64 group_data)
+    {
+        FlushCallbacks();
+        cb_death_span = callback;
+        span_death_data = group_data;
+    }
+
+    // Pass the particles created and destroyed since the last flush to the deferred callbacks.
+    // Births are delivered first, so a particle that was born and died since then shows up in both.
+    inline void FlushCallbacks()
+    {
+        births.Deliver(cb_birth_span, span_birth_data);
+        deaths.Deliver(cb_death_span, span_death_data);
+    }
+
     inline void SetMaxParticles(size_t maxp)
     {
         max_particles = maxp;
@@ -109,9 +166,20 @@ public:
                 for (ParticleList::iterator it = list.begin() + max_particles; it != list.end(); ++it)
                     (*cb_death)((*it), group_death_data);
             }
+            if (cb_death_span) {
+                FlushCallbacks();
+                (*cb_death_span)(&list[max_particles], list.size() - max_particles, span_death_data);
+            }
             list.resize(max_particles);
         }
         list.reserve(max_particles);
+        trails.Resize(max_particles);
+    }
+
+    // Remember the last length positions of each particle. 0 turns trails off.
+    inline void SetTrailLength(size_t length)
+    {
+        trails.Init(length, max_particles);
     }
 
     inline size_t size() const { return list.size(); }
@@ -123,9 +191,13 @@ public:
     {
         if (cb_death)
             (*cb_death)((*it), group_death_data);
+        if (cb_death_span)
+            deaths.Push(*it);
 
         // Copy the one from the end to here.
         if(it != list.end() - 1) {
+            if(trails.Enabled())
+                trails.Move(it - list.begin(), list.size() - 1);
             *it = *(list.end() - 1);
             list.pop_back(); // Delete the one at the end
         } else {
@@ -143,8 +215,12 @@ public:
         else {
             list.push_back(P);
             Particle_t &p = list.back();
+            if (trails.Enabled())
+                trails.Clear(list.size() - 1);
             if (cb_birth)
                 (*cb_birth)(p, group_birth_data);
+            if (cb_birth_span)
+                births.Push(p);
             return true;
         }
     }
@@ -0,0 +1,118 @@
+/// ParticleTrails.h
+///
+/// Copyright 1997-2007 by David K. McAllister
+/// http://www.ParticleSystems.org
+///
+/// The recent positions of each particle in a group, for drawing trails and ribbons
+///
+/// Defines these classes: ParticleTrails
+
+#ifndef ParticleTrails_h
+#define ParticleTrails_h
+
+#include "pVec.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace PAPI {
+
+// The trails are kept apart from the particles so they don't make Particle_t any bigger.
+// Each particle slot owns a ring of trail_length positions. All trails of a group advance together,
+// so one head index says where the newest position is in every ring.
+//
+// Each position is stored twice, trail_length entries apart. That way the newest trail_length positions
+// of every particle are always consecutive in memory and can be drawn as a line strip without copying.
+class ParticleTrails
+{
+    size_t trail_length;             // Positions remembered per particle; 0 when trails are off
+    size_t head;                     // Ring entry of every trail's newest position
+    std::vector<float> pos;          // 2 * trail_length positions of 3 floats per particle slot
+    std::vector<unsigned int> count; // How many positions of each slot's trail are valid
+
+public:
+    ParticleTrails() : trail_length(0), head(0) {}
+
+    inline bool Enabled() const { return trail_length > 0; }
+    inline size_t Length() const { return trail_length; }
+
+    // Positions stored per particle slot.
+    inline size_t Stride() const { return 2 * trail_length; }
+
+    // Offset within a slot of the newest position. The count[i] positions of slot i that end here are its trail.
+    inline size_t Newest() const { return head + trail_length; }
+
+    inline float *Positions() { return pos.empty() ? NULL : &pos[0]; }
+    inline unsigned int *Counts() { return count.empty() ? NULL : &count[0]; }
+
+    // Allocate empty trails of the given length for max_slots particles. A length of 0 turns trails off.
+    inline void Init(const size_t length, const size_t max_slots)
+    {
+        trail_length = length;
+        head = 0;
+        pos.assign(max_slots * Stride() * 3, 0.0f);
+        count.assign(trail_length ? max_slots : 0, 0);
+    }
+
+    // Change the number of slots, keeping the trails of the slots that remain.
+    inline void Resize(const size_t max_slots)
+    {
+        if(!Enabled())
+            return;
+        pos.resize(max_slots * Stride() * 3, 0.0f);
+        count.resize(max_slots, 0);
+    }
+
+    // Start a new position in every trail. Call this once per time step before appending.
+    inline void Advance()
+    {
+        if(++head >= trail_length)
+            head = 0;
+    }
+
+    // Store the newest position of the particle in this slot.
+    inline void Append(const size_t slot, const pVec &p)
+    {
+        float *a = &pos[(slot * Stride() + head) * 3];
+        float *b = a + trail_length * 3;
+        a[0] = b[0] = p.x();
+        a[1] = b[1] = p.y();
+        a[2] = b[2] = p.z();
+        if(count[slot] < trail_length)
+            count[slot]++;
+    }
+
+    // A new particle in this slot starts with an empty trail.
+    inline void Clear(const size_t slot)
+    {
+        count[slot] = 0;
+    }
+
+    // Give the trail in slot from to slot to. Used when a particle is moved to fill a hole.
+    inline void Move(const size_t to, const size_t from)
+    {
+        const size_t n = Stride() * 3;
+        std::copy(pos.begin() + from * n, pos.begin() + (from + 1) * n, pos.begin() + to * n);
+        count[to] = count[from];
+    }
+
+    // Reorder the first order.size() trails so that trail i comes from slot order[i].
+    inline void Permute(const std::vector<size_t> &order)
+    {
+        const size_t n = Stride() * 3;
+        std::vector<float> P(order.size() * n);
+        std::vector<unsigned int> C(order.size());
+
+        for(size_t i = 0; i < order.size(); i++) {
+            std::copy(pos.begin() + order[i] * n, pos.begin() + (order[i] + 1) * n, P.begin() + i * n);
+            C[i] = count[order[i]];
+        }
+
+        std::copy(P.begin(), P.end(), pos.begin());
+        std::copy(C.begin(), C.end(), count.begin());
+    }
+};
+
+};
+
+#endif